@@ -15,9 +15,13 @@
  */
 
 #include <ipc/Connection.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
 #include <services/Console.h>
 #include <services/Storage.h>
 #include <stream/ConsoleStream.h>
+#include <stream/IStringStream.h>
+#include <util/Util.h>
 #include <Test.h>
 
 using namespace nre;
@@ -30,14 +34,9 @@ static Storage::tag_type tag                = 0;
 static Storage::dma_type dma;
 
 static void wait_for(StorageSession &sess, Storage::tag_type tag) {
-    Storage::Packet *pk;
-    Storage::tag_type rtag;
-    do {
-        pk = sess.consumer().get();
-        rtag = pk->tag;
-        sess.consumer().next();
-    }
-    while(rtag != tag);
+    Storage::Packet pk;
+    while(sess.consumer().consume(pk) && pk.tag != tag)
+        ;
 }
 
 static void check_buffer(const DataSpace &buffer, size_t offset, size_t size) {
@@ -128,9 +127,180 @@ static void runtest(Connection &storagecon, DataSpace &buffer, size_t d) {
     }
 }
 
-int main() {
+/**
+ * Tests the overlay <vdrive> of drive <base>: it has to show the content of the base drive until
+ * a sector is written. Afterwards, the overlay has to show the written sector and the rest of the
+ * block, while the base drive stays unchanged. It only writes to the overlay.
+ */
+static void run_overlay(size_t vdrive, size_t base) {
+    Connection storagecon("storage");
+    DataSpace vbuf(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    DataSpace bbuf(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    try {
+        StorageSession vdisk(storagecon, vbuf, vdrive);
+        StorageSession bdisk(storagecon, bbuf, base);
+        Storage::Parameter params = vdisk.get_params();
+        Serial::get() << "Testing overlay '" << params.name << "'\n";
+        WVPASSEQ(params.sectors, bdisk.get_params().sectors);
+
+        size_t secsize = params.sector_size;
+        char *vbytes = reinterpret_cast<char*>(vbuf.virt());
+        char *bbytes = reinterpret_cast<char*>(bbuf.virt());
+        Storage::sector_type sectors[] = {0, 9, 17, params.sectors / 2, params.sectors - 1};
+        for(size_t i = 0; i < ARRAY_SIZE(sectors); ++i) {
+            Storage::sector_type s = sectors[i];
+            Storage::sector_type n = (s ^ 1) < params.sectors ? s ^ 1 : s - 1;
+            WVPRINTF("Reading sector %Lu of the overlay and the base", s);
+            vdisk.read(tag, s, 1, 0);
+            wait_for(vdisk, tag++);
+            bdisk.read(tag, s, 1, 0);
+            wait_for(bdisk, tag++);
+            WVPASS(memcmp(vbytes, bbytes, secsize) == 0);
+
+            WVPRINTF("Writing sector %Lu of the overlay", s);
+            prepare_buffer(vbuf, 0, secsize);
+            vdisk.write(tag, s, 1, 0);
+            wait_for(vdisk, tag++);
+            clear_buffer(vbuf);
+            vdisk.read(tag, s, 1, 0);
+            wait_for(vdisk, tag++);
+            check_buffer(vbuf, 0, secsize);
+
+            WVPRINTF("Checking that sector %Lu of the base is unchanged", s);
+            bdisk.read(tag, s, 1, secsize);
+            wait_for(bdisk, tag++);
+            WVPASS(memcmp(bbytes, bbytes + secsize, secsize) == 0);
+
+            WVPRINTF("Checking that sector %Lu has been copied from the base", n);
+            vdisk.read(tag, n, 1, 0);
+            wait_for(vdisk, tag++);
+            bdisk.read(tag, n, 1, 0);
+            wait_for(bdisk, tag++);
+            WVPASS(memcmp(vbytes, bbytes, secsize) == 0);
+        }
+
+        WVPRINTF("Testing flush cache");
+        vdisk.flush(tag);
+        wait_for(vdisk, tag++);
+    }
+    catch(const Exception &e) {
+        Serial::get() << "Overlay test with " << vdrive << " failed: " << e.msg() << "\n";
+    }
+}
+
+/**
+ * The IOPS benchmark: each client runs on its own CPU with its own session and keeps <depth>
+ * single-sector reads of random sectors in flight. It only reads, so that it's non-destructive.
+ */
+struct IOPSClient {
+    Connection *con;
+    size_t drive;
+    uint depth;
+    uint64_t end;
+    size_t ops;
+    Sm *done;
+};
+
+static void iops_client(void*) {
+    IOPSClient *c = Thread::current()->get_tls<IOPSClient*>(Thread::TLS_PARAM);
+    c->ops = 0;
+    try {
+        DataSpace buffer(ExecEnv::PAGE_SIZE * c->depth, DataSpaceDesc::ANONYMOUS,
+                         DataSpaceDesc::RW);
+        StorageSession disk(*c->con, buffer, c->drive, true);
+        Storage::Parameter params = disk.get_params();
+        // use the tag as the slot in the buffer
+        uint32_t seed = CPU::current().log_id() + 1;
+        for(Storage::tag_type t = 0; t < c->depth; ++t) {
+            seed = seed * 1103515245 + 12345;
+            disk.read(t, seed % params.sectors, 1, t * ExecEnv::PAGE_SIZE);
+        }
+        Storage::Packet pk;
+        while(disk.consumer().consume(pk)) {
+            c->ops++;
+            if(Util::tsc() >= c->end)
+                break;
+            seed = seed * 1103515245 + 12345;
+            disk.read(pk.tag, seed % params.sectors, 1, pk.tag * ExecEnv::PAGE_SIZE);
+        }
+        // wait for the outstanding requests before we destroy the session
+        for(uint i = 1; i < c->depth && disk.consumer().consume(pk); ++i)
+            ;
+    }
+    catch(const Exception &e) {
+        Serial::get() << "IOPS client on CPU " << CPU::current().log_id() << " failed: " << e.msg()
+                      << "\n";
+    }
+    c->done->up();
+}
+
+static void run_iops(size_t drive, uint clients, uint depth, uint secs) {
+    Connection storagecon("storage");
+    Sm done(0);
+    clients = Math::min<uint>(clients, CPU::count());
+    IOPSClient *cl = new IOPSClient[clients];
+    uint64_t end = Util::tsc() + static_cast<uint64_t>(secs) * Hip::get().freq_tsc * 1000;
+    CPU::iterator cpu = CPU::begin();
+    for(uint i = 0; i < clients; ++i, ++cpu) {
+        cl[i].con = &storagecon;
+        cl[i].drive = drive;
+        cl[i].depth = depth;
+        cl[i].end = end;
+        cl[i].done = &done;
+        GlobalThread *gt = GlobalThread::create(iops_client, cpu->log_id(),
+                                                String("disktest-iops"));
+        gt->set_tls<IOPSClient*>(Thread::TLS_PARAM, cl + i);
+        gt->start();
+    }
+
+    size_t total = 0;
+    for(uint i = 0; i < clients; ++i)
+        done.down();
+    for(uint i = 0; i < clients; ++i) {
+        Serial::get() << "Client " << i << ": " << (cl[i].ops / secs) << " IOPS\n";
+        total += cl[i].ops;
+    }
+    Serial::get() << clients << " clients with depth " << depth << " on drive " << drive << ": "
+                  << (total / secs) << " IOPS\n";
+    delete[] cl;
+}
+
+int main(int argc, char *argv[]) {
+    // iops=<clients>: run the IOPS benchmark with one client per CPU instead of the test. it can be
+    // configured with drive=<no>, depth=<requests per client> and secs=<duration>.
+    // overlay=<drive>: test the overlay <drive> of drive base=<no> instead.
+    uint clients = 0;
+    size_t drive = 0;
+    size_t overlay = 0;
+    size_t base = 0;
+    uint depth = 8;
+    uint secs = 10;
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "iops=", 5) == 0)
+            clients = IStringStream::read_from<uint>(argv[i] + 5);
+        else if(strncmp(argv[i], "drive=", 6) == 0)
+            drive = IStringStream::read_from<size_t>(argv[i] + 6);
+        else if(strncmp(argv[i], "depth=", 6) == 0)
+            depth = Math::max<uint>(1, IStringStream::read_from<uint>(argv[i] + 6));
+        else if(strncmp(argv[i], "secs=", 5) == 0)
+            secs = Math::max<uint>(1, IStringStream::read_from<uint>(argv[i] + 5));
+        else if(strncmp(argv[i], "overlay=", 8) == 0)
+            overlay = IStringStream::read_from<size_t>(argv[i] + 8);
+        else if(strncmp(argv[i], "base=", 5) == 0)
+            base = IStringStream::read_from<size_t>(argv[i] + 5);
+    }
+    if(overlay > 0) {
+        run_overlay(overlay, base);
+        return 0;
+    }
+    if(clients > 0) {
+        run_iops(drive, clients, depth, secs);
+        return 0;
+    }
+
     Connection conscon("console");
     ConsoleSession cons(conscon, 1, String("DiskTest"));
+    cons.enable_notify();
     ConsoleStream s(cons, 0);
     s << "Welcome to the disk test program!\n\n";
     s << "WARNING: This test will write on every sector of all harddisks!!!\n";
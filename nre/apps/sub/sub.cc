@@ -28,7 +28,7 @@ int main() {
         if(strstr(mem->cmdline(), "bin/apps/test") != 0) {
             ChildConfig cfg(0, String(mem->cmdline()));
             DataSpace ds(mem->size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::R, mem->addr);
-            cm->load(ds.virt(), mem->size, cfg);
+            cm->load(ds.virt(), mem->size, cfg, mem->addr);
             break;
         }
     }
@@ -20,45 +20,59 @@
 
 using namespace nre;
 
-void ScInfoPage::refresh_console(bool update) {
+void ScInfoPage::refresh_console(bool) {
+    // the statistics are big; we're holding the lock anyway
+    static SysInfo::CPUStats stats;
     ScopedLock<UserSm> guard(&_sm);
     _cons.clear(0);
     ConsoleStream cs(_cons, 0);
 
+    // root samples the times periodically, so that we can simply read them without IPC
+    cs.writef("Load (1s/10s/60s):");
+    for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu) {
+        _sysinfo.get_stats(cpu->log_id(), stats);
+        cs.writef(" CPU%u %u/%u/%u%%", cpu->log_id(), stats.load[SysInfo::WIN_1S] / 10,
+                  stats.load[SysInfo::WIN_10S] / 10, stats.load[SysInfo::WIN_60S] / 10);
+    }
+    cs.writef("\n");
+
     // display header
     cs.writef("%*s: ", MAX_NAME_LEN, "Sc");
     for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu)
         cs.writef(" CPU%u ", cpu->log_id());
     cs.writef("%*s", MAX_SUMTIME_LEN + 1, "Total");
+    cs.writef(" Prio Rsvd");
     cs.writef("\n");
     for(uint i = 0; i < Console::COLS; i++)
         cs << '-';
 
-    // determine the total time elapsed on each CPU. this way we don't assume that exactly 1sec
-    // has passed since last update and are thus less dependend on the timer-service.
-    static timevalue_t cputotal[Hip::MAX_CPUS];
-    for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu)
-        cputotal[cpu->log_id()] = _sysinfo.get_total_time(cpu->log_id(), update);
-
-    for(size_t idx = _top, c = 0; c < ROWS; ++c, ++idx) {
-        SysInfo::TimeUser tu;
-        if(!_sysinfo.get_timeuser(idx, tu))
-            break;
+    size_t idx = 0, c = 0;
+    for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end() && c < ROWS - 1; ++cpu) {
+        _sysinfo.get_stats(cpu->log_id(), stats);
+        for(size_t i = 0; i < stats.count && c < ROWS - 1; ++i, ++idx) {
+            if(idx < _top)
+                continue;
 
-        size_t namelen = 0;
-        const char *name = getname(tu.name(), namelen);
-        namelen = Math::min<size_t>(namelen, MAX_NAME_LEN);
-        // writef doesn't support floats, so calculate it with 1000 as base and use the last decimal
-        // for the first fraction-digit.
-        timevalue_t permil;
-        if(tu.time() == 0)
-            permil = 0;
-        else
-            permil = (timevalue_t)(1000 / ((float)cputotal[tu.cpu()] / tu.time()));
-        cs.writef("%*.*s: %*s%3Lu.%Lu%*s%*Lums\n", MAX_NAME_LEN, namelen, name,
-                  tu.cpu() * MAX_TIME_LEN, "",
-                  permil / 10, permil % 10, (CPU::count() - tu.cpu() - 1) * MAX_TIME_LEN, "",
-                  MAX_SUMTIME_LEN, tu.totaltime() / 1000);
+            const SysInfo::ScStats &sc = stats.scs[i];
+            String scname(sc.name);
+            size_t namelen = 0;
+            const char *name = getname(scname, namelen);
+            namelen = Math::min<size_t>(namelen, MAX_NAME_LEN);
+            // writef doesn't support floats, so use the last decimal of the permil value for the
+            // first fraction-digit.
+            uint permil = sc.load[SysInfo::WIN_1S];
+            cs.writef("%*.*s: %*s%3u.%u%*s%*Lums %4u %2u.%u\n", MAX_NAME_LEN, namelen, name,
+                      cpu->log_id() * MAX_TIME_LEN, "", permil / 10, permil % 10,
+                      (CPU::count() - cpu->log_id() - 1) * MAX_TIME_LEN, "",
+                      MAX_SUMTIME_LEN, sc.totaltime / 1000,
+                      sc.prio, sc.reserved / 10, sc.reserved % 10);
+            c++;
+        }
+        if(stats.dropped && c < ROWS - 1 && idx++ >= _top) {
+            cs.writef("%*s: %u more Scs on CPU%u\n", MAX_NAME_LEN, "...", stats.dropped,
+                      cpu->log_id());
+            c++;
+        }
     }
     display_footer(cs, 0);
 }
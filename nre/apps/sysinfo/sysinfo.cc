@@ -93,6 +93,9 @@ static void refresh_thread() {
 }
 
 int main() {
+    // we only write via ConsoleStream, which announces the changes
+    cons.enable_notify();
+
     // disable cursor
     Console::Register regs = cons.get_regs();
     regs.cursor_style = 0x2000;
@@ -108,6 +108,7 @@ static void view0(void*) {
     size_t subcon = Thread::current()->get_tls<word_t>(Thread::TLS_PARAM);
     OStringStream::format(title, sizeof(title), "Test-%zu", subcon);
     ConsoleSession conssess(*conscon, subcon, String(title));
+    conssess.enable_notify();
     ConsoleStream view(conssess, 0);
     int i = 0;
     while(i < 10000) {
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <ipc/Connection.h>
+#include <services/SysInfo.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sc.h>
+#include <kobj/Sm.h>
+#include <util/Util.h>
+#include <CPU.h>
+
+#include "AdmissionTest.h"
+
+/*
+ * Checks the admission control for CPU reservations. It expects that unittests is allowed to
+ * reserve 20% of each CPU ("reserve=200"), as in boot/unittests. Besides that, it lets a reserved
+ * Sc spin and checks that another Sc of our band on the same CPU still makes progress. We can't
+ * create Scs in the service band, but that is above ours, so that it can't starve either.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_admission();
+
+const TestCase admission = {
+    "Admission control", test_admission
+};
+
+static const uint SPIN_MS = 100;
+
+static volatile bool stop;
+static volatile ulong progress;
+static Sm spin_done(0);
+
+static void wait_thread(void*) {
+    Thread::current()->get_tls<Sm*>(Thread::TLS_PARAM)->down();
+}
+
+static void spin_thread(void*) {
+    while(!stop)
+        Util::pause();
+    spin_done.up();
+}
+
+static void count_thread(void*) {
+    while(!stop)
+        progress++;
+    spin_done.up();
+}
+
+static GlobalThread *start_thread(Sm &sm, const Reservation &res) {
+    GlobalThread *gt = GlobalThread::create(wait_thread, CPU::current().log_id(),
+                                            String("adm-test"));
+    gt->set_tls<Sm*>(Thread::TLS_PARAM, &sm);
+    try {
+        gt->start(Qpd(), Pd::current(), res);
+    }
+    catch(...) {
+        delete gt;
+        throw;
+    }
+    return gt;
+}
+
+static void test_admission() {
+    Connection con("sysinfo");
+    SysInfoSession sysinfo(con);
+    cpu_t cpu = CPU::current().log_id();
+    uint reserved, capacity;
+    sysinfo.get_reserved(cpu, reserved, capacity);
+    WVPRINTF("CPU %u: %u of %u permil reserved", cpu, reserved, capacity);
+    WVPASS(reserved <= capacity);
+
+    // without reservation, we get the band of our Pd, which is guest
+    static Sm sm1(0);
+    GlobalThread *gt1 = start_thread(sm1, Reservation());
+    WVPASSEQ(gt1->sc()->qpd().prio(), static_cast<uint>(Sc::BAND_GUEST));
+    WVPASSEQ(gt1->sc()->reservation().utilization(), 0U);
+
+    // 10% fit into our limit
+    static Sm sm2(0);
+    GlobalThread *gt2 = start_thread(sm2, Reservation(1000, 10000));
+    WVPASSEQ(gt2->sc()->qpd().prio(), static_cast<uint>(Sc::BAND_GUEST));
+    WVPASSEQ(gt2->sc()->qpd().quantum(), 1000U);
+    WVPASSEQ(gt2->sc()->reservation().utilization(), 100U);
+    uint now;
+    sysinfo.get_reserved(cpu, now, capacity);
+    WVPASSEQ(now, reserved + 100);
+
+    // another 50% don't; the soft reservation is demoted and the hard one is rejected
+    static Sm sm3(0);
+    GlobalThread *gt3 = start_thread(sm3, Reservation(5000, 10000));
+    WVPASSEQ(gt3->sc()->qpd().prio(), static_cast<uint>(Sc::BAND_GUEST));
+    WVPASSEQ(gt3->sc()->reservation().utilization(), 0U);
+
+    bool rejected = false;
+    static Sm sm4(0);
+    try {
+        start_thread(sm4, Reservation(5000, 10000, true));
+    }
+    catch(const Exception &e) {
+        WVPASSEQ(e.code(), E_CAPACITY);
+        rejected = true;
+    }
+    WVPASS(rejected);
+
+    // a reserved Sc that runs longer than its budget must not starve the other Scs on its CPU
+    cpu_t other = (cpu + 1) % CPU::count();
+    stop = false;
+    progress = 0;
+    GlobalThread *spinner = GlobalThread::create(spin_thread, other, String("adm-spin"));
+    spinner->start(Qpd(), Pd::current(), Reservation(500, 10000));
+    WVPASSEQ(spinner->sc()->qpd().prio(), static_cast<uint>(Sc::BAND_GUEST));
+    WVPASSEQ(spinner->sc()->reservation().utilization(), 50U);
+    GlobalThread::create(count_thread, other, String("adm-count"))->start();
+    Sm sleep(0);
+    sleep.down(Util::tsc() + static_cast<uint64_t>(SPIN_MS) * Hip::get().freq_tsc);
+    stop = true;
+    spin_done.down();
+    spin_done.down();
+    WVPRINTF("Best-effort Sc counted to %lu next to a spinning reserved Sc", progress);
+    WVPASS(progress > 0);
+
+    // the threads delete themselves when they're done. the semaphores are static because the
+    // threads might still use them when we return
+    sm1.up();
+    sm2.up();
+    sm3.up();
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <ipc/Service.h>
+#include <subsystem/ChildManager.h>
+#include <stream/IStringStream.h>
+#include <stream/OStringStream.h>
+#include <util/Profiler.h>
+#include <util/ScopedLock.h>
+#include <RCU.h>
+#include <CPU.h>
+
+#include "ChildLoad.h"
+
+/*
+ * Loads N identical childs from our own module, once with private copies of all segments, once
+ * with private segments that are lazily populated and once with the segments shared and lazily
+ * populated by the ChildManager. Each child writes to its data segment and registers a service,
+ * so that the start latency includes everything until the child runs and the copy-on-write of
+ * the data segment. Afterwards, the physical memory of all childs plus the shared segments is
+ * reported.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_childload();
+
+const TestCase childload = {
+    "Child load latency and footprint", test_childload
+};
+
+static const size_t CHILDS      = 16;
+
+static int child_value = 1;
+
+PORTAL static void portal_dummy(capsel_t) {
+}
+
+static int loaded_child(int, char *argv[]) {
+    // write to our data segment to get our own copy of it
+    child_value = IStringStream::read_from<int>(argv[1]);
+    Service *srv = new Service(argv[2], CPUSet(CPUSet::ALL), portal_dummy);
+    srv->start();
+    delete srv;
+    return child_value;
+}
+
+static void run(ChildManager *mng, DataSpace &ds, size_t size, uintptr_t module, bool share,
+                const char *mode) {
+    Child::id_type ids[CHILDS];
+    AvgProfiler prof(CHILDS);
+    for(size_t i = 0; i < CHILDS; ++i) {
+        char cmdline[64];
+        OStringStream::format(cmdline, sizeof(cmdline), "childload provides=childload%zu %zu childload%zu",
+                              i, i + 1, i);
+        ChildConfig cfg(0, String(cmdline));
+        cfg.entry(reinterpret_cast<uintptr_t>(loaded_child));
+        prof.start();
+        ids[i] = mng->load(ds.virt(), size, cfg, module, share);
+        prof.stop();
+    }
+    WVPASSEQ(mng->count(), CHILDS);
+
+    size_t phys = 0;
+    {
+        ScopedLock<RCULock> guard(&RCU::lock());
+        for(size_t i = 0; i < CHILDS; ++i) {
+            const Child *c = mng->get(ids[i]);
+            WVPASS(c != 0);
+            if(c) {
+                size_t cvirt, cphys;
+                c->reglist().memusage(cvirt, cphys);
+                phys += cphys;
+            }
+        }
+    }
+    phys += mng->shared_size();
+
+    char name[32];
+    OStringStream::format(name, sizeof(name), "childload.%s.%zu", mode, CHILDS);
+    WVBENCH(name, prof, "cycles");
+    WVPRINTF("%s: %zu KiB for %zu childs (%zu KiB cached)", mode, phys / 1024, CHILDS,
+             mng->shared_size() / 1024);
+    Serial::get().writef("BENCH: %s.mem KiB n=1 avg=%zu\n", name, phys / 1024);
+
+    // the childs still use the cached segments, so that they have to stay until they are gone
+    size_t cached = mng->shared_size();
+    mng->flush_segments();
+    WVPASSEQ(mng->shared_size(), cached);
+    for(size_t i = 0; i < CHILDS; ++i)
+        mng->kill(ids[i]);
+    WVPASSEQ(mng->shared_size(), static_cast<size_t>(0));
+}
+
+static void test_childload() {
+    ChildManager *mng = new ChildManager();
+    Hip::mem_iterator self = Hip::get().mem_begin();
+    // map the memory of the module
+    DataSpace ds(self->size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::R, self->addr);
+    run(mng, ds, self->size, 0, false, "private");
+    run(mng, ds, self->size, self->addr, false, "lazy");
+    run(mng, ds, self->size, self->addr, true, "shared");
+    WVPASSEQ(mng->shared_size(), static_cast<size_t>(0));
+    delete mng;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <ipc/Connection.h>
+#include <kobj/Sm.h>
+#include <services/SysInfo.h>
+#include <services/Console.h>
+#include <util/Util.h>
+#include <Hip.h>
+#include <cstring>
+
+#include "ConsoleIdle.h"
+
+/*
+ * Measures the CPU time that the threads of the console service consume while nobody changes
+ * anything on the screen. To force the view switcher to repaint, we show a session whose
+ * framebuffer is larger than the screen memory, so that it doesn't get direct access. As the
+ * baseline, the session does not announce its changes, so that the view switcher polls it as it
+ * did for all sessions before. Afterwards, it enables the notification, which should let the view
+ * switcher block. The test is skipped if no console is running; boot/console-idle starts one next
+ * to the unittests.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_idle();
+
+const TestCase consoleidle = {
+    "Console idle time", test_idle
+};
+
+static const uint IDLE_SECS = 5;
+// wait a bit more than the view switcher shows the title of a new session
+static const uint SETTLE_SECS = 2;
+
+static bool console_time(SysInfoSession &sysinfo, timevalue_t &total) {
+    bool found = false;
+    total = 0;
+    SysInfo::TimeUser tu;
+    for(size_t idx = 0; sysinfo.get_timeuser(idx, tu); ++idx) {
+        if(strncmp(tu.name().str(), "console", 7) == 0) {
+            total += tu.totaltime();
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void sleep(uint secs) {
+    // just block for the given time; nobody ups this semaphore
+    Sm sm(0);
+    sm.down(Util::tsc() + static_cast<timevalue_t>(secs) * Hip::get().freq_tsc * 1000);
+}
+
+static timevalue_t measure_idle(SysInfoSession &sysinfo) {
+    timevalue_t before, after;
+    WVPASS(console_time(sysinfo, before));
+    sleep(IDLE_SECS);
+    WVPASS(console_time(sysinfo, after));
+    return after - before;
+}
+
+static void test_idle() {
+    Connection con("sysinfo");
+    SysInfoSession sysinfo(con);
+    timevalue_t dummy;
+    if(!console_time(sysinfo, dummy)) {
+        WVPRINTF("No console running; skipping");
+        return;
+    }
+
+    Connection conscon("console");
+    ConsoleSession cons(conscon, Console::SUBCONS - 1, String("ConsoleIdle"),
+                        ExecEnv::PAGE_SIZE * Console::PAGES * 2);
+    sleep(SETTLE_SECS);
+
+    timevalue_t polling = measure_idle(sysinfo);
+    WVPRINTF("Console used %Lu us of CPU time within %u s while polling", polling, IDLE_SECS);
+    WVPERF(polling, "us");
+
+    cons.enable_notify();
+    timevalue_t notified = measure_idle(sysinfo);
+    WVPRINTF("Console used %Lu us of CPU time within %u s with notification", notified, IDLE_SECS);
+    WVPERF(notified, "us");
+    WVPASS(notified <= polling);
+}
@@ -15,45 +15,205 @@
  */
 
 #include <kobj/Pt.h>
+#include <kobj/Pd.h>
 #include <kobj/Ports.h>
+#include <cap/CapBatch.h>
+#include <mem/DataSpace.h>
+#include <stream/OStringStream.h>
 #include <utcb/UtcbFrame.h>
 #include <util/Profiler.h>
 #include <CPU.h>
 
 #include "DelegatePerf.h"
 
+/*
+ * Besides the delegation of a few I/O ports, this measures the throughput of delegating and
+ * revoking 1..MAX_CAPS pages and object capabilities with CapBatch, compared to one typed item
+ * and one revoke per capability. The capabilities are delegated to ourself, at a different place.
+ */
+
 using namespace nre;
 using namespace nre::test;
 
 PORTAL static void portal_test(capsel_t);
+PORTAL static void portal_range(capsel_t);
 static void test_delegate();
 
 const TestCase delegateperf = {
     "Delegate-performance", test_delegate
 };
 
-static const size_t tries = 1000;
+static const size_t DEF_TRIES  = 1000;
+static const size_t DEF_WARMUP = 10;
+static const size_t DEF_BATCH_TRIES     = 100;
+static const size_t DEF_BATCH_WARMUP    = 2;
+static const size_t MAX_CAPS            = 4096;
+static const uint MAX_CAPS_ORDER        = 12;
 
 static void portal_test(capsel_t) {
     UtcbFrameRef uf;
     uf.delegate(CapRange(0x100, 4, Crd::IO_ALL));
 }
 
+// delegates as much of the requested range as fits into the UTCB and replies how much that was
+static void portal_range(capsel_t) {
+    UtcbFrameRef uf;
+    try {
+        CapRange cr;
+        bool batched;
+        uf >> cr >> batched;
+        uf.finish_input();
+
+        size_t count;
+        if(batched) {
+            CapBatch<1> batch;
+            batch.add(cr);
+            count = batch.put(uf);
+        }
+        else {
+            count = Math::min(cr.count(), uf.free_typed());
+            for(size_t i = 0; i < count; ++i)
+                uf.delegate(cr.start() + i, cr.hotspot() + i, UtcbFrame::NONE, cr.attr());
+        }
+        uf << E_SUCCESS << count;
+    }
+    catch(const Exception &e) {
+        uf.clear();
+        uf << e;
+    }
+}
+
+static size_t transfer(Pt &pt, UtcbFrame &uf, CapRange cr, bool batched) {
+    size_t calls = 0;
+    while(cr.count() > 0) {
+        uf.clear();
+        uf << cr << batched;
+        pt.call(uf);
+        uf.check_reply();
+        size_t count;
+        uf >> count;
+        cr.start(cr.start() + count);
+        cr.hotspot(cr.hotspot() + count);
+        cr.count(cr.count() - count);
+        calls++;
+    }
+    return calls;
+}
+
+static size_t revoke(uintptr_t start, size_t count, uint attr, bool batched) {
+    if(batched) {
+        // add them one by one to let the batch merge them
+        CapBatch<> batch;
+        for(size_t i = 0; i < count; ++i)
+            batch.add(start + i, attr);
+        return batch.revoke(true);
+    }
+    for(size_t i = 0; i < count; ++i)
+        Syscalls::revoke(Crd(start + i, 0, attr), true);
+    return count;
+}
+
+static void bench_range(Pt &pt, UtcbFrame &uf, const char *kind, uintptr_t src, uintptr_t dst,
+                        uint attr, size_t count, bool batched) {
+    size_t tries = BenchConfig::iterations(DEF_BATCH_TRIES);
+    size_t warmup = BenchConfig::warmup(DEF_BATCH_WARMUP);
+    AvgProfiler dprof(tries, warmup), rprof(tries, warmup);
+    size_t calls = 0, syscalls = 0;
+    for(size_t i = 0; i < warmup + tries; i++) {
+        dprof.start();
+        calls = transfer(pt, uf, CapRange(src, count, attr, dst), batched);
+        dprof.stop();
+        rprof.start();
+        syscalls = revoke(dst, count, attr, batched);
+        rprof.stop();
+    }
+
+    const char *mode = batched ? "batch" : "single";
+    WVPRINTF("%s.%s.%zu: %zu calls, %zu revokes", kind, mode, count, calls, syscalls);
+    char name[48];
+    OStringStream::format(name, sizeof(name), "delegate.%s.%s.%zu", kind, mode, count);
+    WVBENCH(name, dprof, "cycles");
+    OStringStream::format(name, sizeof(name), "revoke.%s.%s.%zu", kind, mode, count);
+    WVBENCH(name, rprof, "cycles");
+}
+
+static void test_batch() {
+    LocalThread *ec = LocalThread::create(CPU::current().log_id());
+    Pt pt(ec, portal_range);
+
+    {
+        // pages: map the source pages in and delegate them into reserved virtual memory
+        DataSpace srcds(MAX_CAPS * ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+        DataSpace dstds(MAX_CAPS * ExecEnv::PAGE_SIZE, DataSpaceDesc::VIRTUAL, DataSpaceDesc::RW);
+        for(size_t i = 0; i < MAX_CAPS; ++i)
+            *reinterpret_cast<volatile char*>(srcds.virt() + i * ExecEnv::PAGE_SIZE) = i;
+        UtcbFrame uf;
+        uf.delegation_window(Crd(0, 31, Crd::MEM_ALL));
+        uintptr_t src = srcds.virt() >> ExecEnv::PAGE_SHIFT;
+        uintptr_t dst = dstds.virt() >> ExecEnv::PAGE_SHIFT;
+        for(size_t count = 1; count <= MAX_CAPS; count *= 16) {
+            bench_range(pt, uf, "pages", src, dst, Crd::MEM_ALL, count, false);
+            bench_range(pt, uf, "pages", src, dst, Crd::MEM_ALL, count, true);
+        }
+    }
+
+    {
+        // object capabilities: create semaphores and delegate them to other selectors
+        capsel_t src = CapSelSpace::get().allocate(MAX_CAPS, MAX_CAPS);
+        capsel_t dst = CapSelSpace::get().allocate(MAX_CAPS, MAX_CAPS);
+        for(size_t i = 0; i < MAX_CAPS; ++i)
+            Syscalls::create_sm(src + i, 0, Pd::current()->sel());
+        UtcbFrame uf;
+        uf.delegation_window(Crd(dst, MAX_CAPS_ORDER, Crd::OBJ_ALL));
+        for(size_t count = 1; count <= MAX_CAPS; count *= 16) {
+            bench_range(pt, uf, "caps", src, dst, Crd::OBJ_ALL, count, false);
+            bench_range(pt, uf, "caps", src, dst, Crd::OBJ_ALL, count, true);
+        }
+        CapRange(src, MAX_CAPS, Crd::OBJ_ALL).revoke(true);
+        CapSelSpace::get().free(dst, MAX_CAPS);
+        CapSelSpace::get().free(src, MAX_CAPS);
+    }
+    delete ec;
+}
+
+static void test_batch_merge() {
+    // adjacent ranges are merged when added, others only when revoking
+    CapBatch<4> batch;
+    WVPASS(batch.add(CapRange(0x100, 0x10, Crd::OBJ_ALL)));
+    WVPASS(batch.add(CapRange(0x110, 0x10, Crd::OBJ_ALL)));
+    WVPASSEQ(batch.ranges(), static_cast<size_t>(1));
+    WVPASSEQ(batch.items(), static_cast<size_t>(1));
+    WVPASS(batch.add(CapRange(0x200, 1, Crd::OBJ_ALL, 0x301)));
+    WVPASS(batch.add(CapRange(0x201, 1, Crd::OBJ_ALL, 0x302)));
+    WVPASSEQ(batch.ranges(), static_cast<size_t>(2));
+    // 0x200 -> 0x301 and 0x201 -> 0x302 can't be delegated with one Crd
+    WVPASSEQ(batch.items(), static_cast<size_t>(3));
+    WVPASSEQ(batch.caps(), static_cast<size_t>(0x22));
+    WVPASS(batch.add(CapRange(0x400, 1, Crd::OBJ_ALL)));
+    WVPASS(batch.add(CapRange(0x500, 1, Crd::OBJ_ALL)));
+    WVPASS(!batch.add(CapRange(0x600, 1, Crd::OBJ_ALL)));
+    batch.clear();
+    WVPASS(batch.empty());
+}
+
 static void test_delegate() {
+    test_batch_merge();
+    test_batch();
+
     Ports ports(0x100, 1 << 2);
     LocalThread *ec = LocalThread::create(CPU::current().log_id());
     Pt pt(ec, portal_test);
-    AvgProfiler prof(tries);
+    size_t tries = BenchConfig::iterations(DEF_TRIES);
+    size_t warmup = BenchConfig::warmup(DEF_WARMUP);
+    AvgProfiler prof(tries, warmup);
     UtcbFrame uf;
     uf.delegation_window(Crd(0, 31, Crd::IO_ALL));
-    for(size_t i = 0; i < tries; i++) {
+    for(size_t i = 0; i < warmup + tries; i++) {
         prof.start();
         pt.call(uf);
         uf.clear();
         prof.stop();
     }
 
-    WVPERF(prof.avg(), "cycles");
-    WVPRINTF("min: %Lu", prof.min());
-    WVPRINTF("max: %Lu", prof.max());
+    WVBENCH("delegate.io4", prof, "cycles");
 }
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <mem/DataSpace.h>
+#include <util/DirtyTiles.h>
+#include <util/Profiler.h>
+#include <stream/OStringStream.h>
+#include <Hip.h>
+#include <cstring>
+
+#include "FramebufferPerf.h"
+
+/*
+ * Measures how many frames per second the console can copy from a guest framebuffer to the host
+ * framebuffer. It compares the copy of the whole framebuffer with the copy of the dirty tiles
+ * only, for a framebuffer that doesn't change, one with a moving mouse cursor and one that changes
+ * completely.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_fb();
+
+const TestCase framebufferperf = {
+    "Framebuffer copy", test_fb
+};
+
+static const uint DEF_FRAMES    = 100;
+static const uint DEF_WARMUP    = 5;
+// 1024x768 with 32 bits per pixel
+static const size_t WIDTH       = 1024;
+static const size_t HEIGHT      = 768;
+static const size_t PITCH       = WIDTH * 4;
+static const size_t CURSOR      = 16;
+
+enum Scenario {
+    IDLE,
+    CURSOR_MOVE,
+    FULL
+};
+
+static void draw(uint32_t *fb, Scenario sc, uint frame) {
+    switch(sc) {
+        case IDLE:
+            break;
+        case CURSOR_MOVE:
+        {
+            size_t x = (frame * 7) % (WIDTH - CURSOR);
+            size_t y = (frame * 5) % (HEIGHT - CURSOR);
+            for(size_t l = 0; l < CURSOR; ++l) {
+                for(size_t c = 0; c < CURSOR; ++c)
+                    fb[(y + l) * WIDTH + x + c] = frame;
+            }
+        }
+        break;
+        case FULL:
+            for(size_t i = 0; i < WIDTH * HEIGHT; ++i)
+                fb[i] = frame + i;
+            break;
+    }
+}
+
+static void report(const char *name, AvgProfiler &prof) {
+    char bname[32];
+    OStringStream::format(bname, sizeof(bname), "fb.%s", name);
+    AvgProfiler::time_t cycles = WVBENCH(bname, prof, "cycles/frame");
+    uint64_t fps = (static_cast<uint64_t>(Hip::get().freq_tsc) * 1000) / cycles;
+    WVPRINTF("%s: %Lu frames/s", name, fps);
+}
+
+static void run_dirty(const char *name, Scenario sc, uint32_t *src, uint32_t *dst) {
+    uint frames = BenchConfig::iterations(DEF_FRAMES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    DirtyTiles tiles(PITCH, HEIGHT);
+    WVPASSEQ(tiles.update(dst, src), tiles.tiles());
+
+    AvgProfiler prof(frames, warmup);
+    size_t max = 0;
+    for(uint i = 0; i < warmup + frames; ++i) {
+        draw(src, sc, i);
+        prof.start();
+        size_t copied = tiles.update(dst, src);
+        prof.stop();
+        max = Math::max(max, copied);
+    }
+    WVPASS(memcmp(dst, src, PITCH * HEIGHT) == 0);
+    switch(sc) {
+        case IDLE:
+            WVPASSEQ(max, static_cast<size_t>(0));
+            break;
+        case CURSOR_MOVE:
+            // the cursor touches at most 2x2 tiles
+            WVPASS(max > 0 && max <= 4);
+            break;
+        case FULL:
+            WVPASSEQ(max, tiles.tiles());
+            break;
+    }
+    report(name, prof);
+}
+
+static void test_fb() {
+    DataSpace srcds(PITCH * HEIGHT, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    DataSpace dstds(PITCH * HEIGHT, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    uint32_t *src = reinterpret_cast<uint32_t*>(srcds.virt());
+    uint32_t *dst = reinterpret_cast<uint32_t*>(dstds.virt());
+    memset(src, 0, PITCH * HEIGHT);
+
+    WVPRINTF("Copying %zux%zu frames with %zu bytes per line", WIDTH, HEIGHT, PITCH);
+    {
+        uint frames = BenchConfig::iterations(DEF_FRAMES);
+        uint warmup = BenchConfig::warmup(DEF_WARMUP);
+        AvgProfiler prof(frames, warmup);
+        for(uint i = 0; i < warmup + frames; ++i) {
+            draw(src, CURSOR_MOVE, i);
+            prof.start();
+            memcpy(dst, src, PITCH * HEIGHT);
+            prof.stop();
+        }
+        WVPASS(memcmp(dst, src, PITCH * HEIGHT) == 0);
+        report("full", prof);
+    }
+
+    run_dirty("dirty.idle", IDLE, src, dst);
+    run_dirty("dirty.cursor", CURSOR_MOVE, src, dst);
+    run_dirty("dirty.full", FULL, src, dst);
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <ipc/Service.h>
+#include <ipc/Connection.h>
+#include <ipc/ClientSession.h>
+#include <subsystem/ChildManager.h>
+#include <stream/IStringStream.h>
+#include <stream/OStringStream.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Pt.h>
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <utcb/UtcbFrame.h>
+#include <util/ScopedLock.h>
+#include <util/Util.h>
+#include <RCU.h>
+#include <CPU.h>
+
+#include "IPCScale.h"
+
+/*
+ * Measures how a service scales if there is one client per CPU. The service is a child Pd that
+ * handles the calls of each CPU with the portal of its ServiceCPUHandler. The clients are either
+ * GlobalThreads of one child Pd (one session) or separate child Pds (one session each). All
+ * clients start at the same TSC value and report their number of calls and the needed time to
+ * the service, which reports the aggregate calls/second and the costs of the session lookup.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+class ScaleService;
+static void test_ipcscale();
+
+const TestCase ipcscale = {
+    "IPC-scalability", test_ipcscale
+};
+
+enum Op {
+    OP_EMPTY,
+    OP_SMALL,
+    OP_LARGE,
+    OP_DELEGATE,
+    OP_DONE
+};
+
+static const uint DEF_CALLS         = 10000;
+static const size_t SMALL_WORDS     = 8;
+static const size_t LARGE_WORDS     = 128;
+// the time we give the clients to start up before the measurement begins
+static const uint START_DELAY_MS    = 200;
+
+static const char *op_names[] = {"empty", "small", "large", "delegate"};
+
+/**
+ * The per-CPU statistics of the service. Each CPU is written only by the handler-thread of that
+ * CPU, so that we don't need synchronization
+ */
+struct ScaleCPUStats {
+    ullong calls;
+    ullong lookup;
+    char pad[64 - sizeof(ullong) * 2];
+};
+
+static ScaleService *srv;
+static ScaleCPUStats scale_stats[Hip::MAX_CPUS];
+
+class ScaleSession : public ServiceSession {
+public:
+    explicit ScaleSession(Service *s, size_t id, capsel_t cap, capsel_t caps, Pt::portal_func func)
+        : ServiceSession(s, id, cap, caps, func), _sm(0) {
+    }
+
+    virtual void invalidate();
+
+    Sm &sm() {
+        return _sm;
+    }
+
+private:
+    Sm _sm;
+};
+
+class ScaleService : public Service {
+public:
+    explicit ScaleService(Pt::portal_func func, const char *name, size_t sessions, size_t reports)
+        : Service("ipcscale", CPUSet(CPUSet::ALL), func), _lock(), _bench(name),
+          _sessions(sessions), _dead(0), _reports(reports), _reported(0), _calls(0), _rate(0),
+          _minrate(~0ULL), _maxrate(0) {
+    }
+
+    void session_died() {
+        if(++_dead == _sessions)
+            stop();
+    }
+    void report(ullong calls, ullong cycles) {
+        ScopedLock<UserSm> guard(&_lock);
+        // calls/s = calls / (cycles / (freq_tsc * 1000))
+        ullong rate = cycles ? (calls * Hip::get().freq_tsc * 1000) / cycles : 0;
+        _calls += calls;
+        _rate += rate;
+        _minrate = Math::min(_minrate, rate);
+        _maxrate = Math::max(_maxrate, rate);
+        if(++_reported == _reports)
+            print();
+    }
+
+private:
+    void print() {
+        ullong calls = 0, lookup = 0;
+        for(size_t i = 0; i < CPU::count(); ++i) {
+            calls += scale_stats[i].calls;
+            lookup += scale_stats[i].lookup;
+        }
+        Serial::get().writef("BENCH: %s calls/s cpu=%u n=%zu avg=%Lu min=%Lu max=%Lu\n",
+                             _bench, CPU::current().log_id(), _reports, _rate, _minrate, _maxrate);
+        Serial::get().writef("BENCH: %s.lookup cycles n=%Lu avg=%Lu\n",
+                             _bench, calls, calls ? lookup / calls : 0);
+        WVPERF(_rate, "calls/s");
+        WVPASSEQ(calls, _calls + _reports);
+    }
+
+    virtual ServiceSession *create_session(size_t id, capsel_t cap, capsel_t caps,
+                                           Pt::portal_func func) {
+        return new ScaleSession(this, id, cap, caps, func);
+    }
+
+    UserSm _lock;
+    const char *_bench;
+    size_t _sessions;
+    size_t _dead;
+    size_t _reports;
+    size_t _reported;
+    ullong _calls;
+    ullong _rate;
+    ullong _minrate;
+    ullong _maxrate;
+};
+
+void ScaleSession::invalidate() {
+    srv->session_died();
+}
+
+PORTAL static void portal_scale(capsel_t pid) {
+    ScaleCPUStats *stats = scale_stats + CPU::current().log_id();
+    ullong start = Util::tsc();
+    ScopedLock<RCULock> guard(&RCU::lock());
+    ScaleSession *sess = srv->get_session<ScaleSession>(pid);
+    stats->lookup += Util::tsc() - start;
+    stats->calls++;
+
+    UtcbFrameRef uf;
+    try {
+        Op op;
+        uf >> op;
+        switch(op) {
+            case OP_EMPTY:
+                uf.finish_input();
+                break;
+
+            case OP_SMALL:
+            case OP_LARGE: {
+                size_t count;
+                word_t sum = 0;
+                uf >> count;
+                for(size_t i = 0; i < count; ++i) {
+                    word_t w;
+                    uf >> w;
+                    sum += w;
+                }
+                uf.finish_input();
+                uf << sum;
+            }
+            break;
+
+            case OP_DELEGATE:
+                uf.finish_input();
+                uf.delegate(sess->sm().sel());
+                break;
+
+            case OP_DONE: {
+                ullong calls, cycles;
+                uf >> calls >> cycles;
+                uf.finish_input();
+                srv->report(calls, cycles);
+            }
+            break;
+        }
+    }
+    catch(const Exception &e) {
+        Syscalls::revoke(uf.delegation_window(), true);
+        uf.clear();
+        uf << e;
+    }
+}
+
+static int scale_server(int, char *argv[]) {
+    size_t sessions = IStringStream::read_from<size_t>(argv[1]);
+    size_t reports = IStringStream::read_from<size_t>(argv[2]);
+    srv = new ScaleService(portal_scale, argv[3], sessions, reports);
+    srv->start();
+    delete srv;
+    return 0;
+}
+
+struct ScaleClient {
+    ClientSession *sess;
+    Op op;
+    uint calls;
+    ullong start;
+    Sm *done;
+};
+
+static void run_client(ScaleClient *c) {
+    Pt pt(c->sess->caps() + CPU::current().log_id());
+    capsel_t sel = CapSelSpace::get().allocate();
+    size_t words = c->op == OP_LARGE ? LARGE_WORDS : SMALL_WORDS;
+    word_t expected = (words * (words + 1)) / 2;
+    uint errors = 0;
+    UtcbFrame uf;
+
+    // wait until all clients are ready, so that they run in parallel
+    while(Util::tsc() < c->start)
+        ;
+
+    ullong begin = Util::tsc();
+    for(uint i = 0; i < c->calls; ++i) {
+        uf << c->op;
+        switch(c->op) {
+            case OP_SMALL:
+            case OP_LARGE:
+                uf << words;
+                for(size_t w = 1; w <= words; ++w)
+                    uf << static_cast<word_t>(w);
+                break;
+            case OP_DELEGATE:
+                uf.delegation_window(Crd(sel, 0, Crd::OBJ_ALL));
+                break;
+            default:
+                break;
+        }
+        pt.call(uf);
+        if(c->op == OP_SMALL || c->op == OP_LARGE) {
+            word_t sum = 0;
+            uf >> sum;
+            if(sum != expected)
+                errors++;
+        }
+        uf.clear();
+    }
+    ullong cycles = Util::tsc() - begin;
+
+    WVPASSEQ(errors, 0U);
+    uf << OP_DONE << static_cast<ullong>(c->calls) << cycles;
+    pt.call(uf);
+    CapSelSpace::get().free(sel);
+    if(c->done)
+        c->done->up();
+}
+
+static void client_thread(void*) {
+    run_client(Thread::current()->get_tls<ScaleClient*>(Thread::TLS_PARAM));
+}
+
+static int scale_client(int, char *argv[]) {
+    Connection con("ipcscale");
+    ClientSession sess(con);
+    ScaleClient c;
+    c.sess = &sess;
+    c.op = static_cast<Op>(IStringStream::read_from<uint>(argv[1]));
+    c.calls = IStringStream::read_from<uint>(argv[2]);
+    c.start = IStringStream::read_from<ullong>(argv[3]);
+    size_t threads = IStringStream::read_from<size_t>(argv[4]);
+    if(threads == 0) {
+        c.done = 0;
+        run_client(&c);
+    }
+    else {
+        // one GlobalThread per CPU, all sharing our session
+        Sm done(0);
+        c.done = &done;
+        for(size_t i = 0; i < threads; ++i) {
+            GlobalThread *gt = GlobalThread::create(client_thread, i, String("ipcscale-client"));
+            gt->set_tls<ScaleClient*>(Thread::TLS_PARAM, &c);
+            gt->start();
+        }
+        for(size_t i = 0; i < threads; ++i)
+            done.down();
+    }
+    return 0;
+}
+
+static void load(ChildManager *mng, DataSpace &ds, size_t size, const char *cmdline, cpu_t cpu,
+                 int (*func)(int, char*[])) {
+    ChildConfig cfg(0, String(cmdline), cpu);
+    cfg.entry(reinterpret_cast<uintptr_t>(func));
+    mng->load(ds.virt(), size, cfg);
+}
+
+static void run(ChildManager *mng, DataSpace &ds, size_t size, Op op, size_t cpus, bool pds) {
+    uint calls = BenchConfig::iterations(DEF_CALLS);
+    size_t sessions = pds ? cpus : 1;
+    char name[48];
+    OStringStream::format(name, sizeof(name), "ipcscale.%s.%s.%zu",
+                          pds ? "pds" : "threads", op_names[op], cpus);
+
+    char cmdline[96];
+    OStringStream::format(cmdline, sizeof(cmdline), "ipcscaleservice provides=ipcscale %zu %zu %s",
+                          sessions, cpus, name);
+    load(mng, ds, size, cmdline, CPU::current().log_id(), scale_server);
+
+    ullong delay = static_cast<ullong>(Hip::get().freq_tsc) * START_DELAY_MS * sessions;
+    ullong start = Util::tsc() + delay;
+    for(size_t i = 0; i < sessions; ++i) {
+        OStringStream::format(cmdline, sizeof(cmdline), "ipcscaleclient %u %u %Lu %zu",
+                              op, calls, start, pds ? 0 : cpus);
+        load(mng, ds, size, cmdline, i, scale_client);
+    }
+    while(mng->count() > 0)
+        mng->dead_sm().down();
+}
+
+static void test_ipcscale() {
+    ChildManager *mng = new ChildManager();
+    Hip::mem_iterator self = Hip::get().mem_begin();
+    // map the memory of the module
+    DataSpace ds(self->size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::R, self->addr);
+    for(int pds = 0; pds < 2; ++pds) {
+        for(size_t op = OP_EMPTY; op <= OP_DELEGATE; ++op) {
+            WVPRINTF("Using %s with op %s:", pds ? "Pds" : "threads", op_names[op]);
+            for(size_t cpus = 1; cpus <= CPU::count(); ++cpus)
+                run(mng, ds, self->size, static_cast<Op>(op), cpus, pds);
+        }
+    }
+    delete mng;
+}
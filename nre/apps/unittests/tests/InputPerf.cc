@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <ipc/Producer.h>
+#include <ipc/Consumer.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <services/Keyboard.h>
+#include <util/Profiler.h>
+#include <util/ScopedLock.h>
+
+#include "InputPerf.h"
+
+/*
+ * Simulates an input storm (e.g. pasting text or moving the mouse) on the path from the keyboard
+ * service to a client like vancouver: the service produces the packets of one interrupt into the
+ * ring and the client consumes them, taking its lock for each packet it forwards. It compares the
+ * delivery of single packets, which costs one notification and one lock acquisition per packet,
+ * with the batched delivery, which costs one of each per burst.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_input();
+
+const TestCase inputperf = {
+    "Input event delivery", test_input
+};
+
+static const uint DEF_BURSTS    = 1000;
+static const uint DEF_WARMUP    = 10;
+// the number of packets the keyboard service forwards per interrupt at most
+static const size_t BURST       = 16;
+
+static Keyboard::Packet make_packet(size_t i) {
+    Keyboard::Packet pk;
+    pk.scancode = i & 0xFF;
+    pk.keycode = i & 0x7F;
+    pk.flags = i;
+    return pk;
+}
+
+static void report(const char *name, AvgProfiler &prof) {
+    AvgProfiler::time_t cycles = WVBENCH(name, prof, "cycles/burst");
+    WVPRINTF("%s: %Lu cycles/packet", name, cycles / BURST);
+}
+
+static void run(const char *name, bool batch) {
+    uint bursts = BenchConfig::iterations(DEF_BURSTS);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    DataSpace ds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    Consumer<Keyboard::Packet> cons(&ds, true);
+    Producer<Keyboard::Packet> prod(&ds, false);
+    WVPASS(prod.rblength() > BURST);
+
+    UserSm sm;
+    Keyboard::Packet in[BURST];
+    Keyboard::Packet out[BURST];
+    AvgProfiler prof(bursts, warmup);
+    size_t errors = 0;
+    size_t seq = 0;
+    for(uint b = 0; b < warmup + bursts; ++b) {
+        for(size_t i = 0; i < BURST; ++i)
+            in[i] = make_packet(seq + i);
+
+        prof.start();
+        size_t count = 0;
+        if(batch) {
+            prod.produce_batch(in, BURST);
+            count = cons.consume_batch(out, BURST);
+            ScopedLock<UserSm> guard(&sm);
+            for(size_t i = 0; i < count; ++i)
+                errors += out[i].flags != seq + i;
+        }
+        else {
+            for(size_t i = 0; i < BURST; ++i)
+                prod.produce(in[i]);
+            for(; count < BURST && cons.has_data(); ++count) {
+                Keyboard::Packet *pk = cons.get();
+                ScopedLock<UserSm> guard(&sm);
+                errors += pk->flags != seq + count;
+                cons.next();
+            }
+        }
+        prof.stop();
+
+        errors += count != BURST;
+        seq += BURST;
+    }
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVPASS(!cons.has_data());
+    report(name, prof);
+}
+
+static void test_input() {
+    WVPRINTF("Delivering bursts of %zu packets", BURST);
+    run("input.single", false);
+    run("input.batch", true);
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <ipc/MPProducer.h>
+#include <ipc/MPConsumer.h>
+#include <ipc/Producer.h>
+#include <ipc/Consumer.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
+#include <mem/DataSpace.h>
+#include <util/Util.h>
+#include <Hip.h>
+#include <CPU.h>
+
+#include "MPRingPerf.h"
+
+/*
+ * Measures the throughput of the multi-producer ring with 1..N producers, each on a different
+ * CPU than the consumer (as long as there are enough CPUs), with single and batched produces.
+ * The single-producer ring serves as baseline. Besides that, it checks that the items of each
+ * producer arrive completely and in order.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_mpring();
+
+const TestCase mpringperf = {
+    "Multi-producer ring performance", test_mpring
+};
+
+static const size_t DS_SIZE     = ExecEnv::PAGE_SIZE * 4;
+static const size_t ITEMS       = 200000;
+static const size_t BATCH       = 16;
+
+struct Item {
+    word_t producer;
+    word_t seq;
+};
+
+struct ProducerArgs {
+    DataSpace *ds;
+    word_t id;
+    size_t count;
+    size_t batch;
+    Sm *start;
+    Sm *done;
+};
+
+static ProducerArgs args[Hip::MAX_CPUS];
+
+static void producer_thread(void*) {
+    ProducerArgs *a = Thread::current()->get_tls<ProducerArgs*>(Thread::TLS_PARAM);
+    MPProducer<Item> prod(a->ds, false);
+    Item items[BATCH];
+    a->start->down();
+    for(size_t i = 0; i < a->count; ) {
+        size_t n = Math::min(a->batch, a->count - i);
+        for(size_t j = 0; j < n; ++j) {
+            items[j].producer = a->id;
+            items[j].seq = i + j;
+        }
+        size_t res = n == 1 ? prod.produce(items[0]) : prod.produce_batch(items, n);
+        if(res == 0)
+            Util::pause();
+        i += res;
+    }
+    a->done->up();
+}
+
+static void report(const char *name, size_t producers, size_t items, uint64_t cycles) {
+    ullong rate = cycles ? (items * static_cast<ullong>(Hip::get().freq_tsc) * 1000) / cycles : 0;
+    Serial::get().writef("BENCH: mpring.%s.p%zu items/s n=1 avg=%Lu med=%Lu\n",
+                         name, producers, rate, rate);
+}
+
+static void run_mp(size_t producers, size_t batch) {
+    DataSpace ds(DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    MPConsumer<Item> cons(&ds, true);
+    Sm start(0);
+    Sm done(0);
+    size_t per = ITEMS / producers;
+    cpu_t me = CPU::current().log_id();
+    for(size_t i = 0; i < producers; ++i) {
+        args[i].ds = &ds;
+        args[i].id = i;
+        args[i].count = per;
+        args[i].batch = batch;
+        args[i].start = &start;
+        args[i].done = &done;
+        cpu_t cpu = (me + 1 + i) % CPU::count();
+        GlobalThread *gt = GlobalThread::create(producer_thread, cpu, String("mpring-producer"));
+        gt->set_tls<ProducerArgs*>(Thread::TLS_PARAM, args + i);
+        gt->start();
+    }
+
+    static word_t next[Hip::MAX_CPUS];
+    for(size_t i = 0; i < producers; ++i)
+        next[i] = 0;
+
+    size_t errors = 0;
+    size_t total = per * producers;
+    uint64_t begin = Util::tsc();
+    for(size_t i = 0; i < producers; ++i)
+        start.up();
+    Item it;
+    for(size_t i = 0; i < total && cons.consume(it); ++i) {
+        if(it.producer >= producers || it.seq != next[it.producer])
+            errors++;
+        else
+            next[it.producer]++;
+    }
+    uint64_t end = Util::tsc();
+    for(size_t i = 0; i < producers; ++i)
+        done.down();
+
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVPASS(!cons.has_data());
+    report(batch > 1 ? "batch" : "single", producers, total, end - begin);
+}
+
+static void run_sp() {
+    DataSpace ds(DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    Consumer<Item> cons(&ds, true);
+    Producer<Item> prod(&ds, false);
+    Item it;
+    it.producer = 0;
+    // the legacy ring has only one producer, so we interleave producing and consuming
+    uint64_t begin = Util::tsc();
+    for(size_t i = 0; i < ITEMS; ++i) {
+        it.seq = i;
+        prod.produce(it);
+        cons.get();
+        cons.next();
+    }
+    uint64_t end = Util::tsc();
+    report("spsc", 1, ITEMS, end - begin);
+}
+
+static void test_mpring() {
+    run_sp();
+    size_t max = Math::max<size_t>(1, CPU::count() - 1);
+    for(size_t p = 1; p <= max; ++p) {
+        run_mp(p, 1);
+        run_mp(p, BATCH);
+    }
+    WVPRINTF("Measured 1..%zu producers", max);
+}
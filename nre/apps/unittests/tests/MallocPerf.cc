@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
+#include <util/Util.h>
+#include <util/Sync.h>
+#include <Hip.h>
+#include <CPU.h>
+#include <cstdlib>
+
+#include "MallocPerf.h"
+
+using namespace nre;
+using namespace nre::test;
+
+EXTERN_C void* dlmalloc(size_t);
+EXTERN_C void dlfree(void*);
+
+typedef void *(*malloc_func)(size_t);
+typedef void (*free_func)(void*);
+
+static void test_mallocperf();
+
+const TestCase mallocperf = {
+    "Malloc-performance", test_mallocperf
+};
+
+static const size_t DEF_ROUNDS  = 1000;
+static const size_t OBJ_COUNT   = 32;
+static const size_t REMOTE_OBJS = 64;
+static const size_t REMOTE_SIZE = 32;
+// the cache of a size-class holds at most two batches of at most 32 objects locally
+static const size_t MAX_LOCAL   = 64;
+
+static malloc_func cur_malloc;
+static free_func cur_free;
+static size_t rounds;
+static volatile bool go;
+static ullong rates[Hip::MAX_CPUS];
+static Sm done(0);
+static void *remote_objs[REMOTE_OBJS];
+
+static void bench_thread(void*) {
+    void *objs[OBJ_COUNT];
+    while(!go)
+        Util::pause();
+
+    ullong start = Util::tsc();
+    for(size_t r = 0; r < rounds; ++r) {
+        for(size_t i = 0; i < OBJ_COUNT; ++i) {
+            objs[i] = cur_malloc(16 << (i % 6));
+            *static_cast<char*>(objs[i]) = i;
+        }
+        for(size_t i = 0; i < OBJ_COUNT; ++i)
+            cur_free(objs[i]);
+    }
+    ullong cycles = Util::tsc() - start;
+    // a malloc and a free is one operation
+    rates[CPU::current().log_id()] = (rounds * OBJ_COUNT * Hip::get().freq_tsc * 1000) / cycles;
+    done.up();
+}
+
+static void run(const char *name, malloc_func m, free_func f, size_t threads) {
+    cur_malloc = m;
+    cur_free = f;
+    go = false;
+    for(size_t i = 0; i < threads; ++i)
+        GlobalThread::create(bench_thread, i, String("malloc-bench"))->start();
+    Sync::memory_barrier();
+    go = true;
+    for(size_t i = 0; i < threads; ++i)
+        done.down();
+
+    ullong sum = 0, min = ~0ULL, max = 0;
+    for(size_t i = 0; i < threads; ++i) {
+        sum += rates[i];
+        min = Math::min(min, rates[i]);
+        max = Math::max(max, rates[i]);
+    }
+    Serial::get().writef("BENCH: %s.%zu ops/s cpu=%u n=%zu avg=%Lu min=%Lu max=%Lu\n",
+                         name, threads, CPU::current().log_id(), threads, sum, min, max);
+    WVPERF(sum, "ops/s");
+}
+
+static void remote_free_thread(void*) {
+    for(size_t i = 0; i < REMOTE_OBJS; ++i)
+        free(remote_objs[i]);
+    done.up();
+}
+
+static void test_remote_free() {
+    cpu_t other = (CPU::current().log_id() + 1) % CPU::count();
+    for(size_t i = 0; i < REMOTE_OBJS; ++i) {
+        remote_objs[i] = malloc(REMOTE_SIZE);
+        memset(remote_objs[i], i, REMOTE_SIZE);
+    }
+    GlobalThread::create(remote_free_thread, other, String("malloc-remote"))->start();
+    done.down();
+
+    // now allocate objects of the same size-class again. the freed ones are in our remote-free
+    // list, so that we should get all of them back as soon as the local list is empty
+    void *objs[REMOTE_OBJS + MAX_LOCAL];
+    size_t found = 0, n;
+    for(n = 0; n < ARRAY_SIZE(objs) && found < REMOTE_OBJS; ++n) {
+        objs[n] = malloc(REMOTE_SIZE);
+        for(size_t i = 0; i < REMOTE_OBJS; ++i) {
+            if(objs[n] == remote_objs[i]) {
+                found++;
+                break;
+            }
+        }
+    }
+    for(size_t i = 0; i < n; ++i)
+        free(objs[i]);
+    WVPASSEQ(found, REMOTE_OBJS);
+}
+
+static void test_mallocperf() {
+    rounds = BenchConfig::iterations(DEF_ROUNDS);
+    test_remote_free();
+
+    WVPRINTF("Using malloc (per-CPU caches):");
+    for(size_t n = 1; n <= CPU::count(); ++n)
+        run("malloc", malloc, free, n);
+    WVPRINTF("Using dlmalloc:");
+    for(size_t n = 1; n <= CPU::count(); ++n)
+        run("dlmalloc", dlmalloc, dlfree, n);
+}
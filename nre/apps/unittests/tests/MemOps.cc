@@ -17,6 +17,7 @@
 #include <kobj/Pt.h>
 #include <utcb/UtcbFrame.h>
 #include <util/Profiler.h>
+#include <stream/OStringStream.h>
 #include <CPU.h>
 #include <cstdlib>
 
@@ -39,7 +40,8 @@ const TestCase memsettest = {
 };
 
 static const size_t AREA_SIZE   = 4096;
-static const uint TEST_COUNT    = 1000;
+static const uint DEF_COUNT     = 1000;
+static const uint DEF_WARMUP    = 10;
 
 static void memcpy_func(void *a, void *b, size_t len) {
     memcpy(a, const_cast<const void*>(b), len);
@@ -58,31 +60,32 @@ static void test_memset() {
 static void do_test(const char *name, memop_func func) {
     void *mem = malloc(AREA_SIZE);
     void *buf = malloc(AREA_SIZE);
+    uint count = BenchConfig::iterations(DEF_COUNT);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    char bname[32];
 
     {
         WVPRINTF("Testing aligned %s with %zu bytes", name, AREA_SIZE);
-        AvgProfiler prof(TEST_COUNT);
-        for(uint i = 0; i < TEST_COUNT; ++i) {
+        AvgProfiler prof(count, warmup);
+        for(uint i = 0; i < warmup + count; ++i) {
             prof.start();
             func(buf, mem, AREA_SIZE);
             prof.stop();
         }
-        WVPERF(prof.avg(), " cycles");
-        WVPRINTF("min: %Lu", prof.min());
-        WVPRINTF("max: %Lu", prof.max());
+        OStringStream::format(bname, sizeof(bname), "%s.aligned", name);
+        WVBENCH(bname, prof, "cycles");
     }
 
     {
         WVPRINTF("Testing unaligned %s with %zu bytes", name, AREA_SIZE);
-        AvgProfiler prof(TEST_COUNT);
-        for(uint i = 0; i < TEST_COUNT; ++i) {
+        AvgProfiler prof(count, warmup);
+        for(uint i = 0; i < warmup + count; ++i) {
             prof.start();
             func(reinterpret_cast<char*>(buf) + 1, reinterpret_cast<char*>(mem) + 1, AREA_SIZE - 2);
             prof.stop();
         }
-        WVPERF(prof.avg(), " cycles");
-        WVPRINTF("min: %Lu", prof.min());
-        WVPRINTF("max: %Lu", prof.max());
+        OStringStream::format(bname, sizeof(bname), "%s.unaligned", name);
+        WVBENCH(bname, prof, "cycles");
     }
 
     free(buf);
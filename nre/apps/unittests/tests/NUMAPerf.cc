@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <ipc/Connection.h>
+#include <services/SysInfo.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
+#include <mem/DataSpace.h>
+#include <stream/OStringStream.h>
+#include <util/BitField.h>
+#include <util/Profiler.h>
+#include <CPU.h>
+
+#include "NUMAPerf.h"
+
+/*
+ * Measures the memory latency from each NUMA node to the memory of each node by chasing pointers
+ * through a dataspace that has been placed on that node. Besides that, it checks that root
+ * honors the requested placements. Use boot/numa to run it with multiple nodes in qemu.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_numa();
+
+const TestCase numaperf = {
+    "NUMA performance", test_numa
+};
+
+static const size_t AREA_SIZE   = 8 * 1024 * 1024;
+static const size_t CHASE_STEPS = 1024;
+static const uint DEF_COUNT     = 100;
+static const uint DEF_WARMUP    = 10;
+
+struct NodeBench {
+    const NUMA::Info *info;
+    NUMA::node_t node;
+    Sm *done;
+};
+
+static void build_chain(DataSpace &ds) {
+    // visit the pages in random order and use a different cache line in each page
+    size_t n = ds.size() / ExecEnv::PAGE_SIZE;
+    uintptr_t *pages = new uintptr_t[n];
+    for(size_t i = 0; i < n; ++i)
+        pages[i] = ds.virt() + i * ExecEnv::PAGE_SIZE;
+    uint seed = 0x12345678;
+    for(size_t i = n - 1; i > 0; --i) {
+        seed = seed * 1103515245 + 12345;
+        size_t j = (seed >> 8) % (i + 1);
+        uintptr_t tmp = pages[i];
+        pages[i] = pages[j];
+        pages[j] = tmp;
+    }
+    for(size_t i = 0; i < n; ++i)
+        pages[i] += (i * 64) % ExecEnv::PAGE_SIZE;
+    for(size_t i = 0; i < n; ++i)
+        *reinterpret_cast<uintptr_t*>(pages[i]) = pages[(i + 1) % n];
+    delete[] pages;
+}
+
+static void measure(NodeBench *b) {
+    uint iters = BenchConfig::iterations(DEF_COUNT);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    char name[32];
+
+    WVPASSEQ(static_cast<uint>(CPU::current().node()), static_cast<uint>(b->node));
+    for(NUMA::node_t to = 0; to < b->info->nodes(); ++to) {
+        DataSpaceDesc desc(AREA_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW, 0, 0, 0, 0, to);
+        DataSpace ds(desc);
+        WVPASSEQ(ds.desc().node(), static_cast<int>(to));
+        build_chain(ds);
+
+        AvgProfiler prof(iters, warmup);
+        uintptr_t p = ds.virt();
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            for(size_t j = 0; j < CHASE_STEPS; ++j)
+                p = *reinterpret_cast<volatile uintptr_t*>(p);
+            prof.stop();
+        }
+        WVPASS(p != 0);
+        WVPRINTF("node %u -> node %u: distance %u", b->node, to, b->info->distance(b->node, to));
+        OStringStream::format(name, sizeof(name), "numaperf.node%u.mem%u", b->node, to);
+        WVBENCH(name, prof, "cycles/1024");
+    }
+
+    // node-local memory should come from our node
+    DataSpaceDesc desc(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW, 0, 0, 0, 0,
+                       DataSpaceDesc::NODE_LOCAL);
+    DataSpace ds(desc);
+    WVPASSEQ(ds.desc().node(), static_cast<int>(b->node));
+}
+
+static void node_thread(void*) {
+    NodeBench *b = Thread::current()->get_tls<NodeBench*>(Thread::TLS_PARAM);
+    try {
+        measure(b);
+    }
+    catch(const Exception &e) {
+        Serial::get() << e;
+    }
+    b->done->up();
+}
+
+static void test_numa() {
+    Connection con("sysinfo");
+    SysInfoSession sysinfo(con);
+    NUMA::Info info;
+    sysinfo.get_numa(info);
+    WVPRINTF("%zu nodes, %zu memory ranges", info.nodes(), info.ranges());
+    for(NUMA::node_t n = 0; n < info.nodes(); ++n) {
+        size_t total, free;
+        sysinfo.get_node_mem(n, total, free);
+        WVPRINTF("node %u: %zu KiB total, %zu KiB free", n, total / 1024, free / 1024);
+    }
+
+    // measure from the first CPU of each node
+    Sm done(0);
+    NodeBench benches[NUMA::MAX_NODES];
+    for(NUMA::node_t n = 0; n < info.nodes(); ++n) {
+        benches[n].info = &info;
+        benches[n].node = n;
+        benches[n].done = &done;
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
+            if(it->node() == n) {
+                GlobalThread *gt = GlobalThread::create(node_thread, it->log_id(),
+                                                        String("numaperf"));
+                gt->set_tls<NodeBench*>(Thread::TLS_PARAM, benches + n);
+                gt->start();
+                done.down();
+                break;
+            }
+        }
+    }
+
+    // interleaved dataspaces should be distributed over all nodes
+    DataSpace *ds[NUMA::MAX_NODES];
+    BitField<NUMA::MAX_NODES> used;
+    for(size_t i = 0; i < info.nodes(); ++i) {
+        DataSpaceDesc desc(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW,
+                           0, 0, 0, 0, DataSpaceDesc::NODE_INTERLEAVE);
+        ds[i] = new DataSpace(desc);
+        if(ds[i]->desc().node() >= 0)
+            used.set(ds[i]->desc().node());
+    }
+    size_t count = 0;
+    for(size_t i = 0; i < info.nodes(); ++i)
+        count += used.is_set(i) ? 1 : 0;
+    WVPASSEQ(count, info.nodes());
+    for(size_t i = 0; i < info.nodes(); ++i)
+        delete ds[i];
+}
@@ -30,7 +30,8 @@ const TestCase pingpong = {
     "PingPong", test_pingpong
 };
 
-static const uint tries = 10000;
+static const uint DEF_TRIES    = 10000;
+static const uint DEF_WARMUP   = 100;
 
 PORTAL static void portal_empty(capsel_t) {
 }
@@ -48,36 +49,36 @@ PORTAL static void portal_data(capsel_t) {
     }
 }
 
-static void print_result(AvgProfiler &prof, uint sum) {
-    WVPERF(prof.avg(), "cycles");
-    WVPASSEQ(sum, (1 + 2) * tries + (1 + 2 + 3) * tries);
+static void print_result(const char *name, AvgProfiler &prof, uint sum, uint runs) {
+    WVBENCH(name, prof, "cycles");
+    WVPASSEQ(sum, (1 + 2) * runs + (1 + 2 + 3) * runs);
     WVPRINTF("sum: %u", sum);
-    WVPRINTF("min: %Lu", prof.min());
-    WVPRINTF("max: %Lu", prof.max());
 }
 
 static void test_pingpong() {
     LocalThread *ec = LocalThread::create(CPU::current().log_id());
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
 
     {
         Pt pt(ec, portal_empty);
-        AvgProfiler prof(tries);
+        AvgProfiler prof(tries, warmup);
         UtcbFrame uf;
-        for(uint i = 0; i < tries; i++) {
+        for(uint i = 0; i < warmup + tries; i++) {
             prof.start();
             pt.call(uf);
             prof.stop();
         }
         WVPRINTF("Using portal_empty:");
-        print_result(prof, (1 + 2) * tries + (1 + 2 + 3) * tries);
+        print_result("pingpong.empty", prof, (1 + 2) * tries + (1 + 2 + 3) * tries, tries);
     }
 
     {
         Pt pt(ec, portal_data);
-        AvgProfiler prof(tries);
+        AvgProfiler prof(tries, warmup);
         uint sum = 0;
         UtcbFrame uf;
-        for(uint i = 0; i < tries; i++) {
+        for(uint i = 0; i < warmup + tries; i++) {
             prof.start();
             uf << 1 << 2 << 3;
             pt.call(uf);
@@ -88,6 +89,6 @@ static void test_pingpong() {
             prof.stop();
         }
         WVPRINTF("Using portal_data:");
-        print_result(prof, sum);
+        print_result("pingpong.data", prof, sum, warmup + tries);
     }
 }
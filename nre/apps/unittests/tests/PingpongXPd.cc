@@ -39,7 +39,8 @@ const TestCase pingpongxpd = {
 
 typedef void (*client_func)(AvgProfiler &prof, Pt &pt, UtcbFrame &uf, uint &sum);
 
-static const uint tries = 10000;
+static const uint DEF_TRIES    = 10000;
+static const uint DEF_WARMUP   = 100;
 static PingpongService *srv;
 
 class PingpongSession : public ServiceSession {
@@ -115,17 +116,18 @@ static int pingpong_client(int, char *argv[]) {
     Pt pt(sess.caps() + CPU::current().log_id());
     uintptr_t addr = IStringStream::read_from<uintptr_t>(argv[1]);
     client_func func = reinterpret_cast<client_func>(addr);
+    // the benchmark config lives in our parent, so it passes the values to us
+    uint tries = IStringStream::read_from<uint>(argv[2]);
+    uint warmup = IStringStream::read_from<uint>(argv[3]);
     uint sum = 0;
-    AvgProfiler prof(tries);
+    AvgProfiler prof(tries, warmup);
     UtcbFrame uf;
-    for(uint i = 0; i < tries; i++)
+    for(uint i = 0; i < warmup + tries; i++)
         func(prof, pt, uf, sum);
 
-    WVPERF(prof.avg(), "cycles");
-    WVPASSEQ(sum, (1 + 2) * tries + (1 + 2 + 3) * tries);
+    WVBENCH(argv[4], prof, "cycles");
+    WVPASSEQ(sum, (1 + 2) * (warmup + tries) + (1 + 2 + 3) * (warmup + tries));
     WVPRINTF("sum: %u", sum);
-    WVPRINTF("min: %Lu", prof.min());
-    WVPRINTF("max: %Lu", prof.max());
     return 0;
 }
 
@@ -135,6 +137,8 @@ static void test_pingpong() {
     Pt::portal_func funcs[] = {portal_empty, portal_data};
     client_func clientfuncs[] = {client_empty, client_data};
     const char *names[] = {"empty", "data"};
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
     for(size_t i = 0; i < ARRAY_SIZE(funcs); ++i) {
         WVPRINTF("Using the %s portal:", names[i]);
         // map the memory of the module
@@ -148,9 +152,10 @@ static void test_pingpong() {
             mng->load(ds.virt(), self->size, cfg);
         }
         {
-            char cmdline[64];
+            char cmdline[96];
             OStringStream os(cmdline, sizeof(cmdline));
-            os << "pingpongclient " << reinterpret_cast<uintptr_t>(clientfuncs[i]);
+            os << "pingpongclient " << reinterpret_cast<uintptr_t>(clientfuncs[i]) << " " << tries;
+            os << " " << warmup << " pingpongxpd." << names[i];
             ChildConfig cfg(0, String(cmdline));
             cfg.entry(reinterpret_cast<uintptr_t>(pingpong_client));
             mng->load(ds.virt(), self->size, cfg);
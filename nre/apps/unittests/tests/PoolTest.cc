@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <util/ObjectPool.h>
+#include <util/Arena.h>
+#include <util/Profiler.h>
+#include <util/Math.h>
+
+#include "PoolTest.h"
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_pool();
+
+const TestCase pooltest = {
+    "ObjectPool and Arena", test_pool
+};
+
+static const size_t OBJ_COUNT   = 64;
+static const size_t DEF_TRIES   = 1000;
+static const size_t DEF_WARMUP  = 10;
+
+struct PoolObj {
+    explicit PoolObj(int v = 0) : val(v) {
+        instances++;
+    }
+    ~PoolObj() {
+        instances--;
+    }
+
+    int val;
+    char data[44];
+    static int instances;
+};
+
+int PoolObj::instances = 0;
+
+static void test_pool_basic() {
+    ObjectPool<PoolObj, LockPolicyNone, 16> pool;
+    PoolObj *objs[OBJ_COUNT];
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        objs[i] = pool.create(static_cast<int>(i));
+    WVPASSEQ(PoolObj::instances, static_cast<int>(OBJ_COUNT));
+    WVPASSEQ(pool.used(), OBJ_COUNT);
+    WVPASSEQ(pool.capacity(), OBJ_COUNT);
+    bool ok = true;
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        ok &= objs[i]->val == static_cast<int>(i);
+    WVPASS(ok);
+
+    // the last freed object is reused first
+    PoolObj *old = objs[3];
+    pool.destroy(objs[3]);
+    objs[3] = pool.create(42);
+    WVPASS(objs[3] == old);
+    WVPASSEQ(objs[3]->val, 42);
+
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        pool.destroy(objs[i]);
+    WVPASSEQ(PoolObj::instances, 0);
+    WVPASSEQ(pool.used(), static_cast<size_t>(0));
+}
+
+static void test_arena_basic() {
+    Arena arena(256);
+    char *a = static_cast<char*>(arena.alloc(3, 1));
+    uint64_t *b = arena.alloc_array<uint64_t>(4);
+    WVPASS((reinterpret_cast<uintptr_t>(b) % sizeof(uint64_t)) == 0);
+    WVPASS(reinterpret_cast<char*>(b) >= a + 3);
+    size_t used = arena.used();
+    {
+        ArenaScope scope(arena);
+        // force a new chunk
+        arena.alloc(1024);
+        arena.alloc(16);
+        WVPASS(arena.used() > used);
+    }
+    WVPASSEQ(arena.used(), used);
+    arena.reset();
+    WVPASSEQ(arena.used(), static_cast<size_t>(0));
+}
+
+static size_t span(PoolObj **objs, size_t count) {
+    uintptr_t min = ~static_cast<uintptr_t>(0), max = 0;
+    for(size_t i = 0; i < count; ++i) {
+        min = Math::min(min, reinterpret_cast<uintptr_t>(objs[i]));
+        max = Math::max(max, reinterpret_cast<uintptr_t>(objs[i]));
+    }
+    return max - min + sizeof(PoolObj);
+}
+
+static void test_fragmentation() {
+    static PoolObj *objs[OBJ_COUNT];
+    ObjectPool<PoolObj> pool;
+
+    // allocate all, free every second one and allocate the same number of objects again. the pool
+    // should reuse the holes, i.e. not need more slabs
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        objs[i] = pool.create();
+    size_t cap = pool.capacity();
+    for(size_t i = 0; i < OBJ_COUNT; i += 2)
+        pool.destroy(objs[i]);
+    for(size_t i = 0; i < OBJ_COUNT; i += 2)
+        objs[i] = pool.create();
+    WVPASSEQ(pool.capacity(), cap);
+    WVPRINTF("pool: %zu objects span %zu bytes (%zu bytes in slabs)",
+             OBJ_COUNT, span(objs, OBJ_COUNT), pool.size());
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        pool.destroy(objs[i]);
+
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        objs[i] = new PoolObj();
+    for(size_t i = 0; i < OBJ_COUNT; i += 2)
+        delete objs[i];
+    for(size_t i = 0; i < OBJ_COUNT; i += 2)
+        objs[i] = new PoolObj();
+    WVPRINTF("new: %zu objects span %zu bytes", OBJ_COUNT, span(objs, OBJ_COUNT));
+    for(size_t i = 0; i < OBJ_COUNT; ++i)
+        delete objs[i];
+}
+
+static void test_perf() {
+    static PoolObj *objs[OBJ_COUNT];
+    size_t tries = BenchConfig::iterations(DEF_TRIES);
+    size_t warmup = BenchConfig::warmup(DEF_WARMUP);
+
+    {
+        ObjectPool<PoolObj> pool;
+        AvgProfiler prof(tries, warmup);
+        for(size_t j = 0; j < warmup + tries; ++j) {
+            prof.start();
+            for(size_t i = 0; i < OBJ_COUNT; ++i)
+                objs[i] = pool.create();
+            for(size_t i = 0; i < OBJ_COUNT; ++i)
+                pool.destroy(objs[i]);
+            prof.stop();
+        }
+        WVBENCH("pool.objectpool", prof, "cycles");
+    }
+
+    {
+        AvgProfiler prof(tries, warmup);
+        for(size_t j = 0; j < warmup + tries; ++j) {
+            prof.start();
+            for(size_t i = 0; i < OBJ_COUNT; ++i)
+                objs[i] = new PoolObj();
+            for(size_t i = 0; i < OBJ_COUNT; ++i)
+                delete objs[i];
+            prof.stop();
+        }
+        WVBENCH("pool.new", prof, "cycles");
+    }
+
+    {
+        Arena arena;
+        AvgProfiler prof(tries, warmup);
+        for(size_t j = 0; j < warmup + tries; ++j) {
+            prof.start();
+            {
+                ArenaScope scope(arena);
+                for(size_t i = 0; i < OBJ_COUNT; ++i)
+                    objs[i] = new (arena.alloc(sizeof(PoolObj))) PoolObj();
+            }
+            prof.stop();
+        }
+        WVBENCH("pool.arena", prof, "cycles");
+    }
+}
+
+static void test_pool() {
+    test_pool_basic();
+    test_arena_basic();
+    test_fragmentation();
+    test_perf();
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/Pt.h>
+#include <kobj/LocalThread.h>
+#include <utcb/UtcbFrame.h>
+#include <util/Profiler.h>
+#include <String.h>
+#include <CPU.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "PortalAllocs.h"
+
+/*
+ * Counts the heap allocations per portal invocation when receiving strings as String and as
+ * StringView, like the log service does for every line, and measures the costs of both. Besides
+ * that, it receives a large block of data as StringView to check that nothing is copied.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_allocs();
+
+const TestCase portalallocs = {
+    "Portal allocations", test_allocs
+};
+
+static const uint DEF_TRIES     = 1000;
+static const uint DEF_WARMUP    = 10;
+static const size_t LINE_LEN    = 80;
+static const size_t BLOCK_SIZE  = 2048;
+
+static char line[LINE_LEN + 1];
+static char block[BLOCK_SIZE];
+static const char *last_str;
+static size_t alloc_count;
+
+/*
+ * Count the heap allocations by replacing the global allocation functions of the unittests
+ * instead of counting in malloc, which would cost every program something. Only the allocations
+ * via new are counted, but that's what String uses. Not atomic, since the portal runs on our CPU.
+ */
+void *operator new(size_t size) {
+    alloc_count++;
+    return malloc(size);
+}
+void *operator new[](size_t size) {
+    alloc_count++;
+    return malloc(size);
+}
+void operator delete(void *p) throw() {
+    free(p);
+}
+void operator delete[](void *p) throw() {
+    free(p);
+}
+
+template<class STR>
+PORTAL static void portal_str(capsel_t) {
+    UtcbFrameRef uf;
+    try {
+        STR str;
+        uf >> str;
+        uf.finish_input();
+        last_str = str.str();
+        uf << E_SUCCESS << str.length() << static_cast<uint>(str.str()[str.length() - 1]);
+    }
+    catch(const Exception &e) {
+        uf.clear();
+        uf << e;
+    }
+}
+
+template<class STR>
+static size_t run(const char *name, LocalThread *ec, const char *data, size_t len) {
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    Pt pt(ec, portal_str<STR>);
+    AvgProfiler prof(tries, warmup);
+    StringView view(data, len);
+    size_t errors = 0;
+    size_t allocs = 0;
+    for(uint i = 0; i < warmup + tries; i++) {
+        UtcbFrame uf;
+        size_t before = alloc_count;
+        prof.start();
+        uf << view;
+        pt.call(uf);
+        uf.check_reply();
+        prof.stop();
+        if(i >= warmup)
+            allocs += alloc_count - before;
+        size_t rlen;
+        uint last;
+        uf >> rlen >> last;
+        errors += rlen != len || last != static_cast<uint>(data[len - 1]);
+    }
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVPRINTF("%s: %zu allocations in %u calls", name, allocs, tries);
+    WVBENCH(name, prof, "cycles");
+    WVPERF(allocs / tries, "allocs/call");
+    return allocs;
+}
+
+static void test_allocs() {
+    for(size_t i = 0; i < LINE_LEN; ++i)
+        line[i] = 'a' + i % 26;
+    for(size_t i = 0; i < BLOCK_SIZE; ++i)
+        block[i] = i;
+
+    LocalThread *ec = LocalThread::create(CPU::current().log_id());
+    size_t allocs = run<String>("portal.string", ec, line, LINE_LEN);
+    WVPASS(allocs >= BenchConfig::iterations(DEF_TRIES));
+    allocs = run<StringView>("portal.view", ec, line, LINE_LEN);
+    WVPASSEQ(allocs, static_cast<size_t>(0));
+
+    // the view has to point into the UTCB of the portal's thread, not to a copy
+    allocs = run<StringView>("portal.view.block", ec, block, BLOCK_SIZE);
+    WVPASSEQ(allocs, static_cast<size_t>(0));
+    uintptr_t utcb = reinterpret_cast<uintptr_t>(ec->utcb());
+    uintptr_t str = reinterpret_cast<uintptr_t>(last_str);
+    WVPASS(str >= utcb && str < utcb + Utcb::SIZE);
+    delete ec;
+}
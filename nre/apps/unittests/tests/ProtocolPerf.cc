@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/Pt.h>
+#include <kobj/LocalThread.h>
+#include <ipc/Protocol.h>
+#include <services/Storage.h>
+#include <util/Profiler.h>
+#include <CPU.h>
+
+#include "ProtocolPerf.h"
+
+/*
+ * Compares calls via Protocol and ProtocolDispatcher with hand-written marshalling and a switch
+ * over the command, for a timer-shaped method (fixed size) and a storage-shaped one (with a DMA
+ * list). Besides that, it checks that invalid requests are rejected.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_protocol();
+
+const TestCase protocolperf = {
+    "Protocol", test_protocol
+};
+
+static const uint DEF_TRIES     = 10000;
+static const uint DEF_WARMUP    = 100;
+
+enum Command {
+    ADD,
+    READ,
+    COMMAND_COUNT
+};
+
+typedef Method<ADD, Args<uint64_t, uint64_t>, Args<uint64_t> > Add;
+typedef Method<READ, Args<Storage::tag_type, Storage::sector_type, Storage::dma_type>,
+               Args<size_t> > Read;
+// the same commands with the wrong arguments and an unknown one
+typedef Method<ADD, Args<uint64_t> > BadAdd;
+typedef Method<COMMAND_COUNT> Unknown;
+
+struct Calc {
+    static void add(Calc *, UtcbFrameRef &, const Add::In &in, Add::Out &out) {
+        out.a1 = in.a1 + in.a2;
+    }
+    static void read(Calc *, UtcbFrameRef &, const Read::In &in, Read::Out &out) {
+        out.a1 = in.a3.bytecount();
+    }
+};
+
+static Calc calc;
+static ProtocolDispatcher<Calc, COMMAND_COUNT> dispatcher;
+
+PORTAL static void portal_protocol(capsel_t) {
+    UtcbFrameRef uf;
+    try {
+        dispatcher.dispatch(&calc, uf);
+    }
+    catch(const Exception &e) {
+        uf.clear();
+        uf << e;
+    }
+}
+
+PORTAL static void portal_manual(capsel_t) {
+    UtcbFrameRef uf;
+    try {
+        Command cmd;
+        uf >> cmd;
+        switch(cmd) {
+            case ADD: {
+                uint64_t a, b;
+                uf >> a >> b;
+                uf.finish_input();
+                uf << E_SUCCESS << (a + b);
+            }
+            break;
+
+            case READ: {
+                Storage::tag_type tag;
+                Storage::sector_type sector;
+                Storage::dma_type dma;
+                uf >> tag >> sector >> dma;
+                uf.finish_input();
+                uf << E_SUCCESS << dma.bytecount();
+            }
+            break;
+
+            default:
+                throw Exception(E_ARGS_INVALID, "Invalid command");
+        }
+    }
+    catch(const Exception &e) {
+        uf.clear();
+        uf << e;
+    }
+}
+
+static void bench_add(LocalThread *ec) {
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    Pt manual(ec, portal_manual);
+    Pt proto(ec, portal_protocol);
+    AvgProfiler mprof(tries, warmup), pprof(tries, warmup);
+    size_t errors = 0;
+    for(uint i = 0; i < warmup + tries; i++) {
+        uint64_t res;
+        {
+            UtcbFrame uf;
+            mprof.start();
+            uf << ADD << static_cast<uint64_t>(i) << static_cast<uint64_t>(1);
+            manual.call(uf);
+            uf.check_reply();
+            uf >> res;
+            mprof.stop();
+            errors += res != i + 1;
+        }
+        {
+            UtcbFrame uf;
+            pprof.start();
+            res = Protocol::call<Add>(proto, uf, i, 1).a1;
+            pprof.stop();
+            errors += res != i + 1;
+        }
+    }
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVBENCH("ipc.add.manual", mprof, "cycles");
+    WVBENCH("ipc.add.protocol", pprof, "cycles");
+}
+
+static void bench_read(LocalThread *ec) {
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    Pt manual(ec, portal_manual);
+    Pt proto(ec, portal_protocol);
+    AvgProfiler mprof(tries, warmup), pprof(tries, warmup);
+    Storage::dma_type dma;
+    dma.push(DMADesc(0, 0x1000));
+    dma.push(DMADesc(0x2000, 0x200));
+    size_t errors = 0;
+    for(uint i = 0; i < warmup + tries; i++) {
+        size_t res;
+        {
+            UtcbFrame uf;
+            mprof.start();
+            uf << READ << static_cast<Storage::tag_type>(i);
+            uf << static_cast<Storage::sector_type>(i) << dma;
+            manual.call(uf);
+            uf.check_reply();
+            uf >> res;
+            mprof.stop();
+            errors += res != 0x1200;
+        }
+        {
+            UtcbFrame uf;
+            pprof.start();
+            res = Protocol::call<Read>(proto, uf, i, i, dma).a1;
+            pprof.stop();
+            errors += res != 0x1200;
+        }
+    }
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVBENCH("ipc.read.manual", mprof, "cycles");
+    WVBENCH("ipc.read.protocol", pprof, "cycles");
+}
+
+static void test_invalid(LocalThread *ec) {
+    Pt proto(ec, portal_protocol);
+    {
+        UtcbFrame uf;
+        ErrorCode res = E_SUCCESS;
+        try {
+            Protocol::call<BadAdd>(proto, uf, 1);
+        }
+        catch(const Exception &e) {
+            res = e.code();
+        }
+        WVPASSEQ(res, E_UTCB_UNTYPED);
+    }
+    {
+        UtcbFrame uf;
+        ErrorCode res = E_SUCCESS;
+        try {
+            Protocol::call<Unknown>(proto, uf);
+        }
+        catch(const Exception &e) {
+            res = e.code();
+        }
+        WVPASSEQ(res, E_ARGS_INVALID);
+    }
+}
+
+static void test_protocol() {
+    dispatcher.add<Add, &Calc::add>();
+    dispatcher.add<Read, &Calc::read>();
+
+    LocalThread *ec = LocalThread::create(CPU::current().log_id());
+    bench_add(ec);
+    bench_read(ec);
+    test_invalid(ec);
+    delete ec;
+}
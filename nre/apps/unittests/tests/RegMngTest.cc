@@ -79,4 +79,29 @@ void test_regmng() {
         WVPASSEQ(it->addr, static_cast<uintptr_t>(0x280000));
         WVPASSEQ(it->size, static_cast<size_t>(0x2000));
     }
+
+    {
+        // allocations within a range, as used for NUMA nodes
+        ScopedPtr<RegionManager> rm(new RegionManager());
+        rm->free(0x100000, 0x100000);
+
+        addr1 = rm->alloc_in(0x180000, 0x200000, 0x1000);
+        addr2 = rm->alloc_in(0x0, 0x180000, 0x2000, 0x10000);
+        WVPASSEQ(addr1, static_cast<uintptr_t>(0x180000));
+        WVPASSEQ(addr2, static_cast<uintptr_t>(0x100000));
+        WVPASSEQ(rm->total_size(), static_cast<size_t>(0x100000 - 0x3000));
+
+        bool failed = false;
+        try {
+            rm->alloc_in(0x300000, 0x400000, 0x1000);
+        }
+        catch(const RegionManagerException&) {
+            failed = true;
+        }
+        WVPASS(failed);
+
+        rm->free(addr1, 0x1000);
+        rm->free(addr2, 0x2000);
+        WVPASSEQ(rm->total_size(), static_cast<size_t>(0x100000));
+    }
 }
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <ipc/Connection.h>
+#include <services/SysInfo.h>
+#include <util/Profiler.h>
+#include <CPU.h>
+
+#include "SysInfoPerf.h"
+
+/*
+ * Compares the costs of fetching the time of all Scs one by one via IPC with reading the
+ * statistics that root samples into a shared dataspace. Besides that, it checks the statistics.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_sysinfo();
+
+const TestCase sysinfoperf = {
+    "SysInfo performance", test_sysinfo
+};
+
+static const uint DEF_COUNT     = 100;
+static const uint DEF_WARMUP    = 10;
+
+static void test_sysinfo() {
+    static SysInfo::CPUStats stats;
+    uint iters = BenchConfig::iterations(DEF_COUNT);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    Connection con("sysinfo");
+    SysInfoSession sysinfo(con);
+
+    // the first call joins the dataspace
+    size_t total = 0;
+    for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu) {
+        sysinfo.get_stats(cpu->log_id(), stats);
+        WVPASS((stats.seq & 1) == 0);
+        WVPASS(stats.count <= SysInfo::STATS_MAX_SCS);
+        for(size_t w = 0; w < SysInfo::WINDOWS; ++w)
+            WVPASS(stats.load[w] <= 1000);
+        for(size_t i = 0; i < stats.count; ++i)
+            WVPASS(stats.scs[i].load[SysInfo::WIN_1S] <= 1000);
+        total += stats.count;
+    }
+    WVPRINTF("%zu Scs in the statistics", total);
+    WVPASS(total >= CPU::count());
+
+    {
+        AvgProfiler prof(iters, warmup);
+        size_t count = 0;
+        for(uint i = 0; i < warmup + iters; ++i) {
+            SysInfo::TimeUser tu;
+            prof.start();
+            for(count = 0; sysinfo.get_timeuser(count, tu); ++count)
+                ;
+            prof.stop();
+        }
+        WVPRINTF("%zu Scs via IPC", count);
+        WVBENCH("sysinfo.ipc", prof, "cycles");
+    }
+
+    {
+        AvgProfiler prof(iters, warmup);
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu)
+                sysinfo.get_stats(cpu->log_id(), stats);
+            prof.stop();
+        }
+        WVBENCH("sysinfo.shared", prof, "cycles");
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <mem/DataSpace.h>
+#include <stream/OStringStream.h>
+#include <util/Profiler.h>
+#include <util/Util.h>
+
+#include "TLBPerf.h"
+
+/*
+ * Compares the memory access costs of a large anonymous dataspace, which root backs with
+ * superpages, with dataspaces that are one page too small for that. The first touch shows the
+ * number of pagefaults, the pointer-chase through all pages in random order shows the TLB misses
+ * and the sequential read shows the bandwidth.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_tlb();
+
+const TestCase tlbperf = {
+    "TLB performance", test_tlb
+};
+
+static const size_t AREAS       = 4;
+static const size_t CHASE_STEPS = 1024;
+static const uint DEF_COUNT     = 100;
+static const uint DEF_WARMUP    = 10;
+static const size_t MAX_PAGES   = AREAS * ExecEnv::PT_ENTRY_COUNT;
+
+static uintptr_t pages[MAX_PAGES];
+
+static size_t collect_pages(DataSpace **ds, size_t count) {
+    size_t n = 0;
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t off = 0; off < ds[i]->size(); off += ExecEnv::PAGE_SIZE)
+            pages[n++] = ds[i]->virt() + off;
+    }
+    return n;
+}
+
+static void build_chain(size_t n) {
+    // shuffle the pages and use a different cache line in each page to avoid conflicts
+    uint seed = 0x12345678;
+    for(size_t i = n - 1; i > 0; --i) {
+        seed = seed * 1103515245 + 12345;
+        size_t j = (seed >> 8) % (i + 1);
+        uintptr_t tmp = pages[i];
+        pages[i] = pages[j];
+        pages[j] = tmp;
+    }
+    for(size_t i = 0; i < n; ++i)
+        pages[i] += (i * 64) % ExecEnv::PAGE_SIZE;
+    for(size_t i = 0; i < n; ++i)
+        *reinterpret_cast<uintptr_t*>(pages[i]) = pages[(i + 1) % n];
+}
+
+static void measure(const char *mode, DataSpace **ds, size_t count) {
+    uint iters = BenchConfig::iterations(DEF_COUNT);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    char name[32];
+
+    size_t n = collect_pages(ds, count);
+    WVPRINTF("%s: %zu dataspaces with %zu pages, bigpages=%d", mode, count, n,
+             (ds[0]->flags() & DataSpaceDesc::BIGPAGES) != 0);
+
+    // first touch; this includes the pagefaults
+    uint64_t start = Util::tsc();
+    for(size_t i = 0; i < n; ++i)
+        *reinterpret_cast<volatile word_t*>(pages[i]) = 0;
+    uint64_t touch = (Util::tsc() - start) / n;
+    OStringStream::format(name, sizeof(name), "tlbperf.%s.touch", mode);
+    Serial::get().writef("BENCH: %s cycles n=1 avg=%Lu med=%Lu\n", name, touch, touch);
+
+    build_chain(n);
+    {
+        AvgProfiler prof(iters, warmup);
+        uintptr_t p = pages[0];
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            for(size_t j = 0; j < CHASE_STEPS; ++j)
+                p = *reinterpret_cast<volatile uintptr_t*>(p);
+            prof.stop();
+        }
+        WVPASS(p != 0);
+        OStringStream::format(name, sizeof(name), "tlbperf.%s.chase", mode);
+        WVBENCH(name, prof, "cycles/1024");
+    }
+
+    {
+        AvgProfiler prof(iters, warmup);
+        word_t sum = 0;
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            for(size_t j = 0; j < count; ++j) {
+                const word_t *w = reinterpret_cast<const word_t*>(ds[j]->virt());
+                const word_t *end = w + ds[j]->size() / sizeof(word_t);
+                for(; w < end; w += 8)
+                    sum += *w;
+            }
+            prof.stop();
+        }
+        WVPRINTF("sum: %lu", sum);
+        OStringStream::format(name, sizeof(name), "tlbperf.%s.read", mode);
+        WVBENCH(name, prof, "cycles");
+    }
+}
+
+static void test_tlb() {
+    {
+        DataSpace *ds = new DataSpace(AREAS * ExecEnv::BIG_PAGE_SIZE, DataSpaceDesc::ANONYMOUS,
+                                      DataSpaceDesc::RW);
+        measure("big", &ds, 1);
+        delete ds;
+    }
+
+    {
+        // one page less prevents root from using superpages
+        DataSpace *ds[AREAS];
+        for(size_t i = 0; i < AREAS; ++i) {
+            ds[i] = new DataSpace(ExecEnv::BIG_PAGE_SIZE - ExecEnv::PAGE_SIZE,
+                                  DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+        }
+        measure("small", ds, AREAS);
+        for(size_t i = 0; i < AREAS; ++i)
+            delete ds[i];
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <util/ThreadPool.h>
+#include <util/Profiler.h>
+#include <util/Atomic.h>
+#include <CPU.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "ThreadPoolPerf.h"
+
+/*
+ * Checks that the ThreadPool executes every task exactly once and measures the costs of a task
+ * and the speedup of a parallel_for over a checksum of a large buffer, compared to a single thread.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_threadpool();
+
+const TestCase threadpoolperf = {
+    "ThreadPool performance", test_threadpool
+};
+
+static const size_t BUF_SIZE    = 4 * 1024 * 1024;
+static const size_t ELEMS       = 10000;
+static const size_t TASKS       = 1000;
+static const uint DEF_COUNT     = 20;
+static const uint DEF_WARMUP    = 2;
+
+static volatile ulong counter;
+static uint8_t visited[ELEMS];
+static ulong sums[Hip::MAX_CPUS];
+
+static void count_task(void *) {
+    Atomic::add(&counter, 1);
+}
+
+static void visit_range(size_t begin, size_t end, void *) {
+    for(size_t i = begin; i < end; ++i)
+        visited[i]++;
+}
+
+static ulong checksum(const ulong *buf, size_t begin, size_t end) {
+    ulong sum = 0;
+    for(size_t i = begin; i < end; ++i)
+        sum += buf[i];
+    return sum;
+}
+
+static void checksum_range(size_t begin, size_t end, void *arg) {
+    ulong sum = checksum(reinterpret_cast<ulong*>(arg), begin, end);
+    Atomic::add(sums + CPU::current().log_id(), sum);
+}
+
+static void test_threadpool() {
+    uint iters = BenchConfig::iterations(DEF_COUNT);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    ThreadPool pool("tpool");
+    WVPASSEQ(pool.workers(), CPU::count());
+
+    {
+        ThreadPool::Future fut;
+        counter = 0;
+        for(size_t i = 0; i < TASKS; ++i) {
+            cpu_t cpu = i % 2 ? ThreadPool::ANY_CPU : static_cast<cpu_t>(i % CPU::count());
+            pool.submit(count_task, 0, &fut, cpu);
+        }
+        fut.wait();
+        WVPASS(fut.done());
+        WVPASSEQ(counter, static_cast<ulong>(TASKS));
+    }
+
+    {
+        memset(visited, 0, sizeof(visited));
+        pool.parallel_for(0, ELEMS, 7, visit_range, 0);
+        size_t once = 0;
+        for(size_t i = 0; i < ELEMS; ++i)
+            once += visited[i] == 1;
+        WVPASSEQ(once, ELEMS);
+    }
+
+    {
+        AvgProfiler prof(iters, warmup);
+        ThreadPool::Future fut;
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            for(size_t j = 0; j < TASKS; ++j)
+                pool.submit(count_task, 0, &fut);
+            fut.wait();
+            prof.stop();
+        }
+        WVPRINTF("%zu tasks per measurement", TASKS);
+        WVBENCH("threadpool.tasks", prof, "cycles");
+    }
+
+    size_t count = BUF_SIZE / sizeof(ulong);
+    ulong *buf = reinterpret_cast<ulong*>(malloc(BUF_SIZE));
+    for(size_t i = 0; i < count; ++i)
+        buf[i] = i;
+    ulong expected = checksum(buf, 0, count);
+
+    {
+        AvgProfiler prof(iters, warmup);
+        for(uint i = 0; i < warmup + iters; ++i) {
+            prof.start();
+            volatile ulong sum = checksum(buf, 0, count);
+            prof.stop();
+            WVPASSEQ(static_cast<ulong>(sum), expected);
+        }
+        WVBENCH("threadpool.checksum.serial", prof, "cycles");
+    }
+
+    {
+        AvgProfiler prof(iters, warmup);
+        for(uint i = 0; i < warmup + iters; ++i) {
+            memset(sums, 0, sizeof(sums));
+            prof.start();
+            pool.parallel_for(0, count, 0, checksum_range, buf);
+            prof.stop();
+            ulong sum = 0;
+            for(size_t c = 0; c < Hip::MAX_CPUS; ++c)
+                sum += sums[c];
+            WVPASSEQ(sum, expected);
+        }
+        WVPRINTF("Using %zu workers", pool.workers());
+        WVBENCH("threadpool.checksum.parallel", prof, "cycles");
+    }
+    free(buf);
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/Pt.h>
+#include <kobj/LocalThread.h>
+#include <utcb/UtcbFrame.h>
+#include <services/Storage.h>
+#include <util/BitField.h>
+#include <util/Profiler.h>
+#include <stream/OStringStream.h>
+#include <CPU.h>
+#include <cstring>
+
+#include "UtcbMarshal.h"
+
+/*
+ * Checks the compact UTCB encodings of DMADescList, BitField and Storage::Parameter and measures
+ * the costs of storage-shaped calls (command, tag, sector and the DMA list) with the compact
+ * encoding and with a copy of the whole list, as it has been done before.
+ */
+
+using namespace nre;
+using namespace nre::test;
+
+static void test_marshal();
+
+const TestCase utcbmarshal = {
+    "UTCB marshalling", test_marshal
+};
+
+static const uint DEF_TRIES    = 10000;
+static const uint DEF_WARMUP   = 100;
+
+/**
+ * Wraps the list to get the default encoding, i.e. a copy of the whole object
+ */
+struct FullList {
+    Storage::dma_type list;
+};
+
+template<class LIST>
+static size_t bytecount(const LIST &l) {
+    return l.bytecount();
+}
+template<>
+size_t bytecount<FullList>(const FullList &l) {
+    return l.list.bytecount();
+}
+
+template<class LIST>
+PORTAL static void portal_storage(capsel_t) {
+    UtcbFrameRef uf;
+    try {
+        Storage::Command cmd;
+        Storage::tag_type tag;
+        Storage::sector_type sector;
+        LIST dma;
+        uf >> cmd >> tag >> sector >> dma;
+        uf.finish_input();
+        uf << E_SUCCESS << bytecount(dma);
+    }
+    catch(const Exception &e) {
+        uf.clear();
+        uf << e;
+    }
+}
+
+template<class LIST>
+static void bench(const char *name, LocalThread *ec, const LIST &dma, size_t bytes) {
+    uint tries = BenchConfig::iterations(DEF_TRIES);
+    uint warmup = BenchConfig::warmup(DEF_WARMUP);
+    Pt pt(ec, portal_storage<LIST>);
+    AvgProfiler prof(tries, warmup);
+    UtcbFrame uf;
+    size_t errors = 0;
+    for(uint i = 0; i < warmup + tries; i++) {
+        prof.start();
+        uf << Storage::READ << static_cast<Storage::tag_type>(i);
+        uf << static_cast<Storage::sector_type>(i) << dma;
+        pt.call(uf);
+        uf.check_reply();
+        size_t res;
+        uf >> res;
+        uf.clear();
+        prof.stop();
+        errors += res != bytes;
+    }
+    WVPASSEQ(errors, static_cast<size_t>(0));
+    WVBENCH(name, prof, "cycles");
+}
+
+static void test_encodings() {
+    UtcbFrame uf;
+
+    Storage::dma_type dma, rdma;
+    dma.push(DMADesc(0x1000, 0x200));
+    dma.push(DMADesc(0x4000, 0x800));
+    uf << dma;
+    WVPASSEQ(uf.untyped(), 1 + 2 * sizeof(DMADesc) / sizeof(word_t));
+    uf >> rdma;
+    WVPASSEQ(rdma.count(), static_cast<size_t>(2));
+    WVPASSEQ(rdma.bytecount(), static_cast<size_t>(0xA00));
+    WVPASSEQ(rdma.begin()[1].offset, static_cast<size_t>(0x4000));
+    uf.reset();
+
+    BitField<Hip::MAX_CPUS> bf, rbf;
+    rbf.set_all();
+    uf << bf;
+    WVPASSEQ(uf.untyped(), static_cast<size_t>(1));
+    bf.set(3);
+    uf << bf;
+    uf >> rbf;
+    WVPASS(!rbf.is_set(0) && !rbf.is_set(3));
+    uf >> rbf;
+    WVPASS(rbf.is_set(3) && !rbf.is_set(4) && !rbf.is_set(Hip::MAX_CPUS - 1));
+    uf.reset();
+
+    Storage::Parameter params, rparams;
+    params.flags = Storage::Parameter::FLAG_HARDDISK;
+    params.sectors = 0x123456789ULL;
+    params.sector_size = 512;
+    params.max_requests = 32;
+    memcpy(params.name, "disk", 5);
+    uf << params;
+    WVPASS(uf.untyped() < sizeof(params) / sizeof(word_t));
+    uf >> rparams;
+    WVPASSEQ(rparams.sectors, params.sectors);
+    WVPASSEQ(rparams.sector_size, params.sector_size);
+    WVPASS(strcmp(rparams.name, "disk") == 0);
+    uf.reset();
+
+    // a count that exceeds the capacity of the receiver has to be rejected
+    uf << static_cast<word_t>(Storage::MAX_DMA_DESCS + 1);
+    bool caught = false;
+    try {
+        uf >> rdma;
+    }
+    catch(const UtcbException&) {
+        caught = true;
+    }
+    WVPASS(caught);
+}
+
+static void test_marshal() {
+    test_encodings();
+
+    LocalThread *ec = LocalThread::create(CPU::current().log_id());
+    const size_t counts[] = {1, 16};
+    for(size_t i = 0; i < ARRAY_SIZE(counts); ++i) {
+        FullList full;
+        for(size_t j = 0; j < counts[i]; ++j)
+            full.list.push(DMADesc(j * ExecEnv::PAGE_SIZE, ExecEnv::PAGE_SIZE));
+        size_t bytes = full.list.bytecount();
+
+        char name[32];
+        WVPRINTF("Storage request with %zu descriptors", counts[i]);
+        OStringStream::format(name, sizeof(name), "utcb.storage.d%zu.compact", counts[i]);
+        bench(name, ec, full.list, bytes);
+        OStringStream::format(name, sizeof(name), "utcb.storage.d%zu.full", counts[i]);
+        bench(name, ec, full, bytes);
+    }
+    delete ec;
+}
@@ -15,6 +15,10 @@
  */
 
 #include <stream/Serial.h>
+#include <kobj/GlobalThread.h>
+#include <kobj/Sm.h>
+#include <util/Trace.h>
+#include <CPU.h>
 
 #include "tests/Pingpong.h"
 #include "tests/UtcbTest.h"
@@ -32,6 +36,22 @@
 #include "tests/PingpongXPd.h"
 #include "tests/MemOps.h"
 #include "tests/ThreadsTest.h"
+#include "tests/IPCScale.h"
+#include "tests/MallocPerf.h"
+#include "tests/PoolTest.h"
+#include "tests/ChildLoad.h"
+#include "tests/TLBPerf.h"
+#include "tests/NUMAPerf.h"
+#include "tests/AdmissionTest.h"
+#include "tests/SysInfoPerf.h"
+#include "tests/ThreadPoolPerf.h"
+#include "tests/MPRingPerf.h"
+#include "tests/UtcbMarshal.h"
+#include "tests/PortalAllocs.h"
+#include "tests/ProtocolPerf.h"
+#include "tests/FramebufferPerf.h"
+#include "tests/InputPerf.h"
+#include "tests/ConsoleIdle.h"
 
 using namespace nre;
 using namespace nre::test;
@@ -39,13 +59,29 @@ using namespace nre::test;
 const TestCase testcases[] = {
     memcpytest,
     memsettest,
+    tlbperf,
+    numaperf,
+    mallocperf,
+    pooltest,
     threads,
+    admission,
+    sysinfoperf,
+    threadpoolperf,
+    mpringperf,
     pingpong,
     pingpongxpd,
+    ipcscale,
+    childload,
     catchex,
     delegateperf,
     utcbnest,
     utcbperf,
+    utcbmarshal,
+    portalallocs,
+    protocolperf,
+    framebufferperf,
+    inputperf,
+    consoleidle,
     dstest,
     slisttest,
     sortedslisttest,
@@ -62,7 +98,9 @@ const TestCase testcases[] = {
     treaptest_perf,
 };
 
-int main() {
+static Sm done(0);
+
+static void run_tests(void*) {
     for(size_t i = 0; i < ARRAY_SIZE(testcases); ++i) {
         Serial::get().writef("Testing %s...\n", testcases[i].name);
         try {
@@ -73,5 +111,28 @@ int main() {
         }
         Serial::get().writef("Done\n");
     }
+    done.up();
+}
+
+int main(int argc, char *argv[]) {
+    Trace::init();
+    BenchConfig::parse(argc, argv);
+    // run the tests on the requested CPU, so that the benchmarks are not influenced by migrations
+    // or by the other tasks on our CPU
+    cpu_t cpu = BenchConfig::cpu();
+    if(cpu != CPU::current().log_id()) {
+        if(cpu >= CPU::count()) {
+            Serial::get().writef("CPU %u does not exist; running on CPU %u\n", cpu,
+                                 CPU::current().log_id());
+            run_tests(0);
+        }
+        else {
+            GlobalThread::create(run_tests, cpu, String("unittests-bench"))->start();
+            done.down();
+        }
+    }
+    else
+        run_tests(0);
+    Trace::dump(Serial::get(), "unittests");
     return 0;
 }
@@ -55,15 +55,12 @@ public:
 private:
     static void thread(void*) {
         StorageDevice *sd = nre::Thread::current()->get_tls<StorageDevice*>(nre::Thread::TLS_PARAM);
-        while(1) {
-            nre::Storage::Packet *pk = sd->_sess.consumer().get();
+        nre::Storage::Packet pk;
+        while(sd->_sess.consumer().consume(pk)) {
             // the status isn't used anyway
-            {
-                nre::ScopedLock<nre::UserSm> guard(&globalsm);
-                MessageDiskCommit msg(sd->_no, pk->tag, MessageDisk::DISK_OK);
-                sd->_bus.send(msg);
-            }
-            sd->_sess.consumer().next();
+            nre::ScopedLock<nre::UserSm> guard(&globalsm);
+            MessageDiskCommit msg(sd->_no, pk.tag, MessageDisk::DISK_OK);
+            sd->_bus.send(msg);
         }
     }
 
@@ -15,6 +15,8 @@
  * General Public License version 2 for more details.
  */
 
+#include <util/Trace.h>
+
 #include "VCPUBackend.h"
 #include "Vancouver.h"
 
@@ -72,6 +74,7 @@ void VCPUBackend::handle_io(bool is_in, unsigned io_order, unsigned port) {
     UtcbExcFrameRef uf;
     VCVCpu *vcpu = Thread::current()->get_tls<VCVCpu*>(Thread::TLS_PARAM);
 
+    TRACE_BEGIN(VMEXIT, port);
     CpuMessage msg(is_in, reinterpret_cast<CpuState *>(Thread::current()->utcb()),
                    io_order, port, &uf->eax, uf->mtd);
     skip_instruction(msg);
@@ -80,6 +83,7 @@ void VCPUBackend::handle_io(bool is_in, unsigned io_order, unsigned port) {
         if(!vcpu->executor.send(msg, true))
             Util::panic("nobody to execute %s at %x:%x\n", __func__, msg.cpu->cs.sel, msg.cpu->eip);
     }
+    TRACE_END(VMEXIT, port);
     /* TODO if(service_events && !msg.consumed)
        service_events->send_event(*utcb,EventsProtocol::EVENT_UNSERVED_IOACCESS,sizeof(port),
        &port);*/
@@ -89,6 +93,7 @@ void VCPUBackend::handle_vcpu(capsel_t pid, bool skip, CpuMessage::Type type) {
     UtcbExcFrameRef uf;
     VCVCpu *vcpu = Thread::current()->get_tls<VCVCpu*>(Thread::TLS_PARAM);
 
+    TRACE_BEGIN(VMEXIT, type);
     CpuMessage msg(type, reinterpret_cast<CpuState*>(Thread::current()->utcb()), uf->mtd);
     if(skip)
         skip_instruction(msg);
@@ -126,9 +131,10 @@ void VCPUBackend::handle_vcpu(capsel_t pid, bool skip, CpuMessage::Type type) {
                         pid);
     }
     msg.cpu->mtd = msg.mtr_out;
+    TRACE_END(VMEXIT, type);
 }
 
-Crd VCPUBackend::lookup(uintptr_t base, size_t size, uintptr_t hotspot) {
+Crd VCPUBackend::lookup(uintptr_t base, size_t size, uintptr_t hotspot, uintptr_t guestbase) {
     Crd crd((base + hotspot) >> ExecEnv::PAGE_SHIFT, Math::next_pow2_shift(size), Crd::MEM);
     Crd res = Syscalls::lookup(crd);
     if(res.is_null()) {
@@ -138,13 +144,16 @@ Crd VCPUBackend::lookup(uintptr_t base, size_t size, uintptr_t hotspot) {
         assert(!res.is_null());
     }
 
-    // restrict it to a region that fits into [start, start+size)
+    // restrict it to a region that fits into [start, start+size). additionally, the region has
+    // to be aligned in the guest as well, so that it can be delegated with one Crd and thus, the
+    // nested page table can use a large page for it.
     // XXX avoid the loop
     for(int i = res.order(); i >= 0; i--) {
-        Crd x(((base + hotspot) & ~((1 << (i + ExecEnv::PAGE_SHIFT)) - 1)) >> ExecEnv::PAGE_SHIFT, i,
-              res.attr());
+        uintptr_t mask = (1UL << (i + ExecEnv::PAGE_SHIFT)) - 1;
+        Crd x(((base + hotspot) & ~mask) >> ExecEnv::PAGE_SHIFT, i, res.attr());
         uintptr_t start = x.offset() << ExecEnv::PAGE_SHIFT;
-        if((start >= base) && (start + (1 << (ExecEnv::PAGE_SHIFT + x.order()))) <= (base + size))
+        if((start >= base) && (start + (1 << (ExecEnv::PAGE_SHIFT + x.order()))) <= (base + size) &&
+           ((guestbase + (start - base)) & mask) == 0)
             return x;
     }
     return res;
@@ -156,6 +165,7 @@ bool VCPUBackend::handle_memory(bool need_unmap) {
     //Serial::get().writef("NPT fault @ %p for %#Lx, error %#Lx\n",uf->eip,uf->qual[1],uf->qual[0]);
 
     MessageMemRegion msg(uf->qual[1] >> ExecEnv::PAGE_SHIFT);
+    TRACE_EVENT(VMEXIT, uf->qual[1]);
 
     // XXX use a push model on _startup instead
     // do we have not mapped physram yet?
@@ -163,7 +173,7 @@ bool VCPUBackend::handle_memory(bool need_unmap) {
         uintptr_t hostaddr = reinterpret_cast<uintptr_t>(msg.ptr);
         uintptr_t guestbase = msg.start_page << ExecEnv::PAGE_SHIFT;
         uintptr_t hotspot = uf->qual[1] - guestbase;
-        Crd own = lookup(hostaddr, msg.count << ExecEnv::PAGE_SHIFT, hotspot);
+        Crd own = lookup(hostaddr, msg.count << ExecEnv::PAGE_SHIFT, hotspot, guestbase);
 
         if(need_unmap)
             CapRange(own.offset(), 1 << own.order(), Crd::MEM_ALL).revoke(false);
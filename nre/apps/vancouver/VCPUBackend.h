@@ -44,11 +44,12 @@ class VCPUBackend : public nre::SListItem {
     };
 
 public:
-    VCPUBackend(Motherboard *mb, VCVCpu *vcpu, bool use_svm, cpu_t cpu)
+    VCPUBackend(Motherboard *mb, VCVCpu *vcpu, bool use_svm, cpu_t cpu,
+                const nre::Reservation &res = nre::Reservation())
         : SListItem(), _ec(nre::LocalThread::create(cpu)), _caps(get_portals(use_svm)), _sm(0),
           _vcpu(cpu, _caps, nre::String("vmm-vcpu")) {
         _ec->set_tls<VCVCpu*>(nre::Thread::TLS_PARAM, vcpu);
-        _vcpu.start();
+        _vcpu.start(nre::Qpd(), res);
         _mb = mb;
     }
 
@@ -64,7 +65,7 @@ private:
 
     static void handle_io(bool is_in, unsigned io_order, unsigned port);
     static void handle_vcpu(capsel_t pid, bool skip, CpuMessage::Type type);
-    static nre::Crd lookup(uintptr_t base, size_t size, uintptr_t hotspot);
+    static nre::Crd lookup(uintptr_t base, size_t size, uintptr_t hotspot, uintptr_t guestbase);
     static bool handle_memory(bool need_unmap);
 
     static void force_invalid_gueststate_amd(nre::UtcbExcFrameRef &uf);
@@ -19,6 +19,7 @@
 #include <kobj/Ports.h>
 #include <services/Reboot.h>
 #include <util/TimeoutList.h>
+#include <util/Trace.h>
 #include <util/Util.h>
 
 #include "bus/motherboard.h"
@@ -30,6 +31,9 @@
 using namespace nre;
 
 static size_t ncpu = 1;
+static cpu_t vcpu_cpus[16];
+static size_t vcpu_cpu_count = 0;
+static Reservation vcpu_res;
 static DataSpace *guest_mem = 0;
 static size_t guest_size = 0;
 nre::UserSm globalsm(0);
@@ -44,11 +48,25 @@ PARAM_ALIAS(PC_PS2, "an alias to create an PS2 compatible PC",
 PARAM_HANDLER(ncpu, "ncpu - change the number of vcpus that are created") {
     ncpu = argv[0];
 }
+PARAM_HANDLER(cpus, "cpus:p0,p1,... - run vcpu i on the physical CPU pi") {
+    for(vcpu_cpu_count = 0; vcpu_cpu_count < ARRAY_SIZE(vcpu_cpus); ++vcpu_cpu_count) {
+        if(argv[vcpu_cpu_count] == ~0UL)
+            break;
+        vcpu_cpus[vcpu_cpu_count] = argv[vcpu_cpu_count];
+    }
+}
+PARAM_HANDLER(reserve, "reserve:budget,period - reserve CPU time for each vcpu (in microseconds)") {
+    if(argv[1] != ~0UL)
+        vcpu_res = Reservation(argv[0], argv[1]);
+}
 PARAM_HANDLER(m, "m - specify the amount of memory for the guest in MiB") {
     guest_size = argv[0] * 1024 * 1024;
-    guest_mem = new DataSpace(guest_size, DataSpaceDesc::ANONYMOUS,
-                              DataSpaceDesc::RWX | DataSpaceDesc::BIGPAGES, 0, 0,
-                              Math::next_pow2_shift(ExecEnv::BIG_PAGE_SIZE) - ExecEnv::PAGE_SHIFT);
+    // we're running on the CPU of the first vcpu, so take the memory from its node
+    DataSpaceDesc desc(guest_size, DataSpaceDesc::ANONYMOUS,
+                       DataSpaceDesc::RWX | DataSpaceDesc::BIGPAGES, 0, 0, 0,
+                       Math::next_pow2_shift(ExecEnv::BIG_PAGE_SIZE) - ExecEnv::PAGE_SHIFT,
+                       DataSpaceDesc::NODE_LOCAL);
+    guest_mem = new DataSpace(desc);
 }
 PARAM_HANDLER(vcpus, " vcpus - instantiate the vcpus defined with 'ncpu'") {
     for(size_t count = 0; count < ncpu; count++)
@@ -197,7 +215,9 @@ bool Vancouver::receive(MessageHostOp &msg) {
 
         case MessageHostOp::OP_VCPU_CREATE_BACKEND: {
             cpu_t cpu = CPU::current().log_id();
-            VCPUBackend *v = new VCPUBackend(&_mb, msg.vcpu, Hip::get().has_svm(), cpu);
+            if(_vcpus.length() < vcpu_cpu_count)
+                cpu = Hip::get().cpu_phys_to_log(vcpu_cpus[_vcpus.length()]);
+            VCPUBackend *v = new VCPUBackend(&_mb, msg.vcpu, Hip::get().has_svm(), cpu, vcpu_res);
             msg.value = reinterpret_cast<ulong>(v);
             msg.vcpu->executor.add(this, receive_static<CpuMessage> );
             _vcpus.append(v);
@@ -337,38 +357,56 @@ bool Vancouver::receive(MessageDisk &msg) {
     return false;
 }
 
+static bool is_hotkey(const Console::ReceivePacket &pk) {
+    if((~pk.flags & Keyboard::RELEASE) || (~pk.flags & Keyboard::LCTRL))
+        return false;
+    return pk.keycode == Keyboard::VK_HOME || pk.keycode == Keyboard::VK_D ||
+           pk.keycode == Keyboard::VK_S;
+}
+
+bool Vancouver::handle_hotkey(const Console::ReceivePacket &pk) {
+    if(!is_hotkey(pk))
+        return false;
+    switch(pk.keycode) {
+        case Keyboard::VK_HOME:
+            reset();
+            break;
+
+        case Keyboard::VK_D:
+            _mb.dump_counters();
+            break;
+
+        case Keyboard::VK_S: {
+            CpuEvent msg(VCVCpu::EVENT_DEBUG);
+            for(VCVCpu *vcpu = _mb.last_vcpu; vcpu; vcpu = vcpu->get_last())
+                vcpu->bus_event.send(msg);
+        }
+        break;
+    }
+    return true;
+}
+
 void Vancouver::keyboard_thread(void*) {
     Vancouver *vc = Thread::current()->get_tls<Vancouver*>(Thread::TLS_PARAM);
+    Console::ReceivePacket pks[INPUT_BATCH];
     while(1) {
-        Console::ReceivePacket pk = vc->_conssess.receive();
-
-        if((pk.flags & Keyboard::RELEASE) && (pk.flags & Keyboard::LCTRL)) {
-            switch(pk.keycode) {
-                case Keyboard::VK_HOME: {
-                    vc->reset();
-                    continue;
-                }
-                break;
-
-                case Keyboard::VK_D: {
-                    vc->_mb.dump_counters();
-                    continue;
-                }
-                break;
+        size_t count = vc->_conssess.receive(pks, INPUT_BATCH);
+
+        // forward a burst of input with one acquisition of the global lock. the hotkeys are
+        // handled without it, in the order in which they arrived.
+        size_t i = 0;
+        while(i < count) {
+            if(vc->handle_hotkey(pks[i])) {
+                i++;
+                continue;
+            }
 
-                case Keyboard::VK_S: {
-                    CpuEvent msg(VCVCpu::EVENT_DEBUG);
-                    for(VCVCpu *vcpu = vc->_mb.last_vcpu; vcpu; vcpu = vcpu->get_last())
-                        vcpu->bus_event.send(msg);
-                    continue;
-                }
-                break;
+            ScopedLock<UserSm> guard(&globalsm);
+            for(; i < count && !is_hotkey(pks[i]); ++i) {
+                MessageInput msg(0x10000, pks[i].scancode | pks[i].flags);
+                vc->_mb.bus_input.send(msg);
             }
         }
-
-        ScopedLock<UserSm> guard(&globalsm);
-        MessageInput msg(0x10000, pk.scancode | pk.flags);
-        vc->_mb.bus_input.send(msg);
     }
 }
 
@@ -444,14 +482,19 @@ static const char *argv_to_str(int argc, char *argv[]) {
 int main(int argc, char *argv[]) {
     size_t console = 1;
     String constitle("VM");
+    // the VGA framebuffer lives in the console session, which we have to create in advance
+    size_t fbsize = 0;
     for(int i = 1; i < argc; ++i) {
         if(strncmp(argv[i], "console:", 8) == 0)
             console = IStringStream::read_from<size_t>(argv[i] + 8);
         else if(strncmp(argv[i], "constitle:", 10) == 0)
             constitle = String(argv[i] + 10);
+        else if(strncmp(argv[i], "vga_fbsize:", 11) == 0)
+            fbsize = IStringStream::read_from<size_t>(argv[i] + 11) << 10;
     }
 
-    Vancouver *v = new Vancouver(argv_to_str(argc, argv), console, constitle);
+    Trace::init();
+    Vancouver *v = new Vancouver(argv_to_str(argc, argv), console, constitle, fbsize);
     v->reset();
 
     Sm sm(0);
@@ -31,9 +31,14 @@
 extern nre::UserSm globalsm;
 
 class Vancouver : public StaticReceiver<Vancouver> {
+    // the maximum number of input packets we forward at once
+    static const size_t INPUT_BATCH = 16;
+
 public:
-    explicit Vancouver(const char *args, size_t console, const nre::String &constitle)
-        : _mb(), _timeouts(_mb), _conscon("console"), _conssess(_conscon, console, constitle),
+    explicit Vancouver(const char *args, size_t console, const nre::String &constitle,
+                       size_t fbsize)
+        : _mb(), _timeouts(_mb), _conscon("console"),
+          _conssess(_conscon, console, constitle, fbsize),
           _stcon(), _vmmngcon(), _vmmng(), _vcpus(), _stdevs() {
         // storage is optional
         try {
@@ -77,6 +82,7 @@ public:
 
 private:
     static void keyboard_thread(void*);
+    bool handle_hotkey(const nre::Console::ReceivePacket &pk);
     static void vmmng_thread(void*);
     void create_devices(const char *args);
     void create_vcpus();
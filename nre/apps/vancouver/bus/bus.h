@@ -18,6 +18,7 @@
 #pragma once
 
 #include <stream/Serial.h>
+#include <util/Arena.h>
 #include <cstring>
 
 /**
@@ -69,12 +70,23 @@ class DBus {
     DBus(const DBus<M> &bus);
     DBus& operator=(const DBus<M> &bus);
 
+    /**
+     * The entry lists of all busses of this type are allocated from one arena. Busses live as long
+     * as the VM and are only extended during the creation of the devices, which is done with the
+     * global lock held. This way, the lists are packed together instead of being spread over the
+     * heap.
+     */
+    static nre::Arena &arena() {
+        static nre::Arena arena;
+        return arena;
+    }
+
     void set_size(size_t new_size) {
-        Entry *n = new Entry[new_size];
-        if(_list) {
+        // the old list is wasted, but since we double the size, this is at most the size of the
+        // new one
+        Entry *n = arena().alloc_array<Entry>(new_size);
+        if(_list)
             memcpy(n, _list, _list_count * sizeof(*_list));
-            delete[] _list;
-        }
         _list = n;
         _list_size = new_size;
     }
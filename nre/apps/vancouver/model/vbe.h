@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#pragma once
+
+#include <arch/Types.h>
+#include <Compiler.h>
+
+/**
+ * The structures of the VESA BIOS extensions 2.0
+ */
+class Vbe {
+public:
+    static const uint32_t TAG_VESA      = 0x41534556;   // "VESA"
+    static const uint32_t TAG_VBE2      = 0x32454256;   // "VBE2"
+    static const size_t MAX_VESA_MODES  = 16;
+
+    /**
+     * The mode attributes
+     */
+    enum {
+        ATTR_SUPPORTED  = 1 << 0,
+        ATTR_EXT_INFO   = 1 << 1,
+        ATTR_TTY        = 1 << 2,
+        ATTR_COLOR      = 1 << 3,
+        ATTR_GRAPHICS   = 1 << 4,
+        ATTR_NO_WINDOW  = 1 << 6,
+        ATTR_LINEAR     = 1 << 7
+    };
+
+    /**
+     * The memory models
+     */
+    enum {
+        MODEL_TEXT      = 0,
+        MODEL_PACKED    = 4,
+        MODEL_DIRECT    = 6
+    };
+
+    /**
+     * The controller information, returned by function 0x4f00
+     */
+    struct InfoBlock {
+        uint32_t tag;
+        uint16_t version;
+        uint32_t oem_string;
+        uint32_t caps;
+        uint32_t video_mode_ptr;
+        uint16_t memory;            // in 64k blocks
+        uint16_t oem_revision;
+        uint32_t oem_vendor;
+        uint32_t oem_product;
+        uint32_t oem_product_rev;
+        char scratch[222];
+        char oem_data[256];
+    } PACKED;
+
+    /**
+     * The mode information, returned by function 0x4f01
+     */
+    struct ModeInfoBlock {
+        uint16_t attr;
+        uint8_t win_a;
+        uint8_t win_b;
+        uint16_t granularity;
+        uint16_t win_size;
+        uint16_t seg_a;
+        uint16_t seg_b;
+        uint32_t win_func;
+        uint16_t bytes_per_scanline;
+        uint16_t resolution[2];
+        uint8_t char_size[2];
+        uint8_t planes;
+        uint8_t bpp;
+        uint8_t banks;
+        uint8_t memory_model;
+        uint8_t bank_size;
+        uint8_t number_images;
+        uint8_t reserved0;
+        uint8_t red_size;
+        uint8_t red_pos;
+        uint8_t green_size;
+        uint8_t green_pos;
+        uint8_t blue_size;
+        uint8_t blue_pos;
+        uint8_t rsvd_size;
+        uint8_t rsvd_pos;
+        uint8_t directcolor_info;
+        uint32_t phys_base;
+        uint32_t reserved1;
+        uint16_t reserved2;
+        uint16_t bytes_per_scanline_lin;
+        uint8_t number_images_bnk;
+        uint8_t number_images_lin;
+        uint8_t red_size_lin;
+        uint8_t red_pos_lin;
+        uint8_t green_size_lin;
+        uint8_t green_pos_lin;
+        uint8_t blue_size_lin;
+        uint8_t blue_pos_lin;
+        uint8_t rsvd_size_lin;
+        uint8_t rsvd_pos_lin;
+        uint32_t max_pixel_clock;
+        char reserved3[190];
+    } PACKED;
+
+private:
+    Vbe();
+};
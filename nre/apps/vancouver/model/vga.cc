@@ -19,9 +19,11 @@
 #include <stream/ConsoleStream.h>
 #include <util/Util.h>
 #include <Desc.h>
+#include <Logging.h>
 
 #include "../bus/motherboard.h"
 #include "../executor/bios.h"
+#include "vbe.h"
 
 using namespace nre;
 
@@ -49,6 +51,8 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
     unsigned char _crt_index;
     unsigned _ebda_segment;
     unsigned _vbe_mode;
+    Console::ModeInfo _modes[Vbe::MAX_VESA_MODES];
+    unsigned _mode_count;
     ConsoleSession *_csess;
     ConsoleStream _cons;
 
@@ -101,18 +105,68 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
         return true;
     }
 
-    // TODO VESA stuff
-#if 0
     static unsigned vesa_farptr(CpuState *cpu, void *p, void *base) {
         return (cpu->es.sel << 16)
                | (cpu->di + reinterpret_cast<char *>(p) - reinterpret_cast<char *>(base));
     }
 
-    unsigned get_vesa_mode(unsigned vesa_mode, ConsoleModeInfo *info) {
-        for(MessageConsole msg2(0, info);
-            (msg2.index < (Vbe::MAX_VESA_MODES - 1)) && _mb.bus_console.send(msg2);
-            msg2.index++) {
-            if(vesa_mode == info->_vesa_mode) {
+    /**
+     * Converts the mode <index> of the console into a VESA mode info block.
+     */
+    void get_mode_info(unsigned index, Vbe::ModeInfoBlock *info) {
+        const Console::ModeInfo &mode = _modes[index];
+        memset(info, 0, sizeof(*info));
+        info->resolution[0] = mode.width;
+        info->resolution[1] = mode.height;
+        info->bytes_per_scanline = mode.bytes_per_line;
+        info->bytes_per_scanline_lin = mode.bytes_per_line;
+        info->planes = 1;
+        info->banks = 1;
+        if(mode.bpp == 0) {
+            info->attr = Vbe::ATTR_SUPPORTED | Vbe::ATTR_EXT_INFO | Vbe::ATTR_TTY | Vbe::ATTR_COLOR;
+            info->memory_model = Vbe::MODEL_TEXT;
+            info->bpp = 4;
+            info->char_size[0] = 8;
+            info->char_size[1] = 16;
+            return;
+        }
+
+        // we only support the linear framebuffer, which is the shared dataspace of the console
+        info->attr = Vbe::ATTR_SUPPORTED | Vbe::ATTR_EXT_INFO | Vbe::ATTR_COLOR |
+                     Vbe::ATTR_GRAPHICS | Vbe::ATTR_NO_WINDOW | Vbe::ATTR_LINEAR;
+        info->bpp = mode.bpp;
+        info->phys_base = _framebuffer_phys;
+        if(mode.bpp <= 8)
+            info->memory_model = Vbe::MODEL_PACKED;
+        else {
+            // the usual layouts with blue in the lowest bits
+            uint8_t green = mode.bpp == 16 ? 6 : (mode.bpp == 15 ? 5 : 8);
+            uint8_t other = mode.bpp <= 16 ? 5 : 8;
+            info->memory_model = Vbe::MODEL_DIRECT;
+            info->blue_size = info->red_size = other;
+            info->green_size = green;
+            info->blue_pos = 0;
+            info->green_pos = other;
+            info->red_pos = other + green;
+            if(mode.bpp == 32) {
+                info->rsvd_size = 8;
+                info->rsvd_pos = 24;
+            }
+            info->red_size_lin = info->red_size;
+            info->red_pos_lin = info->red_pos;
+            info->green_size_lin = info->green_size;
+            info->green_pos_lin = info->green_pos;
+            info->blue_size_lin = info->blue_size;
+            info->blue_pos_lin = info->blue_pos;
+            info->rsvd_size_lin = info->rsvd_size;
+            info->rsvd_pos_lin = info->rsvd_pos;
+        }
+    }
+
+    unsigned get_vesa_mode(unsigned vesa_mode, Vbe::ModeInfoBlock *info) {
+        for(unsigned i = 0; i < _mode_count; ++i) {
+            if(vesa_mode == _modes[i].vesa_mode) {
+                get_mode_info(i, info);
                 // fix memory info
                 size_t image_size = info->bytes_per_scanline * info->resolution[1];
                 if(!image_size || image_size > _framebuffer_size)
@@ -125,7 +179,7 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
                     info->number_images_bnk = image_pages;
                     info->number_images_lin = image_pages;
                 }
-                return msg2.index;
+                return i;
             }
         }
         return ~0u;
@@ -142,8 +196,9 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
 
                 // copy in the tag
                 copy_in(cpu->es.base + cpu->di, &v, 4);
-                Logging::printf("VESA %x tag %x base %x+%x esi %x\n", cpu->eax, v.tag, cpu->es.base,
-                                cpu->di, cpu->esi);
+                LOG(Logging::CONSOLE, Serial::get().writef(
+                        "VESA %x tag %x base %x+%x esi %x\n", cpu->eax, v.tag, cpu->es.base,
+                        cpu->di, cpu->esi));
 
                 // we support VBE 2.0
                 v.version = 0x0200;
@@ -152,16 +207,13 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
                 v.video_mode_ptr = vesa_farptr(cpu, modes, &v);
 
                 // get all modes
-                ConsoleModeInfo info;
-                for(MessageConsole msg2(0, &info);
-                    msg2.index < (Vbe::MAX_VESA_MODES - 1) && _mb.bus_console.send(msg2);
-                    msg2.index++)
-                    *modes++ = info._vesa_mode;
+                for(unsigned i = 0; i < _mode_count; ++i)
+                    *modes++ = _modes[i].vesa_mode;
                 *modes++ = 0xffff;
 
                 // set the oemstring
                 char *p = reinterpret_cast<char *>(modes);
-                strcpy(p, oemstring);
+                memcpy(p, oemstring, strlen(oemstring) + 1);
                 v.oem_string = vesa_farptr(cpu, p, &v);
                 p += strlen(p) + 1;
                 assert(p < reinterpret_cast<char *>((&v) + 1));
@@ -174,9 +226,8 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
             break;
             case 0x4f01: // get modeinfo
             {
-                ConsoleModeInfo info;
-                if(get_vesa_mode(cpu->ecx & 0x0fff, &info) != 0ul) {
-                    info.phys_base = _framebuffer_phys;
+                Vbe::ModeInfoBlock info;
+                if(get_vesa_mode(cpu->ecx & 0x0fff, &info) != ~0u) {
                     copy_out(cpu->es.base + cpu->di, &info, sizeof(info));
                     break;
                 }
@@ -185,12 +236,13 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
                 return true;
             case 0x4f02: // set vbemode
             {
-                ConsoleModeInfo info;
+                Vbe::ModeInfoBlock info;
                 unsigned index = get_vesa_mode(cpu->ebx & 0x0fff, &info);
                 if(index != ~0u && info.attr & 1) {
                     // ok, we have the mode -> set it
-                    Logging::printf("VESA %x base %x+%x esi %x mode %x\n", cpu->eax, cpu->es.base,
-                                    cpu->di, cpu->esi, index);
+                    LOG(Logging::CONSOLE, Serial::get().writef(
+                            "VESA %x base %x+%x esi %x mode %x\n", cpu->eax, cpu->es.base,
+                            cpu->di, cpu->esi, index));
 
                     // clear buffer
                     if(~cpu->ebx & 0x8000)
@@ -199,6 +251,7 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
                     // switch mode
                     _regs.mode = index;
                     _vbe_mode = cpu->ebx;
+                    _csess->set_regs(_regs);
                     break;
                 }
                 cpu->ax = 0x024f;
@@ -214,7 +267,6 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
         cpu->ax = 0x004f;
         return true;
     }
-#endif
 
     /**
      * Graphic INT.
@@ -225,8 +277,12 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
         COUNTER_INC("int10");
         switch(cpu->ah) {
             case 0x00: // set mode
-                // unsupported
-                //DEBUG;
+                // only the text mode is supported; this brings us back from VESA modes
+                if((cpu->al & 0x7f) == 3 && _regs.mode != 0) {
+                    _regs.mode = 0;
+                    _vbe_mode = 3;
+                    _csess->set_regs(_regs);
+                }
                 break;
             case 0x01: // set cursor shape
                 _regs.cursor_style = cpu->cx;
@@ -364,11 +420,8 @@ class Vga : public StaticReceiver<Vga>, public BiosCommon {
                         // unsupported
                         break;
                     default:
-                        // TODO VESA stuff
-#if 0
                         if(!handle_vesa(cpu))
-#endif
-                        DEBUG(cpu);
+                            DEBUG(cpu);
                         break;
                 }
                 break;
@@ -548,10 +601,19 @@ public:
         uintptr_t framebuffer_phys, size_t framebuffer_size)
         : BiosCommon(mb), _view(), _iobase(iobase), _framebuffer_ptr(framebuffer_ptr),
           _framebuffer_phys(framebuffer_phys), _framebuffer_size(framebuffer_size), _regs(),
-          _crt_index(0), _ebda_segment(), _vbe_mode(), _csess(sess), _cons(*sess) {
+          _crt_index(0), _ebda_segment(), _vbe_mode(), _modes(), _mode_count(), _csess(sess),
+          _cons(*sess) {
         assert(!(framebuffer_phys & 0xfff));
         assert(!(framebuffer_size & 0xfff));
 
+        // ask the console for its modes once; the last one doesn't exist
+        try {
+            for(; _mode_count < Vbe::MAX_VESA_MODES; ++_mode_count)
+                _modes[_mode_count] = _csess->get_mode_info(_mode_count);
+        }
+        catch(const Exception&) {
+        }
+
         Serial::get().writef("VGA console %lx+%lx @ %p\n",
                              _framebuffer_phys, _framebuffer_size, _framebuffer_ptr);
         handle_reset(false);
@@ -561,7 +623,8 @@ public:
 static size_t _default_vga_fbsize = 128;
 
 PARAM_HANDLER(vga_fbsize,
-              "vga_fbsize:size - override the default fbsize for the 'vga' parameter (in KB)") {
+              "vga_fbsize:size - override the default fbsize for the 'vga' parameter (in KB)",
+              "It also determines the size of the console dataspace, i.e. the maximum fbsize.") {
     _default_vga_fbsize = argv[0];
 }
 
@@ -571,21 +634,27 @@ PARAM_HANDLER(vga,
               "The framebuffersize is given in kilobyte and the minimum is 128k.",
               "This also adds support for VGA and VESA graphics BIOS.") {
     size_t fbsize = argv[1];
-    /*if(fbsize == ~0ul)
+    if(fbsize == ~0ul)
         fbsize = _default_vga_fbsize;
 
-       // We need at least 128k for 0xa0000-0xbffff.
-       if(fbsize < 128)
-        fbsize = 128;*/
-    fbsize = 128;
+    // We need at least 128k for 0xa0000-0xbffff.
+    if(fbsize < 128)
+        fbsize = 128;
     fbsize <<= 10;
 
-    MessageHostOp msg1(MessageHostOp::OP_ALLOC_FROM_GUEST, fbsize);
+    // the framebuffer is the output dataspace of our console session, which limits its size
     MessageConsoleView msg(MessageConsoleView::TYPE_GET_INFO);
-    if(!mb.bus_hostop.send(msg1))
-        Util::panic("%s failed to alloc %ld from guest memory\n", __PRETTY_FUNCTION__, fbsize);
     if(!mb.bus_consoleview.send(msg))
         Util::panic("could not get VGA screen");
+    if(fbsize > msg.sess->screen().size()) {
+        Serial::get().writef("VGA framebuffer limited to %zu KB; use vga_fbsize to increase it\n",
+                             msg.sess->screen().size() >> 10);
+        fbsize = msg.sess->screen().size();
+    }
+
+    MessageHostOp msg1(MessageHostOp::OP_ALLOC_FROM_GUEST, fbsize);
+    if(!mb.bus_hostop.send(msg1))
+        Util::panic("%s failed to alloc %ld from guest memory\n", __PRETTY_FUNCTION__, fbsize);
     Vga *dev = new Vga(mb, msg.sess, argv[0],
                        reinterpret_cast<char*>(msg.sess->screen().virt()), msg1.phys, fbsize);
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <util/Topology.h>
+#include <util/ScopedLock.h>
+#include <Assert.h>
+#include <cstring>
+
+#include "Placement.h"
+
+using namespace nre;
+
+void Placement::update(SysInfoSession &sysinfo) {
+    // root samples the load periodically; use the 10s average to not react to short bursts
+    static SysInfo::CPUStats stats;
+    for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
+        sysinfo.get_stats(it->log_id(), stats);
+        _load[it->log_id()] = stats.load[SysInfo::WIN_10S];
+    }
+}
+
+size_t Placement::pick(int package, size_t count, bool busy, cpu_t *cpus, uint &sum) const {
+    // sort the candidates by cost; there are only a few CPUs, so insertion sort is fine
+    cpu_t cand[Hip::MAX_CPUS];
+    size_t n = 0;
+    for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
+        if(package != -1 && it->package() != package)
+            continue;
+        size_t i;
+        for(i = n; i > 0 && cost(cand[i - 1]) > cost(it->log_id()); --i)
+            cand[i] = cand[i - 1];
+        cand[i] = it->log_id();
+        n++;
+    }
+
+    // first take the cheapest CPUs, but skip siblings of already taken ones for busy VMs. if that
+    // is not enough, take the siblings as well.
+    bool taken[Hip::MAX_CPUS];
+    memset(taken, 0, sizeof(taken));
+    size_t res = 0;
+    sum = 0;
+    for(int pass = busy ? 0 : 1; pass < 2 && res < count; ++pass) {
+        for(size_t i = 0; i < n && res < count; ++i) {
+            if(taken[cand[i]])
+                continue;
+            if(pass == 0) {
+                bool sibling = false;
+                for(size_t j = 0; !sibling && j < res; ++j)
+                    sibling = Topology::siblings(CPU::get(cand[i]), CPU::get(cpus[j]));
+                if(sibling)
+                    continue;
+            }
+            taken[cand[i]] = true;
+            sum += cost(cand[i]);
+            cpus[res++] = cand[i];
+        }
+    }
+    return res;
+}
+
+void Placement::place(size_t count, bool busy, cpu_t *cpus) {
+    ScopedLock<UserSm> guard(&_sm);
+    assert(count > 0 && count <= MAX_VCPUS);
+    if(_policy == ROUND_ROBIN) {
+        cpu_t cpu = _cyc.next()->log_id();
+        for(size_t i = 0; i < count; ++i)
+            cpus[i] = cpu;
+    }
+    else {
+        // find the package that can hold all vCPUs with the lowest cost
+        cpu_t tmp[MAX_VCPUS];
+        uint best = ~0U;
+        int bestpkg = -1;
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
+            uint sum;
+            if(pick(it->package(), count, busy, tmp, sum) == count && sum < best) {
+                best = sum;
+                bestpkg = it->package();
+                memcpy(cpus, tmp, count * sizeof(cpu_t));
+            }
+        }
+        // if no package is large enough, spread them over all CPUs and put multiple vCPUs onto
+        // one CPU if necessary
+        if(bestpkg == -1) {
+            uint sum;
+            size_t n = pick(-1, count, busy, cpus, sum);
+            for(size_t i = n; i < count; ++i)
+                cpus[i] = cpus[i % n];
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i)
+        _vcpus[cpus[i]]++;
+}
+
+void Placement::remove(size_t count, const cpu_t *cpus) {
+    ScopedLock<UserSm> guard(&_sm);
+    for(size_t i = 0; i < count; ++i) {
+        if(_vcpus[cpus[i]] > 0)
+            _vcpus[cpus[i]]--;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <services/SysInfo.h>
+#include <kobj/UserSm.h>
+#include <util/Cycler.h>
+#include <Hip.h>
+#include <CPU.h>
+
+#include "VMConfig.h"
+
+/**
+ * Decides on which CPUs the vCPUs of a VM run. The AUTO policy keeps the vCPUs of a VM within
+ * one package (and thus, cache domain and usually NUMA node), prefers the CPUs with the lowest
+ * cost and avoids hyperthread siblings for busy VMs. The cost of a CPU consists of the number of
+ * vCPUs we have placed on it and its utilization according to the Sc times in root. The
+ * ROUND_ROBIN policy puts all vCPUs of a VM on the next CPU, as we did before.
+ */
+class Placement {
+public:
+    enum Policy {
+        ROUND_ROBIN,
+        AUTO
+    };
+
+    // the utilization is given in permil
+    static const uint FULL          = 1000;
+    static const size_t MAX_VCPUS   = VMConfig::MAX_VCPUS;
+
+    explicit Placement(Policy policy)
+        : _policy(policy), _sm(), _cyc(nre::CPU::begin(), nre::CPU::end()), _load(), _vcpus() {
+    }
+
+    Policy policy() const {
+        return _policy;
+    }
+    void policy(Policy policy) {
+        _policy = policy;
+    }
+    // the utilization of the CPU in the last sample period in permil
+    uint load(cpu_t cpu) const {
+        return _load[cpu];
+    }
+    // the number of vCPUs that have been placed on the CPU
+    size_t vcpus(cpu_t cpu) const {
+        return _vcpus[cpu];
+    }
+
+    // fetches the load of all CPUs from the statistics of root
+    void update(nre::SysInfoSession &sysinfo);
+
+    // chooses the logical CPU ids for the <count> vCPUs of a VM and stores them in <cpus>
+    void place(size_t count, bool busy, cpu_t *cpus);
+    void remove(size_t count, const cpu_t *cpus);
+
+private:
+    uint cost(cpu_t cpu) const {
+        return _vcpus[cpu] * FULL + _load[cpu];
+    }
+    size_t pick(int package, size_t count, bool busy, cpu_t *cpus, uint &sum) const;
+
+    Policy _policy;
+    nre::UserSm _sm;
+    nre::Cycler<nre::CPU::iterator> _cyc;
+    uint _load[nre::Hip::MAX_CPUS];
+    size_t _vcpus[nre::Hip::MAX_CPUS];
+};
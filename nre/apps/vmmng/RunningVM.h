@@ -20,24 +20,63 @@
 #include <ipc/Producer.h>
 #include <services/VMManager.h>
 #include <util/SList.h>
+#include <util/Util.h>
+#include <Syscalls.h>
+#include <Hip.h>
+#include <cstring>
 
 #include "VMConfig.h"
 
 class RunningVM : public nre::SListItem {
 public:
-    explicit RunningVM(VMConfig *cfg, nre::Child::id_type id, capsel_t pd)
-        : nre::SListItem(), _cfg(cfg), _id(id), _pd(pd), _prod() {
+    explicit RunningVM(VMConfig *cfg, nre::Child::id_type id, capsel_t pd, const cpu_t *cpus)
+        : nre::SListItem(), _cfg(cfg), _id(id), _pd(pd), _prod(), _cpus(), _start(nre::Util::tsc()),
+          _last(_start), _time(), _usage() {
+        memcpy(_cpus, cpus, cfg->vcpus() * sizeof(cpu_t));
     }
 
     const VMConfig *cfg() const {
         return _cfg;
     }
+    VMConfig *cfg() {
+        return _cfg;
+    }
     nre::Child::id_type id() const {
         return _id;
     }
     capsel_t pd() const {
         return _pd;
     }
+    cpu_t cpu(size_t i) const {
+        return _cpus[i];
+    }
+    const cpu_t *cpus() const {
+        return _cpus;
+    }
+
+    // determines the CPU time that the vCPUs got since the last call
+    void update(const nre::Child &c) {
+        timevalue_t time = 0;
+        for(nre::SList<nre::Child::SchedEntity>::iterator it = c.scs().begin();
+            it != c.scs().end(); ++it) {
+            if(strcmp(it->name().str(), "vmm-vcpu") == 0)
+                time += nre::Syscalls::sc_time(it->cap());
+        }
+        uint64_t now = nre::Util::tsc();
+        timevalue_t elapsed = to_us(now - _last) * _cfg->vcpus();
+        _usage = elapsed == 0 ? 0 : ((time - _time) * 1000) / elapsed;
+        _time = time;
+        _last = now;
+    }
+    // the utilization of the vCPUs in the last period in permil (average of all vCPUs)
+    uint usage() const {
+        return _usage;
+    }
+    // the CPU time per second that the vCPUs got since the start in microseconds
+    timevalue_t throughput() const {
+        timevalue_t elapsed = to_us(_last - _start);
+        return elapsed == 0 ? 0 : (_time * 1000000) / elapsed;
+    }
 
     bool initialized() const {
         return _prod != 0;
@@ -53,8 +92,17 @@ public:
     }
 
 private:
+    static timevalue_t to_us(uint64_t cycles) {
+        return cycles / (nre::Hip::get().freq_tsc / 1000);
+    }
+
     VMConfig *_cfg;
     nre::Child::id_type _id;
     capsel_t _pd;
     nre::Producer<nre::VMManager::Packet> *_prod;
+    cpu_t _cpus[VMConfig::MAX_VCPUS];
+    uint64_t _start;
+    uint64_t _last;
+    timevalue_t _time;
+    uint _usage;
 };
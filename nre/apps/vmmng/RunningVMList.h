@@ -21,9 +21,10 @@
 #include <util/SList.h>
 
 #include "RunningVM.h"
+#include "Placement.h"
 
 class RunningVMList {
-    explicit RunningVMList() : _sm(), _list() {
+    explicit RunningVMList() : _sm(), _list(), _placement(Placement::AUTO) {
     }
 
 public:
@@ -34,14 +35,38 @@ public:
     size_t count() const {
         return _list.length();
     }
-    void add(nre::ChildManager &cm, VMConfig *cfg, cpu_t cpu) {
+    Placement &placement() {
+        return _placement;
+    }
+
+    void add(nre::ChildManager &cm, VMConfig *cfg, bool busy = true) {
         nre::ScopedLock<nre::UserSm> guard(&_sm);
         size_t console = count() + 1;
-        nre::Child::id_type id = cfg->start(cm, console, cpu);
+        cpu_t cpus[VMConfig::MAX_VCPUS];
+        _placement.place(cfg->vcpus(), busy, cpus);
+        nre::Child::id_type id;
+        try {
+            id = cfg->start(cm, console, cpus);
+        }
+        catch(...) {
+            _placement.remove(cfg->vcpus(), cpus);
+            throw;
+        }
         nre::ScopedLock<nre::RCULock> rcuguard(&nre::RCU::lock());
         const nre::Child *child = cm.get(id);
         if(child)
-            _list.append(new RunningVM(cfg, id, child->pd()));
+            _list.append(new RunningVM(cfg, id, child->pd(), cpus));
+        else
+            _placement.remove(cfg->vcpus(), cpus);
+    }
+    void update(nre::ChildManager &cm) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        nre::ScopedLock<nre::RCULock> rcuguard(&nre::RCU::lock());
+        for(nre::SList<RunningVM>::iterator it = _list.begin(); it != _list.end(); ++it) {
+            const nre::Child *child = cm.get(it->id());
+            if(child)
+                it->update(*child);
+        }
     }
     RunningVM *get(size_t idx) {
         nre::ScopedLock<nre::UserSm> guard(&_sm);
@@ -62,12 +87,15 @@ public:
     }
     void remove(RunningVM *vm) {
         nre::ScopedLock<nre::UserSm> guard(&_sm);
-        if(_list.remove(vm))
+        if(_list.remove(vm)) {
+            _placement.remove(vm->cfg()->vcpus(), vm->cpus());
             delete vm;
+        }
     }
 
 private:
     nre::UserSm _sm;
     nre::SList<RunningVM> _list;
+    Placement _placement;
     static RunningVMList _inst;
 };
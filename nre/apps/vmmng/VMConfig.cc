@@ -14,6 +14,10 @@
  * General Public License version 2 for more details.
  */
 
+#include <stream/IStringStream.h>
+#include <util/Math.h>
+#include <cstring>
+
 #include "VMConfig.h"
 
 using namespace nre;
@@ -37,16 +41,30 @@ void VMConfig::find_mods(size_t len) {
     }
 }
 
-Child::id_type VMConfig::start(ChildManager &cm, size_t console, cpu_t cpu) {
+void VMConfig::find_vcpus() {
+    const String &args = _mods.begin()->args();
+    const char *ncpu = strstr(args.str(), " ncpu:");
+    if(ncpu)
+        _vcpus = IStringStream::read_from<size_t>(ncpu + 6);
+    _vcpus = Math::max<size_t>(1, Math::min<size_t>(_vcpus, MAX_VCPUS));
+}
+
+Child::id_type VMConfig::start(ChildManager &cm, size_t console, const cpu_t *cpus) {
     static char args[MAX_ARGS_LEN];
     SList<Module>::iterator first = _mods.begin();
     OStringStream os(args, sizeof(args));
-    os << first->args() << " console:" << console << " constitle:" << _name;
+    // the cpus have to be known before the vcpus are created, i.e. they have to be placed in
+    // front of all other arguments
+    os << first->name() << " cpus:";
+    for(size_t i = 0; i < _vcpus; ++i)
+        os << (i > 0 ? "," : "") << CPU::get(cpus[i]).phys_id();
+    os << (first->args().str() + first->name().length());
+    os << " console:" << console << " constitle:" << _name;
 
-    VMChildConfig cfg(_mods, String(args), cpu);
+    VMChildConfig cfg(_mods, String(args), cpus[0]);
     Hip::mem_iterator mod = get_module(first->name());
     DataSpace ds(mod->size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::R, mod->addr);
-    return cm.load(ds.virt(), mod->size, cfg);
+    return cm.load(ds.virt(), mod->size, cfg, mod->addr, true);
 }
 
 Hip::mem_iterator VMConfig::get_module(const String &name) {
@@ -27,6 +27,11 @@ nre::OStream & operator<<(nre::OStream &os, const VMConfig &cfg);
 class VMConfig : public nre::SListItem {
     static const size_t MAX_ARGS_LEN    = 256;
 
+public:
+    // vancouver accepts at most 16 values per argument
+    static const size_t MAX_VCPUS       = 16;
+
+private:
     friend nre::OStream & operator<<(nre::OStream &os, const VMConfig &cfg);
 
     class Module : public nre::SListItem {
@@ -71,8 +76,9 @@ class VMConfig : public nre::SListItem {
 public:
     explicit VMConfig(uintptr_t phys, size_t size, const char *name)
         : nre::SListItem(), _ds(size, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::R, phys),
-          _name(name), _mods() {
+          _name(name), _mods(), _vcpus(1) {
         find_mods(size);
+        find_vcpus();
     }
     ~VMConfig() {
         for(nre::SList<Module>::iterator it = _mods.begin(); it != _mods.end(); ) {
@@ -88,13 +94,19 @@ public:
         nre::SList<Module>::iterator first = _mods.begin();
         return first->args();
     }
-    nre::Child::id_type start(nre::ChildManager &cm, size_t console, cpu_t cpu);
+    size_t vcpus() const {
+        return _vcpus;
+    }
+    // starts the VM and lets vancouver run vCPU i on cpus[i]
+    nre::Child::id_type start(nre::ChildManager &cm, size_t console, const cpu_t *cpus);
 
 private:
     void find_mods(size_t len);
+    void find_vcpus();
     static nre::Hip::mem_iterator get_module(const nre::String &name);
 
     nre::DataSpace _ds;
     const char *_name;
     nre::SList<Module> _mods;
+    size_t _vcpus;
 };
@@ -17,11 +17,14 @@
 #include <subsystem/ChildManager.h>
 #include <services/Console.h>
 #include <services/Timer.h>
+#include <services/SysInfo.h>
 #include <stream/Serial.h>
 #include <stream/ConsoleStream.h>
+#include <stream/IStringStream.h>
 #include <util/Clock.h>
-#include <util/Cycler.h>
+#include <util/Trace.h>
 #include <Hip.h>
+#include <cstring>
 
 #include "VMConfig.h"
 #include "RunningVM.h"
@@ -37,7 +40,16 @@ static Connection conscon("console");
 static ConsoleSession cons(conscon, 0, String("VMManager"));
 static SList<VMConfig> configs;
 static ChildManager cm;
-static Cycler<CPU::iterator> cpucyc(CPU::begin(), CPU::end());
+static size_t autostart[ChildManager::MAX_CHILDS];
+static size_t autostart_count = 0;
+static uint bench_secs = 0;
+
+static VMConfig *get_config(size_t idx) {
+    SList<VMConfig>::iterator it;
+    for(it = configs.begin(); it != configs.end() && idx-- > 0; ++it)
+        ;
+    return it != configs.end() ? &*it : 0;
+}
 
 static void refresh_console() {
     static UserSm sm;
@@ -64,7 +76,10 @@ static void refresh_console() {
                 cs.color(CUR_ROW_COLOR);
             size_t virt, phys;
             c->reglist().memusage(virt, phys);
-            cs << "  [" << (i + 1) << "] CPU:" << c->cpu() << " MEM:" << (phys / 1024);
+            cs << "  [" << (i + 1) << "] CPU:";
+            for(size_t j = 0; j < vm->cfg()->vcpus(); ++j)
+                cs << (j > 0 ? "," : "") << vm->cpu(j);
+            cs << " USE:" << (vm->usage() / 10) << "% MEM:" << (phys / 1024);
             cs << "K CFG:" << vm->cfg()->name();
             while(cs.x() != 0)
                 cs << ' ';
@@ -72,7 +87,9 @@ static void refresh_console() {
                 cs.color(oldcol);
         }
     }
-    cs << "\nPress R to reset or K to kill the selected VM";
+    cs << "\nPress R to reset, K to kill or B to rebalance the selected VM";
+    if(Trace::mask)
+        cs << ", T to dump the trace";
 }
 
 static void input_thread(void*) {
@@ -81,12 +98,9 @@ static void input_thread(void*) {
         switch(pk->keycode) {
             case Keyboard::VK_1 ... Keyboard::VK_9: {
                 if(pk->flags & Keyboard::RELEASE) {
-                    size_t idx = pk->keycode - Keyboard::VK_1;
-                    SList<VMConfig>::iterator it;
-                    for(it = configs.begin(); it != configs.end() && idx-- > 0; ++it)
-                        ;
-                    if(it != configs.end())
-                        RunningVMList::get().add(cm, &*it, cpucyc.next()->log_id());
+                    VMConfig *cfg = get_config(pk->keycode - Keyboard::VK_1);
+                    if(cfg)
+                        RunningVMList::get().add(cm, cfg);
                 }
             }
             break;
@@ -103,6 +117,11 @@ static void input_thread(void*) {
             }
             break;
 
+            case Keyboard::VK_T:
+                if(pk->flags & Keyboard::RELEASE)
+                    Trace::dump(Serial::get(), "vmmng");
+                break;
+
             case Keyboard::VK_UP:
                 if((~pk->flags & Keyboard::RELEASE) && vmidx > 0) {
                     vmidx--;
@@ -117,6 +136,31 @@ static void input_thread(void*) {
                 }
                 break;
 
+            case Keyboard::VK_B: {
+                // NOVA can't move an Ec to a different CPU, so we rebalance a VM by restarting it
+                // on the CPUs that the placement chooses now
+                if(pk->flags & Keyboard::RELEASE) {
+                    Child::id_type id = ObjCap::INVALID;
+                    VMConfig *cfg = 0;
+                    bool busy = false;
+                    {
+                        ScopedLock<RCULock> guard(&RCU::lock());
+                        RunningVM *vm = RunningVMList::get().get(vmidx);
+                        if(vm) {
+                            id = vm->id();
+                            cfg = vm->cfg();
+                            busy = vm->usage() > Placement::FULL / 2;
+                            RunningVMList::get().remove(vm);
+                        }
+                    }
+                    if(id != ObjCap::INVALID) {
+                        cm.kill(id);
+                        RunningVMList::get().add(cm, cfg, busy);
+                    }
+                }
+            }
+            break;
+
             case Keyboard::VK_K: {
                 if(pk->flags & Keyboard::RELEASE) {
                     Child::id_type id = ObjCap::INVALID;
@@ -141,9 +185,13 @@ static void input_thread(void*) {
 static void refresh_thread(void*) {
     Connection timercon("timer");
     TimerSession timer(timercon);
+    Connection sysinfocon("sysinfo");
+    SysInfoSession sysinfo(sysinfocon);
     Clock clock(1000);
     while(1) {
         timevalue_t next = clock.source_time(1000);
+        RunningVMList::get().placement().update(sysinfo);
+        RunningVMList::get().update(cm);
         refresh_console();
 
         // wait a second
@@ -151,8 +199,46 @@ static void refresh_thread(void*) {
     }
 }
 
-int main() {
+static void autostart_thread(void*) {
+    Connection timercon("timer");
+    TimerSession timer(timercon);
+    Clock clock(1000);
+
+    // vancouver connects to our service, so wait until it is registered
+    while(1) {
+        try {
+            Connection con("vmmanager");
+            break;
+        }
+        catch(const Exception&) {
+            timer.wait_until(clock.source_time(10));
+        }
+    }
+
+    for(size_t i = 0; i < autostart_count; ++i) {
+        VMConfig *cfg = get_config(autostart[i]);
+        if(cfg)
+            RunningVMList::get().add(cm, cfg);
+    }
+    if(bench_secs == 0)
+        return;
+
+    timer.wait_until(clock.source_time(bench_secs * 1000));
+    timevalue_t total = 0;
+    ScopedLock<RCULock> rcuguard(&RCU::lock());
+    RunningVM *vm;
+    for(size_t i = 0; (vm = RunningVMList::get().get(i)) != 0; ++i) {
+        timevalue_t tp = vm->throughput();
+        Serial::get().writef("BENCH: vmmng.vm%zu.%s us/s n=1 avg=%Lu med=%Lu\n",
+                             i + 1, vm->cfg()->name(), tp, tp);
+        total += tp;
+    }
+    Serial::get().writef("BENCH: vmmng.total us/s n=1 avg=%Lu med=%Lu\n", total, total);
+}
+
+int main(int argc, char *argv[]) {
     const Hip &hip = Hip::get();
+    Trace::init();
 
     for(Hip::mem_iterator mem = hip.mem_begin(); mem != hip.mem_end(); ++mem) {
         if(strstr(mem->cmdline(), ".vmconfig")) {
@@ -162,9 +248,29 @@ int main() {
         }
     }
 
+    // place=rr: put all vCPUs of a VM on the next CPU, as we did before
+    // start=<no>: start the config <no> at startup (can be given multiple times)
+    // bench=<secs>: report the CPU time of the autostarted VMs after <secs> seconds
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "place=rr") == 0)
+            RunningVMList::get().placement().policy(Placement::ROUND_ROBIN);
+        else if(strncmp(argv[i], "start=", 6) == 0 && autostart_count < ChildManager::MAX_CHILDS)
+            autostart[autostart_count++] = IStringStream::read_from<size_t>(argv[i] + 6) - 1;
+        else if(strncmp(argv[i], "bench=", 6) == 0)
+            bench_secs = IStringStream::read_from<uint>(argv[i] + 6);
+    }
+
+    // we only write via ConsoleStream, which announces the changes
+    cons.enable_notify();
+
     GlobalThread::create(input_thread, CPU::current().log_id(), String("vmmng-input"))->start();
     GlobalThread::create(refresh_thread, CPU::current().log_id(), String("vmmng-refresh"))->start();
 
+    if(autostart_count > 0) {
+        GlobalThread::create(autostart_thread, CPU::current().log_id(),
+                             String("vmmng-autostart"))->start();
+    }
+
     VMMngService *srv = VMMngService::create("vmmanager");
     srv->start();
     return 0;
@@ -29,3 +29,6 @@ create_iso $dest/test.iso dist/iso
 # build a 20MB disk with 2 ext3 partitions
 tools/disk.py create $dest/hd3.img --part ext3 10 dist/iso --part ext2 12 -
 
+
+# build an empty 16MB disk to store the overlays of virtual drives on
+tools/disk.py create $dest/hd4.img --part ext2 16 -
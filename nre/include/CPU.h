@@ -106,6 +106,17 @@ public:
     uint8_t package() const {
         return _package;
     }
+    /**
+     * The NUMA node of this CPU. It is 0 on machines without a SRAT and for all CPUs that have been
+     * brought up before the ACPI service has told root about the topology. The setter is only
+     * intended for root.
+     */
+    uint8_t node() const {
+        return _node;
+    }
+    void node(uint8_t node) {
+        _node = node;
+    }
 
     /**
      * @return the physical CPU id
@@ -168,8 +179,8 @@ public:
 
 private:
     CPU()
-        : _id(), _next(), _flags(), _thread(), _core(), _package(), _ds_pt(), _io_pt(),
-          _gsi_pt(), _srv_pt(), _sc_pt() {
+        : _id(), _next(), _flags(), _thread(), _core(), _package(), _node(), _ds_pt(),
+          _io_pt(), _gsi_pt(), _srv_pt(), _sc_pt() {
     }
     CPU(const CPU&);
     CPU& operator=(const CPU&);
@@ -184,6 +195,7 @@ private:
     uint8_t _thread;
     uint8_t _core;
     uint8_t _package;
+    uint8_t _node;
     Pt *_ds_pt;
     Pt *_io_pt;
     Pt *_gsi_pt;
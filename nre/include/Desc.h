@@ -165,11 +165,11 @@ static inline OStream &operator<<(OStream &os, const Mtd &mtd) {
 }
 
 /**
- * A quantum+period descriptor.
+ * A quantum+period descriptor. Priority 0 lets the parent choose the priority (see Sc::Band).
  */
 class Qpd : public Desc {
     static const uint DEFAULT_QUANTUM   = 10000;
-    static const uint DEFAULT_PRIORITY  = 1;
+    static const uint DEFAULT_PRIORITY  = 0;
 
 public:
     explicit Qpd(uint prio = DEFAULT_PRIORITY, uint quantum = DEFAULT_QUANTUM)
@@ -189,4 +189,63 @@ static inline OStream &operator<<(OStream &os, const Qpd &qpd) {
     return os;
 }
 
+/**
+ * A CPU reservation: the Sc demands <budget> microseconds every <period> microseconds. Since NOVA
+ * has no budget enforcement, a reservation is granted by the admission control only if the
+ * reservations on the CPU stay below its capacity. Granted Scs stay in the band of their Pd, so
+ * that they can't starve the Scs of higher bands, but get the budget as quantum. If a reservation
+ * can't be granted, it is rejected if it is hard and demoted to the band of the Pd otherwise.
+ */
+class Reservation {
+public:
+    /**
+     * Creates a reservation. Without arguments, it is no reservation at all (best-effort).
+     *
+     * @param budget the budget (in microseconds)
+     * @param period the period (in microseconds)
+     * @param hard whether the Sc should not be started if the reservation can't be granted
+     */
+    explicit Reservation(uint budget = 0, uint period = 0, bool hard = false)
+        : _budget(budget), _period(period), _hard(hard) {
+    }
+
+    /**
+     * @return the budget (in microseconds)
+     */
+    uint budget() const {
+        return _budget;
+    }
+    /**
+     * @return the period (in microseconds)
+     */
+    uint period() const {
+        return _period;
+    }
+    /**
+     * @return true if it should be rejected instead of demoted
+     */
+    bool hard() const {
+        return _hard;
+    }
+    /**
+     * @return the demanded share of the CPU in permil (0 = no reservation)
+     */
+    uint utilization() const {
+        if(_period == 0)
+            return 0;
+        return static_cast<uint>((static_cast<uint64_t>(_budget) * 1000 + _period - 1) / _period);
+    }
+
+private:
+    uint _budget;
+    uint _period;
+    bool _hard;
+};
+
+static inline OStream &operator<<(OStream &os, const Reservation &res) {
+    os << "Reservation[budget=" << res.budget() << " period=" << res.period();
+    os << (res.hard() ? " hard" : "") << "]";
+    return os;
+}
+
 }
@@ -164,7 +164,12 @@ public:
     uint8_t core;
     uint8_t package;
 private:
-    uint32_t : 32;
+    uint8_t : 8;
+public:
+    // the NUMA node; NOVA leaves it zero, root fills it in for its childs
+    uint8_t node;
+private:
+    uint16_t : 16;
 
 public:
     /**
@@ -65,6 +65,8 @@ public:
         STORAGE         = 1 << 19,
         STORAGE_DETAIL  = 1 << 20,
         CONSOLE         = 1 << 21,
+        IPC             = 1 << 22,
+        VMEXITS         = 1 << 23,
     };
 
     static UserSm sm;
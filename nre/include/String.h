@@ -125,6 +125,63 @@ private:
     size_t _len;
 };
 
+/**
+ * A non-owning reference to a string (or any sequence of bytes). It is used to receive strings
+ * from the UTCB without copying them to the heap. In this case, the view points into the UTCB and
+ * is therefore only valid as long as the frame isn't overwritten, i.e. until you put the reply
+ * into it or create a new UtcbFrame (which also happens implicitly, e.g. by calling a portal or,
+ * in some protection domains, by writing to Serial). Copy it, if you need it longer.
+ */
+class StringView {
+public:
+    /**
+     * Creates an empty view
+     */
+    explicit StringView() : _str(""), _len() {
+    }
+    /**
+     * Creates a view of <str> with length <len>. The string has to be null-terminated at <len>.
+     */
+    explicit StringView(const char *str, size_t len) : _str(str), _len(len) {
+    }
+    /**
+     * Creates a view of the given string. Intentionally not explicit, so that a String can be
+     * passed wherever a StringView is expected.
+     */
+    StringView(const String &s) : _str(s.str()), _len(s.length()) {
+    }
+
+    /**
+     * @return the string (always null-terminated)
+     */
+    const char *str() const {
+        return _str;
+    }
+    /**
+     * @return the length of the string
+     */
+    size_t length() const {
+        return _len;
+    }
+
+private:
+    const char *_str;
+    size_t _len;
+};
+
+/**
+ * @return true if s1 and s2 are equal
+ */
+static inline bool operator==(const StringView &s1, const StringView &s2) {
+    return s1.length() == s2.length() && memcmp(s1.str(), s2.str(), s1.length()) == 0;
+}
+/**
+ * @return true if s1 and s2 are not equal
+ */
+static inline bool operator!=(const StringView &s1, const StringView &s2) {
+    return !operator==(s1, s2);
+}
+
 /**
  * @return true if s1 and s2 are equal
  */
@@ -148,5 +205,15 @@ static inline bool operator!=(const String &s1, const String &s2) {
 static inline OStream &operator<<(OStream &os, const String &str) {
     return os << str.str();
 }
+/**
+ * Writes the string into the given output-stream
+ *
+ * @param os the stream
+ * @param str the string
+ * @return the stream
+ */
+static inline OStream &operator<<(OStream &os, const StringView &str) {
+    return os << str.str();
+}
 
 }
@@ -179,6 +179,17 @@ public:
     static void sm_ctrl(capsel_t sm, SmOp op) {
         SyscallABI::syscall(sm << 8 | SM_CTRL | op);
     }
+    /**
+     * Controls the given Sm with a timeout for DOWN and ZERO.
+     *
+     * @param sm the capability selector for the Sm
+     * @param op the operation (DOWN or ZERO)
+     * @param timeout the absolute time in TSC ticks at which the operation is aborted (0 = never)
+     * @throws SyscallException if the system-call failed (E_TIMEOUT if the timeout was reached)
+     */
+    static void sm_ctrl(capsel_t sm, SmOp op, uint64_t timeout) {
+        SyscallABI::syscall(sm << 8 | SM_CTRL | op, timeout >> 32, timeout & 0xFFFFFFFF);
+    }
 
     /**
      * Get consumed CPU time of the given Sc
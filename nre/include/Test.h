@@ -19,9 +19,13 @@
 #pragma once
 
 #include <stream/OStringStream.h>
+#include <stream/IStringStream.h>
 #include <stream/Serial.h>
 #include <utcb/UtcbFrame.h>
+#include <util/Profiler.h>
 #include <Errors.h>
+#include <CPU.h>
+#include <cstring>
 
 namespace nre {
 namespace test {
@@ -63,6 +67,10 @@ struct TestCase {
 // Performance monitoring
 #define WVPERF(value, units)    \
     ({ nre::test::WvTest __t(__FILE__, __LINE__, "PERF: " # value);  __t.check_perf(value, units); })
+// Benchmarks: reports the median as PERF and all statistics of <prof> in "BENCH:" lines, which
+// can be parsed by tools/bench.py. <name> should not contain spaces.
+#define WVBENCH(name, prof, units)    \
+    ({ nre::test::WvTest __t(__FILE__, __LINE__, name);  __t.check_bench(name, prof, units); })
 
 // Debugging
 #define WV(code)                \
@@ -75,6 +83,62 @@ struct TestCase {
     Serial::get().writef("! %s:%d " fmt " ok\n", \
                          nre::test::WvTest::shortpath(__FILE__), __LINE__, ## __VA_ARGS__)
 
+/**
+ * The parameters for benchmarks, which can be changed via the command line of the unittests:
+ * "iters=<n>" sets the number of measured iterations, "warmup=<n>" the number of iterations that
+ * are executed before measuring and "cpu=<n>" the CPU to run the tests on.
+ */
+class BenchConfig {
+public:
+    static void parse(int argc, char *argv[]) {
+        for(int i = 1; i < argc; ++i) {
+            if(strncmp(argv[i], "iters=", 6) == 0)
+                iters() = IStringStream::read_from<size_t>(argv[i] + 6);
+            else if(strncmp(argv[i], "warmup=", 7) == 0)
+                warm() = IStringStream::read_from<size_t>(argv[i] + 7);
+            else if(strncmp(argv[i], "cpu=", 4) == 0)
+                cpuno() = IStringStream::read_from<int>(argv[i] + 4);
+        }
+    }
+
+    /**
+     * @param def the default value of the benchmark
+     * @return the number of iterations to measure
+     */
+    static size_t iterations(size_t def) {
+        return iters() ? iters() : def;
+    }
+    /**
+     * @param def the default value of the benchmark
+     * @return the number of warmup iterations
+     */
+    static size_t warmup(size_t def) {
+        return warm() != static_cast<size_t>(-1) ? warm() : def;
+    }
+    /**
+     * @return the CPU to run the tests on
+     */
+    static cpu_t cpu() {
+        return cpuno() != -1 ? cpuno() : CPU::current().log_id();
+    }
+
+private:
+    static size_t &iters() {
+        static size_t val = 0;
+        return val;
+    }
+    static size_t &warm() {
+        static size_t val = static_cast<size_t>(-1);
+        return val;
+    }
+    static int &cpuno() {
+        static int val = -1;
+        return val;
+    }
+
+    BenchConfig();
+};
+
 class WvTest {
     const char *file, *condstr;
     int line;
@@ -272,6 +336,17 @@ public:
         return val;
     }
 
+    AvgProfiler::time_t check_bench(const char *name, AvgProfiler &prof, const char *units) {
+        // two lines because the serial line is limited to BaseSerial::MAX_LINE_LEN
+        AvgProfiler::time_t med = prof.median();
+        Serial::get().writef("BENCH: %s %s cpu=%u n=%zu avg=%Lu min=%Lu max=%Lu\n",
+                             name, units, CPU::current().log_id(), prof.count(), prof.avg(),
+                             prof.min(), prof.max());
+        Serial::get().writef("BENCH: %s %s med=%Lu p90=%Lu p99=%Lu\n",
+                             name, units, med, prof.percentile(90), prof.percentile(99));
+        return check_perf(med, units);
+    }
+
     const char *show(const char *val) {
         print_result(true, val, "= \"", "\"");
         return val;
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <cap/CapRange.h>
+#include <kobj/Pt.h>
+#include <utcb/UtcbFrame.h>
+#include <util/Math.h>
+
+namespace nre {
+
+/**
+ * Collects capability ranges to delegate or revoke them with as few typed items, system calls
+ * and UTCB frames as possible. When a range is added, it is merged with the previous one if it
+ * continues it (regarding the start, the hotspot and the attributes). Thus, adding one page or
+ * capability after another results in a single range, which is delegated with naturally aligned
+ * Crds of maximum size. For revocations, the ranges are additionally sorted and merged regardless
+ * of the order in which they have been added.
+ * The batch holds at most MAX ranges. If it is full, add() fails and you have to submit the
+ * batch first.
+ */
+template<size_t MAX = 32>
+class CapBatch {
+public:
+    /**
+     * Creates an empty batch
+     */
+    explicit CapBatch() : _ranges(), _first(0), _count(0) {
+    }
+
+    /**
+     * @return true if there is nothing left to delegate or revoke
+     */
+    bool empty() const {
+        return _first == _count;
+    }
+    /**
+     * @return the number of ranges in the batch
+     */
+    size_t ranges() const {
+        return _count - _first;
+    }
+    /**
+     * @return the total number of capabilities in the batch
+     */
+    size_t caps() const {
+        size_t total = 0;
+        for(size_t i = _first; i < _count; ++i)
+            total += _ranges[i].count();
+        return total;
+    }
+    /**
+     * @return the number of typed items that are required to delegate the whole batch
+     */
+    size_t items() const {
+        size_t total = 0;
+        for(size_t i = _first; i < _count; ++i)
+            total += items(_ranges[i], static_cast<size_t>(-1));
+        return total;
+    }
+
+    /**
+     * Removes all ranges
+     */
+    void clear() {
+        _first = _count = 0;
+    }
+
+    /**
+     * Adds the given range
+     *
+     * @param cr the range
+     * @return true if successful, false if the batch is full
+     */
+    bool add(const CapRange &cr) {
+        if(cr.count() == 0)
+            return true;
+        if(!empty()) {
+            CapRange &last = _ranges[_count - 1];
+            if(last.attr() == cr.attr() && last.start() + last.count() == cr.start() &&
+               hotspot(last) + last.count() == hotspot(cr)) {
+                last.count(last.count() + cr.count());
+                return true;
+            }
+        }
+        if(_count == MAX)
+            return false;
+        _ranges[_count++] = cr;
+        return true;
+    }
+    /**
+     * Adds the capability <cap>
+     *
+     * @param cap the capability selector
+     * @param attr the attributes (default Crd::OBJ_ALL)
+     * @param hotspot the hotspot (default: no hotspot)
+     * @return true if successful, false if the batch is full
+     */
+    bool add(capsel_t cap, uint attr = Crd::OBJ_ALL, uintptr_t hotspot = CapRange::NO_HOTSPOT) {
+        return add(CapRange(cap, 1, attr, hotspot));
+    }
+
+    /**
+     * Puts as many delegations as fit into <uf> and removes them from the batch. That is, it
+     * can be used in a portal to delegate as much as possible with the reply.
+     *
+     * @param uf the frame
+     * @param flags the flags for the delegations
+     * @return the number of capabilities that have been put into the frame
+     */
+    size_t put(UtcbFrameRef &uf, UtcbFrameRef::DelFlags flags = UtcbFrameRef::NONE) {
+        return put(uf, uf.free_typed(), flags);
+    }
+    /**
+     * Puts at most <max> typed items for delegations into <uf> and removes them from the batch.
+     *
+     * @param uf the frame
+     * @param max the maximum number of typed items to use
+     * @param flags the flags for the delegations
+     * @return the number of capabilities that have been put into the frame
+     */
+    size_t put(UtcbFrameRef &uf, size_t max, UtcbFrameRef::DelFlags flags) {
+        size_t total = 0;
+        while(!empty() && max > 0) {
+            CapRange &cr = _ranges[_first];
+            size_t count = cr.count();
+            size_t used = items(cr, max, &count);
+            uf.delegate(CapRange(cr.start(), count, cr.attr(), hotspot(cr)), flags);
+            max -= used;
+            total += count;
+            if(count == cr.count())
+                _first++;
+            else {
+                cr.start(cr.start() + count);
+                if(cr.hotspot() != CapRange::NO_HOTSPOT)
+                    cr.hotspot(cr.hotspot() + count);
+                cr.count(cr.count() - count);
+            }
+        }
+        if(empty())
+            clear();
+        return total;
+    }
+
+    /**
+     * Delegates all capabilities in the batch to the protection domain behind <pt>. It calls
+     * <pt> as often as necessary, each time with as many delegations as fit into <uf>. The
+     * portal is expected to accept the delegations and to reply an ErrorCode.
+     *
+     * @param pt the portal
+     * @param uf the frame to use (it is cleared before each call)
+     * @param flags the flags for the delegations
+     * @return the number of calls
+     * @throws Exception if the portal replied an error
+     */
+    size_t delegate(Pt &pt, UtcbFrame &uf, UtcbFrameRef::DelFlags flags = UtcbFrameRef::NONE) {
+        size_t calls = 0;
+        while(!empty()) {
+            uf.clear();
+            put(uf, flags);
+            pt.call(uf);
+            uf.check_reply();
+            calls++;
+        }
+        return calls;
+    }
+
+    /**
+     * Revokes all capabilities in the batch and clears it. Overlapping and adjacent ranges with
+     * the same attributes are merged before, so that the minimum number of system calls is used.
+     *
+     * @param self whether to revoke them from yourself as well
+     * @return the number of system calls
+     */
+    size_t revoke(bool self) {
+        sort();
+        size_t calls = 0;
+        size_t i = _first;
+        while(i < _count) {
+            uintptr_t start = _ranges[i].start();
+            uintptr_t end = start + _ranges[i].count();
+            uint attr = _ranges[i].attr();
+            for(++i; i < _count && _ranges[i].attr() == attr && _ranges[i].start() <= end; ++i)
+                end = Math::max<uintptr_t>(end, _ranges[i].start() + _ranges[i].count());
+            while(start < end) {
+                uint minshift = Math::minshift(start, end - start);
+                Syscalls::revoke(Crd(start, minshift, attr), self);
+                start += static_cast<uintptr_t>(1) << minshift;
+                calls++;
+            }
+        }
+        clear();
+        return calls;
+    }
+
+private:
+    static uintptr_t hotspot(const CapRange &cr) {
+        return cr.hotspot() != CapRange::NO_HOTSPOT ? cr.hotspot() : cr.start();
+    }
+    // determines how many typed items (at most <max>) are used for <cr>. if <count> is given, the
+    // number of capabilities that are covered by them is stored there
+    static size_t items(const CapRange &cr, size_t max, size_t *count = 0) {
+        uintptr_t st = cr.start();
+        uintptr_t hs = hotspot(cr);
+        size_t c = cr.count();
+        size_t used = 0;
+        while(c > 0 && used < max) {
+            uint minshift = Math::minshift(st | hs, c);
+            st += static_cast<uintptr_t>(1) << minshift;
+            hs += static_cast<uintptr_t>(1) << minshift;
+            c -= static_cast<size_t>(1) << minshift;
+            used++;
+        }
+        if(count)
+            *count = cr.count() - c;
+        return used;
+    }
+
+    // sorts the ranges by attributes and start (insertion sort; there are only a few of them)
+    void sort() {
+        for(size_t i = _first + 1; i < _count; ++i) {
+            CapRange cr = _ranges[i];
+            size_t j = i;
+            for(; j > _first && less(cr, _ranges[j - 1]); --j)
+                _ranges[j] = _ranges[j - 1];
+            _ranges[j] = cr;
+        }
+    }
+    static bool less(const CapRange &a, const CapRange &b) {
+        if(a.attr() != b.attr())
+            return a.attr() < b.attr();
+        return a.start() < b.start();
+    }
+
+    CapRange _ranges[MAX];
+    size_t _first;
+    size_t _count;
+};
+
+}
@@ -127,6 +127,26 @@ public:
         _if->rpos = (_if->rpos + 1) & (_max - 1);
     }
 
+    /**
+     * Fetches up to <max> items at once. Like get(), it blocks until there is at least one item.
+     * This way, a burst of items is handled with one wakeup and the consumer can, for example,
+     * acquire its locks once per batch instead of once per item.
+     *
+     * @param values the array to copy the items to
+     * @param max the maximum number of items
+     * @return the number of fetched items (0 if it has been stopped and there is no data anymore)
+     */
+    size_t consume_batch(T *values, size_t max) {
+        if(!get())
+            return 0;
+        size_t n = 0;
+        while(n < max && has_data()) {
+            values[n++] = _if->buffer[_if->rpos];
+            next();
+        }
+        return n;
+    }
+
 private:
     DataSpace *_ds;
     Interface *_if;
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/Sm.h>
+#include <mem/DataSpace.h>
+#include <util/Atomic.h>
+#include <util/Sync.h>
+#include <util/Math.h>
+
+namespace nre {
+
+template<typename T>
+class MPProducer;
+
+/**
+ * Consumer-part for the producer-consumer-communication over a dataspace with multiple producers
+ * and, optionally, multiple consumers. In contrast to Consumer, each slot carries a sequence
+ * number (see Dmitry Vyukov's bounded MPMC queue), so that producers and consumers reserve slots
+ * with a compare-and-swap on the shared indices and publish them afterwards. The indices and the
+ * number of sleeping consumers live on separate cache lines. The producers only up the semaphore
+ * if a consumer announced that it is going to sleep, so that a busy ring costs no syscalls.
+ *
+ * Usage-example:
+ * MPConsumer<Item> cons(&ds);
+ * Item it;
+ * while(cons.consume(it)) {
+ *   // do something with it
+ * }
+ */
+template<typename T>
+class MPConsumer {
+    friend class MPProducer<T>;
+
+    static const size_t CACHE_LINE  = 64;
+
+    struct Slot {
+        volatile size_t seq;
+        T data;
+    };
+    struct Interface {
+        volatile size_t head;
+        char pad1[CACHE_LINE - sizeof(size_t)];
+        volatile size_t tail;
+        char pad2[CACHE_LINE - sizeof(size_t)];
+        volatile long sleeping;
+        char pad3[CACHE_LINE - sizeof(long)];
+        Slot slots[];
+    };
+
+public:
+    /**
+     * Creates a consumer that uses the given dataspace for communication
+     *
+     * @param ds the dataspace
+     * @param init whether the consumer should init the state. this should only be done by one
+     *  party, before the other parties use the ring
+     */
+    explicit MPConsumer(DataSpace *ds, bool init = false)
+        : _ds(ds), _if(reinterpret_cast<Interface*>(ds->virt())), _max(slots(ds)),
+          _sm(_ds->sel(), true), _stop(false) {
+        if(init)
+            reset(_if, _max);
+    }
+
+    /**
+     * @return the length of the ring-buffer
+     */
+    size_t rblength() const {
+        return _max;
+    }
+
+    /**
+     * Stops waiting for the producers. This way, all consumers that are blocked in consume() are
+     * unblocked.
+     */
+    void stop() {
+        _stop = true;
+        Sync::memory_fence();
+        try {
+            for(long i = Math::max<long>(1, _if->sleeping); i > 0; --i)
+                _sm.up();
+        }
+        catch(...) {
+            // ignore it
+        }
+    }
+
+    /**
+     * @return whether there is more data to read
+     */
+    bool has_data() const {
+        size_t pos = _if->tail;
+        return _if->slots[pos & (_max - 1)].seq == pos + 1;
+    }
+
+    /**
+     * Fetches the next item, if there is any.
+     *
+     * @param value will be set to the item
+     * @return true if there was an item
+     */
+    bool try_consume(T &value) {
+        size_t pos = _if->tail;
+        while(1) {
+            Slot *s = _if->slots + (pos & (_max - 1));
+            long diff = static_cast<long>(s->seq - (pos + 1));
+            if(diff == 0) {
+                if(Atomic::cmpnswap(&_if->tail, pos, pos + 1)) {
+                    value = s->data;
+                    Sync::memory_barrier();
+                    // hand the slot to the producers of the next round
+                    s->seq = pos + _max;
+                    return true;
+                }
+                pos = _if->tail;
+            }
+            // it's empty
+            else if(diff < 0)
+                return false;
+            // somebody else took it meanwhile
+            else
+                pos = _if->tail;
+        }
+    }
+
+    /**
+     * Fetches up to <max> items, without blocking.
+     *
+     * @param values the array to write the items to
+     * @param max the maximum number of items
+     * @return the number of fetched items
+     */
+    size_t try_consume_batch(T *values, size_t max) {
+        size_t i = 0;
+        while(i < max && try_consume(values[i]))
+            i++;
+        return i;
+    }
+
+    /**
+     * Fetches the next item. If there is none, it blocks until a producer notifies it that there
+     * is data available. You might interrupt that by using stop(). Note that the method will only
+     * return false if it has been stopped *and* there is no data anymore.
+     *
+     * @param value will be set to the item
+     * @return true if there was an item
+     */
+    bool consume(T &value) {
+        while(EXPECT_FALSE(!try_consume(value))) {
+            if(EXPECT_FALSE(_stop))
+                return false;
+            if(!wait())
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool wait() {
+        // announce that we're going to sleep before we check for the last time. the producers
+        // do it the other way around, so that either we see the item or they see us.
+        Atomic::add(&_if->sleeping, +1);
+        Sync::memory_fence();
+        bool res = true;
+        if(!has_data() && !_stop) {
+            // they might fail if someone revokes the Sm-caps. zero() instead of down(), because
+            // multiple producers might up it for the same wakeup
+            try {
+                _sm.zero();
+            }
+            catch(...) {
+                res = false;
+            }
+        }
+        Atomic::add(&_if->sleeping, -1);
+        return res;
+    }
+
+    static size_t slots(DataSpace *ds) {
+        return Math::prev_pow2((ds->size() - sizeof(Interface)) / sizeof(Slot));
+    }
+    static void reset(Interface *ifc, size_t max) {
+        ifc->head = 0;
+        ifc->tail = 0;
+        ifc->sleeping = 0;
+        for(size_t i = 0; i < max; ++i)
+            ifc->slots[i].seq = i;
+        Sync::memory_barrier();
+    }
+
+    MPConsumer(const MPConsumer&);
+    MPConsumer& operator=(const MPConsumer&);
+
+    DataSpace *_ds;
+    Interface *_if;
+    size_t _max;
+    Sm _sm;
+    bool _stop;
+};
+
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <mem/DataSpace.h>
+#include <ipc/MPConsumer.h>
+#include <util/Atomic.h>
+#include <util/Sync.h>
+#include <util/Math.h>
+#include <util/Util.h>
+
+namespace nre {
+
+/**
+ * Producer-part for the producer-consumer-communication over a dataspace with multiple producers.
+ * All producers may use the same dataspace concurrently, also from different protection domains.
+ * See MPConsumer for details.
+ */
+template<typename T>
+class MPProducer {
+    typedef typename MPConsumer<T>::Slot Slot;
+
+public:
+    /**
+     * Creates a producer that uses the given dataspace for communication
+     *
+     * @param ds the dataspace
+     * @param init whether the producer should init the state. this should only be done by one
+     *  party, before the other parties use the ring. That is, if the client is a producer it
+     *  should init it (because it will create the dataspace and share it to the service).
+     */
+    explicit MPProducer(DataSpace *ds, bool init = true)
+        : _ds(ds), _if(reinterpret_cast<typename MPConsumer<T>::Interface*>(ds->virt())),
+          _max(MPConsumer<T>::slots(ds)), _sm(_ds->sel(), true) {
+        if(init)
+            MPConsumer<T>::reset(_if, _max);
+    }
+
+    /**
+     * @return the length of the ring-buffer
+     */
+    size_t rblength() const {
+        return _max;
+    }
+
+    /**
+     * Produces the given item, if there is a free slot.
+     *
+     * @param value the value to produce
+     * @return true if the item has been written successfully
+     */
+    bool produce(const T &value) {
+        size_t pos = _if->head;
+        while(1) {
+            Slot *s = _if->slots + (pos & (_max - 1));
+            long diff = static_cast<long>(s->seq - pos);
+            if(diff == 0) {
+                if(Atomic::cmpnswap(&_if->head, pos, pos + 1)) {
+                    s->data = value;
+                    Sync::memory_barrier();
+                    s->seq = pos + 1;
+                    notify(1);
+                    return true;
+                }
+                pos = _if->head;
+            }
+            // it's full
+            else if(diff < 0)
+                return false;
+            // another producer took it meanwhile
+            else
+                pos = _if->head;
+        }
+    }
+
+    /**
+     * Produces as many items of <values> as there are free slots, but at most <count>. The slots
+     * are reserved with one atomic operation and the consumers are notified at most once per
+     * sleeping consumer. The items of one batch are consumed in order, but may be interleaved with
+     * the items of other producers.
+     *
+     * @param values the items
+     * @param count the number of items
+     * @return the number of produced items
+     */
+    size_t produce_batch(const T *values, size_t count) {
+        size_t pos, n;
+        do {
+            // read tail first; it might be outdated then, but it does only grow. so we
+            // underestimate the free slots, but never get tail > head
+            size_t tail = _if->tail;
+            Sync::memory_barrier();
+            pos = _if->head;
+            size_t used = pos - tail;
+            if(used >= _max)
+                return 0;
+            n = Math::min(count, _max - used);
+        }
+        while(!Atomic::cmpnswap(&_if->head, pos, pos + n));
+
+        for(size_t i = 0; i < n; ++i) {
+            Slot *s = _if->slots + ((pos + i) & (_max - 1));
+            // the consumer has already taken the slot, but may still copy the item out of it
+            while(s->seq != pos + i)
+                Util::pause();
+            s->data = values[i];
+            Sync::memory_barrier();
+            s->seq = pos + i + 1;
+        }
+        notify(n);
+        return n;
+    }
+
+private:
+    void notify(size_t items) {
+        // the store to seq has to be visible before we check whether a consumer sleeps
+        Sync::memory_fence();
+        long sleeping = _if->sleeping;
+        if(EXPECT_TRUE(sleeping == 0))
+            return;
+        try {
+            for(long i = Math::min<long>(sleeping, items); i > 0; --i)
+                _sm.up();
+        }
+        catch(...) {
+            // if the client closed the session, we might get here. so, just ignore it.
+        }
+    }
+
+    MPProducer(const MPProducer&);
+    MPProducer& operator=(const MPProducer&);
+
+    DataSpace *_ds;
+    typename MPConsumer<T>::Interface *_if;
+    size_t _max;
+    Sm _sm;
+};
+
+}
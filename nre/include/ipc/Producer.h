@@ -75,13 +75,7 @@ public:
      */
     void next() {
         _if->wpos = (_if->wpos + 1) & (_max - 1);
-        Sync::memory_barrier();
-        try {
-            _sm.up();
-        }
-        catch(...) {
-            // if the client closed the session, we might get here. so, just ignore it.
-        }
+        notify();
     }
 
     /**
@@ -100,7 +94,36 @@ public:
         return slot != 0;
     }
 
+    /**
+     * Produces as many items of <values> as there are free slots, but at most <count>. In contrast
+     * to calling produce() for each item, the consumer is notified only once for the whole batch.
+     *
+     * @param values the items
+     * @param count the number of items
+     * @return the number of produced items
+     */
+    size_t produce_batch(const T *values, size_t count) {
+        size_t n = 0;
+        for(T *slot; n < count && (slot = current()) != 0; ++n) {
+            *slot = values[n];
+            _if->wpos = (_if->wpos + 1) & (_max - 1);
+        }
+        if(n > 0)
+            notify();
+        return n;
+    }
+
 private:
+    void notify() {
+        Sync::memory_barrier();
+        try {
+            _sm.up();
+        }
+        catch(...) {
+            // if the client closed the session, we might get here. so, just ignore it.
+        }
+    }
+
     DataSpace *_ds;
     typename Consumer<T>::Interface * _if;
     size_t _max;
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <kobj/Pt.h>
+#include <utcb/UtcbFrame.h>
+#include <Compiler.h>
+#include <Exception.h>
+#include <String.h>
+
+namespace nre {
+
+/**
+ * Marks an unused argument of Args
+ */
+struct NoArg {
+};
+
+/**
+ * A capability that is delegated along with a call. The client specifies the selector and the
+ * hotspot, the server receives the selector in its delegation window.
+ */
+struct Delegation {
+    explicit Delegation(capsel_t sel = 0, uintptr_t hotspot = CapRange::NO_HOTSPOT)
+        : sel(sel), hotspot(hotspot) {
+    }
+
+    capsel_t sel;
+    uintptr_t hotspot;
+};
+
+/**
+ * Describes how an argument of type T is transferred by Protocol. By default, the object is
+ * transferred as defined by UtcbTraits<T>. If FIXED is true, the object occupies exactly WORDS
+ * words, so that put() and get() can be used to access the message directly.
+ */
+template<typename T>
+struct ProtocolArg {
+    static const size_t COUNT   = 1;
+    static const bool FIXED     = UtcbTraits<T>::FIXED;
+    static const size_t WORDS   = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t);
+
+    static void put(UtcbFrameRef &, word_t *msg, const T &value) {
+        UtcbTraits<T>::write(msg, value);
+    }
+    static void get(UtcbFrameRef &, const word_t *msg, T &value) {
+        UtcbTraits<T>::read(msg, value);
+    }
+    static void write(UtcbFrameRef &uf, const T &value) {
+        uf << value;
+    }
+    static void read(UtcbFrameRef &uf, T &value) {
+        uf >> value;
+    }
+};
+
+template<>
+struct ProtocolArg<NoArg> {
+    static const size_t COUNT   = 0;
+    static const bool FIXED     = true;
+    static const size_t WORDS   = 0;
+
+    static void put(UtcbFrameRef &, word_t *, const NoArg &) {
+    }
+    static void get(UtcbFrameRef &, const word_t *, NoArg &) {
+    }
+    static void write(UtcbFrameRef &, const NoArg &) {
+    }
+    static void read(UtcbFrameRef &, NoArg &) {
+    }
+};
+
+/**
+ * Delegations are typed items, i.e. they don't occupy untyped words
+ */
+template<>
+struct ProtocolArg<Delegation> {
+    static const size_t COUNT   = 1;
+    static const bool FIXED     = true;
+    static const size_t WORDS   = 0;
+
+    static void put(UtcbFrameRef &uf, word_t *, const Delegation &value) {
+        write(uf, value);
+    }
+    static void get(UtcbFrameRef &uf, const word_t *, Delegation &value) {
+        read(uf, value);
+    }
+    static void write(UtcbFrameRef &uf, const Delegation &value) {
+        uf.delegate(value.sel, value.hotspot);
+    }
+    static void read(UtcbFrameRef &uf, Delegation &value) {
+        value = Delegation(uf.get_delegated(0).offset());
+    }
+};
+
+template<>
+struct ProtocolArg<String> {
+    static const size_t COUNT   = 1;
+    static const bool FIXED     = false;
+    static const size_t WORDS   = 0;
+
+    static void write(UtcbFrameRef &uf, const String &value) {
+        uf << value;
+    }
+    static void read(UtcbFrameRef &uf, String &value) {
+        uf >> value;
+    }
+};
+
+/**
+ * Note that a received StringView points into the UTCB (see UtcbFrameRef::operator>>)
+ */
+template<>
+struct ProtocolArg<StringView> {
+    static const size_t COUNT   = 1;
+    static const bool FIXED     = false;
+    static const size_t WORDS   = 0;
+
+    static void write(UtcbFrameRef &uf, const StringView &value) {
+        uf << value;
+    }
+    static void read(UtcbFrameRef &uf, StringView &value) {
+        uf >> value;
+    }
+};
+
+/**
+ * The argument list of a method, i.e. either the input or the output of it. Unused arguments are
+ * NoArg. If all arguments have a fixed size, the size of the message is known at compile-time
+ * and is checked at once.
+ */
+template<typename T1 = NoArg, typename T2 = NoArg, typename T3 = NoArg, typename T4 = NoArg>
+struct Args {
+    typedef T1 type1;
+    typedef T2 type2;
+    typedef T3 type3;
+    typedef T4 type4;
+
+    static const size_t COUNT   = ProtocolArg<T1>::COUNT + ProtocolArg<T2>::COUNT +
+                                  ProtocolArg<T3>::COUNT + ProtocolArg<T4>::COUNT;
+    static const bool FIXED     = ProtocolArg<T1>::FIXED && ProtocolArg<T2>::FIXED &&
+                                  ProtocolArg<T3>::FIXED && ProtocolArg<T4>::FIXED;
+    static const size_t WORDS   = ProtocolArg<T1>::WORDS + ProtocolArg<T2>::WORDS +
+                                  ProtocolArg<T3>::WORDS + ProtocolArg<T4>::WORDS;
+
+    explicit Args() : a1(), a2(), a3(), a4() {
+    }
+
+    T1 a1;
+    T2 a2;
+    T3 a3;
+    T4 a4;
+};
+
+/**
+ * Describes a method of a protocol, i.e. the command <ID> that receives <IN> and replies <OUT>.
+ * Methods are typically defined as typedefs in the class that holds the types of a service:
+ *   typedef Method<GET_TIME, Args<>, Args<timevalue_t, timevalue_t> > GetTime;
+ */
+template<word_t ID, class IN = Args<>, class OUT = Args<> >
+struct Method {
+    static const word_t CMD = ID;
+    typedef IN In;
+    typedef OUT Out;
+};
+
+/**
+ * Marshals the messages of methods and provides the client stubs for them. On the wire, the
+ * request consists of the command, followed by the input arguments, and the reply consists of
+ * the ErrorCode, followed by the output arguments (or the exception).
+ *
+ * Usage on the client side:
+ *   UtcbFrame uf;
+ *   Timer::GetTime::Out res = Protocol::call<Timer::GetTime>(pt, uf);
+ * The UtcbFrame is passed in, so that you can add a delegation window or further typed items,
+ * and received StringViews stay valid as long as the frame exists.
+ * On the service side, see ProtocolDispatcher.
+ */
+class Protocol {
+    template<class S, size_t COUNT>
+    friend class ProtocolDispatcher;
+
+    template<bool B>
+    struct Fixed {
+    };
+
+public:
+    /**
+     * Calls the method M via <pt>. There is one overload for every number of input arguments.
+     *
+     * @param pt the portal
+     * @param uf the frame to use
+     * @return the output arguments
+     * @throws Exception if the service replied an error or the reply is invalid
+     */
+    template<class M>
+    static typename M::Out call(Pt &pt, UtcbFrame &uf) {
+        STATIC_ASSERT(M::In::COUNT == 0);
+        return transfer<M>(pt, uf, NoArg(), NoArg(), NoArg(), NoArg());
+    }
+    template<class M>
+    static typename M::Out call(Pt &pt, UtcbFrame &uf, const typename M::In::type1 &a1) {
+        STATIC_ASSERT(M::In::COUNT == 1);
+        return transfer<M>(pt, uf, a1, NoArg(), NoArg(), NoArg());
+    }
+    template<class M>
+    static typename M::Out call(Pt &pt, UtcbFrame &uf, const typename M::In::type1 &a1,
+                                const typename M::In::type2 &a2) {
+        STATIC_ASSERT(M::In::COUNT == 2);
+        return transfer<M>(pt, uf, a1, a2, NoArg(), NoArg());
+    }
+    template<class M>
+    static typename M::Out call(Pt &pt, UtcbFrame &uf, const typename M::In::type1 &a1,
+                                const typename M::In::type2 &a2, const typename M::In::type3 &a3) {
+        STATIC_ASSERT(M::In::COUNT == 3);
+        return transfer<M>(pt, uf, a1, a2, a3, NoArg());
+    }
+    template<class M>
+    static typename M::Out call(Pt &pt, UtcbFrame &uf, const typename M::In::type1 &a1,
+                                const typename M::In::type2 &a2, const typename M::In::type3 &a3,
+                                const typename M::In::type4 &a4) {
+        STATIC_ASSERT(M::In::COUNT == 4);
+        return transfer<M>(pt, uf, a1, a2, a3, a4);
+    }
+
+private:
+    template<class M>
+    static typename M::Out transfer(Pt &pt, UtcbFrame &uf, const typename M::In::type1 &a1,
+                                    const typename M::In::type2 &a2,
+                                    const typename M::In::type3 &a3,
+                                    const typename M::In::type4 &a4) {
+        typedef typename M::In In;
+        write<In>(uf, M::CMD, a1, a2, a3, a4, Fixed<In::FIXED>());
+        pt.call(uf);
+        typename M::Out out;
+        read_reply(uf, out);
+        return out;
+    }
+
+    template<class S, class M,
+             void (*FUNC)(S*, UtcbFrameRef&, const typename M::In&, typename M::Out&)>
+    static void handle(S *sess, UtcbFrameRef &uf) {
+        typedef typename M::Out Out;
+        typename M::In in;
+        read(uf, in, Fixed<M::In::FIXED>());
+        uf.finish_input();
+
+        Out out;
+        FUNC(sess, uf, in, out);
+        write<Out>(uf, E_SUCCESS, out.a1, out.a2, out.a3, out.a4, Fixed<Out::FIXED>());
+    }
+
+    static word_t command(UtcbFrameRef &uf) {
+        return *uf.fetch_untyped(1);
+    }
+
+    template<class ARGS>
+    static void read_reply(UtcbFrameRef &uf, ARGS &args) {
+        const ErrorCode *res = reinterpret_cast<const ErrorCode*>(uf.fetch_untyped(1));
+        if(EXPECT_FALSE(*res != E_SUCCESS)) {
+            // let check_reply() throw the appropriate exception
+            uf._upos = 0;
+            uf.check_reply();
+        }
+        read(uf, args, Fixed<ARGS::FIXED>());
+    }
+
+    // the size of the message is known; reserve it at once and access the message directly
+    template<class ARGS>
+    static void write(UtcbFrameRef &uf, word_t first, const typename ARGS::type1 &a1,
+                      const typename ARGS::type2 &a2, const typename ARGS::type3 &a3,
+                      const typename ARGS::type4 &a4, Fixed<true>) {
+        word_t *msg = uf.reserve_untyped(1 + ARGS::WORDS);
+        *msg++ = first;
+        ProtocolArg<typename ARGS::type1>::put(uf, msg, a1);
+        msg += ProtocolArg<typename ARGS::type1>::WORDS;
+        ProtocolArg<typename ARGS::type2>::put(uf, msg, a2);
+        msg += ProtocolArg<typename ARGS::type2>::WORDS;
+        ProtocolArg<typename ARGS::type3>::put(uf, msg, a3);
+        msg += ProtocolArg<typename ARGS::type3>::WORDS;
+        ProtocolArg<typename ARGS::type4>::put(uf, msg, a4);
+    }
+    template<class ARGS>
+    static void write(UtcbFrameRef &uf, word_t first, const typename ARGS::type1 &a1,
+                      const typename ARGS::type2 &a2, const typename ARGS::type3 &a3,
+                      const typename ARGS::type4 &a4, Fixed<false>) {
+        uf << first;
+        ProtocolArg<typename ARGS::type1>::write(uf, a1);
+        ProtocolArg<typename ARGS::type2>::write(uf, a2);
+        ProtocolArg<typename ARGS::type3>::write(uf, a3);
+        ProtocolArg<typename ARGS::type4>::write(uf, a4);
+    }
+
+    // the remaining message has to have exactly the expected size
+    template<class ARGS>
+    static void read(UtcbFrameRef &uf, ARGS &args, Fixed<true>) {
+        if(EXPECT_FALSE(uf.untyped() - uf._upos != ARGS::WORDS))
+            throw UtcbException(E_UTCB_UNTYPED);
+        const word_t *msg = uf.fetch_untyped(ARGS::WORDS);
+        ProtocolArg<typename ARGS::type1>::get(uf, msg, args.a1);
+        msg += ProtocolArg<typename ARGS::type1>::WORDS;
+        ProtocolArg<typename ARGS::type2>::get(uf, msg, args.a2);
+        msg += ProtocolArg<typename ARGS::type2>::WORDS;
+        ProtocolArg<typename ARGS::type3>::get(uf, msg, args.a3);
+        msg += ProtocolArg<typename ARGS::type3>::WORDS;
+        ProtocolArg<typename ARGS::type4>::get(uf, msg, args.a4);
+    }
+    template<class ARGS>
+    static void read(UtcbFrameRef &uf, ARGS &args, Fixed<false>) {
+        ProtocolArg<typename ARGS::type1>::read(uf, args.a1);
+        ProtocolArg<typename ARGS::type2>::read(uf, args.a2);
+        ProtocolArg<typename ARGS::type3>::read(uf, args.a3);
+        ProtocolArg<typename ARGS::type4>::read(uf, args.a4);
+    }
+
+    Protocol();
+};
+
+/**
+ * The dispatch table for the portal of a service with the session type S and the commands
+ * 0..COUNT-1. The handlers are registered once with add() and dispatch() is called in the portal:
+ *   PORTAL static void portal(capsel_t pid) {
+ *       UtcbFrameRef uf;
+ *       try {
+ *           dispatcher.dispatch(srv->get_session<MySession>(pid), uf);
+ *       }
+ *       catch(const Exception &e) {
+ *           uf.clear();
+ *           uf << e;
+ *       }
+ *   }
+ * dispatch() reads and checks the input arguments and the delegated capabilities, finishes the
+ * input, calls the handler and replies E_SUCCESS and the output arguments. That is, the handler
+ * only has to do the work. It may add typed items to the reply, but no untyped items.
+ */
+template<class S, size_t COUNT>
+class ProtocolDispatcher {
+    typedef void (*handler_func)(S *sess, UtcbFrameRef &uf);
+
+public:
+    explicit ProtocolDispatcher() : _handlers() {
+    }
+
+    /**
+     * Registers FUNC as the handler for method M. Note that FUNC has to have external linkage,
+     * e.g., it can be a static member function.
+     */
+    template<class M, void (*FUNC)(S*, UtcbFrameRef&, const typename M::In&, typename M::Out&)>
+    void add() {
+        STATIC_ASSERT(M::CMD < COUNT);
+        _handlers[M::CMD] = &Protocol::handle<S, M, FUNC>;
+    }
+
+    /**
+     * Handles the request in <uf> for the session <sess>
+     *
+     * @param sess the session
+     * @param uf the frame of the request
+     * @throws Exception if the command is unknown, the request is invalid or the handler failed
+     */
+    void dispatch(S *sess, UtcbFrameRef &uf) const {
+        word_t cmd = Protocol::command(uf);
+        if(EXPECT_FALSE(cmd >= COUNT || !_handlers[cmd]))
+            throw Exception(E_ARGS_INVALID, 32, "Invalid command %lu", cmd);
+        _handlers[cmd](sess, uf);
+    }
+
+private:
+    handler_func _handlers[COUNT];
+};
+
+}
@@ -48,11 +48,14 @@ public:
     /**
      * Destroyes this session
      */
-    virtual ~ServiceSession() {
-        for(uint i = 0; i < CPU::count(); ++i)
-            delete _pts[i];
-        delete[] _pts;
-    }
+    virtual ~ServiceSession();
+
+    /**
+     * Sessions of exactly this class are allocated from a pool, because services without own
+     * session-data create them frequently. Subclasses are allocated on the heap.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
 
     /**
      * @return the session-id
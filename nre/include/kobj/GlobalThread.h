@@ -102,8 +102,10 @@ public:
      *
      * @param qpd the qpd to use
      * @param pd the pd to start the thread in
+     * @param res the CPU reservation to request (none by default)
+     * @throws Exception if a hard reservation can't be granted
      */
-    void start(Qpd qpd = Qpd(), Pd *pd = Pd::current());
+    void start(Qpd qpd = Qpd(), Pd *pd = Pd::current(), const Reservation &res = Reservation());
 
 private:
     explicit GlobalThread(uintptr_t uaddr, capsel_t gt, capsel_t sc, cpu_t cpu, Pd *pd, uintptr_t stack);
@@ -21,6 +21,7 @@
 #include <kobj/LocalThread.h>
 #include <utcb/UtcbFrame.h>
 #include <util/ScopedCapSels.h>
+#include <util/Trace.h>
 #include <Syscalls.h>
 
 namespace nre {
@@ -83,7 +84,9 @@ public:
      * @param uf the UtcbFrame
      */
     void call(UtcbFrame &uf) {
+        TRACE_BEGIN(IPC_CALL, sel());
         Syscalls::call(sel());
+        TRACE_END(IPC_CALL, sel());
         uf._upos = 0;
         uf._tpos = 0;
     }
@@ -39,6 +39,17 @@ public:
         STOP
     };
 
+    /**
+     * The priority bands, i.e. the priorities that the Scs get. The parent puts all Scs of a child
+     * into the band of the child (or lower), so that guests can't starve the system services.
+     * This holds for Scs with a reservation as well. Qpd priority 0 requests the band of the Pd.
+     */
+    enum Band {
+        BAND_PD         = 0,
+        BAND_GUEST      = 1,
+        BAND_SERVICE    = 2
+    };
+
     /**
      * @return the ec it is bound to
      */
@@ -51,6 +62,12 @@ public:
     Qpd qpd() const {
         return _qpd;
     }
+    /**
+     * @return the reservation (might be changed by start(), i.e. dropped if it has been demoted)
+     */
+    const Reservation &reservation() const {
+        return _res;
+    }
     /**
      * @return the protection-domain it belongs to
      */
@@ -68,7 +85,8 @@ private:
      * @param pd the protection domain
      */
     explicit Sc(GlobalThread *gt, capsel_t sel, Pd *pd)
-        : ObjCap(sel, ObjCap::KEEP_SEL_BIT | ObjCap::KEEP_CAP_BIT), _ec(gt), _qpd(), _pd(pd) {
+        : ObjCap(sel, ObjCap::KEEP_SEL_BIT | ObjCap::KEEP_CAP_BIT), _ec(gt), _qpd(), _res(),
+          _pd(pd) {
     }
     /**
      * Creates a new Sc that is bound to the given GlobalThread. Note that it does NOT start it. Please
@@ -77,9 +95,11 @@ private:
      * @param ec the GlobalThread to bind it to
      * @param qpd the quantum-priority descriptor for the Sc
      * @param pd the pd to create it in
+     * @param res the CPU reservation to request
      */
-    explicit Sc(GlobalThread *ec, Qpd qpd, Pd *pd = Pd::current())
-        : ObjCap(), _ec(ec), _qpd(qpd), _pd(pd) {
+    explicit Sc(GlobalThread *ec, Qpd qpd, Pd *pd = Pd::current(),
+                const Reservation &res = Reservation())
+        : ObjCap(), _ec(ec), _qpd(qpd), _res(res), _pd(pd) {
         // don't create the Sc here, because then we have no chance to store the created object
         // somewhere to make it accessible for the just started Thread
     }
@@ -89,9 +109,10 @@ private:
      *
      * @param vcpu the VCPU to bind it to
      * @param qpd the quantum-priority descriptor for the Sc
+     * @param res the CPU reservation to request
      */
-    explicit Sc(VCpu *vcpu, Qpd qpd)
-        : ObjCap(), _ec(vcpu), _qpd(qpd), _pd(Pd::current()) {
+    explicit Sc(VCpu *vcpu, Qpd qpd, const Reservation &res = Reservation())
+        : ObjCap(), _ec(vcpu), _qpd(qpd), _res(res), _pd(Pd::current()) {
     }
     /**
      * Destructor. Stops the associated thread.
@@ -108,6 +129,7 @@ private:
 
     Ec *_ec;
     Qpd _qpd;
+    Reservation _res;
     Pd *_pd;
 };
 
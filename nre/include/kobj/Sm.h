@@ -69,6 +69,23 @@ public:
     void down() {
         Syscalls::sm_ctrl(sel(), Syscalls::SM_DOWN);
     }
+    /**
+     * Performs a down on this semaphore, but blocks at most until <timeout>.
+     *
+     * @param timeout the absolute time in TSC ticks
+     * @return true if the down succeeded, false if the timeout has been reached
+     */
+    bool down(uint64_t timeout) {
+        try {
+            Syscalls::sm_ctrl(sel(), Syscalls::SM_DOWN, timeout);
+            return true;
+        }
+        catch(const SyscallException &e) {
+            if(e.code() != E_TIMEOUT)
+                throw;
+            return false;
+        }
+    }
 
     /**
      * Performs a zero on this semaphore. That is, if the value of it is zero, it will block until
@@ -65,8 +65,10 @@ public:
      * Starts this vcpu with given quantum-priority-descriptor
      *
      * @param qpd the qpd to use
+     * @param res the CPU reservation to request (none by default)
+     * @throws Exception if a hard reservation can't be granted
      */
-    void start(Qpd qpd = Qpd());
+    void start(Qpd qpd = Qpd(), const Reservation &res = Reservation());
 
 private:
     Sc *_sc;
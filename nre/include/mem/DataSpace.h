@@ -60,6 +60,11 @@ public:
      * @throws DataSpaceException if the creation failed
      */
     static void create(DataSpaceDesc &desc, capsel_t *sel = 0, capsel_t *unmapsel = 0);
+    /**
+     * Destroys the dataspace that has been created by create(desc, sel, unmapsel) and frees the
+     * selectors. This function is only intended for the malloc-backend, too.
+     */
+    static void destroy(DataSpaceDesc &desc, capsel_t sel, capsel_t unmapsel);
 
     /**
      * Creates a new dataspace with given properties
@@ -146,6 +151,8 @@ public:
      * Copies the contents of this dataspace into <dest> and swaps this.desc().origin() with
      * <dest>.desc().origin(). That means, afterwards this will access the memory of <dest> and
      * the other way around.
+     *
+     * @param dest the dataspace to switch with
      */
     void switch_to(DataSpace &dest);
 
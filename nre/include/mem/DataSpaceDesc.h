@@ -43,13 +43,24 @@ public:
         RW          = R | W,
         RX          = R | X,
         RWX         = R | W | X,
-        BIGPAGES    = 1 << 3,   // use 4M pages; requires an align to 4M
+        BIGPAGES    = 1 << 3,   // use 4M pages; requires an align to 4M (set by root for large
+                                // anonymous dataspaces, if possible)
+    };
+    /**
+     * Besides a node id, the following NUMA placements can be requested for anonymous memory
+     */
+    enum Placement {
+        NODE_ANY        = -1,   // no preference
+        NODE_LOCAL      = -2,   // the node of the CPU the dataspace is created on
+        NODE_INTERLEAVE = -3,   // distribute the dataspaces round-robin over all nodes. since the
+                                // memory of a dataspace is contiguous, this is done per dataspace
     };
 
     /**
      * Creates an empty descriptor
      */
-    explicit DataSpaceDesc() : _virt(), _phys(), _origin(), _size(), _align(), _flags(), _type() {
+    explicit DataSpaceDesc()
+        : _virt(), _phys(), _origin(), _size(), _align(), _flags(), _type(), _node(NODE_ANY) {
     }
     /**
      * Creates a descriptor from given parameters
@@ -61,11 +72,12 @@ public:
      * @param virt the virtual address (ignored)
      * @param origin the origin of the memory (only used by the dataspace infrastructure)
      * @param align the alignment in order of pages, i.e. 2^<align> * PAGE_SIZE
+     * @param node the NUMA node or placement to request (see Placement)
      */
     explicit DataSpaceDesc(size_t size, Type type, uint flags, uintptr_t phys = 0, uintptr_t virt = 0,
-                           uintptr_t origin = 0, uint align = 0)
+                           uintptr_t origin = 0, uint align = 0, int node = NODE_ANY)
         : _virt(virt), _phys(phys), _origin(origin), _size(size), _align(align), _flags(flags),
-          _type(type) {
+          _type(type), _node(node) {
     }
 
     /**
@@ -138,6 +150,17 @@ public:
         _type = type;
     }
 
+    /**
+     * The NUMA node. When creating a dataspace, it is the requested node or Placement. Afterwards,
+     * it is the node the memory has been taken from (NODE_ANY if unknown, e.g. for device memory).
+     */
+    int node() const {
+        return _node;
+    }
+    void node(int node) {
+        _node = node;
+    }
+
 private:
     uintptr_t _virt;
     uintptr_t _phys;
@@ -146,12 +169,14 @@ private:
     uint _align;
     uint _flags;
     Type _type;
+    int _node;
 };
 
 static inline OStream &operator<<(OStream &os, const DataSpaceDesc &desc) {
-    os.writef("virt=%p phys=%p size=%zu org=%p flags=%#x align=%u",
+    os.writef("virt=%p phys=%p size=%zu org=%p flags=%#x align=%u node=%d",
               reinterpret_cast<void*>(desc.virt()), reinterpret_cast<void*>(desc.phys()),
-              desc.size(), reinterpret_cast<void*>(desc.origin()), desc.flags(), desc.align());
+              desc.size(), reinterpret_cast<void*>(desc.origin()), desc.flags(), desc.align(),
+              desc.node());
     return os;
 }
 
@@ -83,6 +83,22 @@ public:
         return start;
     }
 
+    uintptr_t alloc_in(uintptr_t begin, uintptr_t end, size_t size, size_t align = 1) {
+        for(size_t i = 0; i < MAX_REGIONS; ++i) {
+            if(_regs[i].size < size)
+                continue;
+            uintptr_t rend = Math::min<uintptr_t>(_regs[i].addr + _regs[i].size, end);
+            uintptr_t start = Math::max<uintptr_t>(_regs[i].addr, begin);
+            start = (start + align - 1) & ~(align - 1);
+            if(start >= begin && start < rend && rend - start >= size) {
+                remove_from(_regs + i, start, size);
+                return start;
+            }
+        }
+        throw RegionManagerException(E_CAPACITY, 64, "Unable to allocate %zu bytes in %p..%p",
+                                     size, begin, end);
+    }
+
     void alloc_region(uintptr_t addr, size_t size) {
         Region *r = get(addr, size, true);
         if(!r)
@@ -21,6 +21,7 @@
 #include <ipc/PtClientSession.h>
 #include <services/PCIConfig.h>
 #include <mem/DataSpace.h>
+#include <util/NUMA.h>
 #include <utcb/UtcbFrame.h>
 #include <Exception.h>
 #include <CPU.h>
@@ -40,6 +41,7 @@ public:
         FIND_TABLE,
         IRQ_TO_GSI,
         GET_GSI,
+        GET_NUMA,
     };
 
     /**
@@ -137,6 +139,21 @@ public:
         return gsi;
     }
 
+    /**
+     * Determines the NUMA topology from the SRAT and SLIT. If there is no SRAT, the topology
+     * consists of a single node.
+     *
+     * @param info will be set to the topology
+     */
+    void get_numa(NUMA::Info &info) const {
+        UtcbFrame uf;
+        uf << ACPI::GET_NUMA;
+        pt().call(uf);
+
+        uf.check_reply();
+        uf >> info;
+    }
+
 private:
     void get_mem() {
         UtcbFrame uf;
@@ -18,9 +18,14 @@
 
 #include <arch/Types.h>
 #include <kobj/Pt.h>
+#include <kobj/Sm.h>
 #include <ipc/ClientSession.h>
 #include <ipc/Connection.h>
+#include <ipc/Protocol.h>
 #include <services/Keyboard.h>
+#include <util/Atomic.h>
+#include <util/Math.h>
+#include <util/ScopedCapSels.h>
 #include <Hip.h>
 
 namespace nre {
@@ -41,6 +46,7 @@ public:
     static const size_t TEXT_OFF        = 0x18000;
     static const size_t TEXT_PAGES      = 8;
     static const size_t PAGE_SIZE       = 0x1000;
+    static const size_t CTRL_OFF        = PAGE_SIZE - 0x100;
     static const size_t SUBCONS         = 32;
 
     /**
@@ -49,11 +55,40 @@ public:
     enum Command {
         CREATE,
         GET_REGS,
-        SET_REGS
+        SET_REGS,
+        GET_MODEINFO,
+        COMMAND_COUNT
     };
 
     /**
-     * Specifies attributes for the console
+     * Describes a mode of the console. Mode 0 is always the text mode. The other ones are linear
+     * framebuffer modes, whose framebuffer starts at the beginning of the output dataspace.
+     */
+    struct ModeInfo {
+        uint16_t vesa_mode;         // the VESA mode number
+        uint16_t width;             // in pixels (or columns)
+        uint16_t height;            // in pixels (or rows)
+        uint16_t bpp;               // bits per pixel (0 for the text mode)
+        uint32_t bytes_per_line;
+    };
+
+    /**
+     * The control block at CTRL_OFF in the input dataspace, by which clients announce the changes
+     * of their text pages. If <notify> is NOTIFY_MAGIC, the console repaints only the rows that are
+     * marked in <dirty> (one bit per row and one word per page) and only when being signaled.
+     * Otherwise, it polls the screen while the session has no direct access to it. Graphic modes
+     * are always polled. It's behind the packet ring, which leaves the end of the page free,
+     * because it has a power of two entries. Note that it can't be in the output dataspace,
+     * because that is swapped with the screen memory while the session has direct access.
+     */
+    struct Control {
+        volatile uint32_t notify;
+        volatile uint32_t dirty[TEXT_PAGES];
+    };
+    static const uint32_t NOTIFY_MAGIC  = 0x59544f4e;
+
+    /**
+     * Specifies attributes for the console. <mode> is the index of the mode (see ModeInfo).
      */
     struct Register {
         uint16_t mode;
@@ -62,6 +97,15 @@ public:
         size_t offset;
     };
 
+    /**
+     * The methods. CREATE expects the dataspace for the input and the one for the output and
+     * replies the semaphore of the session to signal changes with (see Control)
+     */
+    typedef Method<CREATE, Args<Delegation, Delegation, size_t, String>, Args<Delegation> > Create;
+    typedef Method<GET_REGS, Args<>, Args<Register> > GetRegs;
+    typedef Method<SET_REGS, Args<Register> > SetRegs;
+    typedef Method<GET_MODEINFO, Args<size_t>, Args<ModeInfo> > GetModeInfo;
+
     /**
      * A packet that we receive from the console
      */
@@ -88,12 +132,24 @@ public:
      * @param con the connection
      * @param console the console to attach to
      * @param title the subconsole title
+     * @param fbsize the minimum size of the output dataspace, i.e. the framebuffer that is
+     *  required for the graphic modes you want to use
      */
-    explicit ConsoleSession(Connection &con, size_t console, const String &title)
+    explicit ConsoleSession(Connection &con, size_t console, const String &title, size_t fbsize = 0)
         : ClientSession(con), _in_ds(IN_DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
-          _out_ds(OUT_DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), _consumer(&_in_ds, true) {
+          _out_ds(Math::max(OUT_DS_SIZE, Math::round_up(fbsize, ExecEnv::PAGE_SIZE)),
+                  DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+          _consumer(&_in_ds, true), _sm() {
+        assert(sizeof(size_t) * 2 + _consumer.rblength() * sizeof(Console::ReceivePacket) <=
+               Console::CTRL_OFF);
+        memset(control(), 0, sizeof(Console::Control));
         create(console, title);
     }
+    virtual ~ConsoleSession() {
+        capsel_t sel = _sm->sel();
+        delete _sm;
+        CapSelSpace::get().free(sel);
+    }
 
     /**
      * @return the screen memory (might be directly mapped or buffered)
@@ -111,6 +167,35 @@ public:
         assert(page < Console::TEXT_PAGES);
         uintptr_t addr = screen().virt() + Console::TEXT_OFF + page * Console::PAGE_SIZE;
         memset(reinterpret_cast<void*>(addr),   0, Console::PAGE_SIZE);
+        mark_dirty(page, 0, Console::ROWS);
+    }
+
+    /**
+     * Tells the console that all changes of the text pages are announced via mark_dirty(), so
+     * that it doesn't need to poll the screen. Note that ConsoleStream and clear() do that, but
+     * if you write to screen() directly, you have to do it yourself.
+     */
+    void enable_notify() {
+        control()->notify = Console::NOTIFY_MAGIC;
+    }
+
+    /**
+     * Marks the rows <first>..<first>+<count>-1 of the text page <page> as changed. The console
+     * is only signaled if it has already repainted the previous changes, so that consecutive
+     * changes are coalesced. Does nothing if enable_notify() hasn't been called.
+     *
+     * @param page the text page
+     * @param first the first row
+     * @param count the number of rows
+     */
+    void mark_dirty(uint page, uint first, uint count = 1) {
+        Console::Control *ctrl = control();
+        if(ctrl->notify != Console::NOTIFY_MAGIC)
+            return;
+        assert(page < Console::TEXT_PAGES && first + count <= Console::ROWS);
+        uint32_t rows = ((static_cast<uint32_t>(1) << count) - 1) << first;
+        if(Atomic::fetch_or(ctrl->dirty + page, rows) == 0)
+            _sm->up();
     }
 
     /**
@@ -120,13 +205,8 @@ public:
      */
     Console::Register get_regs() {
         UtcbFrame uf;
-        uf << Console::GET_REGS;
         Pt pt(caps() + CPU::current().log_id());
-        pt.call(uf);
-        uf.check_reply();
-        Console::Register regs;
-        uf >> regs;
-        return regs;
+        return Protocol::call<Console::GetRegs>(pt, uf).a1;
     }
 
     /**
@@ -136,10 +216,22 @@ public:
      */
     void set_regs(const Console::Register &regs) {
         UtcbFrame uf;
-        uf << Console::SET_REGS << regs;
         Pt pt(caps() + CPU::current().log_id());
-        pt.call(uf);
-        uf.check_reply();
+        Protocol::call<Console::SetRegs>(pt, uf, regs);
+    }
+
+    /**
+     * Requests information about the given mode. Note that the framebuffer of the mode might be
+     * larger than the output dataspace of this session.
+     *
+     * @param mode the mode index
+     * @return the mode information
+     * @throws Exception if the mode does not exist
+     */
+    Console::ModeInfo get_mode_info(size_t mode) {
+        UtcbFrame uf;
+        Pt pt(caps() + CPU::current().log_id());
+        return Protocol::call<Console::GetModeInfo>(pt, uf, mode).a1;
     }
 
     /**
@@ -163,21 +255,40 @@ public:
         _consumer.next();
         return res;
     }
+    /**
+     * Receives up to <max> packets at once. I.e. it waits until at least one packet arrives.
+     *
+     * @param pks the array to store the packets in
+     * @param max the size of the array
+     * @return the number of received packets
+     * @throws Exception if it failed
+     */
+    size_t receive(Console::ReceivePacket *pks, size_t max) {
+        size_t count = _consumer.consume_batch(pks, max);
+        if(count == 0)
+            throw Exception(E_ABORT, "Unable to receive console packet");
+        return count;
+    }
 
 private:
+    Console::Control *control() {
+        return reinterpret_cast<Console::Control*>(_in_ds.virt() + Console::CTRL_OFF);
+    }
+
     void create(size_t console, const String &title) {
         UtcbFrame uf;
-        uf << Console::CREATE << console << title;
-        uf.delegate(_in_ds.sel(), 0);
-        uf.delegate(_out_ds.sel(), 1);
+        ScopedCapSels cap;
+        uf.delegation_window(Crd(cap.get(), 0, Crd::OBJ_ALL));
         Pt pt(caps() + CPU::current().log_id());
-        pt.call(uf);
-        uf.check_reply();
+        Protocol::call<Console::Create>(pt, uf, Delegation(_in_ds.sel(), 0),
+                                        Delegation(_out_ds.sel(), 1), console, title);
+        _sm = new Sm(cap.release(), true);
     }
 
     DataSpace _in_ds;
     DataSpace _out_ds;
     Consumer<Console::ReceivePacket> _consumer;
+    Sm *_sm;
 };
 
 }
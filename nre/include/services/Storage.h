@@ -19,7 +19,8 @@
 #include <arch/Types.h>
 #include <ipc/Connection.h>
 #include <ipc/PtClientSession.h>
-#include <ipc/Consumer.h>
+#include <ipc/Protocol.h>
+#include <ipc/MPConsumer.h>
 #include <utcb/UtcbFrame.h>
 #include <util/DMA.h>
 #include <Exception.h>
@@ -49,6 +50,8 @@ public:
         READ,
         WRITE,
         FLUSH,
+        ADD_QUEUE,
+        COMMAND_COUNT
     };
 
     /**
@@ -73,21 +76,85 @@ public:
         tag_type tag;
         uint status;
 
+        explicit Packet() : tag(), status() {
+        }
         explicit Packet(tag_type tag, uint status) : tag(tag), status(status) {
         }
     };
 
+    /**
+     * The methods. INIT expects the dataspace for the control channel and the one for the data.
+     * ADD_QUEUE expects a dataspace for the completions of the commands that are submitted on the
+     * given CPU; the commands of all other CPUs complete on the control channel.
+     */
+    typedef Method<INIT, Args<Delegation, Delegation, size_t>, Args<Parameter> > Init;
+    typedef Method<READ, Args<tag_type, sector_type, dma_type> > Read;
+    typedef Method<WRITE, Args<tag_type, sector_type, dma_type> > Write;
+    typedef Method<FLUSH, Args<tag_type> > Flush;
+    typedef Method<ADD_QUEUE, Args<Delegation, cpu_t> > AddQueue;
+
 private:
     Storage();
 };
 
 /**
- * Represents a session at the storage service
+ * Transfers the name of the drive only up to its end
+ */
+template<>
+struct UtcbTraits<Storage::Parameter> {
+    static const bool FIXED         = false;
+    static const size_t NAME_SIZE   = sizeof(static_cast<Storage::Parameter*>(0)->name);
+    // the name is the last member
+    static const size_t HEAD_SIZE   = sizeof(Storage::Parameter) - NAME_SIZE;
+    static const size_t HEAD_WORDS  = (HEAD_SIZE + sizeof(word_t) - 1) / sizeof(word_t);
+
+    static size_t words(const Storage::Parameter &p) {
+        return HEAD_WORDS + UtcbTraitsBase::array_words(name_len(p), 1);
+    }
+    static size_t words(const word_t *msg, size_t avail) {
+        if(avail < HEAD_WORDS)
+            return HEAD_WORDS + 1;
+        return HEAD_WORDS + UtcbTraitsBase::array_words(msg + HEAD_WORDS, avail - HEAD_WORDS,
+                                                        NAME_SIZE - 1, 1);
+    }
+    static void write(word_t *msg, const Storage::Parameter &p) {
+        memcpy(msg, &p, HEAD_SIZE);
+        UtcbTraitsBase::write_array(msg + HEAD_WORDS, p.name, name_len(p), 1);
+    }
+    static void read(const word_t *msg, Storage::Parameter &p) {
+        memcpy(&p, msg, HEAD_SIZE);
+        size_t len = UtcbTraitsBase::read_array(msg + HEAD_WORDS, p.name, 1);
+        p.name[len] = '\0';
+    }
+
+private:
+    static size_t name_len(const Storage::Parameter &p) {
+        size_t len = 0;
+        while(len < NAME_SIZE - 1 && p.name[len])
+            len++;
+        return len;
+    }
+};
+
+/**
+ * Represents a session at the storage service. Commands are submitted via the portal of the
+ * current CPU, i.e. on the CPU of the caller. By default, all commands complete on one queue. With
+ * per-CPU queues, each CPU gets its own completion queue, so that clients on multiple CPUs don't
+ * share a queue and the storage service doesn't need to synchronize them.
  */
 class StorageSession : public PtClientSession {
     typedef Storage::tag_type tag_type;
     typedef Storage::sector_type sector_type;
 
+    struct Queue {
+        explicit Queue()
+            : ds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW), cons(&ds, true) {
+        }
+
+        DataSpace ds;
+        MPConsumer<Storage::Packet> cons;
+    };
+
 public:
     /**
      * Creates a new session with given connection
@@ -95,19 +162,42 @@ public:
      * @param con the connection
      * @param ds the dataspace to use for data exchange
      * @param drive the drive
+     * @param percpu whether to create a completion queue for each CPU
      */
-    explicit StorageSession(Connection &con, DataSpace &ds, size_t drive)
+    explicit StorageSession(Connection &con, DataSpace &ds, size_t drive, bool percpu = false)
         : PtClientSession(con),
           _ctrlds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
-          _cons(&_ctrlds, true) {
-        init(ds, drive);
+          _cons(&_ctrlds, true), _queues(new Queue *[CPU::count()]) {
+        for(cpu_t cpu = 0; cpu < CPU::count(); ++cpu)
+            _queues[cpu] = 0;
+        try {
+            init(ds, drive);
+            if(percpu)
+                add_queues();
+        }
+        catch(...) {
+            destroy_queues();
+            throw;
+        }
+    }
+    virtual ~StorageSession() {
+        destroy_queues();
     }
 
     /**
-     * @return the consumer to get notified about finished commands
+     * @return the consumer to get notified about the finished commands that have been submitted
+     *  on the current CPU
      */
-    Consumer<Storage::Packet> &consumer() {
-        return _cons;
+    MPConsumer<Storage::Packet> &consumer() {
+        return consumer(CPU::current().log_id());
+    }
+    /**
+     * @param cpu the logical CPU id
+     * @return the consumer to get notified about the finished commands that have been submitted
+     *  on CPU <cpu>
+     */
+    MPConsumer<Storage::Packet> &consumer(cpu_t cpu) {
+        return _queues[cpu] ? _queues[cpu]->cons : _cons;
     }
 
     /**
@@ -124,9 +214,7 @@ public:
      */
     void flush(tag_type tag) {
         UtcbFrame uf;
-        uf << Storage::FLUSH << tag;
-        pt().call(uf);
-        uf.check_reply();
+        Protocol::call<Storage::Flush>(pt(), uf, tag);
     }
 
     /**
@@ -154,9 +242,7 @@ public:
      */
     void read(tag_type tag, sector_type sector, const Storage::dma_type &dma) {
         UtcbFrame uf;
-        uf << Storage::READ << tag << sector << dma;
-        pt().call(uf);
-        uf.check_reply();
+        Protocol::call<Storage::Read>(pt(), uf, tag, sector, dma);
     }
 
     /**
@@ -185,25 +271,36 @@ public:
      */
     void write(tag_type tag, sector_type sector, const Storage::dma_type &dma) {
         UtcbFrame uf;
-        uf << Storage::WRITE << tag << sector << dma;
-        pt().call(uf);
-        uf.check_reply();
+        Protocol::call<Storage::Write>(pt(), uf, tag, sector, dma);
     }
 
 private:
     void init(DataSpace &ds, size_t drive) {
         UtcbFrame uf;
-        uf.delegate(_ctrlds.sel(), 0);
-        uf.delegate(ds.sel(), 1);
-        uf << Storage::INIT << drive;
-        pt().call(uf);
-        uf.check_reply();
-        uf >> _params;
+        _params = Protocol::call<Storage::Init>(pt(), uf, Delegation(_ctrlds.sel(), 0),
+                                                Delegation(ds.sel(), 1), drive).a1;
     }
+    void add_queues() {
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
+            Queue *q = new Queue();
+            _queues[it->log_id()] = q;
+            UtcbFrame uf;
+            Protocol::call<Storage::AddQueue>(pt(), uf, Delegation(q->ds.sel(), 0), it->log_id());
+        }
+    }
+    void destroy_queues() {
+        for(cpu_t cpu = 0; cpu < CPU::count(); ++cpu)
+            delete _queues[cpu];
+        delete[] _queues;
+    }
+
+    StorageSession(const StorageSession&);
+    StorageSession& operator=(const StorageSession&);
 
     DataSpace _ctrlds;
-    Consumer<Storage::Packet> _cons;
+    MPConsumer<Storage::Packet> _cons;
     Storage::Parameter _params;
+    Queue **_queues;
 };
 
 }
@@ -20,8 +20,14 @@
 #include <ipc/Connection.h>
 #include <ipc/PtClientSession.h>
 #include <utcb/UtcbFrame.h>
+#include <mem/DataSpace.h>
+#include <util/ScopedCapSels.h>
+#include <util/NUMA.h>
+#include <util/Sync.h>
+#include <util/Util.h>
 #include <Exception.h>
 #include <CPU.h>
+#include <cstring>
 
 namespace nre {
 
@@ -29,13 +35,62 @@ class SysInfoSession;
 
 class SysInfo {
 public:
+    /**
+     * The windows over which root averages the load
+     */
+    enum Window {
+        WIN_1S,
+        WIN_10S,
+        WIN_60S,
+        WINDOWS
+    };
+
+    static const uint STATS_PERIOD      = 1000; // ms
+    static const size_t STATS_NAME_LEN  = 32;
+    // this way, the stats of one CPU fit into one page
+    static const size_t STATS_MAX_SCS   = 62;
+
+    /**
+     * The statistics of one Sc, as sampled by root
+     */
+    struct ScStats {
+        char name[STATS_NAME_LEN];
+        // the time it has run in the last period and in total (in microseconds)
+        timevalue_t time;
+        timevalue_t totaltime;
+        // the share of the CPU it got, averaged over the windows (in permil)
+        uint16_t load[WINDOWS];
+        uint16_t prio;
+        uint16_t reserved;
+    };
+
+    /**
+     * The statistics of one CPU. Root samples the time of all Scs every STATS_PERIOD ms and writes
+     * them to a dataspace, which is shared read-only with all clients. The statistics of each CPU
+     * are protected by a seqlock: <seq> is odd while root updates them.
+     */
+    struct CPUStats {
+        volatile uint32_t seq;
+        // the number of valid entries in <scs>
+        uint32_t count;
+        // the time that elapsed on the CPU in the last period (in microseconds)
+        timevalue_t total;
+        // the TSC value of the last update
+        uint64_t stamp;
+        // the load of the CPU, i.e. the time not spent in the idle Sc (in permil)
+        uint16_t load[WINDOWS];
+        // the number of Scs on this CPU that did not fit into <scs>
+        uint16_t dropped;
+        ScStats scs[STATS_MAX_SCS];
+    };
+
     /**
      * The information about a global thread
      */
     class TimeUser {
         friend class SysInfoSession;
     public:
-        explicit TimeUser() : _name(), _cpu(), _time(), _totaltime() {
+        explicit TimeUser() : _name(), _cpu(), _time(), _totaltime(), _prio(), _reserved() {
         }
 
         /**
@@ -62,12 +117,26 @@ public:
         timevalue_t totaltime() const {
             return _totaltime;
         }
+        /**
+         * @return the priority (see Sc::Band)
+         */
+        uint prio() const {
+            return _prio;
+        }
+        /**
+         * @return the reserved share of the CPU in permil (0 = no reservation)
+         */
+        uint reserved() const {
+            return _reserved;
+        }
 
     private:
         nre::String _name;
         cpu_t _cpu;
         timevalue_t _time;
         timevalue_t _totaltime;
+        uint _prio;
+        uint _reserved;
     };
 
     /**
@@ -119,6 +188,11 @@ public:
         GET_TIMEUSER,
         GET_MEM,
         GET_CHILD,
+        GET_NUMA,
+        SET_NUMA,
+        GET_NODE_MEM,
+        GET_RESERVED,
+        GET_STATS,
     };
 };
 
@@ -132,7 +206,31 @@ public:
      *
      * @param con the connection
      */
-    explicit SysInfoSession(Connection &con) : PtClientSession(con) {
+    explicit SysInfoSession(Connection &con) : PtClientSession(con), _stats() {
+    }
+    virtual ~SysInfoSession() {
+        delete _stats;
+    }
+
+    /**
+     * Copies the statistics of the given CPU, that root samples periodically. This does not involve
+     * IPC, except for the first call, which joins the dataspace.
+     *
+     * @param cpu the CPU
+     * @param stats will be set to the statistics
+     */
+    void get_stats(cpu_t cpu, SysInfo::CPUStats &stats) {
+        const SysInfo::CPUStats *src = reinterpret_cast<const SysInfo::CPUStats*>(
+            stats_ds().virt() + cpu * ExecEnv::PAGE_SIZE);
+        uint32_t seq;
+        do {
+            while((seq = src->seq) & 1)
+                Util::pause();
+            Sync::memory_barrier();
+            memcpy(&stats, const_cast<SysInfo::CPUStats*>(src), sizeof(stats));
+            Sync::memory_barrier();
+        }
+        while(src->seq != seq);
     }
 
     /**
@@ -182,10 +280,25 @@ public:
         uf >> found;
         if(!found)
             return false;
-        uf >> tu._name >> tu._cpu >> tu._time >> tu._totaltime;
+        uf >> tu._name >> tu._cpu >> tu._time >> tu._totaltime >> tu._prio >> tu._reserved;
         return true;
     }
 
+    /**
+     * Asks for the CPU reservations on the given CPU
+     *
+     * @param cpu the CPU
+     * @param reserved will be set to the share of the CPU in permil that has been reserved
+     * @param capacity will be set to the share of the CPU in permil that can be reserved at most
+     */
+    void get_reserved(cpu_t cpu, uint &reserved, uint &capacity) {
+        UtcbFrame uf;
+        uf << SysInfo::GET_RESERVED << cpu;
+        pt().call(uf);
+        uf.check_reply();
+        uf >> reserved >> capacity;
+    }
+
     /**
      * Gets the Child number <idx>.
      *
@@ -205,6 +318,65 @@ public:
         uf >> c._cmdline >> c._virt >> c._phys >> c._threads;
         return true;
     }
+
+    /**
+     * Asks for the NUMA topology that root uses to place memory
+     *
+     * @param info will be set to the topology
+     */
+    void get_numa(NUMA::Info &info) {
+        UtcbFrame uf;
+        uf << SysInfo::GET_NUMA;
+        pt().call(uf);
+        uf.check_reply();
+        uf >> info;
+    }
+
+    /**
+     * Tells root about the NUMA topology. This is done by the ACPI service, once it has parsed the
+     * SRAT and SLIT. Childs that are loaded afterwards get the node of each CPU in their Hip. Root
+     * accepts the topology only once.
+     *
+     * @param info the topology
+     * @throws Exception if the topology has already been set
+     */
+    void set_numa(const NUMA::Info &info) {
+        UtcbFrame uf;
+        uf << SysInfo::SET_NUMA << info;
+        pt().call(uf);
+        uf.check_reply();
+    }
+
+    /**
+     * Asks for information about the memory of the given NUMA node
+     *
+     * @param node the node
+     * @param total will be set to the total amount of physical memory of that node (in bytes)
+     * @param free will be set to the free physical memory of that node (in bytes)
+     */
+    void get_node_mem(NUMA::node_t node, size_t &total, size_t &free) {
+        UtcbFrame uf;
+        uf << SysInfo::GET_NODE_MEM << node;
+        pt().call(uf);
+        uf.check_reply();
+        uf >> total >> free;
+    }
+
+private:
+    const DataSpace &stats_ds() {
+        if(!_stats) {
+            UtcbFrame uf;
+            ScopedCapSels cap;
+            uf.delegation_window(Crd(cap.get(), 0, Crd::OBJ_ALL));
+            uf << SysInfo::GET_STATS;
+            pt().call(uf);
+            uf.check_reply();
+            _stats = new DataSpace(cap.release());
+        }
+        return *_stats;
+    }
+
+    DataSpace *_stats;
 };
 
 }
@@ -19,6 +19,7 @@
 #include <arch/Types.h>
 #include <ipc/Connection.h>
 #include <ipc/PtClientSession.h>
+#include <ipc/Protocol.h>
 #include <utcb/UtcbFrame.h>
 #include <Exception.h>
 #include <CPU.h>
@@ -38,9 +39,17 @@ public:
     enum Command {
         GET_SMS,
         PROG_TIMER,
-        GET_TIME
+        GET_TIME,
+        COMMAND_COUNT
     };
 
+    /**
+     * The methods
+     */
+    typedef Method<GET_SMS> GetSms;
+    typedef Method<PROG_TIMER, Args<timevalue_t> > ProgTimer;
+    typedef Method<GET_TIME, Args<>, Args<timevalue_t, timevalue_t> > GetTime;
+
 private:
     Timer();
 };
@@ -105,9 +114,7 @@ public:
      */
     void program(timevalue_t cycles) {
         UtcbFrame uf;
-        uf << Timer::PROG_TIMER << cycles;
-        pt().call(uf);
-        uf.check_reply();
+        Protocol::call<Timer::ProgTimer>(pt(), uf, cycles);
     }
 
     /**
@@ -118,10 +125,9 @@ public:
      */
     void get_time(timevalue_t &uptime, timevalue_t &unixts) {
         UtcbFrame uf;
-        uf << Timer::GET_TIME;
-        pt().call(uf);
-        uf.check_reply();
-        uf >> uptime >> unixts;
+        Timer::GetTime::Out res = Protocol::call<Timer::GetTime>(pt(), uf);
+        uptime = res.a1;
+        unixts = res.a2;
     }
 
 private:
@@ -129,9 +135,7 @@ private:
         UtcbFrame uf;
         ScopedCapSels caps(1 << CPU::order(), 1 << CPU::order());
         uf.delegation_window(Crd(caps.get(), CPU::order(), Crd::OBJ_ALL));
-        uf << Timer::GET_SMS;
-        pt().call(uf);
-        uf.check_reply();
+        Protocol::call<Timer::GetSms>(pt(), uf);
         _caps = caps.release();
         _sms = new Sm *[CPU::count()];
         for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
@@ -104,13 +104,17 @@ public:
 
     /**
      * Writes the given character+colorcode to the given position and updates <pos> accordingly.
+     * The changed rows are announced to the console (see ConsoleSession::mark_dirty).
      *
      * @param value the character+color to write
      * @param pos the position (will be updated)
      */
     void put(ushort value, uint &pos) {
         uintptr_t addr = _sess.screen().virt() + Console::TEXT_OFF + _page * Console::PAGE_SIZE;
-        put(value, reinterpret_cast<ushort*>(addr), pos);
+        if(put(value, reinterpret_cast<ushort*>(addr), pos))
+            _sess.mark_dirty(_page, 0, Console::ROWS);
+        else if(pos > 0)
+            _sess.mark_dirty(_page, (pos - 1) / Console::COLS);
     }
 
     /**
@@ -119,8 +123,9 @@ public:
      * @param value the character+color to write
      * @param base the base address of the console-page
      * @param pos the position (will be updated)
+     * @return true if the page has been scrolled
      */
-    void put(ushort value, ushort *base, uint &pos);
+    bool put(ushort value, ushort *base, uint &pos);
 
 private:
     ConsoleSession &_sess;
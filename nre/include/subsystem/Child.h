@@ -46,6 +46,7 @@ class Child : public RCUObject {
     friend class ChildManager;
     friend OStream & operator<<(OStream &os, const Child &c);
 
+public:
     /**
      * Holds the properties of an Sc that has been announced by a child
      */
@@ -57,9 +58,10 @@ class Child : public RCUObject {
          * @param name the name of the thread
          * @param cpu the cpu its running on
          * @param cap the Sc capability
+         * @param reserved the reserved share of the CPU in permil
          */
-        explicit SchedEntity(const nre::String &name, cpu_t cpu, capsel_t cap)
-            : nre::SListItem(), _name(name), _cpu(cpu), _cap(cap) {
+        explicit SchedEntity(const nre::String &name, cpu_t cpu, capsel_t cap, uint reserved)
+            : nre::SListItem(), _name(name), _cpu(cpu), _cap(cap), _reserved(reserved) {
         }
 
         /**
@@ -80,14 +82,20 @@ class Child : public RCUObject {
         capsel_t cap() const {
             return _cap;
         }
+        /**
+         * @return the reserved share of the CPU in permil
+         */
+        uint reserved() const {
+            return _reserved;
+        }
 
     private:
         nre::String _name;
         cpu_t _cpu;
         capsel_t _cap;
+        uint _reserved;
     };
 
-public:
     typedef capsel_t id_type;
 
     /**
@@ -108,6 +116,31 @@ public:
     capsel_t pd() const {
         return _pd->sel();
     }
+    /**
+     * @return the priority band of its Scs
+     */
+    Sc::Band band() const {
+        return _band;
+    }
+    /**
+     * @return the share of each CPU in permil that its Scs may reserve in total
+     */
+    uint reserve() const {
+        return _reserve;
+    }
+    /**
+     * @param cpu the CPU
+     * @return the share of the CPU in permil that its Scs have reserved
+     */
+    uint reserved(cpu_t cpu) const {
+        ScopedLock<UserSm> guard(&_sm);
+        uint sum = 0;
+        for(SList<SchedEntity>::iterator it = _scs.begin(); it != _scs.end(); ++it) {
+            if(it->cpu() == cpu)
+                sum += it->reserved();
+        }
+        return sum;
+    }
     /**
      * @return its command line
      */
@@ -181,8 +214,9 @@ public:
     }
 
 private:
-    explicit Child(ChildManager *cm, id_type id, const String &cmdline)
-        : RCUObject(), _cm(cm), _id(id), _cmdline(cmdline), _started(), _pd(), _ec(),
+    explicit Child(ChildManager *cm, id_type id, const String &cmdline, Sc::Band band, uint reserve)
+        : RCUObject(), _cm(cm), _id(id), _cmdline(cmdline), _band(band), _reserve(reserve),
+          _started(), _pd(), _ec(),
           _pts(), _ptcount(), _regs(), _io(), _scs(), _gsis(),
           _gsi_caps(CapSelSpace::get().allocate(Hip::MAX_GSIS)), _gsi_next(), _entry(),
           _main(), _stack(), _utcb(), _hip(), _last_fault_addr(), _last_fault_cpu(), _sm() {
@@ -202,9 +236,9 @@ private:
         CapSelSpace::get().free(_gsi_caps, Hip::MAX_GSIS);
     }
 
-    void add_sc(const String &name, cpu_t cpu, capsel_t sc) {
+    void add_sc(const String &name, cpu_t cpu, capsel_t sc, uint reserved) {
         ScopedLock<UserSm> guard(&_sm);
-        _scs.append(new SchedEntity(name, cpu, sc));
+        _scs.append(new SchedEntity(name, cpu, sc, reserved));
     }
     void remove_sc(capsel_t sc) {
         ScopedLock<UserSm> guard(&_sm);
@@ -228,6 +262,8 @@ private:
     ChildManager *_cm;
     id_type _id;
     String _cmdline;
+    Sc::Band _band;
+    uint _reserve;
     bool _started;
     Pd *_pd;
     GlobalThread *_ec;
@@ -246,7 +282,7 @@ private:
     uintptr_t _hip;
     uintptr_t _last_fault_addr;
     cpu_t _last_fault_cpu;
-    UserSm _sm;
+    mutable UserSm _sm;
 };
 
 }
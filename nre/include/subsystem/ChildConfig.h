@@ -17,6 +17,8 @@
 #pragma once
 
 #include <arch/Types.h>
+#include <kobj/Sc.h>
+#include <stream/IStringStream.h>
 #include <util/CPUSet.h>
 
 namespace nre {
@@ -45,8 +47,11 @@ public:
      */
     explicit ChildConfig(size_t no, const String &cmdline, cpu_t cpu = CPU::current().log_id())
         : _no(no), _last(false), _modaccess(OWN), _cpu(cpu), _cpus(), _entry(0), _waitcount(),
-          _waits(), _cmdline() {
+          _waits(), _band(Sc::BAND_PD), _reserve(0), _cmdline() {
         parse(cmdline);
+        // childs that provide services are system services unless specified otherwise
+        if(_band == Sc::BAND_PD)
+            _band = _waitcount > 0 ? Sc::BAND_SERVICE : Sc::BAND_GUEST;
     }
     virtual ~ChildConfig() {
     }
@@ -78,6 +83,21 @@ public:
         return _waits[i];
     }
 
+    /**
+     * @return the priority band of the child ("band=guest|service"). Its Scs can't get a higher
+     *  priority than that, unless they have a reservation.
+     */
+    Sc::Band band() const {
+        return _band;
+    }
+    /**
+     * @return the share of each CPU in permil that the Scs of the child may reserve in total
+     *  ("reserve=<permil>")
+     */
+    uint reserve() const {
+        return _reserve;
+    }
+
     /**
      * @return the commandline
      */
@@ -147,6 +167,12 @@ private:
                     _last = true;
                 else if(strncmp(start, "provides=", 9) == 0 && _waitcount < MAX_WAITS)
                     _waits[_waitcount++] = String(start + 9, len - 9);
+                else if(strncmp(start, "band=guest", len) == 0)
+                    _band = Sc::BAND_GUEST;
+                else if(strncmp(start, "band=service", len) == 0)
+                    _band = Sc::BAND_SERVICE;
+                else if(strncmp(start, "reserve=", 8) == 0)
+                    _reserve = IStringStream::read_from<uint>(start + 8, len - 8);
                 else {
                     if(pos + len + 1 >= sizeof(buffer))
                         len = sizeof(buffer) - (pos + 2);
@@ -168,6 +194,8 @@ private:
     uintptr_t _entry;
     size_t _waitcount;
     String _waits[MAX_WAITS];
+    Sc::Band _band;
+    uint _reserve;
     String _cmdline;
 };
 
@@ -106,6 +106,7 @@ private:
                 cpus[cpu->phys_id()].thread = cpu->thread();
                 cpus[cpu->phys_id()].core = cpu->core();
                 cpus[cpu->phys_id()].package = cpu->package();
+                cpus[cpu->phys_id()].node = cpu->node();
             }
             else
                 cpus[cpu->phys_id()].flags = 0;
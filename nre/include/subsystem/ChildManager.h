@@ -22,6 +22,11 @@
 #include <subsystem/ServiceRegistry.h>
 #include <subsystem/ChildConfig.h>
 #include <mem/DataSpaceManager.h>
+#include <arch/Elf.h>
+#include <util/MaskField.h>
+#include <util/BitField.h>
+#include <util/Treap.h>
+#include <util/DList.h>
 #include <util/Sync.h>
 #include <Exception.h>
 
@@ -81,6 +86,46 @@ class ChildManager {
         FAULT
     };
 
+    /**
+     * A module, mapped by us to populate the segments from it
+     */
+    struct Module {
+        uintptr_t addr;
+        size_t size;
+        const DataSpace *ds;
+        // the number of segments that are populated from it
+        size_t refs;
+    };
+
+    /**
+     * A LOAD segment of a module that is either private to one child or <shared> among all childs
+     * that are loaded from this module. If <present> is set, the pages are populated from <src> on
+     * the first pagefault. <refs> counts the childs that use it and the cache, as long as it is
+     * <cached>. That is, the segment stays until the last child is gone, even if the cache is
+     * flushed before.
+     */
+    struct Segment : public DListItem {
+        explicit Segment()
+            : DListItem(), module(), modsize(), offset(), vaddr(), memsz(), filesz(), src(), sel(),
+              ds(), mod(), present(), refs(), cached(), shared() {
+        }
+
+        uintptr_t module;
+        size_t modsize;
+        uintptr_t offset;
+        uintptr_t vaddr;
+        size_t memsz;
+        size_t filesz;
+        uintptr_t src;
+        capsel_t sel;
+        const DataSpace *ds;
+        Module *mod;
+        MaskField<1> *present;
+        size_t refs;
+        bool cached;
+        bool shared;
+    };
+
 public:
     /**
      * Some settings
@@ -88,6 +133,9 @@ public:
     static const size_t MAX_CHILDS          = 32;
     static const size_t MAX_CMDLINE_LEN     = 256;
     static const size_t MAX_MODAUX_LEN      = ExecEnv::PAGE_SIZE;
+    static const size_t MAX_SEGMENTS        = 64;
+    static const size_t MAX_MODULES         = 16;
+    static const size_t MAX_SRVNAME_LEN     = 64;
 
     /**
      * Creates a new child manager. It will already create all Ecs that are required
@@ -103,16 +151,28 @@ public:
      * Pd, adds the correspondings segments to that Pd, creates a main thread and finally starts
      * the main thread. Afterwards, if the command line contains "provides=..." it waits until
      * the service with given name is registered.
+     * If <module> is given, the ChildManager maps the module itself and populates the pages of the
+     * segments when they are touched for the first time, instead of copying them in advance.
+     * If <share> is true as well, the segments are cached by the module address and size. That is,
+     * further childs that are loaded from the same module share the read-only segments and get the
+     * writable segments copy-on-write, instead of a private copy of the whole ELF file. Since the
+     * cached segments stay until flush_segments() is called, only share the segments of modules
+     * that are loaded more than once. Otherwise, the cache just doubles the memory of the child.
+     * If the cache is full, the child gets private segments instead.
      *
      * @param addr the address of the ELF file
      * @param size the size of the ELF file
      * @param config the config to use. this allows you to specify the access to the modules, the
      *  presented CPUs and other things
+     * @param module the physical address of the module in the Hip the ELF file belongs to (0 =
+     *  copy the segments from <addr> in advance)
+     * @param share whether the segments should be shared with other childs of this module
      * @return the id of the created child
      * @throws ELFException if the ELF is invalid
      * @throws Exception if something else failed
      */
-    Child::id_type load(uintptr_t addr, size_t size, const ChildConfig &config);
+    Child::id_type load(uintptr_t addr, size_t size, const ChildConfig &config,
+                        uintptr_t module = 0, bool share = false);
 
     /**
      * @return the number of childs
@@ -120,6 +180,16 @@ public:
     size_t count() const {
         return _child_count;
     }
+    /**
+     * @return the number of bytes that are occupied by the shared segments of all modules
+     */
+    size_t shared_size() const;
+    /**
+     * Releases all cached segments. That is, further childs will not share them anymore. The
+     * segments that are still in use by childs are destroyed as soon as the last of them is gone.
+     */
+    void flush_segments();
+
     /**
      * @return a semaphore that is up'ed as soon as a child has been killed
      */
@@ -174,7 +244,8 @@ public:
      * @param available the CPUs it is available on
      * @return a semaphore cap that is used to notify the service about potentially destroyed sessions
      */
-    capsel_t reg_service(capsel_t cap, const String& name, const BitField<Hip::MAX_CPUS> &available) {
+    capsel_t reg_service(capsel_t cap, const StringView &name,
+                         const BitField<Hip::MAX_CPUS> &available) {
         return reg_service(0, cap, name, available);
     }
     /**
@@ -182,11 +253,21 @@ public:
      *
      * @param name the service name
      */
-    void unreg_service(const String& name) {
+    void unreg_service(const StringView &name) {
         unreg_service(0, name);
     }
 
 private:
+    /**
+     * The childs that have a dataspace in their address space, indexed by its unmap selector.
+     * This way, we don't have to walk through all childs if we change the mapping of a dataspace.
+     */
+    struct DSUsers : public TreapNode<capsel_t> {
+        explicit DSUsers(capsel_t sel) : TreapNode<capsel_t>(sel), childs() {
+        }
+        BitField<MAX_CHILDS> childs;
+    };
+
     size_t free_slot() const {
         ScopedLock<UserSm> guard(&_slotsm);
         for(size_t i = 0; i < MAX_CHILDS; ++i) {
@@ -199,6 +280,9 @@ private:
     Child *get_child(Child::id_type id) {
         return get_child_at((id - _portal_caps) / per_child_caps());
     }
+    size_t get_idx(const Child *c) const {
+        return (c->id() - _portal_caps) / per_child_caps();
+    }
     Child *get_child_at(size_t idx) {
         Child *c = rcu_dereference(_childs[idx]);
         if(!c)
@@ -216,7 +300,7 @@ private:
         return (pid - _portal_caps) % Hip::get().service_caps();
     }
 
-    const ServiceRegistry::Service *get_service(const String &name) {
+    const ServiceRegistry::Service *get_service(const StringView &name) {
         ScopedLock<UserSm> guard(&_sm);
         const ServiceRegistry::Service* s = registry().find(name);
         if(!s) {
@@ -229,14 +313,14 @@ private:
         }
         return s;
     }
-    capsel_t reg_service(Child *c, capsel_t pts, const String& name,
+    capsel_t reg_service(Child *c, capsel_t pts, const StringView &name,
                          const BitField<Hip::MAX_CPUS> &available) {
         ScopedLock<UserSm> guard(&_sm);
         const ServiceRegistry::Service *srv = _registry.reg(c, name, pts, 1 << CPU::order(), available);
         _regsm.up();
         return srv->sm().sel();
     }
-    void unreg_service(Child *c, const String& name) {
+    void unreg_service(Child *c, const StringView &name) {
         ScopedLock<UserSm> guard(&_sm);
         _registry.unreg(c, name);
     }
@@ -257,6 +341,16 @@ private:
 
     static void prepare_stack(Child *c, uintptr_t &sp, uintptr_t csp);
     void build_hip(Child *c, const ChildConfig &config);
+    const DataSpace &load_segment(uintptr_t addr, size_t size, uintptr_t module, bool share,
+                                  const ElfPh *ph, bool &lazy, bool &shared);
+    Module *map_module(uintptr_t module, size_t size);
+    void populate(capsel_t sel, size_t page, size_t count);
+    void put_segment(capsel_t sel);
+    void drop_segment(Segment *s);
+    ChildMemory::DS *copy_on_write(Child *c, ChildMemory::DS *ds);
+    void add_user(capsel_t sel, Child *c);
+    void remove_user(capsel_t sel, Child *c);
+    BitField<MAX_CHILDS> get_users(capsel_t sel);
 
     capsel_t get_parent_service(const char *name, BitField<Hip::MAX_CPUS> &available);
     void map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type);
@@ -274,6 +368,13 @@ private:
     UserSm _sm;
     UserSm _switchsm;
     mutable UserSm _slotsm;
+    mutable UserSm _segsm;
+    // the number of cached segments
+    size_t _segcount;
+    DList<Segment> _segments;
+    Module _modules[MAX_MODULES];
+    UserSm _usersm;
+    Treap<DSUsers> _users;
     Sm _regsm;
     Sm _diesm;
     // we need different Ecs to be able to receive a different number of caps
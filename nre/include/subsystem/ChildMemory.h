@@ -55,6 +55,10 @@ public:
         RWX = R | W | X,
         // indicates that the memory has been requested by us, i.e. we haven't just joined the DS
         OWN = 1 << 4,
+        // the dataspace is shared with other childs and has to be copied on the first write
+        COW = 1 << 5,
+        // the pages are populated by the ChildManager on the first access
+        LAZY = 1 << 6,
     };
 
     /**
@@ -49,9 +49,9 @@ public:
          * @param count the number of selectors
          * @param available bitfield that specifies on what CPUs its available
          */
-        explicit Service(Child *child, const String &name, capsel_t pts, size_t count,
+        explicit Service(Child *child, const StringView &name, capsel_t pts, size_t count,
                          const BitField<Hip::MAX_CPUS> &available)
-            : SListItem(), _child(child), _name(name), _pts(pts), _count(count), _sm(0),
+            : SListItem(), _child(child), _name(name.str(), name.length()), _pts(pts), _count(count), _sm(0),
               _available(available) {
         }
         /**
@@ -147,7 +147,7 @@ public:
      * @return the created service
      * @throws ServiceRegistryException if the service does already exist
      */
-    const Service* reg(Child *child, const String &name, capsel_t pts, size_t count,
+    const Service* reg(Child *child, const StringView &name, capsel_t pts, size_t count,
                        const BitField<Hip::MAX_CPUS> &available) {
         if(search(name))
             throw ServiceRegistryException(E_EXISTS, 64, "Service '%s' does already exist", name.str());
@@ -163,7 +163,7 @@ public:
      * @param name the name of the service
      * @throws ServiceRegistryException if the service doesn't exist or doesn't belong to <child>
      */
-    void unreg(Child *child, const String &name) {
+    void unreg(Child *child, const StringView &name) {
         Service *s = search(name);
         if(!s)
             throw ServiceRegistryException(E_NOT_FOUND, 64, "Service '%s' does not exist", name.str());
@@ -179,7 +179,7 @@ public:
      * @param name the service name
      * @return the service with given name
      */
-    const Service* find(const String &name) const {
+    const Service* find(const StringView &name) const {
         return search(name);
     }
     /**
@@ -200,7 +200,7 @@ public:
     }
 
 private:
-    Service *search(const String &name) const {
+    Service *search(const StringView &name) const {
         for(iterator it = _srvs.begin(); it != _srvs.end(); ++it) {
             if(it->name() == name)
                 return &*it;
@@ -18,6 +18,7 @@
 
 #include <arch/UtcbExcLayout.h>
 #include <utcb/Utcb.h>
+#include <utcb/UtcbTraits.h>
 #include <cap/CapRange.h>
 #include <cap/CapSelSpace.h>
 #include <Exception.h>
@@ -30,6 +31,7 @@
 namespace nre {
 
 class Pt;
+class Protocol;
 class UtcbFrameRef;
 class UtcbExcFrameRef;
 OStream &operator<<(OStream &os, const Utcb &utcb);
@@ -62,6 +64,7 @@ public:
  */
 class UtcbFrameRef {
     friend class Pt;
+    friend class Protocol;
     friend class Utcb;
     friend OStream & operator<<(OStream &os, const Utcb &utcb);
     friend  OStream & operator<<(OStream &os, const UtcbFrameRef &frm);
@@ -398,7 +401,7 @@ public:
 
     /**
      * Writes the given object as untyped item into the UTCB frame. Note that there might not be
-     * enough space left in the UTCB.
+     * enough space left in the UTCB. The encoding is defined by UtcbTraits<T>.
      *
      * @param value the object to write
      * @return *this
@@ -406,50 +409,99 @@ public:
      */
     template<typename T>
     UtcbFrameRef & operator<<(const T& value) {
-        const size_t words = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t);
+        const size_t words = UtcbTraits<T>::words(value);
         check_untyped_write(words);
         assert(Utcb::get_current_frame(_utcb->base()) == _utcb);
-        *reinterpret_cast<T*>(_utcb->msg + untyped()) = value;
+        UtcbTraits<T>::write(_utcb->msg + untyped(), value);
         _utcb->untyped += words;
         return *this;
     }
     UtcbFrameRef & operator<<(const String& value) {
-        const size_t words = Math::blockcount<size_t>(value.length(), sizeof(word_t)) + 1;
+        return *this << StringView(value);
+    }
+    UtcbFrameRef & operator<<(const StringView& value) {
+        // always reserve space for the null-termination, so that the receiver can use the string
+        // directly in the UTCB
+        const size_t words = string_words(value.length());
         check_untyped_write(words);
         assert(Utcb::get_current_frame(_utcb->base()) == _utcb);
         *reinterpret_cast<size_t*>(_utcb->msg + untyped()) = value.length();
-        memcpy(_utcb->msg + untyped() + 1, value.str(), value.length());
+        char *str = reinterpret_cast<char*>(_utcb->msg + untyped() + 1);
+        memcpy(str, value.str(), value.length());
+        str[value.length()] = '\0';
         _utcb->untyped += words;
         return *this;
     }
 
     /**
      * Reads the next untyped item from the UTCB frame. Of course, you need to know what object you
-     * receive.
+     * receive. The encoding is defined by UtcbTraits<T>.
      *
      * @param value the place to write to
      * @return *this
-     * @throws UtcbException if there is no untyped item anymore
+     * @throws UtcbException if there is no untyped item anymore or its encoding is invalid
      */
     template<typename T>
     UtcbFrameRef & operator>>(T &value) {
-        const size_t words = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t);
-        check_untyped_read(words);
-        value = *reinterpret_cast<T*>(_utcb->msg + _upos);
+        const word_t *msg = _utcb->msg + _upos;
+        const size_t words = UtcbTraits<T>::words(msg, untyped() - _upos);
+        // note that words might be UtcbTraitsBase::INVALID
+        if(words > untyped() - _upos)
+            throw UtcbException(E_UTCB_UNTYPED);
+        UtcbTraits<T>::read(msg, value);
         _upos += words;
         return *this;
     }
     UtcbFrameRef & operator>>(String &value) {
+        StringView view;
+        *this >> view;
+        value.reset(view.str(), view.length());
+        return *this;
+    }
+    /**
+     * Reads the next string from the UTCB frame without copying it. That is, <value> will point
+     * into the UTCB, so that it is only valid until the frame is overwritten (see StringView).
+     * This can also be used to receive large blocks of data without copying them.
+     *
+     * @param value the view to set
+     * @return *this
+     * @throws UtcbException if there is no untyped item anymore
+     */
+    UtcbFrameRef & operator>>(StringView &value) {
         check_untyped_read(1);
         size_t len = *reinterpret_cast<size_t*>(_utcb->msg + _upos);
-        const size_t words = Math::blockcount<size_t>(len, sizeof(word_t)) + 1;
+        if(len >= Utcb::SIZE)
+            throw UtcbException(E_UTCB_UNTYPED);
+        const size_t words = string_words(len);
         check_untyped_read(words);
-        value.reset(reinterpret_cast<const char*>(_utcb->msg + _upos + 1), len);
+        // don't trust the sender; terminate it ourself
+        char *str = reinterpret_cast<char*>(_utcb->msg + _upos + 1);
+        str[len] = '\0';
+        value = StringView(str, len);
         _upos += words;
         return *this;
     }
 
 private:
+    static size_t string_words(size_t len) {
+        return Math::blockcount<size_t>(len + 1, sizeof(word_t)) + 1;
+    }
+
+    // direct access to the untyped items, for Protocol
+    word_t *reserve_untyped(size_t words) {
+        check_untyped_write(words);
+        assert(Utcb::get_current_frame(_utcb->base()) == _utcb);
+        word_t *msg = _utcb->msg + untyped();
+        _utcb->untyped += words;
+        return msg;
+    }
+    const word_t *fetch_untyped(size_t words) {
+        check_untyped_read(words);
+        const word_t *msg = _utcb->msg + _upos;
+        _upos += words;
+        return msg;
+    }
+
     void add_typed(const TypedItem &item) {
         // ensure that we're the current frame
         assert(Utcb::get_current_frame(_utcb->base()) == _utcb);
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <util/Math.h>
+#include <cstring>
+
+namespace nre {
+
+/**
+ * Defines how objects of type T are transferred as untyped items via the UTCB. By default, the
+ * object is copied as a whole, i.e. it occupies sizeof(T) bytes, rounded up to words. Types that
+ * typically use only a part of their capacity (lists, fixed-size strings, ...) can specialize
+ * this template to use a more compact encoding, like a count-prefixed array. UtcbFrameRef's shift
+ * operators use it for all types that don't have an operator of their own.
+ *
+ * A specialization has to provide the same members as this one.
+ */
+template<typename T>
+struct UtcbTraits {
+    /**
+     * Whether every object occupies exactly sizeof(T) bytes, rounded up to words. This allows
+     * Protocol to check the size of a message at once instead of item by item.
+     */
+    static const bool FIXED     = true;
+
+    /**
+     * @param value the object to write
+     * @return the number of words <value> occupies in the UTCB
+     */
+    static size_t words(const T &) {
+        return Math::blockcount(sizeof(T), sizeof(word_t));
+    }
+    /**
+     * @param msg the encoded object in the UTCB
+     * @param avail the number of words that are available at <msg> (might be 0)
+     * @return the number of words the object at <msg> occupies or UtcbTraitsBase::INVALID if
+     *  the encoding is invalid. Note that the result may exceed <avail>; the caller checks that.
+     */
+    static size_t words(const word_t *, size_t) {
+        return Math::blockcount(sizeof(T), sizeof(word_t));
+    }
+    /**
+     * Writes <value> to <msg>, which has space for words(value) words.
+     */
+    static void write(word_t *msg, const T &value) {
+        *reinterpret_cast<T*>(msg) = value;
+    }
+    /**
+     * Reads <value> from <msg>, which has been checked with words(msg, avail) before.
+     */
+    static void read(const word_t *msg, T &value) {
+        value = *reinterpret_cast<const T*>(msg);
+    }
+};
+
+/**
+ * Helpers for UtcbTraits-specializations
+ */
+struct UtcbTraitsBase {
+    static const size_t INVALID     = static_cast<size_t>(-1);
+
+    /**
+     * @param count the number of elements
+     * @param size the size of one element
+     * @return the number of words an array of <count> elements occupies, including the count
+     */
+    static size_t array_words(size_t count, size_t size) {
+        return 1 + Math::blockcount(count * size, sizeof(word_t));
+    }
+    /**
+     * Determines the number of words of the count-prefixed array at <msg>
+     *
+     * @param msg the encoded array
+     * @param avail the number of available words
+     * @param max the maximum number of elements the receiver accepts
+     * @param size the size of one element
+     * @return the number of words or INVALID
+     */
+    static size_t array_words(const word_t *msg, size_t avail, size_t max, size_t size) {
+        if(avail == 0)
+            return 1;
+        if(msg[0] > max)
+            return INVALID;
+        return array_words(msg[0], size);
+    }
+    /**
+     * Writes the count-prefixed array <elems> with <count> elements of <size> bytes to <msg>
+     */
+    static void write_array(word_t *msg, const void *elems, size_t count, size_t size) {
+        msg[0] = count;
+        memcpy(msg + 1, elems, count * size);
+    }
+    /**
+     * Reads the count-prefixed array at <msg> into <elems>
+     *
+     * @return the number of elements
+     */
+    static size_t read_array(const word_t *msg, void *elems, size_t size) {
+        memcpy(elems, msg + 1, msg[0] * size);
+        return msg[0];
+    }
+
+private:
+    UtcbTraitsBase();
+};
+
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <arch/ExecEnv.h>
+#include <util/Math.h>
+
+namespace nre {
+
+/**
+ * An arena allocator. It hands out memory from chunks by simply bumping a pointer. Memory can't
+ * be freed individually, but only all at once (reset or destruction) or everything that has been
+ * allocated after a certain point in time (see ArenaScope). This is useful for lots of small
+ * objects with the same lifetime. Note that no destructors are called, i.e. it should only be used
+ * for POD types. The arena is not thread-safe.
+ */
+class Arena {
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+        size_t pos;
+        // to align the data
+        word_t pad;
+        char data[];
+    };
+
+public:
+    /**
+     * A position in the arena, to which it can be rewinded
+     */
+    struct Mark {
+        Chunk *chunk;
+        size_t pos;
+    };
+
+    /**
+     * Creates an empty arena
+     *
+     * @param chunksize the minimum size of the chunks to allocate
+     */
+    explicit Arena(size_t chunksize = ExecEnv::PAGE_SIZE) : _chunks(), _chunksize(chunksize) {
+    }
+    /**
+     * Frees all memory
+     */
+    ~Arena() {
+        release(Mark());
+    }
+
+    /**
+     * Allocates <size> bytes, aligned to <align> bytes.
+     *
+     * @param size the number of bytes
+     * @param align the alignment (a power of 2, at most 16)
+     * @return the memory
+     * @throws std::bad_alloc if there is not enough memory
+     */
+    void *alloc(size_t size, size_t align = sizeof(word_t)) {
+        size_t pos = _chunks ? Math::round_up(_chunks->pos, align) : 0;
+        if(!_chunks || pos + size > _chunks->size) {
+            size_t csize = Math::max(_chunksize, size);
+            Chunk *c = reinterpret_cast<Chunk*>(new char[sizeof(Chunk) + csize]);
+            c->next = _chunks;
+            c->size = csize;
+            _chunks = c;
+            pos = 0;
+        }
+        _chunks->pos = pos + size;
+        return _chunks->data + pos;
+    }
+    /**
+     * Allocates an array of <count> objects of type T. The objects are not constructed.
+     */
+    template<class T>
+    T *alloc_array(size_t count) {
+        return static_cast<T*>(alloc(sizeof(T) * count));
+    }
+
+    /**
+     * @return the current position, to be able to release everything that is allocated afterwards
+     */
+    Mark mark() const {
+        Mark m;
+        m.chunk = _chunks;
+        m.pos = _chunks ? _chunks->pos : 0;
+        return m;
+    }
+    /**
+     * Releases all memory that has been allocated after <m> has been taken.
+     *
+     * @param m the position
+     */
+    void release(const Mark &m) {
+        while(_chunks != m.chunk) {
+            Chunk *c = _chunks;
+            _chunks = c->next;
+            delete[] reinterpret_cast<char*>(c);
+        }
+        if(_chunks)
+            _chunks->pos = m.pos;
+    }
+    /**
+     * Releases all memory
+     */
+    void reset() {
+        release(Mark());
+    }
+
+    /**
+     * @return the number of bytes that have been handed out
+     */
+    size_t used() const {
+        size_t total = 0;
+        for(Chunk *c = _chunks; c != 0; c = c->next)
+            total += c->pos;
+        return total;
+    }
+    /**
+     * @return the number of bytes occupied by the chunks
+     */
+    size_t size() const {
+        size_t total = 0;
+        for(Chunk *c = _chunks; c != 0; c = c->next)
+            total += c->size;
+        return total;
+    }
+
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    Chunk *_chunks;
+    size_t _chunksize;
+};
+
+/**
+ * RAII class for an arena: releases everything that has been allocated from the arena during
+ * the lifetime of this object.
+ */
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena &arena) : _arena(arena), _mark(arena.mark()) {
+    }
+    ~ArenaScope() {
+        _arena.release(_mark);
+    }
+
+private:
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+
+    Arena &_arena;
+    Arena::Mark _mark;
+};
+
+}
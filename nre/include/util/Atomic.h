@@ -30,6 +30,20 @@ public:
         return __sync_fetch_and_add(ptr, value);
     }
 
+    template<typename T, typename Y>
+    static T fetch_or(T volatile *ptr, Y value) {
+        return __sync_fetch_and_or(ptr, value);
+    }
+    template<typename T, typename Y>
+    static T fetch_and(T volatile *ptr, Y value) {
+        return __sync_fetch_and_and(ptr, value);
+    }
+    template<typename T, typename Y>
+    static T swap(T volatile *ptr, Y value) {
+        // on x86, this is a xchg, i.e. a full barrier
+        return __sync_lock_test_and_set(ptr, value);
+    }
+
     template<typename T>
     static void bit_and(T *ptr, T value) {
         __sync_and_and_fetch(ptr, value);
@@ -18,6 +18,7 @@
 
 #include <arch/Types.h>
 #include <stream/OStream.h>
+#include <utcb/UtcbTraits.h>
 #include <cstring>
 
 namespace nre {
@@ -34,6 +35,7 @@ template<uint BITS>
 class BitField {
     template<uint N>
     friend OStream & operator<<(OStream &os, const BitField<N> &bf);
+    friend struct UtcbTraits<BitField<BITS> >;
 
     static size_t idx(uint bit) {
         return bit / (sizeof(word_t) * 8);
@@ -105,7 +107,41 @@ public:
     }
 
 private:
-    word_t _words[(BITS + sizeof(word_t) * 8 - 1) / (sizeof(word_t) * 8)];
+    /**
+     * @return the number of words up to the last one that has a bit set
+     */
+    size_t used_words() const {
+        size_t n = WORDS;
+        while(n > 0 && _words[n - 1] == 0)
+            n--;
+        return n;
+    }
+
+    static const size_t WORDS = (BITS + sizeof(word_t) * 8 - 1) / (sizeof(word_t) * 8);
+
+    word_t _words[WORDS];
+};
+
+/**
+ * Transfers only the words up to the last one that has a bit set via the UTCB
+ */
+template<uint BITS>
+struct UtcbTraits<BitField<BITS> > {
+    static const bool FIXED = false;
+
+    static size_t words(const BitField<BITS> &bf) {
+        return UtcbTraitsBase::array_words(bf.used_words(), sizeof(word_t));
+    }
+    static size_t words(const word_t *msg, size_t avail) {
+        return UtcbTraitsBase::array_words(msg, avail, BitField<BITS>::WORDS, sizeof(word_t));
+    }
+    static void write(word_t *msg, const BitField<BITS> &bf) {
+        UtcbTraitsBase::write_array(msg, bf._words, bf.used_words(), sizeof(word_t));
+    }
+    static void read(const word_t *msg, BitField<BITS> &bf) {
+        size_t n = UtcbTraitsBase::read_array(msg, bf._words, sizeof(word_t));
+        memset(bf._words + n, 0, sizeof(bf._words) - n * sizeof(word_t));
+    }
 };
 
 template<uint BITS>
@@ -55,6 +55,8 @@ struct DMADesc {
  */
 template<size_t MAX>
 class DMADescList {
+    friend struct UtcbTraits<DMADescList<MAX> >;
+
 public:
     typedef const DMADesc *iterator;
 
@@ -190,29 +192,28 @@ static inline OStream &operator<<(OStream &os, const DMADescList<MAX> &l) {
 }
 
 /**
- * Writes the list into the UTCB. Note that the UTCB size is limited!
+ * Transfers only the used descriptors of the list via the UTCB, as a count-prefixed array. Note
+ * that the UTCB size is limited!
  */
 template<size_t MAX>
-static inline UtcbFrameRef &operator<<(UtcbFrameRef &uf, const DMADescList<MAX> &l) {
-    uf << l.count();
-    for(typename DMADescList<MAX>::iterator it = l.begin(); it != l.end(); ++it)
-        uf << *it;
-    return uf;
-}
-/**
- * Reads the list back from the UTCB
- */
-template<size_t MAX>
-static inline UtcbFrameRef &operator>>(UtcbFrameRef &uf, DMADescList<MAX> &l) {
-    size_t count;
-    uf >> count;
-    l.clear();
-    while(count-- > 0) {
-        DMADesc desc;
-        uf >> desc;
-        l.push(desc);
-    }
-    return uf;
-}
+struct UtcbTraits<DMADescList<MAX> > {
+    static const bool FIXED = false;
+
+    static size_t words(const DMADescList<MAX> &l) {
+        return UtcbTraitsBase::array_words(l.count(), sizeof(DMADesc));
+    }
+    static size_t words(const word_t *msg, size_t avail) {
+        return UtcbTraitsBase::array_words(msg, avail, MAX, sizeof(DMADesc));
+    }
+    static void write(word_t *msg, const DMADescList<MAX> &l) {
+        UtcbTraitsBase::write_array(msg, l._descs, l._count, sizeof(DMADesc));
+    }
+    static void read(const word_t *msg, DMADescList<MAX> &l) {
+        l._count = UtcbTraitsBase::read_array(msg, l._descs, sizeof(DMADesc));
+        l._total = 0;
+        for(size_t i = 0; i < l._count; ++i)
+            l._total += l._descs[i].count;
+    }
+};
 
 }
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#pragma once
+
+#include <arch/Types.h>
+#include <util/Math.h>
+#include <Assert.h>
+#include <cstring>
+
+namespace nre {
+
+/**
+ * Detects the modified regions of a linear framebuffer and copies only these to another one. The
+ * framebuffer is divided into tiles of TILE_LINES scanlines with TILE_BYTES bytes each. For every
+ * tile, a hash of its content is remembered. Thus, update() only reads the source, which is
+ * typically ordinary memory, and writes just the changed tiles to the destination, which is
+ * typically slow device memory. Note that a modification that leads to the same hash is missed,
+ * so that users should call invalidate() from time to time if that matters.
+ */
+class DirtyTiles {
+public:
+    static const size_t TILE_BYTES  = 256;
+    static const size_t TILE_LINES  = 16;
+
+    /**
+     * Creates a tracker for a framebuffer with <lines> scanlines of <pitch> bytes
+     *
+     * @param pitch the number of bytes per scanline (has to be a multiple of 4)
+     * @param lines the number of scanlines
+     */
+    explicit DirtyTiles(size_t pitch, size_t lines)
+        : _pitch(pitch), _lines(lines), _cols((pitch + TILE_BYTES - 1) / TILE_BYTES),
+          _rows((lines + TILE_LINES - 1) / TILE_LINES), _hashes(new uint32_t[_cols * _rows]),
+          _valid(false) {
+        assert((pitch & (sizeof(uint32_t) - 1)) == 0);
+    }
+    ~DirtyTiles() {
+        delete[] _hashes;
+    }
+
+    /**
+     * @return the number of bytes per scanline
+     */
+    size_t pitch() const {
+        return _pitch;
+    }
+    /**
+     * @return the number of bytes of the framebuffer
+     */
+    size_t size() const {
+        return _pitch * _lines;
+    }
+    /**
+     * @return the number of tiles
+     */
+    size_t tiles() const {
+        return _cols * _rows;
+    }
+
+    /**
+     * Forgets all hashes, so that the next update() copies the whole framebuffer. This is
+     * necessary if the destination has been changed by somebody else, e.g. on a view switch.
+     */
+    void invalidate() {
+        _valid = false;
+    }
+
+    /**
+     * Copies all tiles of <src> that have changed since the last call to <dst>. Horizontally
+     * adjacent dirty tiles are copied at once.
+     *
+     * @param dst the destination framebuffer
+     * @param src the source framebuffer
+     * @return the number of copied tiles
+     */
+    size_t update(void *dst, const void *src) {
+        char *d = reinterpret_cast<char*>(dst);
+        const char *s = reinterpret_cast<const char*>(src);
+        size_t copied = 0;
+        for(size_t y = 0; y < _rows; ++y) {
+            size_t first = y * TILE_LINES;
+            size_t lines = Math::min(TILE_LINES, _lines - first);
+            uint32_t *hashes = _hashes + y * _cols;
+            size_t start = 0;
+            bool dirty = false;
+            for(size_t x = 0; x < _cols; ++x) {
+                size_t off = first * _pitch + x * TILE_BYTES;
+                uint32_t h = hash(s + off, Math::min(TILE_BYTES, _pitch - x * TILE_BYTES), lines);
+                if(!_valid || hashes[x] != h) {
+                    hashes[x] = h;
+                    if(!dirty)
+                        start = x;
+                    dirty = true;
+                    copied++;
+                }
+                else if(dirty) {
+                    copy(d, s, first, lines, start, x);
+                    dirty = false;
+                }
+            }
+            if(dirty)
+                copy(d, s, first, lines, start, _cols);
+        }
+        _valid = true;
+        return copied;
+    }
+
+private:
+    void copy(char *d, const char *s, size_t first, size_t lines, size_t start, size_t end) {
+        size_t off = first * _pitch + start * TILE_BYTES;
+        size_t bytes = Math::min(end * TILE_BYTES, _pitch) - start * TILE_BYTES;
+        for(size_t l = 0; l < lines; ++l, off += _pitch)
+            memcpy(d + off, s + off, bytes);
+    }
+
+    uint32_t hash(const char *src, size_t bytes, size_t lines) const {
+        // FNV-1a on 32-bit words
+        uint32_t h = 2166136261u;
+        for(size_t l = 0; l < lines; ++l, src += _pitch) {
+            const uint32_t *w = reinterpret_cast<const uint32_t*>(src);
+            for(size_t i = 0; i < bytes / sizeof(uint32_t); ++i)
+                h = (h ^ w[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    DirtyTiles(const DirtyTiles&);
+    DirtyTiles& operator=(const DirtyTiles&);
+
+    size_t _pitch;
+    size_t _lines;
+    size_t _cols;
+    size_t _rows;
+    uint32_t *_hashes;
+    bool _valid;
+};
+
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <util/Util.h>
+
+namespace nre {
+
+/**
+ * Heapsort implementation. In contrast to Quicksort, it needs neither recursion nor additional
+ * memory and takes O(n log n) in the worst case as well. Thus, it is suitable for large arrays and
+ * small stacks.
+ */
+template<typename T>
+class Heapsort {
+public:
+    typedef bool (*cmp_func)(T const &a, T const &b);
+
+    /**
+     * Sorts the given array with the given comparison function
+     *
+     * @param cmp the comparison function
+     * @param a the array
+     * @param count the number of items in the array
+     */
+    static void sort(cmp_func cmp, T a[], size_t count) {
+        if(count < 2)
+            return;
+        // build a max-heap
+        for(size_t i = count / 2; i-- > 0; )
+            sift_down(cmp, a, i, count);
+        // move the largest element behind the heap, one by one
+        for(size_t end = count - 1; end > 0; --end) {
+            Util::swap<T>(a[0], a[end]);
+            sift_down(cmp, a, 0, end);
+        }
+    }
+
+private:
+    static void sift_down(cmp_func cmp, T a[], size_t root, size_t count) {
+        size_t child;
+        while((child = root * 2 + 1) < count) {
+            if(child + 1 < count && cmp(a[child], a[child + 1]))
+                child++;
+            if(!cmp(a[root], a[child]))
+                break;
+            Util::swap<T>(a[root], a[child]);
+            root = child;
+        }
+    }
+
+    Heapsort();
+};
+
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <stream/OStream.h>
+#include <Hip.h>
+
+namespace nre {
+
+/**
+ * The NUMA topology of the machine as described by the SRAT and SLIT of ACPI. It is determined
+ * by the ACPI service and passed to root, which uses it to place memory and passes the node of
+ * each CPU to its childs via the Hip. The nodes are numbered densely from 0 in the order of the
+ * proximity domains. Without a SRAT, there is a single node that contains all CPUs and all memory.
+ */
+class NUMA {
+public:
+    typedef uint8_t node_t;
+
+    static const size_t MAX_NODES       = 8;
+    static const size_t MAX_RANGES      = 16;
+    // the distance of a node to itself, as defined by ACPI
+    static const uint8_t LOCAL_DIST     = 10;
+    static const uint8_t REMOTE_DIST    = 20;
+
+    /**
+     * A physical memory range that belongs to a node
+     */
+    struct Range {
+        uint64_t addr;
+        uint64_t size;
+        node_t node;
+    };
+
+    /**
+     * The topology. It is passed around by value over IPC.
+     */
+    class Info {
+    public:
+        /**
+         * Creates the topology of a machine with a single node
+         */
+        explicit Info() : _nodes(1), _ranges(0), _cpus(), _mem(), _dist() {
+            _dist[0][0] = LOCAL_DIST;
+        }
+
+        /**
+         * @return the number of nodes
+         */
+        size_t nodes() const {
+            return _nodes;
+        }
+        /**
+         * @return the number of memory ranges
+         */
+        size_t ranges() const {
+            return _ranges;
+        }
+        /**
+         * @param idx the index (< ranges())
+         * @return the memory range with given index
+         */
+        const Range &range(size_t idx) const {
+            return _mem[idx];
+        }
+        /**
+         * @param cpu the physical CPU id
+         * @return the node of the given CPU
+         */
+        node_t cpu_node(cpu_t cpu) const {
+            return _cpus[cpu];
+        }
+        /**
+         * @param addr the physical address
+         * @return the node that contains <addr> (0 if no range contains it)
+         */
+        node_t mem_node(uint64_t addr) const {
+            for(size_t i = 0; i < _ranges; ++i) {
+                if(addr >= _mem[i].addr && addr - _mem[i].addr < _mem[i].size)
+                    return _mem[i].node;
+            }
+            return 0;
+        }
+        /**
+         * @param from the first node
+         * @param to the second node
+         * @return the relative distance between the two nodes (LOCAL_DIST for from == to)
+         */
+        uint distance(node_t from, node_t to) const {
+            return _dist[from][to];
+        }
+
+        /**
+         * Sets the number of nodes and initializes the distances with LOCAL_DIST and REMOTE_DIST.
+         */
+        void nodes(size_t count) {
+            _nodes = count;
+            for(size_t i = 0; i < MAX_NODES; ++i) {
+                for(size_t j = 0; j < MAX_NODES; ++j)
+                    _dist[i][j] = i == j ? LOCAL_DIST : REMOTE_DIST;
+            }
+        }
+        /**
+         * Sets the node of given CPU
+         */
+        void cpu_node(cpu_t cpu, node_t node) {
+            _cpus[cpu] = node;
+        }
+        /**
+         * Adds the given memory range. Ranges beyond MAX_RANGES are ignored.
+         *
+         * @return true if it has been added
+         */
+        bool add_range(uint64_t addr, uint64_t size, node_t node) {
+            if(_ranges == MAX_RANGES)
+                return false;
+            _mem[_ranges].addr = addr;
+            _mem[_ranges].size = size;
+            _mem[_ranges].node = node;
+            _ranges++;
+            return true;
+        }
+        /**
+         * Sets the distance between the two given nodes
+         */
+        void distance(node_t from, node_t to, uint8_t dist) {
+            _dist[from][to] = dist;
+        }
+
+    private:
+        size_t _nodes;
+        size_t _ranges;
+        node_t _cpus[Hip::MAX_CPUS];
+        Range _mem[MAX_RANGES];
+        uint8_t _dist[MAX_NODES][MAX_NODES];
+    };
+
+private:
+    NUMA();
+};
+
+static inline OStream &operator<<(OStream &os, const NUMA::Info &info) {
+    os << "NUMA nodes: " << info.nodes() << "\n";
+    for(size_t i = 0; i < info.ranges(); ++i) {
+        const NUMA::Range &r = info.range(i);
+        os.writef("\t%#Lx..%#Lx: node %u\n", r.addr, r.addr + r.size, r.node);
+    }
+    for(NUMA::node_t i = 0; i < info.nodes(); ++i) {
+        os.writef("\tdistances of node %u:", i);
+        for(NUMA::node_t j = 0; j < info.nodes(); ++j)
+            os.writef(" %u", info.distance(i, j));
+        os << "\n";
+    }
+    return os;
+}
+
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <util/LockPolicy.h>
+#include <new>
+
+namespace nre {
+
+/**
+ * A pool for objects of type T. The memory is allocated in slabs of <SLAB_OBJS> objects and the
+ * free objects are kept in a free list, so that allocating and freeing an object is only a list
+ * operation. The slabs are never given back before the pool is destroyed, which makes it suitable
+ * for objects that are allocated and freed frequently, but whose number is bounded.
+ * By default, the pool is not thread-safe. Pass e.g. LockPolicyDefault<SpinLock> as <LockPolicy>
+ * to change that.
+ */
+template<class T, class LockPolicy = LockPolicyNone, size_t SLAB_OBJS = 32>
+class ObjectPool : public LockPolicy {
+    union Slot {
+        Slot *next;
+        char obj[sizeof(T)];
+        // for the alignment
+        word_t word;
+        double dbl;
+    };
+    struct Slab {
+        Slab *next;
+        Slot slots[SLAB_OBJS];
+    };
+
+public:
+    /**
+     * Creates an empty pool
+     */
+    explicit ObjectPool() : LockPolicy(), _free(), _slabs(), _slab_count(), _used() {
+    }
+    /**
+     * Destroys the pool and frees all slabs. Note that the objects have to be destroyed before.
+     */
+    virtual ~ObjectPool() {
+        while(_slabs) {
+            Slab *s = _slabs;
+            _slabs = s->next;
+            delete s;
+        }
+    }
+
+    /**
+     * @return the number of objects in use
+     */
+    size_t used() const {
+        return _used;
+    }
+    /**
+     * @return the number of objects that fit into the slabs allocated so far
+     */
+    size_t capacity() const {
+        return _slab_count * SLAB_OBJS;
+    }
+    /**
+     * @return the number of bytes occupied by the slabs
+     */
+    size_t size() const {
+        return _slab_count * sizeof(Slab);
+    }
+
+    /**
+     * Allocates memory for one object, without constructing it.
+     *
+     * @return the memory
+     * @throws std::bad_alloc if there is not enough memory
+     */
+    void *alloc() {
+        this->lock();
+        Slot *s = _free;
+        if(!s) {
+            // allocate the slab without holding the lock
+            this->unlock();
+            Slab *slab = new Slab;
+            this->lock();
+            for(size_t i = 0; i < SLAB_OBJS; ++i) {
+                slab->slots[i].next = _free;
+                _free = slab->slots + i;
+            }
+            slab->next = _slabs;
+            _slabs = slab;
+            _slab_count++;
+            s = _free;
+        }
+        _free = s->next;
+        _used++;
+        this->unlock();
+        return s->obj;
+    }
+    /**
+     * Puts the memory of <p> back into the pool, without destructing the object.
+     *
+     * @param p the memory, allocated by alloc()
+     */
+    void free(void *p) {
+        Slot *s = reinterpret_cast<Slot*>(p);
+        this->lock();
+        s->next = _free;
+        _free = s;
+        _used--;
+        this->unlock();
+    }
+
+    /**
+     * Allocates an object and constructs it with the given arguments. If the constructor throws,
+     * the memory is given back to the pool.
+     *
+     * @return the object
+     */
+    T *create() {
+        void *p = alloc();
+        try {
+            return new (p) T();
+        }
+        catch(...) {
+            free(p);
+            throw;
+        }
+    }
+    template<typename A1>
+    T *create(const A1 &a1) {
+        void *p = alloc();
+        try {
+            return new (p) T(a1);
+        }
+        catch(...) {
+            free(p);
+            throw;
+        }
+    }
+    template<typename A1, typename A2>
+    T *create(const A1 &a1, const A2 &a2) {
+        void *p = alloc();
+        try {
+            return new (p) T(a1, a2);
+        }
+        catch(...) {
+            free(p);
+            throw;
+        }
+    }
+    template<typename A1, typename A2, typename A3>
+    T *create(const A1 &a1, const A2 &a2, const A3 &a3) {
+        void *p = alloc();
+        try {
+            return new (p) T(a1, a2, a3);
+        }
+        catch(...) {
+            free(p);
+            throw;
+        }
+    }
+
+    /**
+     * Destructs <obj> and puts it back into the pool. Does nothing if <obj> is 0.
+     *
+     * @param obj the object, created by create()
+     */
+    void destroy(T *obj) {
+        if(obj) {
+            obj->~T();
+            free(obj);
+        }
+    }
+
+private:
+    ObjectPool(const ObjectPool&);
+    ObjectPool& operator=(const ObjectPool&);
+
+    Slot *_free;
+    Slab *_slabs;
+    size_t _slab_count;
+    size_t _used;
+};
+
+}
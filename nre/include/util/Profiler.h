@@ -18,7 +18,9 @@
 
 #include <util/Util.h>
 #include <util/Math.h>
+#include <util/HeapSort.h>
 #include <Assert.h>
+#include <cstring>
 
 namespace nre {
 
@@ -45,13 +47,18 @@ public:
         _start = Util::tsc();
     }
     virtual time_t stop() {
-        time_t time = Util::tsc() - _start;
-        time = time > _rdtsc ? time - _rdtsc : 0;
+        time_t time = elapsed();
         _min = Math::min(_min, time);
         _max = Math::max(_max, time);
         return time;
     }
 
+protected:
+    time_t elapsed() const {
+        time_t time = Util::tsc() - _start;
+        return time > _rdtsc ? time - _rdtsc : 0;
+    }
+
 private:
     static time_t measure() {
         time_t tic = Util::tsc();
@@ -65,35 +72,86 @@ private:
     time_t _max;
 };
 
+/**
+ * A profiler that stores all measured times, so that you can get the average, the median and
+ * other percentiles afterwards. The first <warmup> measurements are not recorded, to ignore
+ * cold caches and TLBs.
+ */
 class AvgProfiler : public Profiler {
 public:
-    explicit AvgProfiler(size_t count) : _count(count), _pos(0), _results(new time_t[count]) {
+    explicit AvgProfiler(size_t count, size_t warmup = 0)
+        : _count(count), _warmup(warmup), _pos(0), _results(new time_t[count]), _sorted() {
     }
     virtual ~AvgProfiler() {
         delete[] _results;
+        delete[] _sorted;
     }
 
+    /**
+     * @return the number of recorded measurements
+     */
+    size_t count() const {
+        return _pos;
+    }
     time_t avg() const {
+        if(_pos == 0)
+            return 0;
         time_t avg = 0;
-        for(size_t i = 0; i < _count; i++)
+        for(size_t i = 0; i < _pos; i++)
             avg += _results[i];
-        return avg / _count;
+        return avg / _pos;
+    }
+    time_t median() {
+        return percentile(50);
+    }
+    /**
+     * @param p the percentile (0..100)
+     * @return the smallest recorded time that is larger or equal than <p> percent of all times
+     */
+    time_t percentile(uint p) {
+        if(_pos == 0)
+            return 0;
+        if(!_sorted) {
+            _sorted = new time_t[_pos];
+            memcpy(_sorted, _results, _pos * sizeof(time_t));
+            // don't use Quicksort here, which recurses up to <_pos> times for already sorted
+            // times, which don't fit on our stack for large profilers
+            Heapsort<time_t>::sort(cmp_times, _sorted, _pos);
+        }
+        size_t rank = (Math::min<uint>(p, 100) * _pos + 99) / 100;
+        return _sorted[rank > 0 ? rank - 1 : 0];
     }
 
     virtual void start() {
-        assert(_pos < _count);
+        assert(_warmup > 0 || _pos < _count);
         Profiler::start();
     }
     virtual time_t stop() {
+        if(_warmup > 0) {
+            _warmup--;
+            return elapsed();
+        }
         time_t time = Profiler::stop();
         _results[_pos++] = time;
+        // the sorted copy is outdated now
+        delete[] _sorted;
+        _sorted = 0;
         return time;
     }
 
 private:
+    static bool cmp_times(const time_t &a, const time_t &b) {
+        return a < b;
+    }
+
+    AvgProfiler(const AvgProfiler&);
+    AvgProfiler& operator=(const AvgProfiler&);
+
     size_t _count;
+    size_t _warmup;
     size_t _pos;
     time_t *_results;
+    time_t *_sorted;
 };
 
 }
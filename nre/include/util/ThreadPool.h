@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <util/WorkDeque.h>
+#include <util/Atomic.h>
+#include <util/Sync.h>
+
+namespace nre {
+
+class Thread;
+
+/**
+ * A pool of worker threads, one GlobalThread per CPU, to parallelize work inside a service, like
+ * loading ELF files, computing checksums or copying large buffers. Each worker owns a
+ * work-stealing deque. Tasks that are submitted by a worker are pushed to its own deque, tasks
+ * from other threads are put into the inbox of a worker, which moves them into its deque. Idle
+ * workers steal from the others and block on their semaphore if there is nothing left to do.
+ *
+ * The completion of tasks can be waited for with a Future. Note that tasks should not block for a
+ * long time, because the worker can't do anything else meanwhile.
+ */
+class ThreadPool {
+    static const size_t CACHE_LINE      = 64;
+
+public:
+    typedef void (*task_func)(void *arg);
+    typedef void (*range_func)(size_t begin, size_t end, void *arg);
+
+    static const cpu_t ANY_CPU          = static_cast<cpu_t>(-1);
+    static const size_t DEF_CAPACITY    = 1024;
+
+    /**
+     * Tracks the completion of a set of tasks. A Future may be reused for further tasks as soon as
+     * wait() returned, but there may only be one thread that waits for it at a time.
+     */
+    class Future {
+        friend class ThreadPool;
+
+    public:
+        explicit Future() : _state(0), _sm(0) {
+        }
+
+        /**
+         * @return true if all tasks that have been submitted with this future are done
+         */
+        bool done() const {
+            return (_state >> 1) == 0;
+        }
+
+        /**
+         * Blocks until all tasks that have been submitted with this future are done
+         */
+        void wait() {
+            long s;
+            while((s = _state) != 0) {
+                // announce that we're waiting; the last complete() will wake us up
+                if(!Atomic::cmpnswap(&_state, s, s | 1))
+                    continue;
+                _sm.down();
+                Atomic::add(&_state, -1);
+            }
+        }
+
+    private:
+        Future(const Future&);
+        Future& operator=(const Future&);
+
+        void add() {
+            Atomic::add(&_state, +2);
+        }
+        void complete() {
+            // touch the object only once, because the waiter might leave as soon as it sees 0
+            if(Atomic::add(&_state, -2) == 3)
+                _sm.up();
+        }
+
+        // the number of pending tasks times 2, plus 1 if somebody is waiting
+        volatile long _state;
+        Sm _sm;
+    };
+
+    /**
+     * Creates a pool with one worker on each CPU and starts them.
+     *
+     * @param name the name prefix for the worker threads
+     * @param capacity the maximum number of queued tasks per worker. If it's exceeded, the
+     *  task is executed by the submitting thread.
+     */
+    explicit ThreadPool(const char *name = "pool", size_t capacity = DEF_CAPACITY);
+    /**
+     * Lets the workers execute the tasks that are still queued and waits until they are gone.
+     * Must not be called by a worker.
+     */
+    ~ThreadPool();
+
+    /**
+     * @return the number of workers
+     */
+    size_t workers() const {
+        return _count;
+    }
+
+    /**
+     * Submits a task. If called from a worker, the task is pushed to the deque of this worker.
+     * Otherwise, it is put into the inbox of the worker on <cpu> or, if <cpu> is ANY_CPU, of the
+     * next worker in a round-robin fashion. In any case, <cpu> is only a hint, because other
+     * workers might steal it.
+     *
+     * @param func the function to call
+     * @param arg the argument to pass to <func>
+     * @param fut the future to notify on completion (optional)
+     * @param cpu the logical CPU to prefer (ANY_CPU = don't care)
+     */
+    void submit(task_func func, void *arg, Future *fut = 0, cpu_t cpu = ANY_CPU);
+
+    /**
+     * Calls <func> for all subranges of <begin>..<end> with at most <grain> elements and waits
+     * until all are done. The calling thread helps to execute them.
+     *
+     * @param begin the first element
+     * @param end the element behind the last one
+     * @param grain the maximum number of elements per call (0 = choose it automatically)
+     * @param func the function to call
+     * @param arg the argument to pass to <func>
+     */
+    void parallel_for(size_t begin, size_t end, size_t grain, range_func func, void *arg);
+
+private:
+    struct Task {
+        task_func func;
+        void *arg;
+        Future *future;
+    };
+
+    /**
+     * The tasks that are submitted by other threads. Since there may be multiple producers, it is
+     * protected by a lock.
+     */
+    class Inbox {
+    public:
+        explicit Inbox(size_t capacity)
+            : _lock(), _head(0), _tail(0), _count(0), _mask(capacity - 1),
+              _tasks(new Task[capacity]) {
+        }
+        ~Inbox() {
+            delete[] _tasks;
+        }
+
+        bool empty() const {
+            return _count == 0;
+        }
+        bool put(const Task &t);
+        bool take(Task &t);
+
+    private:
+        Inbox(const Inbox&);
+        Inbox& operator=(const Inbox&);
+
+        UserSm _lock;
+        size_t _head;
+        size_t _tail;
+        volatile size_t _count;
+        size_t _mask;
+        Task *_tasks;
+    };
+
+    struct Worker {
+        explicit Worker(ThreadPool *pool, size_t idx, cpu_t cpu, size_t capacity)
+            : deque(capacity), inbox(deque.capacity()), pool(pool), thread(), idx(idx), cpu(cpu),
+              sleeping(0), sm(0) {
+        }
+
+        WorkDeque<Task> deque;
+        Inbox inbox;
+        ThreadPool *pool;
+        Thread *thread;
+        size_t idx;
+        cpu_t cpu;
+        volatile int sleeping;
+        Sm sm;
+    };
+
+    struct Range {
+        size_t begin;
+        size_t end;
+        range_func func;
+        void *arg;
+    };
+
+    static void worker_main(void*);
+    static void run_range(void *arg);
+    static void run(const Task &t);
+
+    Worker *current() const;
+    bool next(Worker *w, Task &t);
+    bool steal(Worker *w, Task &t);
+    bool has_work() const;
+    void park(Worker *w);
+    bool wake(Worker *w);
+    void wake_one(Worker *except);
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    size_t _count;
+    Worker **_workers;
+    volatile size_t _next;
+    volatile long _idle;
+    volatile bool _stop;
+    Sm _done;
+};
+
+}
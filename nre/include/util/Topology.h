@@ -85,6 +85,15 @@ public:
         }
     }
 
+    /**
+     * @param a the first CPU
+     * @param b the second CPU
+     * @return true if <a> and <b> are hyperthreads of the same core
+     */
+    static bool siblings(const CPU &a, const CPU &b) {
+        return a.package() == b.package() && a.core() == b.core();
+    }
+
 private:
     static bool cmp_cpus(const SortCPU &a, const SortCPU &b) {
         uint a_v = (a.package << 16) | (a.core << 8) | (a.thread);
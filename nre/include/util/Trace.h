@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <Logging.h>
+
+/**
+ * Records the tracepoint <point> with the phase <phase> and the argument <arg>, if the
+ * Logging-category of the tracepoint is enabled in Trace::mask. Like LOG(), the compiler is able to
+ * eliminate the code completely, if the category is disabled.
+ */
+#define TRACE(point, phase, arg)                                            \
+    do {                                                                    \
+        if(nre::Trace::mask & nre::Trace::category(nre::Trace::point))      \
+            nre::Trace::record(nre::Trace::point, nre::Trace::phase, (arg)); \
+    }                                                                       \
+    while(0)
+
+#define TRACE_BEGIN(point, arg)     TRACE(point, BEGIN, arg)
+#define TRACE_END(point, arg)       TRACE(point, END, arg)
+#define TRACE_EVENT(point, arg)     TRACE(point, INSTANT, arg)
+
+namespace nre {
+
+class OStream;
+class DataSpace;
+
+/**
+ * A lightweight tracing facility. The tracepoints are registered at compile-time in the Point
+ * enum and belong to a Logging category. If this category is enabled in Trace::mask, the
+ * tracepoint writes a binary record (TSC, CPU, thread, argument) into the buffer of the current
+ * CPU. The buffers live in a dataspace that is created by Trace::init(); as long as it doesn't
+ * exist, all records are dropped. Each CPU-buffer is a ring, i.e. older records are overwritten.
+ * Trace::dump() writes the records in a line-based format to a stream, which can be converted
+ * by tools/trace into a Chrome-trace/Perfetto timeline.
+ */
+class Trace {
+public:
+    /**
+     * The tracepoints
+     */
+    enum Point {
+        IPC_CALL,           // Pt::call; arg = portal selector
+        PAGEFAULT,          // ChildManager::Portals::pf; arg = fault address
+        STORAGE_REQ,        // storage request, from submit (ASYNC_BEGIN) to completion
+                            // (ASYNC_END); arg = tag
+        VMEXIT,             // Vancouver VM exit; arg = exit type, port or address
+        POINT_COUNT
+    };
+
+    /**
+     * The phases, as understood by the Chrome-trace format. ASYNC_BEGIN and ASYNC_END are matched
+     * by the tracepoint and their argument instead of by the thread. Thus, both have to use the
+     * same tracepoint.
+     */
+    enum Phase {
+        BEGIN,
+        END,
+        INSTANT,
+        ASYNC_BEGIN,
+        ASYNC_END
+    };
+
+    /**
+     * A trace record
+     */
+    struct Record {
+        uint64_t tsc;
+        word_t thread;
+        word_t arg;
+        uint16_t point;
+        uint8_t phase;
+        uint8_t cpu;
+    };
+
+    static const size_t CACHE_LINE      = 64;
+    static const size_t DEF_RECORDS     = 4096;
+
+    /**
+     * The Logging categories for which tracepoints are enabled
+     */
+    static const int mask = 0;
+
+    /**
+     * @param p the tracepoint
+     * @return the Logging category of the tracepoint
+     */
+    static int category(Point p) {
+        switch(p) {
+            case IPC_CALL:
+                return Logging::IPC;
+            case PAGEFAULT:
+                return Logging::PFS;
+            case STORAGE_REQ:
+                return Logging::STORAGE;
+            case VMEXIT:
+                return Logging::VMEXITS;
+            default:
+                return 0;
+        }
+    }
+    /**
+     * @param p the tracepoint
+     * @return the name of the tracepoint
+     */
+    static const char *name(Point p);
+
+    /**
+     * Creates the trace buffers with <records> records per CPU. Does nothing if tracing is
+     * disabled or the buffers exist already.
+     *
+     * @param records the number of records per CPU
+     * @throws DataSpaceException if the creation of the dataspace failed
+     */
+    static void init(size_t records = DEF_RECORDS);
+
+    /**
+     * @return the dataspace that holds the buffers (0 if not initialized). It can be shared with
+     *  other protection domains to let them read the records.
+     */
+    static const DataSpace *buffers() {
+        return _ds;
+    }
+
+    /**
+     * Records the given tracepoint. Should be used via the TRACE* macros.
+     *
+     * @param p the tracepoint
+     * @param ph the phase
+     * @param arg the argument
+     */
+    static void record(Point p, Phase ph, word_t arg);
+
+    /**
+     * Writes all records to <os>, CPU by CPU. The recording is paused meanwhile.
+     *
+     * @param os the stream
+     * @param name the name to put into the header, to distinguish different protection domains
+     */
+    static void dump(OStream &os, const char *name = "");
+
+private:
+    struct Buffer {
+        volatile size_t pos;
+        char pad[CACHE_LINE - sizeof(size_t)];
+        Record records[];
+    };
+
+    static Buffer *buffer(cpu_t cpu);
+
+    Trace();
+
+    static DataSpace *_ds;
+    static size_t _records;
+    static size_t _bufsize;
+    static bool _paused;
+};
+
+}
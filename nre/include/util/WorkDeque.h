@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+#include <util/Atomic.h>
+#include <util/Math.h>
+#include <util/Sync.h>
+
+namespace nre {
+
+/**
+ * A fixed-size work-stealing deque as described by Chase and Lev ("Dynamic circular work-stealing
+ * deque", SPAA 2005), but without growing. The owner pushes and pops at the bottom (LIFO), while
+ * any other thread may steal from the top (FIFO). Only steal() and the pop of the last element
+ * need an atomic operation; everything else is a plain load or store.
+ *
+ * Since the array never grows, an element may be copied out by a thief while the owner overwrites
+ * it. This can only happen if top has moved on meanwhile, so that the compare-and-swap of the thief
+ * fails and the copy is discarded. Thus, T may be any POD type, not only a word.
+ */
+template<typename T>
+class WorkDeque {
+    static const size_t CACHE_LINE  = 64;
+
+public:
+    /**
+     * Creates a deque for at least <capacity> elements
+     *
+     * @param capacity the capacity (will be rounded up to the next power of 2)
+     */
+    explicit WorkDeque(size_t capacity)
+        : _top(0), _bottom(0), _mask(Math::next_pow2(capacity) - 1), _elems(new T[_mask + 1]) {
+    }
+    ~WorkDeque() {
+        delete[] _elems;
+    }
+
+    /**
+     * @return the capacity
+     */
+    size_t capacity() const {
+        return _mask + 1;
+    }
+    /**
+     * @return true if the deque seems to be empty (may be outdated immediately, of course)
+     */
+    bool empty() const {
+        return _bottom <= _top;
+    }
+
+    /**
+     * Pushes <e> to the bottom. May only be called by the owner.
+     *
+     * @param e the element
+     * @return true if successful, false if the deque is full
+     */
+    bool push(const T &e) {
+        long b = _bottom;
+        if(b - _top > static_cast<long>(_mask))
+            return false;
+        _elems[b & _mask] = e;
+        // x86 doesn't reorder stores with other stores, so that a compiler barrier suffices
+        Sync::memory_barrier();
+        _bottom = b + 1;
+        return true;
+    }
+
+    /**
+     * Pops the element from the bottom. May only be called by the owner.
+     *
+     * @param e will be set to the element
+     * @return true if successful, false if the deque is empty
+     */
+    bool pop(T &e) {
+        long b = _bottom - 1;
+        _bottom = b;
+        // the store to bottom has to be visible before we read top; otherwise a thief and we might
+        // both take the last element
+        Sync::memory_fence();
+        long t = _top;
+        if(t > b) {
+            _bottom = b + 1;
+            return false;
+        }
+        e = _elems[b & _mask];
+        if(t == b) {
+            // last element: race with the thieves for it
+            bool res = Atomic::cmpnswap(&_top, t, t + 1);
+            _bottom = b + 1;
+            return res;
+        }
+        return true;
+    }
+
+    /**
+     * Steals the element from the top. May be called by every thread.
+     *
+     * @param e will be set to the element
+     * @return true if successful, false if the deque is empty or we lost a race
+     */
+    bool steal(T &e) {
+        long t = _top;
+        // x86 doesn't reorder loads with other loads
+        Sync::memory_barrier();
+        long b = _bottom;
+        if(t >= b)
+            return false;
+        e = _elems[t & _mask];
+        return Atomic::cmpnswap(&_top, t, t + 1);
+    }
+
+private:
+    WorkDeque(const WorkDeque&);
+    WorkDeque& operator=(const WorkDeque&);
+
+    // top is written by the thieves and bottom by the owner; keep them on different cache lines
+    volatile long _top;
+    char _pad[CACHE_LINE - sizeof(long)];
+    volatile long _bottom;
+    size_t _mask;
+    T *_elems;
+};
+
+}
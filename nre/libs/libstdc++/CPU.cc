@@ -64,6 +64,7 @@ CPUInit::CPUInit() {
         cpu._package = it->package;
         cpu._core = it->core;
         cpu._thread = it->thread;
+        cpu._node = it->node;
 
         // create per-cpu-portals
         if(_startup_info.child) {
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <arch/SpinLock.h>
+#include <kobj/Thread.h>
+#include <util/Atomic.h>
+#include <Compiler.h>
+#include <Hip.h>
+#include <cstring>
+
+#include "dlmalloc-cache.h"
+
+using namespace nre;
+
+EXTERN_C void* dlmemalign(size_t, size_t);
+EXTERN_C void dlfree(void*);
+EXTERN_C void** dlindependent_comalloc(size_t, size_t*, void**);
+EXTERN_C size_t dlbulk_free(void**, size_t);
+
+/*
+ * Each object is preceded by a header of HEADER_SIZE bytes to keep the alignment of dlmalloc. The
+ * word directly before the object would be the head of the chunk, if the object would have been
+ * allocated by dlmalloc. dlmalloc never sets FLAG4_BIT (4) in the head, so that we use it to
+ * distinguish our objects from the ones of dlmalloc. The remaining bits hold the owner CPU and the
+ * size-class. The word before that is used to link the free objects.
+ */
+static const size_t HEADER_SIZE     = 2 * sizeof(word_t);
+static const word_t TAG             = 4;
+static const size_t CLASS_COUNT     = 10;
+static const size_t MAX_SIZE        = 512;
+// the number of objects we fetch from dlmalloc at once is SLAB_SIZE / size, limited by MAX_BATCH
+static const size_t SLAB_SIZE       = 4096;
+static const size_t MIN_BATCH       = 4;
+static const size_t MAX_BATCH       = 32;
+static const size_t CACHE_LINE      = 64;
+
+static const size_t class_sizes[CLASS_COUNT] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+// maps (size + 15) / 16 to the size-class
+static const uchar class_of_size[MAX_SIZE / 16 + 1] = {
+    0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9
+};
+
+struct CPUCache {
+    // protects the local lists against other threads on the same CPU
+    spinlock_t lock;
+    word_t *free[CLASS_COUNT];
+    size_t count[CLASS_COUNT];
+    char pad[CACHE_LINE];
+    // written by other CPUs; therefore on different cache lines
+    word_t *volatile remote[CLASS_COUNT];
+};
+
+static CPUCache *volatile caches[Hip::MAX_CPUS];
+
+static inline word_t *&next(word_t *obj) {
+    return reinterpret_cast<word_t**>(obj)[-2];
+}
+
+static inline size_t batch_size(size_t cls) {
+    size_t count = SLAB_SIZE / (class_sizes[cls] + HEADER_SIZE);
+    return count < MIN_BATCH ? MIN_BATCH : (count > MAX_BATCH ? MAX_BATCH : count);
+}
+
+static CPUCache *get_cache(cpu_t cpu) {
+    CPUCache *c = caches[cpu];
+    if(EXPECT_TRUE(c))
+        return c;
+
+    c = static_cast<CPUCache*>(dlmemalign(CACHE_LINE, sizeof(CPUCache)));
+    if(!c)
+        return 0;
+    memset(c, 0, sizeof(*c));
+    // somebody else might have been faster
+    if(!Atomic::cmpnswap(caches + cpu, static_cast<CPUCache*>(0), c)) {
+        dlfree(c);
+        c = caches[cpu];
+    }
+    return c;
+}
+
+static void push_remote(CPUCache *c, size_t cls, word_t *obj) {
+    word_t *head;
+    do {
+        head = c->remote[cls];
+        next(obj) = head;
+    }
+    while(!Atomic::cmpnswap(c->remote + cls, head, obj));
+}
+
+// moves the objects in the remote list to the local list. requires the lock
+static void take_remote(CPUCache *c, size_t cls) {
+    // the owner is the only one that removes objects and it takes all at once. thus, there is no
+    // ABA problem.
+    word_t *list;
+    do
+        list = c->remote[cls];
+    while(list && !Atomic::cmpnswap(c->remote + cls, list, static_cast<word_t*>(0)));
+
+    while(list) {
+        word_t *n = next(list);
+        next(list) = c->free[cls];
+        c->free[cls] = list;
+        c->count[cls]++;
+        list = n;
+    }
+}
+
+// fetches a slab of objects from dlmalloc. requires the lock
+static void refill(CPUCache *c, cpu_t cpu, size_t cls) {
+    size_t sizes[MAX_BATCH];
+    void *chunks[MAX_BATCH];
+    size_t count = batch_size(cls);
+    for(size_t i = 0; i < count; ++i)
+        sizes[i] = class_sizes[cls] + HEADER_SIZE;
+    if(!dlindependent_comalloc(count, sizes, chunks))
+        return;
+
+    word_t tag = (static_cast<word_t>(cpu) << 16) | (cls << 8) | TAG;
+    for(size_t i = 0; i < count; ++i) {
+        word_t *obj = reinterpret_cast<word_t*>(static_cast<char*>(chunks[i]) + HEADER_SIZE);
+        obj[-1] = tag;
+        next(obj) = c->free[cls];
+        c->free[cls] = obj;
+    }
+    c->count[cls] += count;
+}
+
+// gives one batch back to dlmalloc. requires the lock
+static void flush(CPUCache *c, size_t cls) {
+    void *chunks[MAX_BATCH];
+    size_t count = batch_size(cls);
+    for(size_t i = 0; i < count; ++i) {
+        word_t *obj = c->free[cls];
+        c->free[cls] = next(obj);
+        chunks[i] = reinterpret_cast<char*>(obj) - HEADER_SIZE;
+    }
+    c->count[cls] -= count;
+    dlbulk_free(chunks, count);
+}
+
+void *dlcache_malloc(size_t size) {
+    if(size > MAX_SIZE)
+        return 0;
+    Thread *t = Thread::current();
+    if(EXPECT_FALSE(!t))
+        return 0;
+    cpu_t cpu = t->cpu();
+    CPUCache *c = get_cache(cpu);
+    // if another thread on this CPU is using the cache at the moment, we've interrupted it. don't
+    // wait for it, but let dlmalloc handle that request
+    if(EXPECT_FALSE(!c || !Atomic::cmpnswap(&c->lock, 0, 1)))
+        return 0;
+
+    size_t cls = class_of_size[(size + 15) / 16];
+    if(EXPECT_FALSE(!c->free[cls])) {
+        take_remote(c, cls);
+        if(!c->free[cls])
+            refill(c, cpu, cls);
+    }
+    word_t *obj = c->free[cls];
+    if(EXPECT_TRUE(obj)) {
+        c->free[cls] = next(obj);
+        c->count[cls]--;
+    }
+    unlock(&c->lock);
+    return obj;
+}
+
+bool dlcache_free(void *p) {
+    word_t *obj = static_cast<word_t*>(p);
+    word_t tag = obj[-1];
+    if(!(tag & TAG))
+        return false;
+
+    cpu_t owner = tag >> 16;
+    size_t cls = (tag >> 8) & 0xFF;
+    CPUCache *c = caches[owner];
+    Thread *t = Thread::current();
+    if(EXPECT_TRUE(t && t->cpu() == owner && Atomic::cmpnswap(&c->lock, 0, 1))) {
+        next(obj) = c->free[cls];
+        c->free[cls] = obj;
+        c->count[cls]++;
+        if(EXPECT_FALSE(c->count[cls] > batch_size(cls) * 2)) {
+            take_remote(c, cls);
+            while(c->count[cls] > batch_size(cls))
+                flush(c, cls);
+        }
+        unlock(&c->lock);
+    }
+    else
+        push_remote(c, cls, obj);
+    return true;
+}
+
+size_t dlcache_size(void *p) {
+    word_t tag = static_cast<word_t*>(p)[-1];
+    if(!(tag & TAG))
+        return 0;
+    return class_sizes[(tag >> 8) & 0xFF];
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <arch/Types.h>
+
+/**
+ * Per-CPU caches for small objects on top of dlmalloc. Each CPU has a cache for every size-class,
+ * which is refilled with a slab of objects from dlmalloc at once and flushed back in batches, so
+ * that the global dlmalloc-lock is only taken once per batch. Objects that are freed on a different
+ * CPU than the one they've been allocated on are put into a lock-free remote-free list of their
+ * owner, which takes them back on its next refill.
+ */
+
+/**
+ * Allocates <size> bytes from the cache of the current CPU.
+ *
+ * @param size the number of bytes
+ * @return the object or 0 if the cache can't handle this request (use dlmalloc in this case)
+ */
+void *dlcache_malloc(size_t size);
+
+/**
+ * Frees <p>, if it has been allocated by dlcache_malloc.
+ *
+ * @param p the object (allocated either by dlcache_malloc or dlmalloc)
+ * @return true if it has been freed; false if it belongs to dlmalloc
+ */
+bool dlcache_free(void *p);
+
+/**
+ * @param p the object (allocated either by dlcache_malloc or dlmalloc)
+ * @return the usable size of <p>, if it has been allocated by dlcache_malloc. 0 otherwise
+ */
+size_t dlcache_size(void *p);
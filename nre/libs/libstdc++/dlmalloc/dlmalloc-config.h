@@ -29,6 +29,7 @@
 #define HAVE_MORECORE           0
 #define HAVE_MMAP               1
 #define HAVE_MREMAP             0
+#define MMAP_CLEARS             0                   // DataSpaces are not zeroed
 
 #define LACKS_UNISTD_H
 #define LACKS_FCNTL_H
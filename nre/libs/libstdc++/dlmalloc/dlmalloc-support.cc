@@ -24,6 +24,7 @@
 #include <Syscalls.h>
 #include <util/Atomic.h>
 #include "dlmalloc-config.h"
+#include "dlmalloc-cache.h"
 
 using namespace nre;
 
@@ -44,6 +45,9 @@ EXTERN_C void free(void*);
 
 static void* startup_malloc(size_t size);
 static void startup_free(void *ptr);
+static void* cached_malloc(size_t size);
+static void* cached_realloc(void *p, size_t size);
+static void cached_free(void *p);
 
 static malloc_func malloc_ptr = startup_malloc;
 static realloc_func realloc_ptr = 0;
@@ -77,15 +81,87 @@ void semaphore_up(DlMallocSm *lk) {
 
 // Backend allocator
 
+/*
+ * We remember the dataspaces we've created for dlmalloc to be able to destroy them in munmap.
+ * Both mmap and munmap are only called by dlmalloc with its global lock held. If the table is
+ * full, we append another one, which is kept forever. Note that we can't store the DataSpaceDesc
+ * itself, because its constructor might run after the first mmap.
+ */
+struct Mapping {
+    uintptr_t virt;
+    uintptr_t phys;
+    uintptr_t origin;
+    size_t size;
+    size_t reqsize;
+    uint align;
+    uint flags;
+    capsel_t sel;
+    capsel_t unmapsel;
+};
+
+static const size_t MAX_MAPPINGS    = 128;
+
+struct MappingTable {
+    MappingTable *next;
+    Mapping entries[MAX_MAPPINGS];
+};
+
+static MappingTable mappings;
+
+static Mapping *find_mapping(uintptr_t virt) {
+    for(MappingTable *t = &mappings; t; t = t->next) {
+        for(size_t i = 0; i < MAX_MAPPINGS; ++i) {
+            if(t->entries[i].virt == virt)
+                return t->entries + i;
+        }
+    }
+    return 0;
+}
+
+static Mapping *grow_mappings() {
+    capsel_t sel, unmapsel;
+    DataSpaceDesc desc(sizeof(MappingTable), DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    DataSpace::create(desc, &sel, &unmapsel);
+    MappingTable *table = reinterpret_cast<MappingTable*>(desc.virt());
+    memset(table, 0, sizeof(*table));
+    MappingTable *last = &mappings;
+    while(last->next)
+        last = last->next;
+    last->next = table;
+    return table->entries;
+}
+
 void *mmap(void *, size_t size, int prot, int, int, off_t) {
+    // find a free entry first, so that we don't have to undo the mapping if that fails
+    Mapping *m = find_mapping(0);
+    if(!m)
+        m = grow_mappings();
+
+    capsel_t sel, unmapsel;
     DataSpaceDesc desc(size, DataSpaceDesc::ANONYMOUS, prot);
-    DataSpace::create(desc);
-    memset(reinterpret_cast<void*>(desc.virt()), 0, desc.size());
+    DataSpace::create(desc, &sel, &unmapsel);
+    // note that we don't need to clear the memory, since MMAP_CLEARS is 0
+    m->virt = desc.virt();
+    m->phys = desc.phys();
+    m->origin = desc.origin();
+    m->size = desc.size();
+    m->reqsize = size;
+    m->align = desc.align();
+    m->flags = desc.flags();
+    m->sel = sel;
+    m->unmapsel = unmapsel;
     return reinterpret_cast<void*>(desc.virt());
 }
 
-int munmap(void *, size_t) {
-    // TODO implement me
+int munmap(void *addr, size_t size) {
+    Mapping *m = find_mapping(reinterpret_cast<uintptr_t>(addr));
+    // we can't release parts of a dataspace. dlmalloc copes with that
+    if(!m || m->reqsize != size)
+        return -1;
+    DataSpaceDesc desc(m->size, DataSpaceDesc::ANONYMOUS, m->flags, m->phys, m->virt,
+                       m->origin, m->align);
+    DataSpace::destroy(desc, m->sel, m->unmapsel);
+    m->virt = 0;
     return 0;
 }
 
@@ -93,9 +169,9 @@ int munmap(void *, size_t) {
 
 void dlmalloc_init() {
     dlmalloc_init_locks();
-    malloc_ptr = dlmalloc;
-    realloc_ptr = dlrealloc;
-    free_ptr = dlfree;
+    malloc_ptr = cached_malloc;
+    realloc_ptr = cached_realloc;
+    free_ptr = cached_free;
 }
 
 void* malloc(size_t size) {
@@ -112,6 +188,34 @@ void free(void *p) {
         free_ptr(p);
 }
 
+// per-CPU caches in front of dlmalloc
+
+static void* cached_malloc(size_t size) {
+    void *p = dlcache_malloc(size);
+    return p ? p : dlmalloc(size);
+}
+
+static void* cached_realloc(void *p, size_t size) {
+    if(!p)
+        return cached_malloc(size);
+    size_t old = dlcache_size(p);
+    if(old == 0)
+        return dlrealloc(p, size);
+    if(size <= old)
+        return p;
+    void *res = cached_malloc(size);
+    if(res) {
+        memcpy(res, p, old);
+        dlcache_free(p);
+    }
+    return res;
+}
+
+static void cached_free(void *p) {
+    if(p && !dlcache_free(p))
+        dlfree(p);
+}
+
 // startup malloc implementation
 
 static void* startup_malloc(size_t size) {
@@ -16,19 +16,63 @@
 
 #include <ipc/Service.h>
 #include <ipc/ServiceSession.h>
+#include <util/ObjectPool.h>
+#include <util/Atomic.h>
+#include <arch/SpinLock.h>
 
 namespace nre {
 
+typedef ObjectPool<ServiceSession, LockPolicyDefault<SpinLock> > SessionPool;
+typedef ObjectPool<Pt, LockPolicyDefault<SpinLock> > PtPool;
+
+// the pools are created on first use and are never destroyed, because sessions might still be
+// destroyed during the destruction of static objects
+template<class T>
+static T *get_pool(T *volatile *pool) {
+    T *p = *pool;
+    if(!p) {
+        p = new T();
+        if(!Atomic::cmpnswap(pool, static_cast<T*>(0), p)) {
+            delete p;
+            p = *pool;
+        }
+    }
+    return p;
+}
+
+static SessionPool *volatile session_pool;
+static PtPool *volatile pt_pool;
+
 ServiceSession::ServiceSession(Service *s, size_t id, capsel_t cap, capsel_t pts, Pt::portal_func func)
     : RCUObject(), _id(id), _cap(cap), _caps(pts), _pts(new Pt *[CPU::count()]) {
+    PtPool *pool = get_pool(&pt_pool);
     for(uint i = 0; i < CPU::count(); ++i) {
         _pts[i] = 0;
         if(s->available().is_set(i)) {
             LocalThread *ec = s->get_thread(i);
             assert(ec != 0);
-            _pts[i] = new Pt(ec, pts + i, func);
+            _pts[i] = pool->create(ec, pts + i, func);
         }
     }
 }
 
+ServiceSession::~ServiceSession() {
+    for(uint i = 0; i < CPU::count(); ++i)
+        pt_pool->destroy(_pts[i]);
+    delete[] _pts;
+}
+
+void *ServiceSession::operator new(size_t size) {
+    if(size == sizeof(ServiceSession))
+        return get_pool(&session_pool)->alloc();
+    return ::operator new(size);
+}
+
+void ServiceSession::operator delete(void *p, size_t size) {
+    if(size == sizeof(ServiceSession))
+        session_pool->free(p);
+    else
+        ::operator delete(p);
+}
+
 }
@@ -36,9 +36,9 @@ GlobalThread::~GlobalThread() {
     delete _sc;
 }
 
-void GlobalThread::start(Qpd qpd, Pd *pd) {
+void GlobalThread::start(Qpd qpd, Pd *pd, const Reservation &res) {
     assert(_sc == 0);
-    _sc = new Sc(this, qpd, pd);
+    _sc = new Sc(this, qpd, pd, res);
     _sc->start(_name);
 }
 
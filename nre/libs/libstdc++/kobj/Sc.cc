@@ -39,7 +39,7 @@ void Sc::start(const String &name) {
     UtcbFrame uf;
     ScopedCapSels sc;
     uf.delegation_window(Crd(sc.get(), 0, Crd::OBJ_ALL));
-    uf << START << name << _ec->cpu() << _qpd;
+    uf << START << name << _ec->cpu() << _qpd << _res;
     uf.delegate(_ec->sel());
     // in this case we should assign the selector before it has been successfully created
     // because the Sc starts immediatly. therefore, it should be completely initialized before
@@ -48,7 +48,7 @@ void Sc::start(const String &name) {
         sel(sc.get());
         CPU::current().sc_pt().call(uf);
         uf.check_reply();
-        uf >> _qpd;
+        uf >> _qpd >> _res;
         sc.release();
     }
     catch(...) {
@@ -23,9 +23,9 @@ VCpu::~VCpu() {
     delete _sc;
 }
 
-void VCpu::start(Qpd qpd) {
+void VCpu::start(Qpd qpd, const Reservation &res) {
     assert(_sc == 0);
-    _sc = new Sc(this, qpd);
+    _sc = new Sc(this, qpd, res);
     _sc->start(_name);
 }
 
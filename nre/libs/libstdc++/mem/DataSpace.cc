@@ -84,6 +84,10 @@ void DataSpace::join() {
 
 void DataSpace::destroy() {
     assert(_sel != ObjCap::INVALID && _unmapsel != ObjCap::INVALID);
+    destroy(_desc, _sel, _unmapsel);
+}
+
+void DataSpace::destroy(DataSpaceDesc &desc, capsel_t sel, capsel_t unmapsel) {
     UtcbFrame uf;
 
     // don't do that in the root-task. we allocate all memory at the beginning and simply manage
@@ -93,16 +97,16 @@ void DataSpace::destroy() {
         // otherwise because the ds might still be in use by somebody else. thus, the parent won't
         // revoke the memory in this case. but the parent might try to reuse the addresses in our
         // address space
-        CapRange(_desc.virt() >> ExecEnv::PAGE_SHIFT,
-                 _desc.size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(true);
+        CapRange(desc.virt() >> ExecEnv::PAGE_SHIFT,
+                 desc.size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(true);
     }
 
-    uf.translate(_unmapsel);
-    uf << DESTROY << _desc;
+    uf.translate(unmapsel);
+    uf << DESTROY << desc;
     CPU::current().ds_pt().call(uf);
 
-    CapSelSpace::get().free(_unmapsel);
-    CapSelSpace::get().free(_sel);
+    CapSelSpace::get().free(unmapsel);
+    CapSelSpace::get().free(sel);
 }
 
 void DataSpace::touch() {
@@ -31,12 +31,13 @@ char ConsoleStream::read() {
     return c;
 }
 
-void ConsoleStream::put(ushort value, ushort *base, uint &pos) {
+bool ConsoleStream::put(ushort value, ushort *base, uint &pos) {
     bool visible = false;
+    bool scrolled = false;
     switch(value & 0xff) {
         // ignore '\0'
         case '\0':
-            return;
+            return false;
         // backspace
         case 8:
             if(pos)
@@ -61,7 +62,9 @@ void ConsoleStream::put(ushort value, ushort *base, uint &pos) {
         memmove(base, base + Console::COLS, (Console::ROWS - 1) * Console::COLS * 2);
         memset(base + (Console::ROWS - 1) * Console::COLS, 0, Console::COLS * 2);
         pos = Console::COLS * (Console::ROWS - 1);
+        scrolled = true;
     }
     if(visible)
         base[pos++] = value;
+    return scrolled;
 }
@@ -60,8 +60,10 @@ void Child::release_regs() {
     ScopedLock<UserSm> guard(&_cm->_sm);
     for(ChildMemory::iterator it = _regs.begin(); it != _regs.end(); ++it) {
         DataSpaceDesc desc = it->desc();
-        if(it->cap() != ObjCap::INVALID && desc.type() != DataSpaceDesc::VIRTUAL)
+        if(it->cap() != ObjCap::INVALID && desc.type() != DataSpaceDesc::VIRTUAL) {
+            _cm->remove_user(it->cap(), this);
             _cm->_dsm.release(desc, it->cap());
+        }
     }
 }
 
@@ -20,8 +20,10 @@
 #include <ipc/Service.h>
 #include <kobj/Gsi.h>
 #include <kobj/Ports.h>
+#include <cap/CapBatch.h>
 #include <arch/Elf.h>
 #include <util/Math.h>
+#include <util/Trace.h>
 #include <Logging.h>
 #include <new>
 
@@ -30,7 +32,8 @@ namespace nre {
 ChildManager::ChildManager()
     : _child_count(), _childs(),
       _portal_caps(CapSelSpace::get().allocate(MAX_CHILDS * per_child_caps(), per_child_caps())),
-      _dsm(), _registry(), _sm(), _switchsm(), _slotsm(), _regsm(0), _diesm(0), _ecs(), _regecs() {
+      _dsm(), _registry(), _sm(), _switchsm(), _slotsm(), _segsm(), _segcount(), _segments(),
+      _modules(), _regsm(0), _diesm(0), _ecs(), _regecs() {
     _ecs = new LocalThread *[CPU::count()];
     _regecs = new LocalThread *[CPU::count()];
     for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
@@ -62,6 +65,7 @@ ChildManager::~ChildManager() {
     }
     delete[] _ecs;
     delete[] _regecs;
+    flush_segments();
     CapSelSpace::get().free(MAX_CHILDS * per_child_caps());
     RCU::gc(true);
 }
@@ -175,7 +179,246 @@ void ChildManager::build_hip(Child *c, const ChildConfig &config) {
     c->reglist().add(ds.desc(), c->_hip, ChildMemory::R | ChildMemory::OWN, ds.unmapsel());
 }
 
-Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig &config) {
+size_t ChildManager::shared_size() const {
+    ScopedLock<UserSm> guard(&_segsm);
+    size_t total = 0;
+    for(DList<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        // the private ones are accounted to the child
+        if(it->shared)
+            total += Math::round_up<size_t>(it->memsz, ExecEnv::PAGE_SIZE);
+    }
+    return total;
+}
+
+void ChildManager::flush_segments() {
+    ScopedLock<UserSm> guard(&_segsm);
+    for(DList<Segment>::iterator it = _segments.begin(); it != _segments.end(); ) {
+        Segment *s = &*it++;
+        if(!s->cached)
+            continue;
+        // drop the reference of the cache. the segments that are still in use stay until the last
+        // child is gone, because we still populate them and they share the mappings
+        s->cached = false;
+        _segcount--;
+        DataSpaceDesc desc;
+        _dsm.release(desc, s->sel);
+        if(--s->refs == 0)
+            drop_segment(s);
+    }
+}
+
+void ChildManager::put_segment(capsel_t sel) {
+    ScopedLock<UserSm> guard(&_segsm);
+    for(DList<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        if(it->sel == sel) {
+            if(--it->refs == 0)
+                drop_segment(&*it);
+            break;
+        }
+    }
+}
+
+void ChildManager::drop_segment(Segment *s) {
+    _segments.remove(s);
+    if(s->mod && --s->mod->refs == 0) {
+        DataSpaceDesc desc;
+        _dsm.release(desc, s->mod->ds->unmapsel());
+        s->mod->ds = 0;
+    }
+    delete s->present;
+    delete s;
+}
+
+ChildManager::Module *ChildManager::map_module(uintptr_t module, size_t size) {
+    Module *m = 0;
+    for(size_t i = 0; i < MAX_MODULES; ++i) {
+        if(!_modules[i].ds)
+            m = m ? m : _modules + i;
+        else if(_modules[i].addr == module && _modules[i].size == size)
+            return _modules + i;
+    }
+    if(!m)
+        return 0;
+
+    m->ds = &_dsm.create(DataSpaceDesc(size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::R, module));
+    m->addr = module;
+    m->size = size;
+    m->refs = 0;
+    return m;
+}
+
+void ChildManager::populate(capsel_t sel, size_t page, size_t count) {
+    ScopedLock<UserSm> guard(&_segsm);
+    Segment *s = 0;
+    for(DList<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        if(it->sel == sel) {
+            s = &*it;
+            break;
+        }
+    }
+    if(!s || !s->present)
+        return;
+
+    for(size_t end = page + count; page < end; ++page) {
+        if(s->present->get(page))
+            continue;
+        size_t off = page * ExecEnv::PAGE_SIZE;
+        size_t amount = off < s->filesz ? Math::min<size_t>(ExecEnv::PAGE_SIZE, s->filesz - off) : 0;
+        char *dst = reinterpret_cast<char*>(s->ds->virt() + off);
+        memcpy(dst, reinterpret_cast<void*>(s->src + off), amount);
+        memset(dst + amount, 0, ExecEnv::PAGE_SIZE - amount);
+        s->present->set(page, 1);
+    }
+}
+
+const DataSpace &ChildManager::load_segment(uintptr_t addr, size_t size, uintptr_t module,
+                                            bool share, const ElfPh *ph, bool &lazy, bool &shared) {
+    ScopedLock<UserSm> guard(&_segsm);
+    lazy = shared = false;
+    if(share) {
+        for(DList<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+            if(it->cached && it->module == module && it->modsize == size &&
+               it->offset == ph->p_offset && it->vaddr == ph->p_vaddr && it->memsz == ph->p_memsz) {
+                it->refs++;
+                lazy = it->present != 0;
+                shared = true;
+                return _dsm.join(it->ds->sel());
+            }
+        }
+    }
+
+    // note that the memory is always allocated here, because anonymous dataspaces are allocated
+    // eagerly. populating it lazily only saves the time for copying the untouched pages
+    size_t dssize = Math::round_up<size_t>(ph->p_memsz, ExecEnv::PAGE_SIZE);
+    const DataSpace &ds = _dsm.create(
+        DataSpaceDesc(dssize, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RWX));
+    bool cache = module && share && _segcount < MAX_SEGMENTS;
+    // we can only populate it later, if the module stays mapped. <addr> belongs to our caller
+    Module *mod = 0;
+    if(module) {
+        try {
+            mod = map_module(module, size);
+        }
+        catch(const Exception&) {
+            // just copy it now then
+        }
+    }
+    if(!mod) {
+        memcpy(reinterpret_cast<void*>(ds.virt()),
+               reinterpret_cast<void*>(addr + ph->p_offset), ph->p_filesz);
+        memset(reinterpret_cast<void*>(ds.virt() + ph->p_filesz), 0, ph->p_memsz - ph->p_filesz);
+        if(!cache)
+            return ds;
+    }
+
+    // if it's cached, the cache keeps the reference we got by creating it and the child joins it
+    Segment *s = new Segment();
+    s->module = module;
+    s->modsize = size;
+    s->offset = ph->p_offset;
+    s->vaddr = ph->p_vaddr;
+    s->memsz = ph->p_memsz;
+    s->filesz = ph->p_filesz;
+    s->sel = ds.unmapsel();
+    s->ds = &ds;
+    s->refs = cache ? 2 : 1;
+    s->cached = s->shared = cache;
+    if(mod) {
+        s->mod = mod;
+        mod->refs++;
+        s->src = mod->ds->virt() + ph->p_offset;
+        s->present = new MaskField<1>(dssize / ExecEnv::PAGE_SIZE);
+        s->present->clear_all();
+        lazy = true;
+    }
+    _segments.append(s);
+    if(!cache)
+        return ds;
+    _segcount++;
+    shared = true;
+    return _dsm.join(ds.sel());
+}
+
+void ChildManager::add_user(capsel_t sel, Child *c) {
+    ScopedLock<UserSm> guard(&_usersm);
+    DSUsers *u = _users.find(sel);
+    if(!u) {
+        u = new DSUsers(sel);
+        _users.insert(u);
+    }
+    u->childs.set(get_idx(c));
+}
+
+void ChildManager::remove_user(capsel_t sel, Child *c) {
+    {
+        ScopedLock<UserSm> guard(&_usersm);
+        DSUsers *u = _users.find(sel);
+        if(u) {
+            u->childs.clear(get_idx(c));
+            if(u->childs.first_set() == MAX_CHILDS) {
+                _users.remove(u);
+                delete u;
+            }
+        }
+    }
+    // if it's a segment, the child doesn't need it anymore
+    put_segment(sel);
+}
+
+BitField<ChildManager::MAX_CHILDS> ChildManager::get_users(capsel_t sel) {
+    ScopedLock<UserSm> guard(&_usersm);
+    DSUsers *u = _users.find(sel);
+    return u ? u->childs : BitField<MAX_CHILDS>();
+}
+
+ChildMemory::DS *ChildManager::copy_on_write(Child *c, ChildMemory::DS *ds) {
+    capsel_t shared = ds->cap();
+    uintptr_t addr = ds->desc().virt();
+    uintptr_t origin = ds->desc().origin();
+    size_t size = ds->desc().size();
+    uint flags = (ds->desc().flags() & ~ChildMemory::COW) | ChildMemory::OWN;
+
+    if(flags & ChildMemory::LAZY)
+        populate(shared, 0, size / ExecEnv::PAGE_SIZE);
+    flags &= ~ChildMemory::LAZY;
+    const DataSpace &priv = _dsm.create(
+        DataSpaceDesc(size, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RWX));
+    memcpy(reinterpret_cast<void*>(priv.virt()), reinterpret_cast<void*>(origin), size);
+    c->reglist().remove(shared);
+    c->reglist().add(priv.desc(), addr, flags, priv.unmapsel());
+    remove_user(shared, c);
+    DataSpaceDesc desc;
+    _dsm.release(desc, shared);
+
+    // the child has probably mapped some of the shared pages read-only already. since we can't
+    // revoke them for just one Pd, we revoke them from everyone and let the other childs, that
+    // still share the segment, fault them in again (as switch_to does).
+    CapRange(origin >> ExecEnv::PAGE_SHIFT, size >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(false);
+    c->_last_fault_addr = 0;
+    c->_last_fault_cpu = 0;
+    BitField<MAX_CHILDS> users = get_users(shared);
+    for(size_t i = 0; i < MAX_CHILDS; ++i) {
+        Child *ch = users.is_set(i) ? rcu_dereference(_childs[i]) : 0;
+        if(ch == 0 || ch == c)
+            continue;
+
+        ScopedLock<UserSm> guard_regs(&ch->_sm);
+        ChildMemory::DS *other = ch->reglist().find(shared);
+        if(other) {
+            ch->_last_fault_addr = 0;
+            ch->_last_fault_cpu = 0;
+            other->all_perms(0);
+        }
+    }
+
+    LOG(Logging::PFS, Serial::get().writef("Child '%s': Copied %p..%p on write\n",
+                                           c->cmdline().str(), reinterpret_cast<void*>(addr),
+                                           reinterpret_cast<void*>(addr + size)));
+    return c->reglist().find(priv.unmapsel());
+}
+
+Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig &config,
+                                  uintptr_t module, bool share) {
     ElfEh *elf = reinterpret_cast<ElfEh*>(addr);
 
     // check ELF
@@ -198,7 +441,7 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
     // create child
     size_t idx = free_slot();
     capsel_t pts = _portal_caps + idx * per_child_caps();
-    Child *c = new Child(this, pts, config.cmdline());
+    Child *c = new Child(this, pts, config.cmdline(), config.band(), config.reserve());
     try {
         // we have to create the portals first to be able to delegate them to the new Pd
         c->_ptcount = CPU::count() * (ARRAY_SIZE(exc) + Portals::COUNT - 1);
@@ -241,23 +484,23 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
             if(size < ph->p_offset + ph->p_filesz)
                 throw ElfException(E_ELF_INVALID, "LOAD segment outside binary");
 
-            uint perms = ChildMemory::OWN;
+            // TODO leak, if reglist().add throws
+            bool lazy, shared;
+            const DataSpace &ds = load_segment(addr, size, module, share, ph, lazy, shared);
+
+            // shared segments are not ours; writable ones become ours on the first write
+            uint perms = shared ? 0 : ChildMemory::OWN;
             if(ph->p_flags & PF_R)
                 perms |= ChildMemory::R;
             if(ph->p_flags & PF_W)
-                perms |= ChildMemory::W;
+                perms |= shared ? ChildMemory::W | ChildMemory::COW : ChildMemory::W;
             if(ph->p_flags & PF_X)
                 perms |= ChildMemory::X;
-
-            size_t dssize = Math::round_up<size_t>(ph->p_memsz, ExecEnv::PAGE_SIZE);
-            // TODO leak, if reglist().add throws
-            const DataSpace &ds = _dsm.create(
-                DataSpaceDesc(dssize, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RWX));
-            // TODO actually it would be better to do that later
-            memcpy(reinterpret_cast<void*>(ds.virt()),
-                   reinterpret_cast<void*>(addr + ph->p_offset), ph->p_filesz);
-            memset(reinterpret_cast<void*>(ds.virt() + ph->p_filesz), 0, ph->p_memsz - ph->p_filesz);
+            if(lazy)
+                perms |= ChildMemory::LAZY;
             c->reglist().add(ds.desc(), ph->p_vaddr, perms, ds.unmapsel());
+            if(shared)
+                add_user(ds.unmapsel(), c);
         }
 
         // utcb
@@ -282,7 +525,7 @@ Child::id_type ChildManager::load(uintptr_t addr, size_t size, const ChildConfig
 
         // start child; we have to put the child into the list before that
         rcu_assign_pointer(_childs[idx], c);
-        c->_ec->start(Qpd(), c->_pd);
+        c->_ec->start(Qpd(c->band()), c->_pd);
     }
     catch(...) {
         delete c;
@@ -376,11 +619,20 @@ void ChildManager::Portals::service(capsel_t pid) {
     try {
         ScopedLock<RCULock> guard(&RCU::lock());
         Child *c = cm->get_child(pid);
-        String name;
+        // the view points into the UTCB, which is overwritten if we log something or ask our
+        // parent for the service. so, copy it to the stack
+        char namebuf[MAX_SRVNAME_LEN + 1];
+        StringView name;
         Service::Command cmd;
         uf >> cmd;
-        if(cmd != Service::CLIENT_DIED)
+        if(cmd != Service::CLIENT_DIED) {
             uf >> name;
+            if(name.length() > MAX_SRVNAME_LEN)
+                throw ChildException(E_ARGS_INVALID, 64, "Service name too long (%zu)",
+                                     name.length());
+            memcpy(namebuf, name.str(), name.length() + 1);
+            name = StringView(namebuf, name.length());
+        }
         switch(cmd) {
             case Service::REGISTER: {
                 BitField<Hip::MAX_CPUS> available;
@@ -602,35 +854,47 @@ void ChildManager::Portals::sc(capsel_t pid) {
             break;
 
             case Sc::START: {
+                // a copy, because we pass it on to our parent with a new frame
                 String name;
                 Qpd qpd;
+                Reservation res;
                 cpu_t cpu;
                 capsel_t ec = uf.get_delegated(0).offset();
-                uf >> name >> cpu >> qpd;
+                uf >> name >> cpu >> qpd >> res;
                 uf.finish_input();
 
-                // TODO later one could add policy here and adjust the qpd accordingly
+                // the child can't leave its band and can't reserve more than it is allowed to
+                if(qpd.prio() == Sc::BAND_PD || qpd.prio() > c->band())
+                    qpd = Qpd(c->band(), qpd.quantum());
+                if(res.utilization() > 0 && c->reserved(cpu) + res.utilization() > c->reserve()) {
+                    if(res.hard()) {
+                        throw ChildException(E_CAPACITY, 64,
+                                             "Unable to reserve %u permil of CPU %u",
+                                             res.utilization(), cpu);
+                    }
+                    res = Reservation();
+                }
 
                 capsel_t sc;
                 {
                     UtcbFrame puf;
                     puf.accept_delegates(0);
-                    puf << Sc::START << name << cpu << qpd;
+                    puf << Sc::START << name << cpu << qpd << res;
                     puf.delegate(ec);
                     CPU::current().sc_pt().call(puf);
                     puf.check_reply();
                     sc = puf.get_delegated(0).offset();
-                    puf >> qpd;
+                    puf >> qpd >> res;
                 }
-                c->add_sc(name, cpu, sc);
+                c->add_sc(name, cpu, sc, res.utilization());
 
                 LOG(Logging::ADMISSION,
-                    Serial::get().writef("Child '%s' created sc '%s' on cpu %u (%u)\n",
-                                         c->cmdline().str(), name.str(), cpu, sc));
+                    Serial::get().writef("Child '%s' created sc '%s' on cpu %u (%u) with prio %u\n",
+                                         c->cmdline().str(), name.str(), cpu, sc, qpd.prio()));
 
                 uf.accept_delegates();
                 uf.delegate(sc);
-                uf << E_SUCCESS << qpd;
+                uf << E_SUCCESS << qpd << res;
             }
             break;
 
@@ -690,7 +954,10 @@ void ChildManager::map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type)
             // only create creations and non-device-memory
             if(type != DataSpace::JOIN && desc.phys() == 0)
                 flags |= ChildMemory::OWN;
-            size_t align = 1 << (desc.align() + ExecEnv::PAGE_SHIFT);
+            // take the alignment of the dataspace into account as well to be able to map it
+            // with large pages
+            uint order = Math::max<uint>(desc.align(), ds.desc().align());
+            size_t align = 1UL << (order + ExecEnv::PAGE_SHIFT);
             addr = c->reglist().find_free(ds.size(), align);
             c->reglist().add(ds.desc(), addr, flags, ds.unmapsel());
         }
@@ -698,6 +965,7 @@ void ChildManager::map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type)
             _dsm.release(desc, ds.unmapsel());
             throw;
         }
+        add_user(ds.unmapsel(), c);
 
         // build answer
         if(type == DataSpace::CREATE) {
@@ -713,7 +981,7 @@ void ChildManager::map(UtcbFrameRef &uf, Child *c, DataSpace::RequestType type)
             uf.delegate(ds.unmapsel());
         }
         uf << E_SUCCESS << DataSpaceDesc(ds.size(), ds.type(), ds.flags(), ds.phys(), addr, ds.virt(),
-                                         ds.desc().align());
+                                         ds.desc().align(), ds.desc().node());
     }
 }
 
@@ -735,23 +1003,26 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
             ChildMemory::DS *src, *dst;
             src = c->reglist().find(srcsel);
             dst = c->reglist().find(dstsel);
-            LOG(Logging::DATASPACES, Serial::get() << "Child '" << c->cmdline()
-                                                   << "' switches:\n\t" << src->desc() << "\n\t" <<
-                dst->desc() << "\n");
             if(!src || !dst)
                 throw Exception(E_ARGS_INVALID, 64, "Unable to switch. DS %u or %u not found", srcsel,
                                 dstsel);
+            LOG(Logging::DATASPACES, Serial::get() << "Child '" << c->cmdline()
+                                                   << "' switches:\n\t" << src->desc() << "\n\t" <<
+                dst->desc() << "\n");
             if(src->desc().size() != dst->desc().size()) {
                 throw Exception(E_ARGS_INVALID, 64,
                                 "Unable to switch non-equal-sized dataspaces (%zu,%zu)",
                                 src->desc().size(), dst->desc().size());
             }
 
-            // first revoke the memory to prevent further accesses
-            CapRange(src->desc().origin() >> ExecEnv::PAGE_SHIFT,
-                     src->desc().size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(false);
-            CapRange(dst->desc().origin() >> ExecEnv::PAGE_SHIFT,
-                     dst->desc().size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL).revoke(false);
+            // first revoke the memory to prevent further accesses. this affects only the childs
+            // that have mapped the memory.
+            CapBatch<2> revokes;
+            revokes.add(CapRange(src->desc().origin() >> ExecEnv::PAGE_SHIFT,
+                                 src->desc().size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL));
+            revokes.add(CapRange(dst->desc().origin() >> ExecEnv::PAGE_SHIFT,
+                                 dst->desc().size() >> ExecEnv::PAGE_SHIFT, Crd::MEM_ALL));
+            revokes.revoke(false);
             // we have to reset the last pf information here, because of the revoke. otherwise it
             // can happen that last time CPU X caused the last fault and this time, CPU X causes
             // the second fault (the first one will handle it and the second one will find it already
@@ -773,13 +1044,16 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
         }
 
         // now change the mapping for all other childs that have one of these dataspaces
-        for(size_t x = 0, i = 0; i < MAX_CHILDS && x < _child_count; ++i) {
+        BitField<MAX_CHILDS> srcusers = get_users(srcsel);
+        BitField<MAX_CHILDS> dstusers = get_users(dstsel);
+        for(size_t i = 0; i < MAX_CHILDS; ++i) {
+            if(!srcusers.is_set(i) && !dstusers.is_set(i))
+                continue;
             Child *ch = rcu_dereference(_childs[i]);
             if(ch == 0 || ch == c)
                 continue;
 
             ScopedLock<UserSm> guard_regs(&ch->_sm);
-            DataSpaceDesc dummy;
             ChildMemory::DS *src, *dst;
             src = ch->reglist().find(srcsel);
             dst = ch->reglist().find(dstsel);
@@ -795,9 +1069,8 @@ void ChildManager::switch_to(UtcbFrameRef &uf, Child *c) {
             }
             if(dst) {
                 dst->desc().origin(srcorg);
-                src->all_perms(0);
+                dst->all_perms(0);
             }
-            x++;
         }
 
         // now swap the origins also in the dataspace-manager (otherwise clients that join
@@ -828,6 +1101,9 @@ void ChildManager::unmap(UtcbFrameRef &uf, Child *c) {
         // destroy (decrease refs) the ds
         _dsm.release(desc, sel);
         c->reglist().remove(sel);
+        // he might have mapped it multiple times
+        if(!c->reglist().find(sel))
+            remove_user(sel, c);
     }
     uf << E_SUCCESS;
 }
@@ -879,6 +1155,7 @@ void ChildManager::Portals::pf(capsel_t pid) {
         return;
     }
 
+    TRACE_BEGIN(PAGEFAULT, pfaddr);
     try {
         ScopedLock<RCULock> guard(&RCU::lock());
         Child *c = cm->get_child(pid);
@@ -890,7 +1167,6 @@ void ChildManager::Portals::pf(capsel_t pid) {
                                  c->cmdline().str(), reinterpret_cast<void*>(pfaddr),
                                  reinterpret_cast<void*>(eip), cpu, error));
 
-        // TODO different handlers (cow, ...)
         uintptr_t pfpage = pfaddr & ~(ExecEnv::PAGE_SIZE - 1);
         bool remap = false;
         ChildMemory::DS *ds = c->reglist().find_by_addr(pfaddr);
@@ -909,6 +1185,16 @@ void ChildManager::Portals::pf(capsel_t pid) {
                 kill = true;
         }
 
+        if(!kill && (ds->desc().flags() & ChildMemory::COW)) {
+            // on a write, give him his own copy of the segment. otherwise map it read-only
+            if(error & 0x2) {
+                ds = cm->copy_on_write(c, ds);
+                flags = 0;
+            }
+            else
+                perms &= ~ChildMemory::W;
+        }
+
         // is the page already mapped (may be ok if two cpus accessed the page at the same time)
         if(!kill && flags) {
             // first check if our parent has unmapped the memory
@@ -946,11 +1232,15 @@ void ChildManager::Portals::pf(capsel_t pid) {
             // try to map the next few pages
             size_t pages = 32;
             if(ds->desc().flags() & DataSpaceDesc::BIGPAGES) {
-                // try to map the whole pagetable at once
-                pages = ExecEnv::PT_ENTRY_COUNT;
-                // take care that we start at the beginning (note that this assumes that it is
-                // properly aligned, which is made sure by root. otherwise we might leave the ds
-                pfpage &= ~(ExecEnv::BIG_PAGE_SIZE - 1);
+                // try to map the whole pagetable at once. take care that we start at the beginning,
+                // which requires that source and destination are equally aligned. in this case,
+                // it is delegated with a single Crd and thus, can be mapped with a large page.
+                uintptr_t bigpage = pfpage & ~(ExecEnv::BIG_PAGE_SIZE - 1);
+                if(bigpage >= ds->desc().virt() &&
+                   (ds->origin(bigpage) & (ExecEnv::BIG_PAGE_SIZE - 1)) == 0) {
+                    pages = ExecEnv::PT_ENTRY_COUNT;
+                    pfpage = bigpage;
+                }
             }
             uintptr_t src = ds->origin(pfpage);
             CapRange cr(src >> ExecEnv::PAGE_SHIFT, pages, Crd::MEM | (perms << 2),
@@ -958,6 +1248,10 @@ void ChildManager::Portals::pf(capsel_t pid) {
             // ensure that it fits into the utcb
             cr.limit_to(uf.free_typed());
             cr.count(ds->page_perms(pfpage, cr.count(), perms));
+            if(ds->desc().flags() & ChildMemory::LAZY) {
+                cm->populate(ds->cap(), (pfpage - ds->desc().virt()) >> ExecEnv::PAGE_SHIFT,
+                             cr.count());
+            }
             uf.delegate(cr);
             // ensure that we have the memory (if we're a subsystem this might not be true)
             // TODO this is not sufficient, in general
@@ -991,6 +1285,7 @@ void ChildManager::Portals::pf(capsel_t pid) {
             uf->rip = ExecEnv::KERNEL_START;
         }
     }
+    TRACE_END(PAGEFAULT, pfaddr);
 }
 
 void ChildManager::Portals::exception(capsel_t pid) {
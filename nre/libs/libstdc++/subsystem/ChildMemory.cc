@@ -25,11 +25,12 @@ OStream &operator<<(OStream &os, const ChildMemory &cm) {
     for(ChildMemory::iterator it = cm.begin(); it != cm.end(); ++it) {
         uint flags = it->desc().flags();
         os.writef(
-            "\t\t%p .. %p (%#0" FMT_WORD_HEXLEN "zx bytes) %c%c%c%c <- %p\n",
+            "\t\t%p .. %p (%#0" FMT_WORD_HEXLEN "zx bytes) %c%c%c%c%c <- %p\n",
             reinterpret_cast<void*>(it->desc().virt()),
             reinterpret_cast<void*>(it->desc().virt() + it->desc().size()),
             it->desc().size(),
             (flags & ChildMemory::OWN) ? 'o' : '-',
+            (flags & ChildMemory::COW) ? 'c' : '-',
             (flags & ChildMemory::R) ? 'r' : '-',
             (flags & ChildMemory::W) ? 'w' : '-',
             (flags & ChildMemory::X) ? 'x' : '-',
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <util/ThreadPool.h>
+#include <util/ScopedLock.h>
+#include <util/Math.h>
+#include <kobj/GlobalThread.h>
+#include <stream/OStringStream.h>
+#include <stream/Serial.h>
+#include <Exception.h>
+#include <CPU.h>
+
+namespace nre {
+
+bool ThreadPool::Inbox::put(const Task &t) {
+    ScopedLock<UserSm> guard(&_lock);
+    if(_count > _mask)
+        return false;
+    _tasks[_tail++ & _mask] = t;
+    _count++;
+    return true;
+}
+
+bool ThreadPool::Inbox::take(Task &t) {
+    if(empty())
+        return false;
+    ScopedLock<UserSm> guard(&_lock);
+    if(_count == 0)
+        return false;
+    t = _tasks[_head++ & _mask];
+    _count--;
+    return true;
+}
+
+ThreadPool::ThreadPool(const char *name, size_t capacity)
+    : _count(CPU::count()), _workers(new Worker*[_count]), _next(0), _idle(0), _stop(false),
+      _done(0) {
+    size_t i = 0;
+    for(CPU::iterator cpu = CPU::begin(); cpu != CPU::end(); ++cpu, ++i)
+        _workers[i] = new Worker(this, i, cpu->log_id(), capacity);
+
+    // create all workers before starting them, because they steal from each other
+    for(i = 0; i < _count; ++i) {
+        char tname[32];
+        OStringStream::format(tname, sizeof(tname), "%s-%u", name, _workers[i]->cpu);
+        GlobalThread *gt = GlobalThread::create(worker_main, _workers[i]->cpu, String(tname));
+        gt->set_tls<Worker*>(Thread::TLS_PARAM, _workers[i]);
+        _workers[i]->thread = gt;
+    }
+    for(i = 0; i < _count; ++i)
+        static_cast<GlobalThread*>(_workers[i]->thread)->start();
+}
+
+ThreadPool::~ThreadPool() {
+    _stop = true;
+    Sync::memory_fence();
+    for(size_t i = 0; i < _count; ++i)
+        wake(_workers[i]);
+    for(size_t i = 0; i < _count; ++i)
+        _done.down();
+    for(size_t i = 0; i < _count; ++i)
+        delete _workers[i];
+    delete[] _workers;
+}
+
+void ThreadPool::worker_main(void*) {
+    Worker *w = Thread::current()->get_tls<Worker*>(Thread::TLS_PARAM);
+    ThreadPool *pool = w->pool;
+    Task t;
+    while(true) {
+        if(pool->next(w, t))
+            run(t);
+        // finish the queued tasks before we leave
+        else if(pool->_stop)
+            break;
+        else
+            pool->park(w);
+    }
+    pool->_done.up();
+}
+
+void ThreadPool::run(const Task &t) {
+    try {
+        t.func(t.arg);
+    }
+    catch(const Exception &e) {
+        Serial::get() << e;
+    }
+    if(t.future)
+        t.future->complete();
+}
+
+void ThreadPool::run_range(void *arg) {
+    Range *r = reinterpret_cast<Range*>(arg);
+    r->func(r->begin, r->end, r->arg);
+}
+
+ThreadPool::Worker *ThreadPool::current() const {
+    Thread *cur = Thread::current();
+    for(size_t i = 0; i < _count; ++i) {
+        if(_workers[i]->thread == cur)
+            return _workers[i];
+    }
+    return 0;
+}
+
+bool ThreadPool::next(Worker *w, Task &t) {
+    if(w->deque.pop(t))
+        return true;
+    if(w->inbox.take(t)) {
+        // move the rest into our deque, so that the others can steal it
+        Task other;
+        size_t moved = 0;
+        while(w->inbox.take(other)) {
+            if(!w->deque.push(other)) {
+                run(other);
+                break;
+            }
+            moved++;
+        }
+        if(moved)
+            wake_one(w);
+        return true;
+    }
+    return steal(w, t);
+}
+
+bool ThreadPool::steal(Worker *w, Task &t) {
+    // start with our neighbour to spread the thieves across the victims
+    size_t start = w ? w->idx + 1 : Atomic::add(&_next, 1);
+    for(size_t i = 0; i < _count; ++i) {
+        Worker *victim = _workers[(start + i) % _count];
+        if(victim == w)
+            continue;
+        if(victim->deque.steal(t))
+            return true;
+        // if the victim is busy with a long-running task, its inbox would starve otherwise
+        if(victim->inbox.take(t))
+            return true;
+    }
+    return false;
+}
+
+bool ThreadPool::has_work() const {
+    for(size_t i = 0; i < _count; ++i) {
+        if(!_workers[i]->deque.empty() || !_workers[i]->inbox.empty())
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::park(Worker *w) {
+    w->sleeping = 1;
+    Atomic::add(&_idle, +1);
+    // announce that we're sleeping before we check for work for the last time. the submitter
+    // does it the other way around, so that either we see the work or it sees us sleeping.
+    Sync::memory_fence();
+    if(_stop || has_work()) {
+        // if somebody has already claimed the wakeup, we have to consume it
+        if(!Atomic::cmpnswap(&w->sleeping, 1, 0))
+            w->sm.down();
+    }
+    else
+        w->sm.down();
+    Atomic::add(&_idle, -1);
+}
+
+bool ThreadPool::wake(Worker *w) {
+    if(w->sleeping && Atomic::cmpnswap(&w->sleeping, 1, 0)) {
+        w->sm.up();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::wake_one(Worker *except) {
+    Sync::memory_fence();
+    if(_idle == 0)
+        return;
+    for(size_t i = 0; i < _count; ++i) {
+        if(_workers[i] != except && wake(_workers[i]))
+            return;
+    }
+}
+
+void ThreadPool::submit(task_func func, void *arg, Future *fut, cpu_t cpu) {
+    Task t;
+    t.func = func;
+    t.arg = arg;
+    t.future = fut;
+    if(fut)
+        fut->add();
+
+    Worker *cur = current();
+    if(cur && (cpu == ANY_CPU || cpu == cur->cpu)) {
+        if(cur->deque.push(t))
+            wake_one(cur);
+        else
+            run(t);
+        return;
+    }
+
+    Worker *w = 0;
+    if(cpu != ANY_CPU) {
+        for(size_t i = 0; i < _count; ++i) {
+            if(_workers[i]->cpu == cpu) {
+                w = _workers[i];
+                break;
+            }
+        }
+    }
+    if(!w)
+        w = _workers[Atomic::add(&_next, 1) % _count];
+    if(!w->inbox.put(t)) {
+        run(t);
+        return;
+    }
+    // if the target is busy, let somebody else steal it
+    Sync::memory_fence();
+    if(!wake(w))
+        wake_one(w);
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, range_func func, void *arg) {
+    if(begin >= end)
+        return;
+    // by default, give each worker a few chunks to balance the load
+    if(grain == 0)
+        grain = Math::max<size_t>(1, (end - begin) / (_count * 4));
+    size_t chunks = (end - begin + grain - 1) / grain;
+
+    Range *ranges = new Range[chunks];
+    Future fut;
+    for(size_t i = 0; i < chunks; ++i) {
+        ranges[i].begin = begin + i * grain;
+        ranges[i].end = Math::min(end, ranges[i].begin + grain);
+        ranges[i].func = func;
+        ranges[i].arg = arg;
+    }
+    // we execute the first chunk ourself
+    for(size_t i = 1; i < chunks; ++i)
+        submit(run_range, ranges + i, &fut);
+    run_range(ranges);
+
+    // help the workers until there is nothing left to steal
+    Worker *cur = current();
+    Task t;
+    while(!fut.done()) {
+        if(!(cur ? next(cur, t) : steal(0, t)))
+            break;
+        run(t);
+    }
+    fut.wait();
+    delete[] ranges;
+}
+
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <util/Trace.h>
+#include <util/Atomic.h>
+#include <util/Math.h>
+#include <util/Sync.h>
+#include <util/Util.h>
+#include <kobj/Thread.h>
+#include <mem/DataSpace.h>
+#include <stream/OStream.h>
+#include <Hip.h>
+#include <CPU.h>
+#include <cstring>
+
+namespace nre {
+
+DataSpace *Trace::_ds = 0;
+size_t Trace::_records = 0;
+size_t Trace::_bufsize = 0;
+bool Trace::_paused = false;
+
+static const char *point_names[] = {
+    "IPC_CALL",
+    "PAGEFAULT",
+    "STORAGE_REQ",
+    "VMEXIT",
+};
+static const char phase_names[] = {'B', 'E', 'i', 'b', 'e'};
+
+const char *Trace::name(Point p) {
+    if(p < ARRAY_SIZE(point_names))
+        return point_names[p];
+    return "???";
+}
+
+Trace::Buffer *Trace::buffer(cpu_t cpu) {
+    return reinterpret_cast<Buffer*>(_ds->virt() + cpu * _bufsize);
+}
+
+void Trace::init(size_t records) {
+    if(!mask || _ds)
+        return;
+
+    // note that we create the dataspace with _ds == 0, so that the portal calls to do so are not
+    // recorded into a non-existing buffer
+    size_t bufsize = Math::round_up<size_t>(sizeof(Buffer) + records * sizeof(Record), CACHE_LINE);
+    DataSpace *ds = new DataSpace(Math::round_up<size_t>(bufsize * CPU::count(), ExecEnv::PAGE_SIZE),
+                                  DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW);
+    memset(reinterpret_cast<void*>(ds->virt()), 0, ds->size());
+    _records = records;
+    _bufsize = bufsize;
+    Sync::memory_barrier();
+    _ds = ds;
+}
+
+void Trace::record(Point p, Phase ph, word_t arg) {
+    if(!_ds || _paused)
+        return;
+
+    Thread *t = Thread::current();
+    Buffer *buf = buffer(t->cpu());
+    size_t idx = Atomic::add(&buf->pos, 1);
+    Record *r = buf->records + (idx % _records);
+    r->tsc = Util::tsc();
+    r->thread = t->sel();
+    r->arg = arg;
+    r->point = p;
+    r->phase = ph;
+    r->cpu = t->cpu();
+}
+
+void Trace::dump(OStream &os, const char *name) {
+    if(!_ds)
+        return;
+
+    // writing to the stream might call portals, which should not end up in the buffers
+    _paused = true;
+    Sync::memory_barrier();
+    os.writef("TRACE: begin %s %u %zu\n", name, Hip::get().freq_tsc, CPU::count());
+    for(cpu_t cpu = 0; cpu < CPU::count(); ++cpu) {
+        Buffer *buf = buffer(cpu);
+        size_t end = buf->pos;
+        size_t start = end > _records ? end - _records : 0;
+        for(size_t i = start; i < end; ++i) {
+            Record *r = buf->records + (i % _records);
+            os.writef("TRACE: %u %Lu %lx %s %c %lx\n", r->cpu, r->tsc, r->thread,
+                      Trace::name(static_cast<Point>(r->point)), phase_names[r->phase], r->arg);
+        }
+    }
+    os.writef("TRACE: end %s\n", name);
+    Sync::memory_barrier();
+    _paused = false;
+}
+
+}
@@ -100,6 +100,115 @@ uint HostACPI::irq_to_gsi(uint irq) {
     return irq;
 }
 
+size_t HostACPI::get_apic_ids(uint8_t *ids, size_t max) {
+    // NOVA numbers the CPUs in the order of the enabled LAPIC entries in the MADT. thus, we can
+    // determine the APIC id of each physical CPU id in the same way.
+    size_t len, count = 0;
+    uintptr_t addr = find("APIC", 0, len);
+    if(addr) {
+        MADT *madt = reinterpret_cast<MADT*>(_ds->virt() + addr);
+        for(APIC *apic = madt->apic;
+            reinterpret_cast<uintptr_t>(apic) < _ds->virt() + addr + madt->length && count < max;
+            apic = reinterpret_cast<APIC*>(reinterpret_cast<uintptr_t>(apic) + apic->length)) {
+            if(apic->type == APIC::LAPIC) {
+                APICLAPIC *lapic = reinterpret_cast<APICLAPIC*>(apic);
+                if(lapic->flags & 1)
+                    ids[count++] = lapic->apic_id;
+            }
+        }
+    }
+    return count;
+}
+
+size_t HostACPI::get_node(uint32_t domain, const uint32_t *domains, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        if(domains[i] == domain)
+            return i;
+    }
+    return count;
+}
+
+void HostACPI::numa(NUMA::Info &info) {
+    info = NUMA::Info();
+    size_t len;
+    uintptr_t addr = find("SRAT", 0, len);
+    if(!addr)
+        return;
+
+    // collect the proximity domains of all enabled entries in ascending order
+    SRAT *srat = reinterpret_cast<SRAT*>(_ds->virt() + addr);
+    uintptr_t end = reinterpret_cast<uintptr_t>(srat) + srat->length;
+    uint32_t domains[NUMA::MAX_NODES];
+    size_t count = 0;
+    for(SRATEntry *e = srat->entries; reinterpret_cast<uintptr_t>(e) < end;
+        e = reinterpret_cast<SRATEntry*>(reinterpret_cast<uintptr_t>(e) + e->length)) {
+        uint32_t dom;
+        if(e->type == SRATEntry::CPU && (static_cast<SRATCPU*>(e)->flags & 1)) {
+            SRATCPU *cpu = static_cast<SRATCPU*>(e);
+            dom = cpu->domain_lo | (cpu->domain_hi[0] << 8) | (cpu->domain_hi[1] << 16) |
+                  (cpu->domain_hi[2] << 24);
+        }
+        else if(e->type == SRATEntry::MEM && (static_cast<SRATMem*>(e)->flags & 1))
+            dom = static_cast<SRATMem*>(e)->domain;
+        else
+            continue;
+
+        if(get_node(dom, domains, count) < count)
+            continue;
+        if(count == NUMA::MAX_NODES) {
+            LOG(Logging::ACPI, Serial::get().writef(
+                    "ACPI: ignoring proximity domain %u; too many nodes\n", dom));
+            continue;
+        }
+        size_t i;
+        for(i = count; i > 0 && domains[i - 1] > dom; --i)
+            domains[i] = domains[i - 1];
+        domains[i] = dom;
+        count++;
+    }
+    if(count == 0)
+        return;
+    info.nodes(count);
+
+    // now assign the CPUs and memory ranges to the nodes
+    uint8_t apics[Hip::MAX_CPUS];
+    size_t cpus = get_apic_ids(apics, Hip::MAX_CPUS);
+    for(SRATEntry *e = srat->entries; reinterpret_cast<uintptr_t>(e) < end;
+        e = reinterpret_cast<SRATEntry*>(reinterpret_cast<uintptr_t>(e) + e->length)) {
+        if(e->type == SRATEntry::CPU && (static_cast<SRATCPU*>(e)->flags & 1)) {
+            SRATCPU *cpu = static_cast<SRATCPU*>(e);
+            uint32_t dom = cpu->domain_lo | (cpu->domain_hi[0] << 8) | (cpu->domain_hi[1] << 16) |
+                           (cpu->domain_hi[2] << 24);
+            size_t node = get_node(dom, domains, count);
+            for(size_t i = 0; node < count && i < cpus; ++i) {
+                if(apics[i] == cpu->apic_id)
+                    info.cpu_node(i, node);
+            }
+        }
+        else if(e->type == SRATEntry::MEM && (static_cast<SRATMem*>(e)->flags & 1)) {
+            SRATMem *mem = static_cast<SRATMem*>(e);
+            size_t node = get_node(mem->domain, domains, count);
+            if(node < count && mem->size > 0 && !info.add_range(mem->base, mem->size, node)) {
+                LOG(Logging::ACPI, Serial::get().writef(
+                        "ACPI: ignoring memory range %#Lx..%#Lx; too many ranges\n",
+                        mem->base, mem->base + mem->size));
+            }
+        }
+    }
+
+    // the SLIT is indexed by proximity domain; without it, we stay with the default distances
+    addr = find("SLIT", 0, len);
+    if(addr) {
+        SLIT *slit = reinterpret_cast<SLIT*>(_ds->virt() + addr);
+        for(size_t i = 0; i < count; ++i) {
+            for(size_t j = 0; j < count; ++j) {
+                if(domains[i] < slit->count && domains[j] < slit->count)
+                    info.distance(i, j, slit->dist[domains[i] * slit->count + domains[j]]);
+            }
+        }
+    }
+}
+
 HostACPI::RSDP *HostACPI::get_rsdp() {
     // search in BIOS readonly memory range
     DataSpace *ds = new DataSpace(BIOS_MEM_SIZE, DataSpaceDesc::LOCKED, DataSpaceDesc::R, BIOS_MEM_ADDR);
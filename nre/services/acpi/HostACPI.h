@@ -19,6 +19,7 @@
 
 #include <arch/Types.h>
 #include <services/ACPI.h>
+#include <util/NUMA.h>
 #include <Compiler.h>
 
 class HostACPI {
@@ -51,6 +52,13 @@ class HostACPI {
         uint8_t length;
     } PACKED;
 
+    // Processor Local APIC Structure (5.2.11.5)
+    struct APICLAPIC : public APIC {
+        uint8_t acpi_id;
+        uint8_t apic_id;
+        uint32_t flags;
+    } PACKED;
+
     // Interrupt Source Override (5.2.11.8)
     struct APICIntr : public APIC {
         uint8_t bus;
@@ -66,6 +74,49 @@ class HostACPI {
         APIC apic[];
     } PACKED;
 
+    // Static Resource Affinity Structure (5.2.16)
+    struct SRATEntry {
+        enum Type {
+            CPU = 0, MEM = 1, X2APIC = 2,
+        };
+        uint8_t type;
+        uint8_t length;
+    } PACKED;
+
+    // Processor Local APIC/SAPIC Affinity Structure (5.2.16.1)
+    struct SRATCPU : public SRATEntry {
+        uint8_t domain_lo;
+        uint8_t apic_id;
+        uint32_t flags;
+        uint8_t sapic_eid;
+        uint8_t domain_hi[3];
+        uint32_t clock_domain;
+    } PACKED;
+
+    // Memory Affinity Structure (5.2.16.2)
+    struct SRATMem : public SRATEntry {
+        uint32_t domain;
+        uint16_t reserved1;
+        uint64_t base;
+        uint64_t size;
+        uint32_t reserved2;
+        uint32_t flags;
+        uint64_t reserved3;
+    } PACKED;
+
+    // System Resource Affinity Table
+    struct SRAT : public nre::ACPI::RSDT {
+        uint32_t reserved1;
+        uint64_t reserved2;
+        SRATEntry entries[];
+    } PACKED;
+
+    // System Locality Distance Information Table (5.2.17)
+    struct SLIT : public nre::ACPI::RSDT {
+        uint64_t count;
+        uint8_t dist[];
+    } PACKED;
+
 public:
     explicit HostACPI();
     ~HostACPI() {
@@ -78,6 +129,7 @@ public:
     }
     uintptr_t find(const char *name, uint instance, size_t &length);
     uint irq_to_gsi(uint irq);
+    void numa(nre::NUMA::Info &info);
 
 private:
     static char checksum(char *table, unsigned count) {
@@ -87,6 +139,8 @@ private:
         return res;
     }
     static RSDP *get_rsdp();
+    size_t get_apic_ids(uint8_t *ids, size_t max);
+    static size_t get_node(uint32_t domain, const uint32_t *domains, size_t count);
 
 private:
     size_t _count;
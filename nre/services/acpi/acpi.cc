@@ -17,6 +17,8 @@
 #include <ipc/Service.h>
 #include <services/ACPI.h>
 #include <services/PCIConfig.h>
+#include <services/SysInfo.h>
+#include <Logging.h>
 
 #include "HostACPI.h"
 #include "HostATARE.h"
@@ -43,7 +45,7 @@ PORTAL static void portal_acpi(capsel_t) {
             break;
 
             case ACPI::FIND_TABLE: {
-                String name;
+                StringView name;
                 uint instance;
                 uf >> name >> instance;
                 uf.finish_input();
@@ -74,6 +76,15 @@ PORTAL static void portal_acpi(capsel_t) {
                 uf << E_SUCCESS << gsi;
             }
             break;
+
+            case ACPI::GET_NUMA: {
+                uf.finish_input();
+
+                NUMA::Info info;
+                hostacpi->numa(info);
+                uf << E_SUCCESS << info;
+            }
+            break;
         }
     }
     catch(const Exception &e) {
@@ -91,6 +102,22 @@ int main() {
         Serial::get() << e;
     }
 
+    // tell root about the topology, so that it can place memory accordingly. this is done before
+    // we register our service, so that all childs that are loaded after us know their nodes.
+    if(hostacpi) {
+        try {
+            NUMA::Info info;
+            hostacpi->numa(info);
+            LOG(Logging::ACPI, Serial::get() << info);
+            Connection con("sysinfo");
+            SysInfoSession sysinfo(con);
+            sysinfo.set_numa(info);
+        }
+        catch(const Exception &e) {
+            Serial::get() << e;
+        }
+    }
+
     Service *srv = new Service("acpi", CPUSet(CPUSet::ALL), portal_acpi);
     srv->start();
     return 0;
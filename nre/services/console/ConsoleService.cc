@@ -17,12 +17,13 @@
 #include "ConsoleService.h"
 #include "ConsoleSessionData.h"
 #include "HostVGA.h"
+#include "HostFramebuffer.h"
 
 using namespace nre;
 
-ConsoleService::ConsoleService(const char *name, uint modifier)
+ConsoleService::ConsoleService(const char *name, uint modifier, HostFramebuffer *fb)
     : Service(name, CPUSet(CPUSet::ALL), ConsoleSessionData::portal), _rbcon("reboot"), _reboot(_rbcon),
-      _screen(new HostVGA()), _cons(), _concyc(), _switcher(this), _modifier(modifier) {
+      _screen(new HostVGA()), _fb(fb), _cons(), _concyc(), _switcher(this), _modifier(modifier) {
     // we want to accept two dataspaces
     for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
         LocalThread *t = get_thread(it->log_id());
@@ -49,6 +50,21 @@ void ConsoleService::create_dummy(uint page, const String &title) {
     sess->create(0, ds, 0, title);
 }
 
+Console::ModeInfo ConsoleService::mode_info(size_t mode) const {
+    if(mode == 0) {
+        Console::ModeInfo info;
+        info.vesa_mode = 3;
+        info.width = Screen::COLS;
+        info.height = Screen::ROWS;
+        info.bpp = 0;
+        info.bytes_per_line = Screen::COLS * 2;
+        return info;
+    }
+    if(mode == 1 && _fb)
+        return _fb->info();
+    throw Exception(E_NOT_FOUND, 32, "Mode %zu does not exist", mode);
+}
+
 void ConsoleService::up() {
     ScopedLock<UserSm> guard(&_sm);
     ConsoleSessionData *old = active();
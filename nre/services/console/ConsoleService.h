@@ -27,12 +27,13 @@
 #include "ViewSwitcher.h"
 
 class ConsoleSessionData;
+class HostFramebuffer;
 
 class ConsoleService : public nre::Service {
 public:
     typedef nre::DList<ConsoleSessionData>::iterator iterator;
 
-    ConsoleService(const char *name, uint modifier);
+    ConsoleService(const char *name, uint modifier, HostFramebuffer *fb);
 
     ConsoleSessionData *active() {
         if(_concyc[_console] == 0)
@@ -54,6 +55,13 @@ public:
     Screen *screen() {
         return _screen;
     }
+    HostFramebuffer *framebuffer() {
+        return _fb;
+    }
+    uint modifier() const {
+        return _modifier;
+    }
+    nre::Console::ModeInfo mode_info(size_t mode) const;
     void session_ready(ConsoleSessionData *sess);
     bool handle_keyevent(const nre::Keyboard::Packet &pk);
 
@@ -66,6 +74,7 @@ private:
     nre::Connection _rbcon;
     nre::RebootSession _reboot;
     Screen *_screen;
+    HostFramebuffer *_fb;
     size_t _console;
     nre::DList<ConsoleSessionData> *_cons[nre::Console::SUBCONS];
     nre::Cycler<iterator> *_concyc[nre::Console::SUBCONS];
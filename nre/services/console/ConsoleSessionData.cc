@@ -27,6 +27,8 @@ void ConsoleSessionData::create(DataSpace *in_ds, DataSpace *out_ds, size_t con,
         throw Exception(E_EXISTS, "Console session already initialized");
     if(con >= Console::SUBCONS)
         throw Exception(E_ARGS_INVALID, 32, "Subconsole %zu does not exist", con);
+    if(in_ds && in_ds->size() < Console::CTRL_OFF + sizeof(Console::Control))
+        throw Exception(E_ARGS_INVALID, 64, "Input dataspace too small (%zu)", in_ds->size());
     _in_ds = in_ds;
     _out_ds = out_ds;
     if(_in_ds)
@@ -36,46 +38,42 @@ void ConsoleSessionData::create(DataSpace *in_ds, DataSpace *out_ds, size_t con,
     _srv->session_ready(this);
 }
 
+void ConsoleSessionData::set_regs(const Console::Register &regs) {
+    // throws if the mode doesn't exist
+    _srv->mode_info(regs.mode);
+    bool mode_changed = regs.mode != _regs.mode;
+    _regs = regs;
+    if(_srv->active() == this) {
+        // let the viewswitcher take the screen away or give it back, if necessary
+        if(mode_changed)
+            _srv->switcher().switch_to(this, this);
+        else if(!graphic())
+            _srv->screen()->set_regs(_regs);
+    }
+}
+
+ConsoleSessionData::Dispatcher ConsoleSessionData::_dispatcher;
+
+ConsoleSessionData::Dispatcher::Dispatcher() : ProtocolDispatcher() {
+    add<Console::Create, &ConsoleSessionData::portal_create>();
+    add<Console::GetRegs, &ConsoleSessionData::portal_get_regs>();
+    add<Console::SetRegs, &ConsoleSessionData::portal_set_regs>();
+    add<Console::GetModeInfo, &ConsoleSessionData::portal_get_mode_info>();
+}
+
+void ConsoleSessionData::portal_create(ConsoleSessionData *sess, UtcbFrameRef &uf,
+                                       const Console::Create::In &in, Console::Create::Out &out) {
+    sess->create(new DataSpace(in.a1.sel), new DataSpace(in.a2.sel), in.a3, in.a4);
+    uf.accept_delegates();
+    out.a1 = Delegation(sess->_srv->switcher().wakeup(sess->id()).sel());
+}
+
 void ConsoleSessionData::portal(capsel_t pid) {
     UtcbFrameRef uf;
     try {
         ScopedLock<RCULock> guard(&RCU::lock());
         ConsoleService *srv = Thread::current()->get_tls<ConsoleService*>(Thread::TLS_PARAM);
-        ConsoleSessionData *sess = srv->get_session<ConsoleSessionData>(pid);
-        Console::Command cmd;
-        uf >> cmd;
-        switch(cmd) {
-            case Console::CREATE: {
-                size_t con;
-                String title;
-                capsel_t insel = uf.get_delegated(0).offset();
-                capsel_t outsel = uf.get_delegated(0).offset();
-                uf >> con >> title;
-                uf.finish_input();
-
-                sess->create(new DataSpace(insel), new DataSpace(outsel), con, title);
-                uf.accept_delegates();
-                uf << E_SUCCESS;
-            }
-            break;
-
-            case Console::GET_REGS: {
-                uf.finish_input();
-
-                uf << E_SUCCESS << sess->regs();
-            }
-            break;
-
-            case Console::SET_REGS: {
-                Console::Register regs;
-                uf >> regs;
-                uf.finish_input();
-
-                sess->set_regs(regs);
-                uf << E_SUCCESS;
-            }
-            break;
-        }
+        _dispatcher.dispatch(srv->get_session<ConsoleSessionData>(pid), uf);
     }
     catch(const Exception &e) {
         Syscalls::revoke(uf.delegation_window(), true);
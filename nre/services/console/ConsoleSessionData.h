@@ -40,6 +40,8 @@ public:
     }
 
     virtual void invalidate() {
+        // the client must not be able to wake up the viewswitcher via the next session with our id
+        _srv->switcher().release(id());
         if(_srv->active() == this) {
             // ensure that we don't have the screen; the session might be destroyed before the
             // viewswitcher can handle the switch and therefore, take away the screen, if necessary.
@@ -64,11 +66,36 @@ public:
     nre::DataSpace *out_ds() {
         return _out_ds;
     }
+    /**
+     * @return the control block of the client or 0 if there is none
+     */
+    nre::Console::Control *control() {
+        if(!_in_ds)
+            return 0;
+        return reinterpret_cast<nre::Console::Control*>(_in_ds->virt() + nre::Console::CTRL_OFF);
+    }
 
     void create(nre::DataSpace *in_ds, nre::DataSpace *out_ds, size_t con, const nre::String &title);
 
+    bool has_screen() const {
+        return _has_screen;
+    }
+    /**
+     * @return true if the session uses a graphic mode
+     */
+    bool graphic() const {
+        return _regs.mode != 0;
+    }
+    /**
+     * @return true if the session can get direct access to the screen. Otherwise, the
+     *  viewswitcher has to repaint the screen from the session's dataspace.
+     */
+    bool direct() const {
+        return !graphic() && _out_ds && _out_ds->size() == _srv->screen()->mem().size();
+    }
+
     void to_front() {
-        if(!_has_screen) {
+        if(!_has_screen && direct()) {
             swap();
             activate();
             _has_screen = true;
@@ -90,15 +117,36 @@ public:
     const nre::Console::Register &regs() const {
         return _regs;
     }
-    void set_regs(const nre::Console::Register &regs) {
-        _regs = regs;
-        if(_srv->active() == this)
-            _srv->screen()->set_regs(_regs);
-    }
+    void set_regs(const nre::Console::Register &regs);
 
     PORTAL static void portal(capsel_t pid);
 
 private:
+    class Dispatcher : public nre::ProtocolDispatcher<ConsoleSessionData,
+                                                      nre::Console::COMMAND_COUNT> {
+    public:
+        explicit Dispatcher();
+    };
+
+    static void portal_create(ConsoleSessionData *sess, nre::UtcbFrameRef &uf,
+                              const nre::Console::Create::In &in,
+                              nre::Console::Create::Out &out);
+    static void portal_get_regs(ConsoleSessionData *sess, nre::UtcbFrameRef &,
+                                const nre::Console::GetRegs::In &,
+                                nre::Console::GetRegs::Out &out) {
+        out.a1 = sess->regs();
+    }
+    static void portal_set_regs(ConsoleSessionData *sess, nre::UtcbFrameRef &,
+                                const nre::Console::SetRegs::In &in,
+                                nre::Console::SetRegs::Out &) {
+        sess->set_regs(in.a1);
+    }
+    static void portal_get_mode_info(ConsoleSessionData *sess, nre::UtcbFrameRef &,
+                                     const nre::Console::GetModeInfo::In &in,
+                                     nre::Console::GetModeInfo::Out &out) {
+        out.a1 = sess->_srv->mode_info(in.a1);
+    }
+
     void swap() {
         _out_ds->switch_to(_srv->screen()->mem());
     }
@@ -112,4 +160,5 @@ private:
     nre::Producer<nre::Console::ReceivePacket> *_prod;
     nre::Console::Register _regs;
     ConsoleService *_srv;
+    static Dispatcher _dispatcher;
 };
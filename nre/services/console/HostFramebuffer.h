@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#pragma once
+
+#include <arch/ExecEnv.h>
+#include <mem/DataSpace.h>
+#include <services/Console.h>
+#include <util/Math.h>
+
+#include "Screen.h"
+
+/**
+ * The linear framebuffer of the host. Since we can't set a graphic mode ourself, the mode has to
+ * be set by the bootloader and we have to be told about its location and geometry.
+ */
+class HostFramebuffer : public Screen {
+public:
+    // an OEM-defined VESA mode number, under which we present the host mode to guests
+    static const uint16_t VESA_MODE     = 0x140;
+
+    explicit HostFramebuffer(uintptr_t phys, const nre::Console::ModeInfo &info)
+        : Screen(), _info(info),
+          _ds(nre::Math::round_up<size_t>(info.bytes_per_line * info.height, PAGE_SIZE),
+              nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW, phys) {
+        _info.vesa_mode = VESA_MODE;
+    }
+
+    /**
+     * @return the mode of the framebuffer
+     */
+    const nre::Console::ModeInfo &info() const {
+        return _info;
+    }
+
+    virtual nre::DataSpace &mem() {
+        return _ds;
+    }
+    virtual void set_regs(const nre::Console::Register &) {
+        // there is neither a cursor nor page flipping in graphic modes
+    }
+
+private:
+    nre::Console::ModeInfo _info;
+    nre::DataSpace _ds;
+};
@@ -14,15 +14,16 @@
  * General Public License version 2 for more details.
  */
 
-#include <ipc/Connection.h>
 #include <stream/OStringStream.h>
-#include <services/Timer.h>
+#include <util/Atomic.h>
 #include <util/Clock.h>
+#include <util/Sync.h>
 #include <Logging.h>
 
 #include "ViewSwitcher.h"
 #include "ConsoleService.h"
 #include "ConsoleSessionData.h"
+#include "HostFramebuffer.h"
 
 using namespace nre;
 
@@ -30,10 +31,16 @@ char ViewSwitcher::_backup[Screen::COLS * 2];
 char ViewSwitcher::_buffer[Screen::COLS + 1];
 
 ViewSwitcher::ViewSwitcher(ConsoleService *srv)
-    : _sm(1), _ds(DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+    : _sm(1), _wakeups(), _watching(), _ds(DS_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
       _prod(&_ds, true), _cons(&_ds, false),
       _ec(GlobalThread::create(switch_thread, CPU::current().log_id(), String("console-vs"))),
-      _srv(srv) {
+      _srv(srv), _tiles() {
+    if(_srv->framebuffer()) {
+        const Console::ModeInfo &info = _srv->framebuffer()->info();
+        _tiles = new DirtyTiles(info.bytes_per_line, info.height);
+    }
+    for(size_t i = 0; i < Service::MAX_SESSIONS; ++i)
+        _wakeups[i] = new Sm(0);
     _ec->set_tls<ViewSwitcher*>(Thread::TLS_PARAM, this);
 }
 
@@ -46,16 +53,22 @@ void ViewSwitcher::switch_to(ConsoleSessionData *from, ConsoleSessionData *to) {
     // we can't access the producer concurrently
     ScopedLock<UserSm> guard(&_sm);
     _prod.produce(cmd);
+    // if the switcher has read the old session before we produced the command, it sees it before
+    // blocking. otherwise, we up the semaphore it's blocking on
+    Sync::memory_barrier();
+    _wakeups[_watching]->up();
 }
 
 void ViewSwitcher::switch_thread(void*) {
     ViewSwitcher *vs = Thread::current()->get_tls<ViewSwitcher*>(Thread::TLS_PARAM);
     Clock clock(1000);
-    Connection con("timer");
-    TimerSession timer(con);
     timevalue_t until = 0;
     size_t sessid = 0;
     bool tag_done = false;
+    // whether we have to repaint the session, because it has no direct access
+    bool refresh = false;
+    // whether we have to repaint everything, because the screen shows something else
+    bool full = false;
     while(1) {
         // are we finished?
         if(until && clock.source_time() >= until) {
@@ -65,16 +78,20 @@ void ViewSwitcher::switch_thread(void*) {
                 ConsoleSessionData *sess = vs->_srv->get_session_by_id<ConsoleSessionData>(sessid);
                 // finally swap to that session. i.e. give him direct screen access
                 sess->to_front();
+                refresh = !sess->has_screen();
             }
             catch(const Exception &e) {
                 LOG(Logging::CONSOLE, Serial::get() << e);
                 // just ignore it
+                refresh = false;
             }
+            // the tag is gone now
+            full = true;
             until = 0;
         }
 
-        // either block until the next request, or - if we're switching - check for new requests
-        if(until == 0 || vs->_cons.has_data()) {
+        // handle new requests
+        if(vs->_cons.has_data()) {
             SwitchCommand *cmd = vs->_cons.get();
             LOG(Logging::CONSOLE,
                 Serial::get() << "Got switch " << cmd->oldsessid << " to " << cmd->sessid << "\n");
@@ -94,36 +111,40 @@ void ViewSwitcher::switch_thread(void*) {
             // show the tag for 1sec
             until = clock.source_time(SWITCH_TIME);
             tag_done = false;
+            refresh = false;
+            full = true;
+            // somebody else has painted the framebuffer in the meantime
+            if(vs->_tiles)
+                vs->_tiles->invalidate();
             vs->_cons.next();
         }
 
-        {
+        bool poll = false;
+        if(until || refresh) {
             ScopedLock<RCULock> guard(&RCU::lock());
             try {
                 ConsoleSessionData *sess = vs->_srv->get_session_by_id<ConsoleSessionData>(sessid);
 
-                // repaint all lines from the buffer except the first
-                uintptr_t start = vs->_srv->screen()->mem().virt();
-                if(sess->out_ds()) {
-                    memcpy(reinterpret_cast<void*>(start + sess->offset() + Screen::COLS * 2),
-                           reinterpret_cast<void*>(sess->out_ds()->virt() + sess->offset() +
-                                                   Screen::COLS * 2),
-                           Screen::PAGE_SIZE - Screen::COLS * 2);
-                }
+                poll = vs->repaint(sess, until != 0, full);
+                full = false;
 
                 if(!tag_done) {
-                    // write tag into buffer
-                    memset(_buffer, 0, sizeof(_buffer));
-                    OStringStream os(_buffer, sizeof(_buffer));
-                    os << "Console " << sess->console() << ": " << sess->title() << " (" <<
-                    sess->id() << ")";
-
-                    // write console tag
-                    char *screen = reinterpret_cast<char*>(start + sess->offset());
-                    char *s = _buffer;
-                    for(uint x = 0; x < Screen::COLS; ++x, ++s) {
-                        screen[x * 2] = *s ? *s : ' ';
-                        screen[x * 2 + 1] = COLOR;
+                    // graphic modes have no room for a tag
+                    if(!sess->graphic()) {
+                        // write tag into buffer
+                        memset(_buffer, 0, sizeof(_buffer));
+                        OStringStream os(_buffer, sizeof(_buffer));
+                        os << "Console " << sess->console() << ": " << sess->title() << " (" <<
+                        sess->id() << ")";
+
+                        // write console tag
+                        uintptr_t start = vs->_srv->screen()->mem().virt();
+                        char *screen = reinterpret_cast<char*>(start + sess->offset());
+                        char *s = _buffer;
+                        for(uint x = 0; x < Screen::COLS; ++x, ++s) {
+                            screen[x * 2] = *s ? *s : ' ';
+                            screen[x * 2 + 1] = COLOR;
+                        }
                     }
                     sess->activate();
                     tag_done = true;
@@ -133,15 +154,72 @@ void ViewSwitcher::switch_thread(void*) {
                 LOG(Logging::CONSOLE, Serial::get() << e);
                 // if the session is dead, stop switching to it
                 until = 0;
-                continue;
+                refresh = false;
             }
         }
 
-        // wait 25ms
-        LOG(Logging::CONSOLE,
-            Serial::get() << "Waiting until " << clock.source_time(REFRESH_DELAY) << "\n");
-        timer.wait_until(clock.source_time(REFRESH_DELAY));
-        LOG(Logging::CONSOLE,
-            Serial::get() << "Waiting done\n");
+        // wait until the next request or change arrives, or we have to poll the screen or to
+        // finish the switch. we don't need the timer for that; the timeout of the Sm suffices.
+        timevalue_t timeout = poll ? clock.source_time(REFRESH_DELAY) : 0;
+        if(until && (timeout == 0 || until < timeout))
+            timeout = until;
+        LOG(Logging::CONSOLE, Serial::get() << "Waiting until " << timeout << "\n");
+        vs->_watching = sessid;
+        Sync::memory_barrier();
+        if(vs->_cons.has_data())
+            continue;
+        if(timeout)
+            vs->_wakeups[sessid]->down(timeout);
+        else
+            vs->_wakeups[sessid]->down();
+    }
+}
+
+bool ViewSwitcher::repaint(ConsoleSessionData *sess, bool tag, bool full) {
+    if(!sess->out_ds())
+        return false;
+
+    if(sess->graphic()) {
+        // only copy the tiles that have changed since the last time; the framebuffer memory is
+        // much slower than ordinary memory
+        if(_tiles && sess->out_ds()->size() >= _tiles->size()) {
+            _tiles->update(reinterpret_cast<void*>(_srv->framebuffer()->mem().virt()),
+                           reinterpret_cast<void*>(sess->out_ds()->virt()));
+        }
+        // we can't know when the framebuffer changes
+        return true;
+    }
+
+    // if the client announces its changes, repaint only the changed rows
+    const size_t row_size = Screen::COLS * 2;
+    uintptr_t src = sess->out_ds()->virt();
+    Console::Control *ctrl = sess->control();
+    size_t page = (sess->offset() - Screen::TEXT_OFF) / Screen::PAGE_SIZE;
+    bool notify = ctrl && ctrl->notify == Console::NOTIFY_MAGIC && page < Screen::TEXT_PAGES &&
+                  (sess->offset() - Screen::TEXT_OFF) % Screen::PAGE_SIZE == 0;
+    uint32_t rows = ~static_cast<uint32_t>(0);
+    if(notify) {
+        uint32_t dirty = Atomic::swap(ctrl->dirty + page, 0);
+        if(!full)
+            rows = dirty;
+    }
+    // the first row holds the tag
+    if(tag)
+        rows &= ~static_cast<uint32_t>(1);
+
+    // copy consecutive rows at once
+    src += sess->offset();
+    uintptr_t dst = _srv->screen()->mem().virt() + sess->offset();
+    for(uint r = 0; r < Screen::ROWS; ) {
+        if(~rows & (static_cast<uint32_t>(1) << r)) {
+            r++;
+            continue;
+        }
+        uint first = r;
+        while(r < Screen::ROWS && (rows & (static_cast<uint32_t>(1) << r)))
+            r++;
+        memcpy(reinterpret_cast<void*>(dst + first * row_size),
+               reinterpret_cast<void*>(src + first * row_size), (r - first) * row_size);
     }
+    return !notify;
 }
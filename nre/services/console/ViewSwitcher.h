@@ -18,9 +18,12 @@
 
 #include <ipc/Producer.h>
 #include <ipc/Consumer.h>
+#include <ipc/Service.h>
 #include <kobj/GlobalThread.h>
 #include <kobj/Sc.h>
+#include <kobj/Sm.h>
 #include <mem/DataSpace.h>
+#include <util/DirtyTiles.h>
 
 #include "Screen.h"
 
@@ -40,22 +43,49 @@ class ViewSwitcher {
 
 public:
     explicit ViewSwitcher(ConsoleService *srv);
+    ~ViewSwitcher() {
+        for(size_t i = 0; i < nre::Service::MAX_SESSIONS; ++i)
+            delete _wakeups[i];
+        delete _tiles;
+    }
 
     void start() {
         _ec->start();
     }
 
+    /**
+     * @param sessid the session id
+     * @return the semaphore by which session <sessid> wakes up the viewswitcher to repaint its
+     *  changed rows. It has only an effect while the session is shown.
+     */
+    nre::Sm &wakeup(size_t sessid) {
+        return *_wakeups[sessid];
+    }
+    /**
+     * Revokes the semaphore of session <sessid> from its client, because the session is destroyed
+     *
+     * @param sessid the session id
+     */
+    void release(size_t sessid) {
+        nre::CapRange(_wakeups[sessid]->sel(), 1, nre::Crd::OBJ_ALL).revoke(false);
+    }
+
     void switch_to(ConsoleSessionData *from, ConsoleSessionData *to);
 
 private:
     static void switch_thread(void*);
+    bool repaint(ConsoleSessionData *sess, bool tag, bool full);
 
     nre::UserSm _sm;
+    // we wait on the semaphore of the session we show, so that the others can't wake us up
+    nre::Sm *_wakeups[nre::Service::MAX_SESSIONS];
+    volatile size_t _watching;
     nre::DataSpace _ds;
     nre::Producer<SwitchCommand> _prod;
     nre::Consumer<SwitchCommand> _cons;
     nre::GlobalThread *_ec;
     ConsoleService *_srv;
+    nre::DirtyTiles *_tiles;
     static char _backup[];
     static char _buffer[];
 };
@@ -15,42 +15,85 @@
  */
 
 #include <stream/IStringStream.h>
+#include <stream/Serial.h>
 
 #include "ConsoleSessionData.h"
 #include "ConsoleService.h"
+#include "HostFramebuffer.h"
 #include "Keymap.h"
 
 using namespace nre;
 
+static const size_t INPUT_BATCH = 16;
+
 static ConsoleService *srv;
 
+static void forward(const Console::ReceivePacket *pks, size_t count) {
+    if(count == 0)
+        return;
+    ScopedLock<RCULock> guard(&RCU::lock());
+    ConsoleSessionData *sess = srv->active();
+    if(sess && sess->prod())
+        sess->prod()->produce_batch(pks, count);
+}
+
 static void input_thread(void*) {
     Connection con("keyboard");
     KeyboardSession kb(con);
-    for(Keyboard::Packet *pk; (pk = kb.consumer().get()) != 0; kb.consumer().next()) {
-        if(!srv->handle_keyevent(*pk)) {
-            ScopedLock<RCULock> guard(&RCU::lock());
-            ConsoleSessionData *sess = srv->active();
-            if(sess && sess->prod()) {
-                Console::ReceivePacket rpk;
-                rpk.flags = pk->flags;
-                rpk.scancode = pk->scancode;
-                rpk.keycode = pk->keycode;
-                rpk.character = Keymap::translate(*pk);
-                sess->prod()->produce(rpk);
+    Keyboard::Packet pks[INPUT_BATCH];
+    Console::ReceivePacket rpks[INPUT_BATCH];
+    size_t n;
+    while((n = kb.consumer().consume_batch(pks, INPUT_BATCH)) != 0) {
+        size_t count = 0;
+        for(size_t i = 0; i < n; ++i) {
+            // the key event might switch to a different session, so that the packets before it
+            // have to be delivered to the current one first
+            if(pks[i].flags & srv->modifier()) {
+                forward(rpks, count);
+                count = 0;
+                if(srv->handle_keyevent(pks[i]))
+                    continue;
             }
+            rpks[count].flags = pks[i].flags;
+            rpks[count].scancode = pks[i].scancode;
+            rpks[count].keycode = pks[i].keycode;
+            rpks[count].character = Keymap::translate(pks[i]);
+            count++;
         }
+        forward(rpks, count);
     }
 }
 
+static HostFramebuffer *create_fb(const char *spec) {
+    // the Hip doesn't tell us about the mode that the bootloader has set, so that we get it via
+    // "fb=<phys>,<width>,<height>,<bpp>,<bytes_per_line>". we need all values, because the stream
+    // would wait for them otherwise.
+    size_t values = 1;
+    for(const char *s = spec; *s; ++s)
+        values += *s == ',';
+    if(values != 5) {
+        Serial::get() << "Ignoring invalid framebuffer specification '" << spec << "'\n";
+        return 0;
+    }
+
+    IStringStream is(spec);
+    uintptr_t phys;
+    Console::ModeInfo info;
+    is >> phys >> info.width >> info.height >> info.bpp >> info.bytes_per_line;
+    return new HostFramebuffer(phys, info);
+}
+
 int main(int argc, char *argv[]) {
     uint modifier = Keyboard::LCTRL;
+    HostFramebuffer *fb = 0;
     for(int i = 1; i < argc; ++i) {
         if(strncmp(argv[i], "modifier=", 9) == 0)
             modifier = 1 << IStringStream::read_from<uint>(argv[i] + 9, strlen(argv[i] + 9));
+        else if(strncmp(argv[i], "fb=", 3) == 0)
+            fb = create_fb(argv[i] + 3);
     }
 
-    srv = new ConsoleService("console", modifier);
+    srv = new ConsoleService("console", modifier, fb);
     GlobalThread::create(input_thread, CPU::current().log_id(), String("console-input"))->start();
     srv->start();
     return 0;
@@ -31,6 +31,9 @@ enum {
     MOUSE_IRQ       = 12
 };
 
+// the maximum number of packets we forward per interrupt
+static const size_t MAX_BATCH   = 16;
+
 template<class T>
 class KeyboardSessionData : public ServiceSession {
 public:
@@ -98,35 +101,44 @@ static uint kbgsi;
 static uint msgsi;
 
 template<class T>
-static void broadcast(KeyboardService<T> *srv, const T &data) {
+static void broadcast(KeyboardService<T> *srv, const T *data, size_t count) {
     ScopedLock<RCULock> guard(&RCU::lock());
     for(typename KeyboardService<T>::iterator it = srv->sessions_begin(); it != srv->sessions_end();
         ++it) {
         if(it->prod())
-            it->prod()->produce(data);
+            it->prod()->produce_batch(data, count);
     }
 }
 
-static void kbhandler(void*) {
-    Gsi gsi(kbgsi);
+template<class T>
+static void handler(uint gsinum, KeyboardService<T> *srv) {
+    Gsi gsi(gsinum);
+    // mouse packets consist of multiple bytes, which might arrive with different interrupts
+    T cur = T();
+    T data[MAX_BATCH];
     while(1) {
         gsi.down();
 
-        Keyboard::Packet data;
-        if(hostkb->read(data))
-            broadcast(kbsrv, data);
+        // drain the controller, so that a burst of input costs one notification per client
+        // instead of one per packet
+        size_t count;
+        do {
+            count = 0;
+            while(count < MAX_BATCH && hostkb->read(cur))
+                data[count++] = cur;
+            if(count > 0)
+                broadcast(srv, data, count);
+        }
+        while(count == MAX_BATCH);
     }
 }
 
-static void mousehandler(void*) {
-    Gsi gsi(msgsi);
-    while(1) {
-        gsi.down();
+static void kbhandler(void*) {
+    handler(kbgsi, kbsrv);
+}
 
-        Mouse::Packet data;
-        if(hostkb->read(data))
-            broadcast(mousesrv, data);
-    }
+static void mousehandler(void*) {
+    handler(msgsi, mousesrv);
 }
 
 template<class T>
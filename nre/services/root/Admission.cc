@@ -16,6 +16,9 @@
 
 #include <kobj/Sc.h>
 #include <utcb/UtcbFrame.h>
+#include <util/Math.h>
+#include <util/Sync.h>
+#include <util/Util.h>
 #include <Syscalls.h>
 #include <Logging.h>
 
@@ -26,8 +29,14 @@
 
 using namespace nre;
 
+const uint Admission::CAPACITY;
 UserSm Admission::_sm INIT_PRIO_ADM;
 SList<Admission::SchedEntity> Admission::_list INIT_PRIO_ADM;
+DataSpace *Admission::_stats;
+uint Admission::_cpuavg[Hip::MAX_CPUS][SysInfo::WINDOWS];
+
+// the number of periods that make up the windows
+static const uint window_periods[] = {1, 10, 60};
 
 void Admission::init() {
     // add idle Scs
@@ -36,8 +45,138 @@ void Admission::init() {
         OStringStream stream(name, sizeof(name));
         stream << "CPU" << it->log_id() << "-idle";
         capsel_t sc = Hypervisor::request_idle_sc(it->phys_id());
-        add_sc(new SchedEntity(String(name), it->log_id(), sc));
+        add_sc(new SchedEntity(StringView(name, stream.length()), it->log_id(), sc));
+    }
+
+    // one page per CPU for the statistics. we can write to it anyway, but the clients can't
+    STATIC_ASSERT(sizeof(SysInfo::CPUStats) <= ExecEnv::PAGE_SIZE);
+    _stats = new DataSpace(CPU::count() * ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS,
+                           DataSpaceDesc::R);
+    memset(reinterpret_cast<void*>(_stats->virt()), 0, _stats->size());
+}
+
+void Admission::average(uint *avg, uint cur) {
+    // exponential moving averages over the windows, in ppm
+    for(size_t w = 0; w < SysInfo::WINDOWS; ++w) {
+        uint n = window_periods[w];
+        avg[w] = static_cast<uint>((static_cast<uint64_t>(avg[w]) * (n - 1) + cur * 1000) / n);
+    }
+}
+
+void Admission::sample(cpu_t cpu) {
+    SysInfo::CPUStats *cs = reinterpret_cast<SysInfo::CPUStats*>(
+        _stats->virt() + cpu * ExecEnv::PAGE_SIZE);
+
+    // first determine the time of all Scs on this CPU, since we need the total time
+    timevalue_t total = 0, idle = 0;
+    for(SList<SchedEntity>::iterator s = _list.begin(); s != _list.end(); ++s) {
+        if(s->cpu() == cpu) {
+            timevalue_t diff = s->sample();
+            total += diff;
+            if(s->idle())
+                idle += diff;
+        }
     }
+
+    cs->seq++;
+    Sync::memory_barrier();
+    cs->total = total;
+    cs->stamp = Util::tsc();
+    uint load = total == 0 ? 0 : static_cast<uint>(((total - idle) * 1000) / total);
+    average(_cpuavg[cpu], load);
+    for(size_t w = 0; w < SysInfo::WINDOWS; ++w)
+        cs->load[w] = _cpuavg[cpu][w] / 1000;
+
+    size_t count = 0, dropped = 0;
+    for(SList<SchedEntity>::iterator s = _list.begin(); s != _list.end(); ++s) {
+        if(s->cpu() != cpu)
+            continue;
+        uint cur = total == 0 ? 0 : static_cast<uint>((s->sampled_diff() * 1000) / total);
+        average(s->averages(), cur);
+        // keep the averages of the others up to date, so that they are right when they fit again
+        if(count == SysInfo::STATS_MAX_SCS) {
+            dropped++;
+            continue;
+        }
+
+        SysInfo::ScStats *ss = cs->scs + count++;
+        size_t len = Math::min<size_t>(s->name().length(), SysInfo::STATS_NAME_LEN - 1);
+        memcpy(ss->name, s->name().str(), len);
+        ss->name[len] = '\0';
+        ss->time = s->sampled_diff();
+        ss->totaltime = s->sampled_total();
+        for(size_t w = 0; w < SysInfo::WINDOWS; ++w)
+            ss->load[w] = s->averages()[w] / 1000;
+        ss->prio = s->prio();
+        ss->reserved = s->reserved();
+    }
+    if(dropped != cs->dropped) {
+        LOG(Logging::ADMISSION, Serial::get().writef(
+                "Root: Statistics of CPU %u: %zu of %zu Scs don't fit\n", cpu, dropped,
+                count + dropped));
+    }
+    cs->count = count;
+    cs->dropped = dropped;
+    Sync::memory_barrier();
+    cs->seq++;
+}
+
+void Admission::sampler() {
+    Sm sm(0);
+    uint64_t period = static_cast<uint64_t>(Hip::get().freq_tsc) * SysInfo::STATS_PERIOD;
+    uint64_t next = Util::tsc() + period;
+    while(1) {
+        // nobody ups the Sm; we just use it to wait until the next period starts
+        sm.down(next);
+        // don't try to catch up if we've missed periods
+        uint64_t now = Util::tsc();
+        next += period;
+        if(next < now)
+            next = now + period;
+
+        ScopedLock<UserSm> guard(&_sm);
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
+            sample(it->log_id());
+    }
+}
+
+capsel_t Admission::create_sc(const StringView &name, cpu_t cpu, capsel_t ec, Qpd &qpd,
+                              Reservation &res) {
+    // the ChildManagers have put the Scs of their childs into their band already; the remaining
+    // ones are our own and therefore system services
+    if(qpd.prio() == Sc::BAND_PD || qpd.prio() > Sc::BAND_SERVICE)
+        qpd = Qpd(Sc::BAND_SERVICE, qpd.quantum());
+
+    // check and add the Sc with the lock held, so that concurrent requests can't oversubscribe
+    ScopedLock<UserSm> guard(&_sm);
+    uint util = res.utilization();
+    if(util > 0) {
+        uint reserved = get_reserved(cpu);
+        if(reserved + util > CAPACITY) {
+            if(res.hard()) {
+                throw Exception(E_CAPACITY, 96,
+                                "Unable to reserve %u permil of CPU %u for '%s' (%u reserved)",
+                                util, cpu, name.str(), reserved);
+            }
+            LOG(Logging::ADMISSION, Serial::get().writef(
+                    "Root: Demoting sc '%s' on cpu %u; %u permil reserved already\n",
+                    name.str(), cpu, reserved));
+            res = Reservation();
+            util = 0;
+        }
+        // NOVA can't enforce the budget. thus, we can't put the Sc above its band, because it
+        // could starve the higher bands on this CPU if it runs longer than it said
+        else
+            qpd = Qpd(qpd.prio(), res.budget());
+    }
+
+    ScopedCapSels sc;
+    LOG(Logging::ADMISSION,
+        Serial::get().writef("Root: Creating sc '%s' on cpu %u with prio %u (%u permil)\n",
+                             name.str(), cpu, qpd.prio(), util));
+    Syscalls::create_sc(sc.get(), ec, qpd, Pd::current()->sel());
+    _list.append(new SchedEntity(name, cpu, sc.get(), qpd.prio(), util));
+    return sc.release();
 }
 
 void Admission::portal_sc(capsel_t) {
@@ -71,22 +210,19 @@ void Admission::portal_sc(capsel_t) {
             break;
 
             case Sc::START: {
-                String name;
+                StringView name;
                 Qpd qpd;
+                Reservation res;
                 cpu_t cpu;
                 capsel_t ec = uf.get_delegated(0).offset();
-                uf >> name >> cpu >> qpd;
+                uf >> name >> cpu >> qpd >> res;
                 uf.finish_input();
 
-                ScopedCapSels sc;
-                LOG(Logging::ADMISSION,
-                    Serial::get().writef("Root: Creating sc '%s' on cpu %u\n", name.str(), cpu));
-                Syscalls::create_sc(sc.get(), ec, qpd, Pd::current()->sel());
-                add_sc(new SchedEntity(name, cpu, sc.get()));
+                capsel_t sc = create_sc(name, cpu, ec, qpd, res);
 
                 uf.accept_delegates();
-                uf.delegate(sc.release());
-                uf << E_SUCCESS << qpd;
+                uf.delegate(sc);
+                uf << E_SUCCESS << qpd << res;
             }
             break;
 
@@ -17,16 +17,19 @@
 #pragma once
 
 #include <kobj/UserSm.h>
+#include <kobj/Sc.h>
+#include <services/SysInfo.h>
 #include <util/SList.h>
 #include <util/ScopedLock.h>
 #include <Exception.h>
 #include <String.h>
 
 /**
- * This class keeps track of all schedulable entities in the system. Note that there is no policy
- * here. This is done by ChildManager. This class does only react on portal-calls by adding
- * SchedEntitites to a list and removing them again. Additionally, since root is the only task that
- * is allowed to create Scs, it does so as well.
+ * This class keeps track of all schedulable entities in the system. The ChildManagers put the Scs
+ * of their childs into the priority band of the child. Since root is the only task that is allowed
+ * to create Scs, it does so and performs the admission control for CPU reservations: a
+ * reservation is granted if the sum of all reservations on the CPU stays below CAPACITY. Otherwise
+ * the Sc is rejected (hard reservations) or demoted to its band.
  */
 class Admission {
     /**
@@ -34,9 +37,11 @@ class Admission {
      */
     class SchedEntity : public nre::SListItem {
     public:
-        explicit SchedEntity(const nre::String &name, cpu_t cpu, capsel_t cap)
-            : nre::SListItem(), _name(name), _cpu(cpu), _cap(cap),
-              _last(nre::Syscalls::sc_time(_cap)), _lastdiff() {
+        explicit SchedEntity(const nre::StringView &name, cpu_t cpu, capsel_t cap, uint prio = 0,
+                             uint reserved = 0)
+            : nre::SListItem(), _name(name.str(), name.length()), _cpu(cpu), _cap(cap), _prio(prio), _reserved(reserved),
+              _last(nre::Syscalls::sc_time(_cap)), _lastdiff(), _sampled(_last), _sampdiff(),
+              _avg() {
         }
         virtual ~SchedEntity() {
             nre::CapRange(_cap, 1, nre::Crd::OBJ_ALL).revoke(true);
@@ -52,6 +57,12 @@ class Admission {
         capsel_t cap() const {
             return _cap;
         }
+        uint prio() const {
+            return _prio;
+        }
+        uint reserved() const {
+            return _reserved;
+        }
         timevalue_t ms_last_sec(bool update) {
             timevalue_t res = _lastdiff;
             if(update) {
@@ -65,21 +76,69 @@ class Admission {
         timevalue_t totaltime() const {
             return _last;
         }
+        // the idle Scs are the only ones without priority
+        bool idle() const {
+            return _prio == 0;
+        }
+
+        /**
+         * Samples the time of this Sc for the statistics. This is independent of ms_last_sec(),
+         * which is used by the clients that update the time themself.
+         */
+        timevalue_t sample() {
+            timevalue_t time = nre::Syscalls::sc_time(_cap);
+            _sampdiff = time - _sampled;
+            _sampled = time;
+            return _sampdiff;
+        }
+        timevalue_t sampled_diff() const {
+            return _sampdiff;
+        }
+        timevalue_t sampled_total() const {
+            return _sampled;
+        }
+        uint *averages() {
+            return _avg;
+        }
 
     private:
         nre::String _name;
         cpu_t _cpu;
         capsel_t _cap;
+        uint _prio;
+        uint _reserved;
         timevalue_t _last;
         timevalue_t _lastdiff;
+        timevalue_t _sampled;
+        timevalue_t _sampdiff;
+        // in ppm to not lose too much precision
+        uint _avg[nre::SysInfo::WINDOWS];
     };
 
 public:
+    /**
+     * The share of each CPU in permil that can be reserved. The rest is left for the best-effort
+     * Scs, so that they can't be starved completely.
+     */
+    static const uint CAPACITY  = 900;
+
     /**
      * Inits this module
      */
     static void init();
 
+    /**
+     * @return the dataspace that holds the statistics (see SysInfo::CPUStats)
+     */
+    static const nre::DataSpace &stats() {
+        return *_stats;
+    }
+    /**
+     * Samples the time of all Scs every SysInfo::STATS_PERIOD ms and updates the statistics.
+     * Does never return.
+     */
+    static void sampler();
+
     /**
      * Calculates the total time that has elapsed in the last second on cpu <cpu>
      *
@@ -98,6 +157,15 @@ public:
         return total;
     }
 
+    /**
+     * @param cpu the logical cpu id
+     * @return the share of the CPU in permil that has been reserved
+     */
+    static uint reserved(cpu_t cpu) {
+        nre::ScopedLock<nre::UserSm> guard(&_sm);
+        return get_reserved(cpu);
+    }
+
     /**
      * Retrieves the properties of SchedEntity with index <idx>
      *
@@ -106,9 +174,11 @@ public:
      * @param cpu will be set to the CPU the Sc runs on
      * @param time will be set to the time it has run in the last second (in microseconds)
      * @param totaltime will be set to the total time it has run so far (in microseconds)
+     * @param prio will be set to its priority
+     * @param reserved will be set to the reserved share of the CPU in permil
      */
     static bool get_sched_entity(size_t idx, nre::String &name, cpu_t &cpu, timevalue_t &time,
-                                 timevalue_t &totaltime) {
+                                 timevalue_t &totaltime, uint &prio, uint &reserved) {
         nre::ScopedLock<nre::UserSm> guard(&_sm);
         if(idx < _list.length()) {
             nre::SList<SchedEntity>::iterator s;
@@ -118,6 +188,8 @@ public:
             cpu = s->cpu();
             time = s->ms_last_sec(false);
             totaltime = s->totaltime();
+            prio = s->prio();
+            reserved = s->reserved();
             return true;
         }
         return false;
@@ -135,6 +207,16 @@ private:
         nre::ScopedLock<nre::UserSm> guard(&_sm);
         _list.append(se);
     }
+    static uint get_reserved(cpu_t cpu) {
+        uint sum = 0;
+        for(nre::SList<SchedEntity>::iterator it = _list.begin(); it != _list.end(); ++it) {
+            if(it->cpu() == cpu)
+                sum += it->reserved();
+        }
+        return sum;
+    }
+    static capsel_t create_sc(const nre::StringView &name, cpu_t cpu, capsel_t ec, nre::Qpd &qpd,
+                              nre::Reservation &res);
     static SchedEntity *remove_sc(capsel_t sc) {
         nre::ScopedLock<nre::UserSm> guard(&_sm);
         for(nre::SList<SchedEntity>::iterator it = _list.begin(); it != _list.end(); ++it) {
@@ -146,6 +228,11 @@ private:
         throw nre::Exception(nre::E_NOT_FOUND, 32, "Unable to find Sc %u", sc);
     }
 
+    static void sample(cpu_t cpu);
+    static void average(uint *avg, uint cur);
+
     static nre::UserSm _sm;
     static nre::SList<SchedEntity> _list;
+    static nre::DataSpace *_stats;
+    static uint _cpuavg[nre::Hip::MAX_CPUS][nre::SysInfo::WINDOWS];
 };
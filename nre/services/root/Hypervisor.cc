@@ -17,6 +17,7 @@
 #include <kobj/UserSm.h>
 #include <kobj/Gsi.h>
 #include <kobj/Ports.h>
+#include <cap/CapBatch.h>
 #include <utcb/UtcbFrame.h>
 #include <util/ScopedLock.h>
 #include <Logging.h>
@@ -60,37 +61,17 @@ void Hypervisor::map_mem(uintptr_t phys, uintptr_t virt, size_t size) {
     uf.delegation_window(Crd(0, 31, Crd::MEM_ALL));
     size_t pages = Math::blockcount<size_t>(size, ExecEnv::PAGE_SIZE);
     CapRange cr(phys >> ExecEnv::PAGE_SHIFT, pages, Crd::MEM_ALL, virt >> ExecEnv::PAGE_SHIFT);
-    size_t count = pages;
-    while(count > 0) {
+    while(cr.count() > 0) {
+        // portal_map delegates as much as fits into the UTCB and tells us how much that was
         uf.clear();
-        if(cr.hotspot() != CapRange::NO_HOTSPOT) {
-            // if start and hotspot are different, we have to check whether it fits in the utcb
-            uintptr_t diff = cr.hotspot() ^ cr.start();
-            if(diff) {
-                // the lowest bit that's different defines how many we can map with one Crd.
-                // with bit 0, its 2^0 = 1 at once, with bit 1, 2^1 = 2 and so on.
-                unsigned at_once = Math::bit_scan_forward(diff);
-                if((1 << at_once) < count) {
-                    // be carefull that we might have to align it to 1 << at_once first. this takes
-                    // at most at_once typed items.
-                    size_t free = uf.free_typed();
-                    // we still have to put in the caprange
-                    free -= Math::blockcount(sizeof(CapRange), sizeof(word_t) * 2);
-                    size_t min = Math::min<uintptr_t>(free - at_once, count >> at_once);
-                    cr.count(min << at_once);
-                }
-            }
-        }
-
         uf << cr;
         _map_pts[CPU::current().log_id()]->call(uf);
 
-        // adjust start and hotspot for the next round
-        cr.start(cr.start() + cr.count());
-        if(cr.hotspot() != CapRange::NO_HOTSPOT)
-            cr.hotspot(cr.hotspot() + cr.count());
-        count -= cr.count();
-        cr.count(count);
+        size_t count;
+        uf >> count;
+        cr.start(cr.start() + count);
+        cr.hotspot(cr.hotspot() + count);
+        cr.count(cr.count() - count);
     }
 }
 
@@ -128,10 +109,7 @@ void Hypervisor::unmap_string(const char *str) {
     size_t len = reinterpret_cast<uintptr_t>(str) - begin + strlen(str);
     VirtualMemory::free(begin, len);
     size_t pages = Math::blockcount<size_t>(len, ExecEnv::PAGE_SIZE);
-    while(pages-- > 0) {
-        CapRange(begin >> ExecEnv::PAGE_SHIFT, 1, Crd::MEM_ALL).revoke(true);
-        begin += ExecEnv::PAGE_SIZE;
-    }
+    CapRange(begin >> ExecEnv::PAGE_SHIFT, pages, Crd::MEM_ALL).revoke(true);
 }
 
 void Hypervisor::portal_map(capsel_t) {
@@ -139,7 +117,10 @@ void Hypervisor::portal_map(capsel_t) {
     CapRange range;
     uf >> range;
     uf.clear();
-    uf.delegate(range, UtcbFrame::FROM_HV);
+    CapBatch<1> batch;
+    batch.add(range);
+    size_t count = batch.put(uf, UtcbFrame::FROM_HV);
+    uf << count;
 }
 
 void Hypervisor::portal_gsi(capsel_t) {
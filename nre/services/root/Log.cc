@@ -67,7 +67,7 @@ void Log::portal(capsel_t pid) {
     ServiceSession *sess = _srv->get_session<ServiceSession>(pid);
     UtcbFrameRef uf;
     try {
-        String line;
+        StringView line;
         uf >> line;
         uf.finish_input();
 
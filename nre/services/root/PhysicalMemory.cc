@@ -25,6 +25,8 @@ using namespace nre;
 PhysicalMemory::RootDataSpace *PhysicalMemory::RootDataSpace::_free = 0;
 size_t PhysicalMemory::_totalsize = 0;
 RegionManager PhysicalMemory::_mem INIT_PRIO_PMEM;
+NUMA::Info PhysicalMemory::_numa INIT_PRIO_PMEM;
+NUMA::node_t PhysicalMemory::_next_node = 0;
 DataSpaceManager<PhysicalMemory::RootDataSpace> PhysicalMemory::_dsmng INIT_PRIO_PMEM;
 
 PhysicalMemory::RootDataSpace::RootDataSpace(const DataSpaceDesc &desc)
@@ -40,13 +42,39 @@ PhysicalMemory::RootDataSpace::RootDataSpace(const DataSpaceDesc &desc)
         }
         _desc.virt(VirtualMemory::alloc(_desc.size()));
         _desc.origin(_desc.phys());
+        _desc.node(DataSpaceDesc::NODE_ANY);
         Hypervisor::map_mem(_desc.phys(), _desc.virt(), _desc.size());
     }
     else {
         size_t align = 1UL << (_desc.align() + ExecEnv::PAGE_SHIFT);
-        if(align < ExecEnv::BIG_PAGE_SIZE || _desc.size() < ExecEnv::BIG_PAGE_SIZE)
+        int node = select_node(_desc.node());
+        uintptr_t phys = 0;
+        if(_desc.size() < ExecEnv::BIG_PAGE_SIZE)
             flags &= ~DataSpaceDesc::BIGPAGES;
-        _desc.phys(alloc(_desc.size(), align));
+        // back large dataspaces with superpage-aligned memory, if possible, even if it has not
+        // been requested. this way, they can be mapped with large pages. but the node is more
+        // important than large pages, so that we don't go to a different node for them
+        else if(align < ExecEnv::BIG_PAGE_SIZE) {
+            phys = alloc_on(_desc.size(), ExecEnv::BIG_PAGE_SIZE, node);
+            if(phys) {
+                _desc.align(Math::next_pow2_shift(ExecEnv::BIG_PAGE_SIZE) - ExecEnv::PAGE_SHIFT);
+                flags |= DataSpaceDesc::BIGPAGES;
+            }
+            else
+                flags &= ~DataSpaceDesc::BIGPAGES;
+        }
+        if(!phys)
+            phys = alloc_on(_desc.size(), align, node);
+        if(!phys) {
+            if(node != DataSpaceDesc::NODE_ANY) {
+                LOG(Logging::DATASPACES, Serial::get().writef(
+                        "Root: Not enough memory on node %d for %zu bytes; falling back\n",
+                        node, _desc.size()));
+            }
+            phys = alloc(_desc.size(), align);
+        }
+        _desc.phys(phys);
+        _desc.node(node_of(_desc.phys()));
         _desc.origin(_desc.phys());
         _desc.virt(VirtualMemory::phys_to_virt(_desc.phys()));
     }
@@ -103,6 +131,83 @@ void PhysicalMemory::RootDataSpace::revoke_mem(uintptr_t addr, size_t size, bool
     CapRange(start, count, Crd::MEM_ALL).revoke(self);
 }
 
+int PhysicalMemory::select_node(int node) {
+    if(node == DataSpaceDesc::NODE_ANY || _numa.nodes() == 1)
+        return DataSpaceDesc::NODE_ANY;
+
+    if(node == DataSpaceDesc::NODE_LOCAL)
+        return CPU::current().node();
+    if(node == DataSpaceDesc::NODE_INTERLEAVE) {
+        node = _next_node;
+        _next_node = (_next_node + 1) % _numa.nodes();
+        return node;
+    }
+    if(node < 0 || static_cast<size_t>(node) >= _numa.nodes())
+        return DataSpaceDesc::NODE_ANY;
+    return node;
+}
+
+uintptr_t PhysicalMemory::alloc_on(size_t size, size_t align, int node) {
+    try {
+        if(node == DataSpaceDesc::NODE_ANY)
+            return alloc(size, align);
+
+        for(size_t i = 0; i < _numa.ranges(); ++i) {
+            const NUMA::Range &r = _numa.range(i);
+            // we can't use the memory above 4G anyway (see root.cc)
+            if(r.node != node || r.addr >= static_cast<uintptr_t>(-1))
+                continue;
+            uintptr_t end = Math::min<uint64_t>(r.addr + r.size, static_cast<uintptr_t>(-1));
+            try {
+                return _mem.alloc_in(r.addr, end, size, align);
+            }
+            catch(const RegionManagerException&) {
+            }
+        }
+    }
+    catch(const RegionManagerException&) {
+    }
+    return 0;
+}
+
+void PhysicalMemory::numa(const NUMA::Info &info) {
+    _numa = info;
+    for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
+        it->node(info.cpu_node(it->phys_id()));
+    LOG(Logging::MEM_MAP, Serial::get() << "Root: Got " << info);
+}
+
+size_t PhysicalMemory::node_overlap(NUMA::node_t node, uintptr_t addr, size_t size) {
+    // without ranges, all memory belongs to node 0
+    if(_numa.ranges() == 0)
+        return node == 0 ? size : 0;
+
+    size_t res = 0;
+    for(size_t i = 0; i < _numa.ranges(); ++i) {
+        const NUMA::Range &r = _numa.range(i);
+        if(r.node != node)
+            continue;
+        uint64_t start = Math::max<uint64_t>(r.addr, addr);
+        uint64_t end = Math::min<uint64_t>(r.addr + r.size, static_cast<uint64_t>(addr) + size);
+        if(end > start)
+            res += end - start;
+    }
+    return res;
+}
+
+void PhysicalMemory::node_size(NUMA::node_t node, size_t &total, size_t &free) {
+    total = free = 0;
+    const Hip &hip = Hip::get();
+    for(Hip::mem_iterator it = hip.mem_begin(); it != hip.mem_end(); ++it) {
+        if(it->type == HipMem::AVAILABLE && it->addr < 0x100000000)
+            total += node_overlap(node, it->addr, it->size);
+    }
+    for(RegionManager::iterator it = _mem.begin(); it != _mem.end(); ++it) {
+        if(it->size)
+            free += node_overlap(node, it->addr, it->size);
+    }
+}
+
 void PhysicalMemory::add(uintptr_t addr, size_t size) {
     if(VirtualMemory::alloc_ram(addr, size))
         free(addr, size);
@@ -20,6 +20,7 @@
 #include <kobj/UserSm.h>
 #include <mem/RegionManager.h>
 #include <mem/DataSpaceManager.h>
+#include <util/NUMA.h>
 
 /**
  * Manages all physical memory. At the beginning, it is told what memory is available according
@@ -78,6 +79,24 @@ public:
     static uintptr_t alloc(size_t size, size_t align = 1) {
         return _mem.alloc(size, align);
     }
+    /**
+     * Determines the NUMA node to allocate memory from. Note that every call with
+     * NODE_INTERLEAVE advances to the next node.
+     *
+     * @param node the node id or a DataSpaceDesc::Placement
+     * @return the node id or NODE_ANY if every node is fine
+     */
+    static int select_node(int node);
+    /**
+     * Allocates <size> bytes from the physical memory of the given NUMA node. It does not fall
+     * back to the other nodes, so that the caller can decide whether to relax the alignment first.
+     *
+     * @param size the number of bytes to allocate
+     * @param align the alignment (in bytes; has to be a power of 2)
+     * @param node the node id or NODE_ANY, as returned by select_node()
+     * @return the physical address or 0 if there is not enough memory left
+     */
+    static uintptr_t alloc_on(size_t size, size_t align, int node);
     /**
      * Free's the given physical memory
      *
@@ -115,6 +134,33 @@ public:
         return _mem.total_size();
     }
 
+    /**
+     * @return the NUMA topology
+     */
+    static const nre::NUMA::Info &numa() {
+        return _numa;
+    }
+    /**
+     * Sets the NUMA topology, which is determined by the ACPI service. This also sets the node
+     * of all CPUs.
+     */
+    static void numa(const nre::NUMA::Info &info);
+    /**
+     * @param addr the physical address
+     * @return the NUMA node of the given address
+     */
+    static nre::NUMA::node_t node_of(uintptr_t addr) {
+        return _numa.mem_node(addr);
+    }
+    /**
+     * Determines the total and free amount of memory of the given NUMA node
+     *
+     * @param node the node
+     * @param total will be set to the total amount of memory (in bytes)
+     * @param free will be set to the free memory (in bytes)
+     */
+    static void node_size(nre::NUMA::node_t node, size_t &total, size_t &free);
+
     /**
      * @return the list of available physical memory regions
      */
@@ -129,11 +175,14 @@ public:
 
 private:
     static bool can_map(uintptr_t phys, size_t size, uint &flags);
+    static size_t node_overlap(nre::NUMA::node_t node, uintptr_t addr, size_t size);
 
     PhysicalMemory();
 
     static size_t _totalsize;
     static nre::RegionManager _mem;
+    static nre::NUMA::Info _numa;
+    static nre::NUMA::node_t _next_node;
     static nre::DataSpaceManager<RootDataSpace> _dsmng;
 };
 
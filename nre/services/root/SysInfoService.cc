@@ -15,6 +15,7 @@
  */
 
 #include <services/SysInfo.h>
+#include <util/Atomic.h>
 
 #include "SysInfoService.h"
 #include "Admission.h"
@@ -30,6 +31,9 @@ extern void *__fini_array_end;
 extern void *__fini_array_end;
 extern void *end;
 
+// the NUMA topology can only be set once, which is done by the ACPI service during boot
+static volatile bool numa_set = false;
+
 const char *SysInfoService::get_root_info(size_t &virt, size_t &phys, size_t &threads) {
     // find our own module; we're always the first one
     const char *cmdline = "";
@@ -92,15 +96,59 @@ void SysInfoService::portal(capsel_t) {
                 String name;
                 cpu_t cpu = 0;
                 timevalue_t total = 0, time = 0;
-                bool res = Admission::get_sched_entity(idx, name, cpu, time, total);
+                uint prio = 0, reserved = 0;
+                bool res = Admission::get_sched_entity(idx, name, cpu, time, total, prio, reserved);
                 uf << E_SUCCESS;
                 if(res)
-                    uf << true << name << cpu << time << total;
+                    uf << true << name << cpu << time << total << prio << reserved;
                 else
                     uf << false;
             }
             break;
 
+            case SysInfo::GET_STATS: {
+                uf.finish_input();
+                uf.delegate(Admission::stats().sel());
+                uf << E_SUCCESS;
+            }
+            break;
+
+            case SysInfo::GET_RESERVED: {
+                cpu_t cpu;
+                uf >> cpu;
+                uf.finish_input();
+                uf << E_SUCCESS << Admission::reserved(cpu) << Admission::CAPACITY;
+            }
+            break;
+
+            case SysInfo::GET_NUMA: {
+                uf.finish_input();
+                uf << E_SUCCESS << PhysicalMemory::numa();
+            }
+            break;
+
+            case SysInfo::SET_NUMA: {
+                NUMA::Info info;
+                uf >> info;
+                uf.finish_input();
+                if(!Atomic::cmpnswap(&numa_set, false, true))
+                    throw Exception(E_EXISTS, "NUMA topology has already been set");
+                PhysicalMemory::numa(info);
+                uf << E_SUCCESS;
+            }
+            break;
+
+            case SysInfo::GET_NODE_MEM: {
+                NUMA::node_t node;
+                uf >> node;
+                uf.finish_input();
+
+                size_t total, free;
+                PhysicalMemory::node_size(node, total, free);
+                uf << E_SUCCESS << total << free;
+            }
+            break;
+
             case SysInfo::GET_CHILD: {
                 SysInfoService *srv = Thread::current()->get_tls<SysInfoService*>(Thread::TLS_PARAM);
                 size_t idx;
@@ -22,6 +22,8 @@
 #include <ipc/Service.h>
 #include <util/Math.h>
 #include <util/Cycler.h>
+#include <util/Trace.h>
+#include <util/Util.h>
 #include <String.h>
 #include <Hip.h>
 #include <CPU.h>
@@ -50,6 +52,7 @@ class CPU0Init {
 EXTERN_C void dlmalloc_init();
 static void log_thread(void*);
 static void sysinfo_thread(void*);
+static void sampler_thread(void*);
 PORTAL static void portal_service(capsel_t);
 PORTAL static void portal_pagefault(capsel_t);
 PORTAL static void portal_startup(capsel_t pid);
@@ -147,6 +150,7 @@ int main() {
         // create memory mapping portals for the other CPUs
         Hypervisor::init();
         Admission::init();
+        Trace::init();
 
         // now init the stuff for all other CPUs (using dlmalloc)
         for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
@@ -215,6 +219,7 @@ int main() {
     mng = new ChildManager();
     GlobalThread::create(log_thread, CPU::current().log_id(), String("root-log"))->start();
     GlobalThread::create(sysinfo_thread, CPU::current().log_id(), String("root-sysinfo"))->start();
+    GlobalThread::create(sampler_thread, CPU::current().log_id(), String("root-sampler"))->start();
 
     // wait until log and sysinfo are registered
     while(mng->registry().find(String("log")) == 0 || mng->registry().find(String("sysinfo")) == 0)
@@ -236,6 +241,24 @@ static void sysinfo_thread(void*) {
     sysinfo->start();
 }
 
+static void sampler_thread(void*) {
+    Admission::sampler();
+}
+
+static void report_start(const char *cmdline, uint64_t cycles) {
+    // use the name of the binary as the name of the benchmark
+    const char *end = strchr(cmdline, ' ');
+    if(!end)
+        end = cmdline + strlen(cmdline);
+    const char *name = cmdline;
+    for(const char *p = cmdline; p < end; ++p) {
+        if(*p == '/')
+            name = p + 1;
+    }
+    Serial::get().writef("BENCH: start.%.*s cycles n=1 avg=%Lu med=%Lu\n",
+                         static_cast<int>(end - name), name, cycles, cycles);
+}
+
 static void start_childs() {
     size_t mod = 0, i = 0;
     ForwardCycler<CPU::iterator> cpus(CPU::begin(), CPU::end());
@@ -248,7 +271,10 @@ static void start_childs() {
             Hypervisor::map_mem(it->addr, virt, it->size);
 
             ChildConfig cfg(mod, String(it->cmdline()), cpus.next()->log_id());
-            mng->load(virt, it->size, cfg);
+            uint64_t start = Util::tsc();
+            mng->load(virt, it->size, cfg, it->addr);
+            // this includes the time until all services of the child are registered
+            LOG(Logging::CHILD_CREATE, report_start(it->cmdline(), Util::tsc() - start));
             if(cfg.last())
                 break;
         }
@@ -259,7 +285,7 @@ static void portal_service(capsel_t) {
     UtcbFrameRef uf;
     try {
         Service::Command cmd;
-        String name;
+        StringView name;
         uf >> cmd >> name;
         switch(cmd) {
             case Service::REGISTER: {
@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/GlobalThread.h>
+#include <stream/OStringStream.h>
+#include <stream/Serial.h>
+#include <util/ScopedLock.h>
+#include <util/Trace.h>
+#include <Logging.h>
+
+#include "BlockCache.h"
+
+using namespace nre;
+
+BlockCache::BlockCache(Controller *ctrl, size_t drive, const Storage::Parameter &params,
+                       size_t size, size_t readahead)
+    : _ctrl(ctrl), _drive(drive), _secsize(params.sector_size), _sectors(params.sectors),
+      _count(Math::max<size_t>(size / (BLOCK_SECTORS * params.sector_size), 4 * MAX_SPAN)),
+      _readahead(readahead), _span(Math::min<size_t>(MAX_SPAN, _count / 4)),
+      _ds(Math::round_up<size_t>((_count + 1) * BLOCK_SECTORS * _secsize, ExecEnv::PAGE_SIZE),
+          DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _ringds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _cons(&_ringds, true), _prod(&_ringds, false), _blocks(new Block[_count]), _tree(), _lru(),
+      _free(), _waiting(), _ops(), _opcount(), _streams(), _nextstream(), _dirty(), _gen(),
+      _wberror(), _stats(), _sm() {
+    for(size_t i = 0; i < _count; ++i)
+        _free.append(_blocks + i);
+
+    char name[32];
+    OStringStream os(name, sizeof(name));
+    os << "storage-cache-" << drive;
+    GlobalThread *gt = GlobalThread::create(completion_thread, CPU::current().log_id(), String(name));
+    gt->set_tls<BlockCache*>(Thread::TLS_PARAM, this);
+    gt->start();
+}
+
+void BlockCache::read(producer_type *prod, tag_type tag, const DataSpace &ds, sector_type sector,
+                      const dma_type &dma) {
+    check_dma(ds, dma);
+    Request r(Request::READ, prod, tag, &ds, sector, dma.bytecount() / _secsize, dma, 0);
+    ScopedLock<UserSm> guard(&_sm);
+    account(r);
+    reset_failed(sector, r.count);
+    submit(r);
+    read_ahead(r);
+}
+
+void BlockCache::write(producer_type *prod, tag_type tag, const DataSpace &ds, sector_type sector,
+                       const dma_type &dma) {
+    check_dma(ds, dma);
+    Request r(Request::WRITE, prod, tag, &ds, sector, dma.bytecount() / _secsize, dma, 0);
+    ScopedLock<UserSm> guard(&_sm);
+    _stats.writes++;
+    submit(r);
+}
+
+void BlockCache::flush(producer_type *prod, tag_type tag, const DataSpace &ds) {
+    ScopedLock<UserSm> guard(&_sm);
+    // everything that became dirty up to now has to be on the disk before we complete it
+    Request r(Request::FLUSH, prod, tag, &ds, 0, 0, dma_type(), _gen++);
+    submit(r);
+}
+
+void BlockCache::detach(const DataSpace &ds) {
+    ScopedLock<UserSm> guard(&_sm);
+    for(DList<Request>::iterator it = _waiting.begin(); it != _waiting.end(); ) {
+        Request *r = &*it++;
+        if(r->ds == &ds) {
+            _waiting.remove(r);
+            delete r;
+        }
+    }
+    for(size_t i = 0; i < MAX_OPS; ++i) {
+        if(_ops[i].kind == Op::FORWARD && _ops[i].ds == &ds)
+            _ops[i].prod = 0;
+    }
+    for(size_t i = 0; i < MAX_STREAMS; ++i) {
+        if(_streams[i].ds == &ds)
+            _streams[i].ds = 0;
+    }
+}
+
+BlockCache::Stats BlockCache::stats() const {
+    ScopedLock<UserSm> guard(&_sm);
+    return _stats;
+}
+
+void BlockCache::print(OStream &os) const {
+    size_t dirty;
+    Stats s;
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        dirty = _dirty;
+        s = _stats;
+    }
+    os.writef("Cache of drive %zu: %zu blocks of %zu bytes, %zu dirty\n",
+              _drive, _count, BLOCK_SECTORS * _secsize, dirty);
+    os.writef("  lookups=%Lu hits=%Lu (%Lu%%) readahead=%Lu (%Lu hits)\n",
+              s.lookups, s.hits, s.lookups ? (s.hits * 100) / s.lookups : 0,
+              s.readahead, s.ahead_hits);
+    os.writef("  writes=%Lu writebacks=%Lu (%Lu failed, %Lu lost) evictions=%Lu bypassed=%Lu\n",
+              s.writes, s.writebacks, s.wberrors, s.wblost, s.evictions, s.bypassed);
+}
+
+void BlockCache::completion_thread(void*) {
+    BlockCache *c = Thread::current()->get_tls<BlockCache*>(Thread::TLS_PARAM);
+    Storage::Packet pk;
+    while(c->_cons.consume(pk)) {
+        ScopedLock<UserSm> guard(&c->_sm);
+        c->finish(pk);
+        // process all completions that are there before we retry the waiting requests
+        while(c->_cons.try_consume(pk))
+            c->finish(pk);
+        c->retry();
+    }
+}
+
+void BlockCache::check_dma(const DataSpace &ds, const dma_type &dma) const {
+    for(dma_type::iterator it = dma.begin(); it != dma.end(); ++it) {
+        if(it->offset > ds.size() || it->offset + it->count > ds.size()) {
+            throw Exception(E_ARGS_INVALID, 64, "Invalid offset(%zu)/count(%zu)",
+                            it->offset, it->count);
+        }
+    }
+}
+
+void BlockCache::account(const Request &r) {
+    sector_type last = (r.sector + r.count - 1) / BLOCK_SECTORS;
+    sector_type no = r.sector / BLOCK_SECTORS;
+    if(last - no + 1 > _span)
+        return;
+
+    for(; no <= last; ++no) {
+        // blocks that aren't in the cache at all are misses as well
+        _stats.lookups++;
+        Block *b = _tree.find(no);
+        if(!b)
+            continue;
+        uint32_t mask = sector_mask(no, r.sector, r.count);
+        if((b->valid & mask) == mask)
+            _stats.hits++;
+        if(b->ahead) {
+            if(((b->valid | b->loading) & mask) == mask)
+                _stats.ahead_hits++;
+            b->ahead = false;
+        }
+    }
+}
+
+void BlockCache::submit(Request &r) {
+    if(!try_request(r))
+        _waiting.append(new Request(r));
+}
+
+bool BlockCache::try_request(Request &r) {
+    switch(r.type) {
+        case Request::READ:
+            return try_read(r);
+        case Request::WRITE:
+            return try_write(r);
+        default:
+            return try_flush(r);
+    }
+}
+
+void BlockCache::retry() {
+    for(DList<Request>::iterator it = _waiting.begin(); it != _waiting.end(); ) {
+        Request *r = &*it++;
+        bool done;
+        try {
+            done = try_request(*r);
+        }
+        catch(const Exception &e) {
+            // there is nobody to throw it to, so report it in the completion
+            complete(r->prod, r->tag, e.code());
+            done = true;
+        }
+        if(done) {
+            _waiting.remove(r);
+            delete r;
+        }
+    }
+}
+
+bool BlockCache::try_read(Request &r) {
+    sector_type first = r.sector / BLOCK_SECTORS;
+    size_t n = (r.sector + r.count - 1) / BLOCK_SECTORS - first + 1;
+    if(n > _span)
+        return forward(r);
+
+    Block *blks[MAX_SPAN];
+    bool ready = true;
+    uint error = 0;
+    size_t i;
+    for(i = 0; i < n; ++i) {
+        sector_type no = first + i;
+        uint32_t mask = sector_mask(no, r.sector, r.count);
+        if(!(blks[i] = _tree.find(no)) && !(blks[i] = alloc(no, true))) {
+            ready = false;
+            break;
+        }
+        if(blks[i]->failed & mask) {
+            error = blks[i]->error;
+            break;
+        }
+        // don't let the following blocks evict this one
+        blks[i]->pins++;
+        if((blks[i]->valid & mask) != mask) {
+            ready = false;
+            try {
+                load(blks[i]);
+            }
+            catch(const Exception &e) {
+                error = e.code();
+                i++;
+                break;
+            }
+        }
+    }
+
+    size_t off = 0;
+    for(size_t j = 0; j < i; ++j) {
+        blks[j]->pins--;
+        if(ready && !error) {
+            uint32_t mask = sector_mask(first + j, r.sector, r.count);
+            size_t len = Math::popcount(mask) * _secsize;
+            r.dma.out(reinterpret_cast<void*>(addr(blks[j], mask)), len, off, *r.ds);
+            off += len;
+            touch(blks[j]);
+        }
+    }
+    if(error) {
+        complete(r.prod, r.tag, error);
+        return true;
+    }
+    if(ready)
+        complete(r.prod, r.tag, 0);
+    return ready;
+}
+
+bool BlockCache::try_write(Request &r) {
+    sector_type first = r.sector / BLOCK_SECTORS;
+    size_t n = (r.sector + r.count - 1) / BLOCK_SECTORS - first + 1;
+    if(n > _span)
+        return forward(r);
+
+    // we can't change the sectors while they are transferred
+    Block *blks[MAX_SPAN];
+    for(size_t i = 0; i < n; ++i) {
+        blks[i] = _tree.find(first + i);
+        uint32_t mask = sector_mask(first + i, r.sector, r.count);
+        if(blks[i] && ((blks[i]->loading | blks[i]->writing) & mask))
+            return false;
+    }
+
+    for(size_t i = 0; i < n; ++i) {
+        if(blks[i])
+            blks[i]->pins++;
+    }
+    bool ready = true;
+    for(size_t i = 0; i < n; ++i) {
+        if(!blks[i]) {
+            if(!(blks[i] = alloc(first + i, true))) {
+                ready = false;
+                break;
+            }
+            blks[i]->pins++;
+        }
+    }
+
+    size_t off = 0;
+    for(size_t i = 0; i < n; ++i) {
+        if(!blks[i])
+            continue;
+        blks[i]->pins--;
+        if(ready) {
+            uint32_t mask = sector_mask(first + i, r.sector, r.count);
+            size_t len = Math::popcount(mask) * _secsize;
+            r.dma.in(reinterpret_cast<void*>(addr(blks[i], mask)), len, off, *r.ds);
+            off += len;
+            if(!blks[i]->dirty) {
+                blks[i]->gen = _gen;
+                blks[i]->wbfails = 0;
+                _dirty++;
+            }
+            blks[i]->valid |= mask;
+            blks[i]->failed &= ~mask;
+            blks[i]->dirty |= mask;
+            blks[i]->ahead = false;
+            touch(blks[i]);
+        }
+    }
+    if(!ready)
+        return false;
+    complete(r.prod, r.tag, 0);
+
+    // don't let the dirty blocks pile up until we need the space
+    if(_dirty > _count / 2) {
+        size_t started = 0;
+        for(DList<Block>::iterator it = _lru.begin();
+            it != _lru.end() && started < WRITEBACK_BATCH; ++it) {
+            if(it->dirty & ~it->writing) {
+                if(!writeback(&*it))
+                    break;
+                started++;
+            }
+        }
+    }
+    return true;
+}
+
+bool BlockCache::try_flush(Request &r) {
+    bool clean = true;
+    for(DList<Block>::iterator it = _lru.begin(); it != _lru.end(); ++it) {
+        if(it->dirty && it->gen <= r.gen) {
+            clean = false;
+            if(!writeback(&*it))
+                break;
+        }
+    }
+    if(clean && _wberror) {
+        complete(r.prod, r.tag, _wberror);
+        _wberror = 0;
+        return true;
+    }
+    return clean && forward(r);
+}
+
+bool BlockCache::forward(Request &r) {
+    if(r.type != Request::FLUSH) {
+        // the drive has to see the latest data and we have to see the data of the drive
+        bool busy = false;
+        sector_type last = (r.sector + r.count - 1) / BLOCK_SECTORS;
+        for(sector_type no = r.sector / BLOCK_SECTORS; no <= last; ++no) {
+            Block *b = _tree.find(no);
+            if(!b)
+                continue;
+            uint32_t mask = sector_mask(no, r.sector, r.count);
+            if((b->loading | b->writing) & mask)
+                busy = true;
+            else if(r.type == Request::READ && (b->dirty & mask)) {
+                busy = true;
+                writeback(b);
+            }
+        }
+        if(busy)
+            return false;
+    }
+
+    Op *op = alloc_op(Op::FORWARD);
+    if(!op)
+        return false;
+    op->prod = r.prod;
+    op->tag = r.tag;
+    op->ds = r.ds;
+    op->sector = r.sector;
+    op->count = r.type == Request::WRITE ? r.count : 0;
+    try {
+        tag_type tag = op - _ops;
+        if(r.type == Request::READ)
+            _ctrl->read(_drive, &_prod, tag, *r.ds, r.sector, r.dma);
+        else if(r.type == Request::WRITE)
+            _ctrl->write(_drive, &_prod, tag, *r.ds, r.sector, r.dma);
+        else
+            _ctrl->flush(_drive, &_prod, tag);
+    }
+    catch(const Exception &e) {
+        free_op(op);
+        if(e.code() == E_CAPACITY)
+            return false;
+        throw;
+    }
+
+    if(r.type == Request::WRITE)
+        invalidate(r.sector, r.count);
+    if(r.type != Request::FLUSH)
+        _stats.bypassed++;
+    return true;
+}
+
+void BlockCache::finish(const Storage::Packet &pk) {
+    if(pk.tag >= MAX_OPS)
+        return;
+
+    Op *op = _ops + pk.tag;
+    switch(op->kind) {
+        case Op::LOAD:
+            op->blk->loading &= ~op->mask;
+            if(pk.status == 0)
+                op->blk->valid |= op->mask;
+            else {
+                // let the waiting reads of these sectors fail instead of loading them forever
+                op->blk->failed |= op->mask;
+                op->blk->error = pk.status;
+                LOG(Logging::STORAGE, Serial::get().writef(
+                        "Cache of drive %zu: loading sector %Lu failed: %u\n", _drive,
+                        op->blk->key() * BLOCK_SECTORS + Math::bit_scan_forward(op->mask),
+                        pk.status));
+            }
+            break;
+        case Op::WRITEBACK:
+            op->blk->writing &= ~op->mask;
+            if(pk.status == 0) {
+                op->blk->wbfails = 0;
+                clean(op->blk, op->mask);
+            }
+            else
+                writeback_failed(op->blk, op->mask, pk.status);
+            break;
+        case Op::FORWARD:
+            if(op->prod)
+                complete(op->prod, op->tag, pk.status);
+            break;
+        default:
+            return;
+    }
+    free_op(op);
+}
+
+void BlockCache::writeback_failed(Block *b, uint32_t mask, uint status) {
+    _stats.wberrors++;
+    b->wbfails++;
+    LOG(Logging::STORAGE, Serial::get().writef(
+            "Cache of drive %zu: writing back sector %Lu failed (%u times): %u\n", _drive,
+            b->key() * BLOCK_SECTORS + Math::bit_scan_forward(mask), b->wbfails, status));
+
+    // the FLUSHes that wait for this block would not complete until it has been written back
+    bool reported = fail_flushes(b->gen, status);
+    if(b->wbfails >= MAX_WRITEBACK_TRIES) {
+        // give up to not write it back forever. the data stays in the cache until it's evicted
+        clean(b, mask);
+        _stats.wblost++;
+        if(!reported)
+            _wberror = status;
+    }
+}
+
+bool BlockCache::fail_flushes(uint64_t gen, uint status) {
+    bool reported = false;
+    for(DList<Request>::iterator it = _waiting.begin(); it != _waiting.end(); ) {
+        Request *r = &*it++;
+        if(r->type == Request::FLUSH && r->gen >= gen) {
+            complete(r->prod, r->tag, status);
+            _waiting.remove(r);
+            delete r;
+            reported = true;
+        }
+    }
+    return reported;
+}
+
+void BlockCache::complete(producer_type *prod, tag_type tag, uint status) {
+    TRACE(STORAGE_REQ, ASYNC_END, tag);
+    prod->produce(Storage::Packet(tag, status));
+}
+
+void BlockCache::read_ahead(const Request &r) {
+    if(!_readahead)
+        return;
+
+    Stream *s = 0;
+    for(size_t i = 0; i < MAX_STREAMS; ++i) {
+        if(_streams[i].ds == r.ds && _streams[i].next == r.sector) {
+            s = _streams + i;
+            break;
+        }
+    }
+    if(!s) {
+        s = _streams + (_nextstream++ % MAX_STREAMS);
+        s->ds = r.ds;
+        s->window = 0;
+    }
+    else
+        s->window = Math::min<size_t>(s->window ? s->window * 2 : 2, _readahead);
+    s->next = r.sector + r.count;
+
+    // start behind the block with the last requested sector
+    sector_type no = (s->next - 1) / BLOCK_SECTORS + 1;
+    for(size_t i = 0; i < s->window && no * BLOCK_SECTORS < _sectors; ++i, ++no) {
+        // leave the majority of the commands to the requests of the clients
+        if(_opcount >= MAX_OPS / 2)
+            break;
+        if(_tree.find(no))
+            continue;
+        Block *b = alloc(no, false);
+        if(!b)
+            break;
+        b->ahead = true;
+        try {
+            if(!load(b))
+                break;
+        }
+        catch(const Exception &e) {
+            LOG(Logging::STORAGE, Serial::get().writef(
+                    "Cache of drive %zu: read-ahead failed: %s\n", _drive, e.msg()));
+            break;
+        }
+        _stats.readahead++;
+    }
+}
+
+BlockCache::Block *BlockCache::alloc(sector_type no, bool writeback) {
+    Block *b = 0;
+    if(_free.length() > 0) {
+        b = &*_free.begin();
+        _free.remove(b);
+    }
+    else {
+        // evict the least recently used block that is clean and idle. start writing back the
+        // dirty ones that we pass on the way, so that they can be evicted next time
+        size_t started = 0;
+        for(DList<Block>::iterator it = _lru.begin(); it != _lru.end(); ++it) {
+            if(it->pins || it->loading || it->writing)
+                continue;
+            if(!it->dirty) {
+                b = &*it;
+                break;
+            }
+            if(writeback && started < WRITEBACK_BATCH && this->writeback(&*it))
+                started++;
+        }
+        if(!b)
+            return 0;
+        _lru.remove(b);
+        _tree.remove(b);
+        _stats.evictions++;
+    }
+
+    b->key(no);
+    b->valid = b->dirty = b->loading = b->writing = b->failed = 0;
+    b->wbfails = b->pins = 0;
+    b->ahead = false;
+    _tree.insert(b);
+    _lru.append(b);
+    return b;
+}
+
+bool BlockCache::load(Block *b) {
+    uint32_t mask = block_mask(b->key()) & ~(b->valid | b->loading | b->failed);
+    if(!mask)
+        return true;
+    // the data on the drive is about to change
+    if(forwarding(b->key()))
+        return false;
+    Op *op = alloc_op(Op::LOAD);
+    if(!op)
+        return false;
+
+    // read from the first to the last missing sector and put the sectors in between, that we
+    // have already or that are being loaded, into the scratch block
+    uint first = Math::bit_scan_forward(mask);
+    uint last = Math::bit_scan_reverse(mask);
+    size_t scratch = _count * BLOCK_SECTORS * _secsize;
+    dma_type dma;
+    for(uint s = first; s <= last; ) {
+        bool missing = mask & (1U << s);
+        uint e = s + 1;
+        while(e <= last && ((mask & (1U << e)) != 0) == missing)
+            e++;
+        dma.push(DMADesc(missing ? offset(b) + s * _secsize : scratch, (e - s) * _secsize));
+        s = e;
+    }
+
+    op->blk = b;
+    op->mask = mask;
+    b->loading |= mask;
+    try {
+        _ctrl->read(_drive, &_prod, op - _ops, _ds, b->key() * BLOCK_SECTORS + first, dma);
+    }
+    catch(const Exception &e) {
+        b->loading &= ~mask;
+        free_op(op);
+        if(e.code() == E_CAPACITY)
+            return false;
+        throw;
+    }
+    return true;
+}
+
+bool BlockCache::writeback(Block *b) {
+    uint32_t mask = b->dirty & ~b->writing;
+    while(mask) {
+        // write back each run of dirty sectors with one command
+        uint first = Math::bit_scan_forward(mask);
+        uint32_t run = ((mask >> first) & ~((mask >> first) + 1)) << first;
+        Op *op = alloc_op(Op::WRITEBACK);
+        if(!op)
+            return false;
+
+        op->blk = b;
+        op->mask = run;
+        dma_type dma;
+        dma.push(DMADesc(offset(b) + first * _secsize, Math::popcount(run) * _secsize));
+        b->writing |= run;
+        try {
+            _ctrl->write(_drive, &_prod, op - _ops, _ds, b->key() * BLOCK_SECTORS + first, dma);
+        }
+        catch(const Exception &e) {
+            b->writing &= ~run;
+            free_op(op);
+            if(e.code() != E_CAPACITY) {
+                LOG(Logging::STORAGE, Serial::get().writef(
+                        "Cache of drive %zu: writeback failed: %s\n", _drive, e.msg()));
+            }
+            return false;
+        }
+        _stats.writebacks++;
+        mask &= ~run;
+    }
+    return true;
+}
+
+void BlockCache::invalidate(sector_type sector, size_t count) {
+    sector_type last = (sector + count - 1) / BLOCK_SECTORS;
+    for(sector_type no = sector / BLOCK_SECTORS; no <= last; ++no) {
+        Block *b = _tree.find(no);
+        if(b) {
+            uint32_t mask = sector_mask(no, sector, count);
+            b->valid &= ~mask;
+            b->failed &= ~mask;
+            clean(b, mask);
+        }
+    }
+}
+
+void BlockCache::reset_failed(sector_type sector, size_t count) {
+    sector_type last = (sector + count - 1) / BLOCK_SECTORS;
+    for(sector_type no = sector / BLOCK_SECTORS; no <= last; ++no) {
+        Block *b = _tree.find(no);
+        if(b)
+            b->failed &= ~sector_mask(no, sector, count);
+    }
+}
+
+bool BlockCache::forwarding(sector_type no) const {
+    for(size_t i = 0; i < MAX_OPS; ++i) {
+        const Op *op = _ops + i;
+        if(op->kind == Op::FORWARD && op->count &&
+           Math::overlapped(op->sector, op->count, no * BLOCK_SECTORS, BLOCK_SECTORS))
+            return true;
+    }
+    return false;
+}
+
+BlockCache::Op *BlockCache::alloc_op(Op::Kind kind) {
+    for(size_t i = 0; i < MAX_OPS; ++i) {
+        if(_ops[i].kind == Op::FREE) {
+            _ops[i].kind = kind;
+            _opcount++;
+            return _ops + i;
+        }
+    }
+    return 0;
+}
+
+void BlockCache::free_op(Op *op) {
+    op->kind = Op::FREE;
+    _opcount--;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <ipc/MPProducer.h>
+#include <ipc/MPConsumer.h>
+#include <services/Storage.h>
+#include <stream/OStream.h>
+#include <util/Treap.h>
+#include <util/DList.h>
+#include <util/Math.h>
+
+#include "Controller.h"
+
+/**
+ * A write-back cache for one drive, which is shared by all sessions for that drive. The cache
+ * consists of blocks of BLOCK_SECTORS sectors that are managed in LRU order. Each block tracks
+ * which of its sectors are valid, dirty, being loaded and being written back, so that partial
+ * accesses don't need to read the whole block first.
+ *
+ * Reads that hit the cache are copied into the dataspace of the client and are completed
+ * immediately; misses load the block and are completed when the data is there. If loading fails,
+ * the waiting reads of the affected sectors are completed with the error of the drive; the next
+ * new read of them tries again. Sequential reads are detected per session and trigger a
+ * read-ahead with a growing window. Writes are copied into the cache and are completed
+ * immediately as well. The dirty blocks are written back if the cache needs space, if more than
+ * half of the blocks are dirty and on FLUSH, which completes only when all blocks that have been
+ * dirty at the time of the FLUSH are on the disk and the disk has flushed its own cache. If
+ * writing back a block fails, the FLUSHes that wait for it are completed with the error of the
+ * drive. The block is tried again MAX_WRITEBACK_TRIES times; afterwards the changes are dropped
+ * and the next FLUSH reports the error, if nobody has been told about it yet. Requests that span
+ * more than a few blocks bypass the cache.
+ *
+ * All commands of the cache complete on an internal ring, which is processed by a separate
+ * thread. Requests that can't be served immediately are retried whenever a command completed.
+ */
+class BlockCache {
+    typedef nre::Storage::sector_type sector_type;
+    typedef nre::Storage::tag_type tag_type;
+    typedef nre::MPProducer<nre::Storage::Packet> producer_type;
+    typedef nre::Storage::dma_type dma_type;
+
+    static const size_t BLOCK_SECTORS   = 8;
+    static const size_t MAX_OPS         = 32;
+    static const size_t MAX_SPAN        = 32;
+    static const size_t MAX_STREAMS     = 8;
+    static const size_t WRITEBACK_BATCH = 4;
+    static const uint MAX_WRITEBACK_TRIES = 3;
+
+    struct Block : public nre::TreapNode<sector_type>, public nre::DListItem {
+        explicit Block()
+            : nre::TreapNode<sector_type>(0), nre::DListItem(), valid(), dirty(), loading(),
+              writing(), failed(), error(), wbfails(), pins(), ahead(), gen() {
+        }
+
+        uint32_t valid;
+        uint32_t dirty;
+        uint32_t loading;
+        uint32_t writing;
+        // the sectors that could not be loaded and the status of the drive
+        uint32_t failed;
+        uint error;
+        // the number of failed writebacks since the block has been written back the last time
+        uint wbfails;
+        uint pins;
+        bool ahead;
+        // the FLUSH generation in which the block became dirty
+        uint64_t gen;
+    };
+
+    /**
+     * A command that has been submitted to the drive and completes on our ring
+     */
+    struct Op {
+        enum Kind {
+            FREE,
+            LOAD,
+            WRITEBACK,
+            FORWARD
+        };
+
+        Kind kind;
+        Block *blk;
+        uint32_t mask;
+        // for FORWARD: the client to notify and the sectors that are written (count = 0 otherwise)
+        producer_type *prod;
+        tag_type tag;
+        const nre::DataSpace *ds;
+        sector_type sector;
+        size_t count;
+    };
+
+    /**
+     * A client request that could not be completed immediately
+     */
+    struct Request : public nre::DListItem {
+        enum Type {
+            READ,
+            WRITE,
+            FLUSH
+        };
+
+        explicit Request(Type type, producer_type *prod, tag_type tag, const nre::DataSpace *ds,
+                         sector_type sector, size_t count, const dma_type &dma, uint64_t gen)
+            : nre::DListItem(), type(type), prod(prod), tag(tag), ds(ds), sector(sector),
+              count(count), dma(dma), gen(gen) {
+        }
+
+        Type type;
+        producer_type *prod;
+        tag_type tag;
+        const nre::DataSpace *ds;
+        sector_type sector;
+        size_t count;
+        dma_type dma;
+        uint64_t gen;
+    };
+
+    /**
+     * A sequential reader, identified by the dataspace of its session
+     */
+    struct Stream {
+        const nre::DataSpace *ds;
+        sector_type next;
+        size_t window;
+    };
+
+public:
+    /**
+     * The counters of the cache. <lookups> and <hits> count the blocks that have been read by the
+     * clients; <readahead> counts the blocks that have been loaded in advance and <ahead_hits>
+     * how many of them have been read afterwards.
+     */
+    struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t readahead;
+        uint64_t ahead_hits;
+        uint64_t writes;
+        uint64_t writebacks;
+        // the writebacks that failed and the blocks whose changes have been dropped because of that
+        uint64_t wberrors;
+        uint64_t wblost;
+        uint64_t evictions;
+        uint64_t bypassed;
+    };
+
+    /**
+     * Creates a cache for the given drive
+     *
+     * @param ctrl the controller of the drive
+     * @param drive the drive number
+     * @param params the parameters of the drive
+     * @param size the size of the cache in bytes
+     * @param readahead the maximum number of blocks to read ahead (0 = disabled)
+     */
+    explicit BlockCache(Controller *ctrl, size_t drive, const nre::Storage::Parameter &params,
+                        size_t size, size_t readahead);
+
+    /**
+     * Reads <dma> from sector <sector> into <ds>. Has the same semantics as Controller::read().
+     */
+    void read(producer_type *prod, tag_type tag, const nre::DataSpace &ds, sector_type sector,
+              const dma_type &dma);
+    /**
+     * Writes <dma> from <ds> to sector <sector>. Has the same semantics as Controller::write().
+     */
+    void write(producer_type *prod, tag_type tag, const nre::DataSpace &ds, sector_type sector,
+               const dma_type &dma);
+    /**
+     * Writes back all dirty blocks and flushes the cache of the drive afterwards. <tag> is
+     * completed when both is done.
+     */
+    void flush(producer_type *prod, tag_type tag, const nre::DataSpace &ds);
+
+    /**
+     * Drops all pending requests of the session with dataspace <ds>, because it is destroyed.
+     *
+     * @param ds the dataspace of the session
+     */
+    void detach(const nre::DataSpace &ds);
+
+    /**
+     * @return the current counters
+     */
+    Stats stats() const;
+
+    /**
+     * Writes the counters to <os>
+     *
+     * @param os the stream
+     */
+    void print(nre::OStream &os) const;
+
+private:
+    BlockCache(const BlockCache&);
+    BlockCache& operator=(const BlockCache&);
+
+    static void completion_thread(void*);
+
+    void submit(Request &r);
+    bool try_request(Request &r);
+    bool try_read(Request &r);
+    bool try_write(Request &r);
+    bool try_flush(Request &r);
+    bool forward(Request &r);
+    void retry();
+    void finish(const nre::Storage::Packet &pk);
+    void writeback_failed(Block *b, uint32_t mask, uint status);
+    bool fail_flushes(uint64_t gen, uint status);
+    void complete(producer_type *prod, tag_type tag, uint status);
+    void read_ahead(const Request &r);
+    void account(const Request &r);
+    void check_dma(const nre::DataSpace &ds, const dma_type &dma) const;
+
+    Block *alloc(sector_type no, bool writeback);
+    bool load(Block *b);
+    bool writeback(Block *b);
+    void invalidate(sector_type sector, size_t count);
+    void reset_failed(sector_type sector, size_t count);
+    bool forwarding(sector_type no) const;
+    Op *alloc_op(Op::Kind kind);
+    void free_op(Op *op);
+
+    void touch(Block *b) {
+        _lru.remove(b);
+        _lru.append(b);
+    }
+    void clean(Block *b, uint32_t mask) {
+        if(b->dirty & mask) {
+            b->dirty &= ~mask;
+            if(!b->dirty)
+                _dirty--;
+        }
+    }
+    uint32_t sector_mask(sector_type no, sector_type sector, size_t count) const {
+        sector_type start = no * BLOCK_SECTORS;
+        sector_type first = nre::Math::max(sector, start);
+        sector_type end = nre::Math::min(nre::Math::min(sector + count, start + BLOCK_SECTORS),
+                                         _sectors);
+        return ((1U << (end - first)) - 1) << (first - start);
+    }
+    uint32_t block_mask(sector_type no) const {
+        return sector_mask(no, no * BLOCK_SECTORS, BLOCK_SECTORS);
+    }
+    size_t offset(const Block *b) const {
+        return (b - _blocks) * BLOCK_SECTORS * _secsize;
+    }
+    uintptr_t addr(const Block *b, uint32_t mask) const {
+        return _ds.virt() + offset(b) + nre::Math::bit_scan_forward(mask) * _secsize;
+    }
+
+    Controller *_ctrl;
+    size_t _drive;
+    size_t _secsize;
+    sector_type _sectors;
+    size_t _count;
+    size_t _readahead;
+    size_t _span;
+    // the blocks and one more block to put sectors into that we don't want to load
+    nre::DataSpace _ds;
+    nre::DataSpace _ringds;
+    nre::MPConsumer<nre::Storage::Packet> _cons;
+    producer_type _prod;
+    Block *_blocks;
+    nre::Treap<Block> _tree;
+    nre::DList<Block> _lru;
+    nre::DList<Block> _free;
+    nre::DList<Request> _waiting;
+    Op _ops[MAX_OPS];
+    size_t _opcount;
+    Stream _streams[MAX_STREAMS];
+    size_t _nextstream;
+    size_t _dirty;
+    uint64_t _gen;
+    // the error of dropped changes that has not been reported by a FLUSH yet
+    uint _wberror;
+    Stats _stats;
+    mutable nre::UserSm _sm;
+};
@@ -17,7 +17,7 @@
 #pragma once
 
 #include <mem/DataSpace.h>
-#include <ipc/Producer.h>
+#include <ipc/MPProducer.h>
 #include <services/Storage.h>
 
 /**
@@ -27,7 +27,7 @@ class Controller {
 protected:
     typedef nre::Storage::sector_type sector_type;
     typedef nre::Storage::tag_type tag_type;
-    typedef nre::Producer<nre::Storage::Packet> producer_type;
+    typedef nre::MPProducer<nre::Storage::Packet> producer_type;
     typedef nre::DMADescList<nre::Storage::MAX_DMA_DESCS> dma_type;
 
 public:
@@ -96,6 +96,15 @@ public:
     virtual void write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
                        sector_type sector, const dma_type &dma) = 0;
 
+    /**
+     * Is called when the session with dataspace <ds> is destroyed. Controllers that keep requests
+     * around, which refer to the dataspace, have to drop them.
+     *
+     * @param ds the dataspace of the session
+     */
+    virtual void detach(const nre::DataSpace &) {
+    }
+
 protected:
     uint _id;
 };
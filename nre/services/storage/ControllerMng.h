@@ -44,6 +44,23 @@ public:
     Controller *get(size_t ctrl) const {
         return _ctrls[ctrl];
     }
+    /**
+     * @return the number of controllers, i.e. the id of the next one
+     */
+    size_t count() const {
+        return _count;
+    }
+    /**
+     * Adds a controller that has not been found on the PCI bus, i.e. one with virtual drives
+     *
+     * @param ctrl the controller with id count()
+     * @throws Exception if there is no free slot
+     */
+    void add(Controller *ctrl) {
+        if(_count >= nre::Storage::MAX_CONTROLLER)
+            throw nre::Exception(nre::E_CAPACITY, "No free controller slot");
+        _ctrls[_count++] = ctrl;
+    }
 
 private:
     void find_ahci_controller();
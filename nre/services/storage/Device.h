@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <ipc/MPProducer.h>
 #include <services/Storage.h>
 #include <Compiler.h>
 
@@ -140,7 +141,7 @@ class Device {
 public:
     typedef nre::Storage::sector_type sector_type;
     typedef nre::Storage::tag_type tag_type;
-    typedef nre::Producer<nre::Storage::Packet> producer_type;
+    typedef nre::MPProducer<nre::Storage::Packet> producer_type;
     typedef nre::DMADescList<nre::Storage::MAX_DMA_DESCS> dma_type;
 
     enum Operation {
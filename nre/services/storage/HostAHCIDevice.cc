@@ -15,13 +15,15 @@
  * General Public License version 2 for more details.
  */
 
+#include <util/ScopedLock.h>
+#include <util/Trace.h>
 #include <Logging.h>
 
 #include "HostAHCIDevice.h"
 
 using namespace nre;
 
-void HostAHCIDevice::init() {
+void HostAHCIDevice::stop() {
     if(_regs->cmd & 0xc009) {
         // stop processing by clearing ST
         _regs->cmd &= ~1;
@@ -34,6 +36,10 @@ void HostAHCIDevice::init() {
         if(wait_timeout(&_regs->cmd, 1 << 14, 0))
             throw Exception(E_FAILURE, 32, "Device %u: Unable to stop FIS receiving", _id);
     }
+}
+
+void HostAHCIDevice::init() {
+    stop();
 
     // set CL and FIS pointer
     addr2phys(_clds, _cl, &_regs->clb);
@@ -58,9 +64,6 @@ void HostAHCIDevice::init() {
         throw Exception(E_FAILURE, 64, "Device %u: CLO did not clear (%#x)", _id, res);
     _regs->cmd |= 0x1;
 
-    // nothing in progress anymore
-    _inprogress = 0;
-
     // enable irqs
     _regs->ie = 0xf98000f1;
     identify_drive(_bufferds);
@@ -69,10 +72,23 @@ void HostAHCIDevice::init() {
     //return identify_drive(buffer);
 }
 
-void HostAHCIDevice::readwrite(Producer<Storage::Packet> *prod, Storage::tag_type tag,
-                               const DataSpace &ds, sector_type sector, const dma_type &dma,
-                               bool write) {
-    ScopedLock<UserSm> guard(&_sm);
+uint HostAHCIDevice::alloc_slot() {
+    // start with our own context and take the slots of the others only if necessary
+    size_t first = CPU::current().log_id() % _ctxcount;
+    for(size_t i = 0; i < _ctxcount; ++i) {
+        HwContext *ctx = _ctxs + (first + i) % _ctxcount;
+        uint32_t busy;
+        while((busy = ctx->busy) != ctx->slots) {
+            uint slot = Math::bit_scan_forward(ctx->slots & ~busy);
+            if(Atomic::cmpnswap(&ctx->busy, busy, busy | (1u << slot)))
+                return slot;
+        }
+    }
+    throw Exception(E_CAPACITY, 32, "Device %u: No free command slot", _id);
+}
+
+void HostAHCIDevice::readwrite(producer_type *prod, Storage::tag_type tag, const DataSpace &ds,
+                               sector_type sector, const dma_type &dma, bool write) {
     size_t length = dma.bytecount();
     // invalid offset or size?
     if(length >> 13)
@@ -81,16 +97,45 @@ void HostAHCIDevice::readwrite(Producer<Storage::Packet> *prod, Storage::tag_typ
     uint8_t command = has_lba48() ? 0x25 : 0xc8;
     if(write)
         command = has_lba48() ? 0x35 : 0xca;
-    set_command(command, sector, !write, length >> 13);
+    uint slot = alloc_slot();
+    try {
+        set_command(slot, command, sector, !write, length >> 13);
 
-    for(dma_type::iterator it = dma.begin(); it != dma.end(); ++it) {
-        if(it->offset > ds.size() || it->offset + it->count > ds.size()) {
-            throw Exception(E_ARGS_INVALID, 64, "Device %u: Invalid offset(%zu)/count(%zu)",
-                            it->offset, it->count);
+        for(dma_type::iterator it = dma.begin(); it != dma.end(); ++it) {
+            if(it->offset > ds.size() || it->offset + it->count > ds.size()) {
+                throw Exception(E_ARGS_INVALID, 64, "Device %u: Invalid offset(%zu)/count(%zu)",
+                                it->offset, it->count);
+            }
+            add_dma(slot, ds, it->offset, it->count);
         }
-        add_dma(ds, it->offset, it->count);
     }
-    start_command(prod, tag);
+    catch(...) {
+        free_slot(slot);
+        throw;
+    }
+    start_command(slot, prod, tag);
+}
+
+void HostAHCIDevice::complete(uint slot, uint status) {
+    // both the interrupt thread and the submitter might try to complete it
+    if(!(Atomic::fetch_and(&_active, ~(1u << slot)) & (1u << slot)))
+        return;
+    // the irq thread might have taken its snapshot before the slot has been reused. in this
+    // case, we've claimed the new command, which is still in flight. give it back; whoever
+    // notices its completion (the submitter or the next irq) will complete it.
+    if(_regs->ci & (1u << slot)) {
+        Atomic::fetch_or(&_active, 1u << slot);
+        return;
+    }
+
+    LOG(nre::Logging::STORAGE_DETAIL,
+        nre::Serial::get().writef("Operation for user %lx is finished\n", _usertags[slot].tag));
+    if(_usertags[slot].prod) {
+        TRACE(STORAGE_REQ, ASYNC_END, _usertags[slot].tag);
+        _usertags[slot].prod->produce(nre::Storage::Packet(_usertags[slot].tag, status));
+    }
+    _usertags[slot].tag = ~0;
+    free_slot(slot);
 }
 
 void HostAHCIDevice::irq() {
@@ -99,85 +144,120 @@ void HostAHCIDevice::irq() {
     // clear interrupt status
     _regs->is = is;
 
-    for(uint done = _inprogress & ~_regs->ci, tag; done; done &= ~(1 << tag)) {
-        tag = nre::Math::bit_scan_forward(done);
-        LOG(nre::Logging::STORAGE_DETAIL,
-            nre::Serial::get().writef("Operation for user %lx is finished\n", _usertags[tag].tag));
-        if(_usertags[tag].prod)
-            _usertags[tag].prod->produce(nre::Storage::Packet(_usertags[tag].tag, 0));
+    // read the active slots before the command issue register. the submitter marks a slot active
+    // after issuing it, so that a cleared bit of an active slot means that it is finished.
+    uint32_t active = _active;
+    Sync::memory_barrier();
+    for(uint done = active & ~_regs->ci, slot; done; done &= ~(1u << slot)) {
+        slot = nre::Math::bit_scan_forward(done);
+        complete(slot);
+    }
+
+    uint32_t tfd = _regs->tfd;
+    if((tfd & 1) && (~tfd & 0x400)) {
+        LOG(nre::Logging::STORAGE, nre::Serial::get().writef("command failed with %x\n", tfd));
+        reset(tfd);
+    }
+}
+
+void HostAHCIDevice::reset(uint32_t tfd) {
+    // nobody must issue commands while the port is stopped and reinitialized
+    ScopedLock<UserSm> guard(&_sm);
+    try {
+        stop();
+    }
+    catch(const Exception &e) {
+        LOG(nre::Logging::STORAGE, nre::Serial::get() << e.msg() << "\n");
+    }
 
-        _usertags[tag].tag = ~0;
-        _inprogress &= ~(1 << tag);
+    // stopping the port has cleared the command issue register, i.e. the commands that are still
+    // active will never finish. this frees their slots as well, which init() needs for IDENTIFY.
+    for(uint32_t active = _active, slot; active; active &= ~(1u << slot)) {
+        slot = nre::Math::bit_scan_forward(active);
+        complete(slot, tfd);
     }
 
-    if((_regs->tfd & 1) && (~_regs->tfd & 0x400)) {
-        LOG(nre::Logging::STORAGE, nre::Serial::get().writef("command failed with %x\n", _regs->tfd));
+    try {
         init();
     }
+    catch(const Exception &e) {
+        LOG(nre::Logging::STORAGE, nre::Serial::get() << e.msg() << "\n");
+    }
 }
 
-void HostAHCIDevice::set_command(uint8_t command, uint64_t sector, bool read, uint count, bool atapi,
-                                 uint pmp, uint features) {
-    _cl[_tag * CL_DWORDS + 0] = (atapi ? 0x20 : 0) | (read ? 0 : 0x40) | 5 | ((pmp & 0xf) << 12);
-    _cl[_tag * CL_DWORDS + 1] = 0;
+void HostAHCIDevice::set_command(uint slot, uint8_t command, uint64_t sector, bool read, uint count,
+                                 bool atapi, uint pmp, uint features) {
+    _cl[slot * CL_DWORDS + 0] = (atapi ? 0x20 : 0) | (read ? 0 : 0x40) | 5 | ((pmp & 0xf) << 12);
+    _cl[slot * CL_DWORDS + 1] = 0;
 
     // link command list and tables
-    addr2phys(_ctds, _ct + _tag * (128 + MAX_PRD_COUNT * 16) / 4, _cl + _tag * CL_DWORDS + 2);
+    addr2phys(_ctds, _ct + slot * (128 + MAX_PRD_COUNT * 16) / 4, _cl + slot * CL_DWORDS + 2);
 
     // XXX Does any one know how to avoid these type casts in C++0x mode?
 #define UC(x) static_cast<uint8_t>(x)
     uint8_t cfis[20] = {0x27, UC(0x80 | (pmp & 0xf)), command, UC(features), UC(sector),
                         UC(sector >> 8), UC(sector >> 16), 0x40, UC(sector >> 24), UC(sector >> 32),
                         UC(sector >> 40), UC(features >> 8), UC(count), UC(count >> 8), 0, 0, 0, 0, 0, 0};
-    memcpy(_ct + _tag * (128 + MAX_PRD_COUNT * 16) / 4, cfis, sizeof(cfis));
+    memcpy(_ct + slot * (128 + MAX_PRD_COUNT * 16) / 4, cfis, sizeof(cfis));
 }
 
-void HostAHCIDevice::add_dma(const nre::DataSpace &ds, size_t offset, uint bytes) {
-    uint32_t prd = _cl[_tag * CL_DWORDS] >> 16;
+void HostAHCIDevice::add_dma(uint slot, const nre::DataSpace &ds, size_t offset, uint bytes) {
+    uint32_t prd = _cl[slot * CL_DWORDS] >> 16;
     if(prd >= MAX_PRD_COUNT)
         throw nre::Exception(nre::E_ARGS_INVALID, 32, "Device %u: No free PRD slot", _id);
-    _cl[_tag * CL_DWORDS] += 1 << 16;
-    uint32_t *p = _ct + ((_tag * (128 + MAX_PRD_COUNT * 16) + 0x80 + prd * 16) >> 2);
+    _cl[slot * CL_DWORDS] += 1 << 16;
+    uint32_t *p = _ct + ((slot * (128 + MAX_PRD_COUNT * 16) + 0x80 + prd * 16) >> 2);
     addr2phys(ds, reinterpret_cast<void*>(ds.virt() + offset), p);
     p[3] = bytes - 1;
 }
 
-void HostAHCIDevice::add_prd(const nre::DataSpace &ds, uint bytes) {
-    uint32_t prd = _cl[_tag * CL_DWORDS] >> 16;
+void HostAHCIDevice::add_prd(uint slot, const nre::DataSpace &ds, uint bytes) {
+    uint32_t prd = _cl[slot * CL_DWORDS] >> 16;
     assert(~bytes & 1);
     assert(!(bytes >> 22));
     if(prd >= MAX_PRD_COUNT)
         throw nre::Exception(nre::E_ARGS_INVALID, 32, "Device %u: No free PRD slot", _id);
-    _cl[_tag * CL_DWORDS] += 1 << 16;
-    uint32_t *p = _ct + ((_tag * (128 + MAX_PRD_COUNT * 16) + 0x80 + prd * 16) >> 2);
+    _cl[slot * CL_DWORDS] += 1 << 16;
+    uint32_t *p = _ct + ((slot * (128 + MAX_PRD_COUNT * 16) + 0x80 + prd * 16) >> 2);
     addr2phys(ds, reinterpret_cast<void*>(ds.virt()), p);
     p[3] = bytes - 1;
 }
 
-size_t HostAHCIDevice::start_command(nre::Producer<nre::Storage::Packet> *prod, ulong usertag) {
-    // remember work in progress commands
-    assert(!(_inprogress & (1 << _tag)));
-    _inprogress |= 1 << _tag;
-    _usertags[_tag].tag = usertag;
-    _usertags[_tag].prod = prod;
+void HostAHCIDevice::start_command(uint slot, producer_type *prod, ulong usertag) {
+    _usertags[slot].tag = usertag;
+    _usertags[slot].prod = prod;
+    Sync::memory_barrier();
+
+    {
+        // writing a 0 to the command issue register has no effect, so that we would not need a
+        // lock. but the interrupt thread might reset the port at the same time
+        ScopedLock<UserSm> guard(&_sm);
+        _regs->ci = 1u << slot;
+        Atomic::fetch_or(&_active, 1u << slot);
+    }
+    // the interrupt thread ignores the slot as long as it's not active. thus, if the command has
+    // been finished meanwhile, it's up to us to complete it.
+    if(~_regs->ci & (1u << slot))
+        complete(slot);
+}
 
-    _regs->ci = 1 << _tag;
-    size_t res = _tag;
-    _tag = (_tag + 1) % _max_slots;
+uint32_t HostAHCIDevice::run_polled(uint slot) {
+    _regs->ci = 1u << slot;
+    uint32_t res = wait_timeout(&_regs->ci, 1u << slot, 0);
+    free_slot(slot);
     return res;
 }
 
 void HostAHCIDevice::identify_drive(nre::DataSpace &buffer) {
     uint16_t *buf = reinterpret_cast<uint16_t*>(buffer.virt());
     memset(reinterpret_cast<void*>(buffer.virt()), 0, 512);
-    set_command(0xec, 0, true);
-    add_prd(buffer, 512);
-    size_t tag = start_command(0, 0);
+    uint slot = alloc_slot();
+    set_command(slot, 0xec, 0, true);
+    add_prd(slot, buffer, 512);
 
     // there is no IRQ on identify, as this is PIO data-in command
-    if(wait_timeout(&_regs->ci, 1 << tag, 0))
+    if(run_polled(slot))
         throw Exception(E_TIMEOUT, 64, "Device %u: Timeout while waiting on IDENTIFY to finish", _id);
-    _inprogress &= ~(1 << tag);
 
     // we do not support spinup
     // TODO is 0 in qemu!? assert(buf[2] == 0xc837);
@@ -186,11 +266,10 @@ void HostAHCIDevice::identify_drive(nre::DataSpace &buffer) {
 }
 
 uint HostAHCIDevice::set_features(uint features, uint count) {
-    set_command(0xef, 0, false, count, false, 0, features);
-    size_t tag = start_command(0, 0);
+    uint slot = alloc_slot();
+    set_command(slot, 0xef, 0, false, count, false, 0, features);
 
     // there is no IRQ on set_features, as this is a PIO command
-    check3(wait_timeout(&_regs->ci, 1 << tag, 0));
-    _inprogress &= ~(1 << tag);
+    check3(run_polled(slot));
     return 0;
 }
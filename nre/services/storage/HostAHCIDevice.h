@@ -17,10 +17,13 @@
 
 #pragma once
 
+#include <kobj/UserSm.h>
 #include <mem/DataSpace.h>
-#include <ipc/Producer.h>
+#include <ipc/MPProducer.h>
+#include <util/Atomic.h>
 #include <util/Clock.h>
 #include <Assert.h>
+#include <CPU.h>
 
 #include "Device.h"
 
@@ -29,6 +32,16 @@
 /**
  * A single AHCI port with its command list and receive FIS buffer.
  *
+ * The command slots are distributed among hardware contexts, one per CPU (as long as there are
+ * enough slots). Since commands are submitted on the CPU of the client, each CPU allocates the
+ * slots of its own context first and only takes the slots of other contexts if its own are in
+ * use. Slots are allocated and released with atomic operations and the command tables are private
+ * to a slot, so that clients on different CPUs can submit commands without a lock. The completion
+ * is usually delivered by the interrupt thread, but might also be delivered by the submitter, if
+ * the command finished before it has been marked as active (see start_command()). Only issuing a
+ * command takes a lock, because the interrupt thread resets the port if a command failed. The
+ * commands that are in flight at this point are completed with the task file data as status.
+ *
  * State: testing
  * Supports: read-sectors, write-sectors, identify-drive
  * Missing: ATAPI detection
@@ -36,6 +49,8 @@
 class HostAHCIDevice : public Device {
     static const size_t CL_DWORDS     = 8;
     static const size_t MAX_PRD_COUNT = 64;
+    static const size_t MAX_SLOTS     = 32;
+    static const size_t CACHE_LINE    = 64;
     // timeout in milliseconds
     static const uint FREQ            = 1000;
     static const uint TIMEOUT         = 200;
@@ -51,10 +66,20 @@ class HostAHCIDevice : public Device {
     };
 
     struct UserTag {
-        nre::Producer<nre::Storage::Packet> *prod;
+        producer_type *prod;
         nre::Storage::tag_type tag;
     };
 
+    /**
+     * A set of command slots. Each context is padded to the size of a cacheline, so that it
+     * shares a line with at most its neighbours (the device itself is not cacheline aligned).
+     */
+    struct HwContext {
+        volatile uint32_t busy;
+        uint32_t slots;
+        char pad[CACHE_LINE - sizeof(uint32_t) * 2];
+    };
+
 public:
     enum Signature {
         SATA_SIG_ATA                  = 0x00000101,   // SATA drive
@@ -103,7 +128,7 @@ public:
     }
 
     explicit HostAHCIDevice(Register *regs, uint disknr, size_t max_slots, bool dmar)
-        : Device(disknr), _sm(), _regs(regs), _clock(FREQ), _max_slots(max_slots), _dmar(dmar),
+        : Device(disknr), _regs(regs), _clock(FREQ), _max_slots(max_slots), _dmar(dmar),
           _bufferds(512, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW),
           _clds(max_slots * CL_DWORDS * 4, nre::DataSpaceDesc::ANONYMOUS, nre::DataSpaceDesc::RW),
           _ctds(max_slots * (32 + MAX_PRD_COUNT * 4) * 4,
@@ -112,7 +137,10 @@ public:
           _cl(reinterpret_cast<uint32_t*>(_clds.virt())),
           _ct(reinterpret_cast<uint32_t*>(_ctds.virt())),
           _fis(reinterpret_cast<uint32_t*>(_fisds.virt())),
-          _tag(0), _usertags(), _inprogress() {
+          _usertags(), _active(), _ctxcount(nre::Math::min<size_t>(nre::CPU::count(), max_slots)),
+          _ctxs(), _sm() {
+        for(size_t i = 0; i < _max_slots; ++i)
+            _ctxs[i % _ctxcount].slots |= 1u << i;
         init();
     }
 
@@ -123,18 +151,18 @@ public:
         _capacity = has_lba48() ? _info.lba48MaxLBA : _info.userSectorCount;
     }
 
-    void flush(nre::Producer<nre::Storage::Packet> *prod, nre::Storage::tag_type tag) {
-        nre::ScopedLock<nre::UserSm> guard(&_sm);
-        set_command(has_lba48() ? 0xea : 0xe7, 0, true);
-        start_command(prod, tag);
+    void flush(producer_type *prod, nre::Storage::tag_type tag) {
+        uint slot = alloc_slot();
+        set_command(slot, has_lba48() ? 0xea : 0xe7, 0, true);
+        start_command(slot, prod, tag);
     }
-    void readwrite(nre::Producer<nre::Storage::Packet> *prod, nre::Storage::tag_type tag,
-                   const nre::DataSpace &ds, sector_type sector, const dma_type &dma, bool write);
+    void readwrite(producer_type *prod, nre::Storage::tag_type tag, const nre::DataSpace &ds,
+                   sector_type sector, const dma_type &dma, bool write);
     void irq();
 
     void debug() {
-        nre::Serial::get().writef("AHCI is %x ci %x ie %x cmd %x tfd %x tag %zx\n",
-                                  _regs->is, _regs->ci, _regs->ie, _regs->cmd, _regs->tfd, _tag);
+        nre::Serial::get().writef("AHCI is %x ci %x ie %x cmd %x tfd %x active %x\n",
+                                  _regs->is, _regs->ci, _regs->ie, _regs->cmd, _regs->tfd, _active);
     }
 
 private:
@@ -156,16 +184,24 @@ private:
         dst[1] = 0; // support 64bit mode
     }
 
+    uint alloc_slot();
+    void free_slot(uint slot) {
+        nre::Atomic::fetch_and(&_ctxs[slot % _ctxcount].busy, ~(1u << slot));
+    }
+
     void init();
-    void set_command(uint8_t command, uint64_t sector, bool read, uint count = 0, bool atapi = false,
-                     uint pmp = 0, uint features = 0);
-    void add_dma(const nre::DataSpace &ds, size_t offset, uint count);
-    void add_prd(const nre::DataSpace &ds, uint count);
-    size_t start_command(nre::Producer<nre::Storage::Packet> *prod, ulong usertag);
+    void stop();
+    void reset(uint32_t tfd);
+    void set_command(uint slot, uint8_t command, uint64_t sector, bool read, uint count = 0,
+                     bool atapi = false, uint pmp = 0, uint features = 0);
+    void add_dma(uint slot, const nre::DataSpace &ds, size_t offset, uint count);
+    void add_prd(uint slot, const nre::DataSpace &ds, uint count);
+    void start_command(uint slot, producer_type *prod, ulong usertag);
+    void complete(uint slot, uint status = 0);
+    uint32_t run_polled(uint slot);
     void identify_drive(nre::DataSpace &buffer);
     uint set_features(uint features, uint count = 0);
 
-    nre::UserSm _sm;
     Register volatile *_regs;
     nre::Clock _clock;
     size_t _max_slots;
@@ -177,7 +213,11 @@ private:
     uint32_t *_cl;
     uint32_t *_ct;
     uint32_t *_fis;
-    size_t _tag;
-    UserTag _usertags[32];
-    uint _inprogress;
+    UserTag _usertags[MAX_SLOTS];
+    // the slots whose commands have been issued, but not completed yet
+    volatile uint32_t _active;
+    size_t _ctxcount;
+    HwContext _ctxs[MAX_SLOTS];
+    // serializes the issuing of commands with the reset of the port
+    nre::UserSm _sm;
 };
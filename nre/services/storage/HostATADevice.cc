@@ -14,6 +14,8 @@
  * General Public License version 2 for more details.
  */
 
+#include <util/Trace.h>
+
 #include "HostATADevice.h"
 
 using namespace nre;
@@ -104,8 +106,10 @@ void HostATADevice::transferPIO(Operation op, const DataSpace &ds, size_t secsiz
             throw Exception(E_ARGS_INVALID, 64, "Device %u: Unable to copyout data", _id);
         offset += secsize;
     }
-    if(prod)
+    if(prod) {
+        TRACE(STORAGE_REQ, ASYNC_END, tag);
         prod->produce(Storage::Packet(tag, 0));
+    }
 }
 
 void HostATADevice::transferDMA(Operation op, const DataSpace &ds, const dma_type &dma,
@@ -21,6 +21,7 @@
 #include <kobj/GlobalThread.h>
 #include <kobj/Sc.h>
 #include <util/Clock.h>
+#include <util/Trace.h>
 #include <Logging.h>
 
 #include "Device.h"
@@ -30,7 +31,7 @@ class HostATADevice;
 
 class HostIDECtrl : public Controller {
     struct UserTag {
-        nre::Producer<nre::Storage::Packet> *prod;
+        producer_type *prod;
         nre::Storage::tag_type tag;
         bool dma;
     };
@@ -220,8 +221,10 @@ private:
                 ctrl->inbmrb(BMR_REG_STATUS);
                 ctrl->outbmrb(BMR_REG_COMMAND, 0);
             }
-            if(ctrl->_tag.prod)
+            if(ctrl->_tag.prod) {
+                TRACE(STORAGE_REQ, ASYNC_END, ctrl->_tag.tag);
                 ctrl->_tag.prod->produce(nre::Storage::Packet(ctrl->_tag.tag, status));
+            }
             ctrl->_ready.up();
             ctrl->_in_progress = false;
             // just in case we receive another interrupt
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <kobj/GlobalThread.h>
+#include <stream/OStringStream.h>
+#include <util/ScopedLock.h>
+#include <util/Trace.h>
+#include <util/Util.h>
+#include <Hip.h>
+
+#include "OverlayCtrl.h"
+
+using namespace nre;
+
+static Storage::Parameter get_drive_params(Controller *ctrl, size_t drive) {
+    Storage::Parameter params;
+    ctrl->get_params(drive, &params);
+    return params;
+}
+
+OverlayCtrl::OverlayCtrl(uint id, Controller *basectrl, BlockCache *basecache, size_t base,
+                         Controller *storectrl, BlockCache *storecache, size_t store,
+                         size_t count)
+    : Controller(id), _base(), _store(), _params(get_drive_params(basectrl, base)),
+      _count(count), _drives(),
+      _blocks(Math::min<sector_type>(get_drive_params(storectrl, store).sectors / BLOCK_SECTORS,
+                                     0xFFFFFFFE)),
+      _used(_blocks), _free(_blocks), _next(),
+      _bounce(Math::round_up<size_t>(MAX_OPS * BLOCK_SECTORS * _params.sector_size,
+                                     ExecEnv::PAGE_SIZE),
+              DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _ringds(ExecEnv::PAGE_SIZE, DataSpaceDesc::ANONYMOUS, DataSpaceDesc::RW),
+      _cons(&_ringds, true), _prod(&_ringds, false), _ops(), _opcount(), _inflight(), _queued(),
+      _waiting(), _kicked(), _sleep(0), _sm() {
+    Storage::Parameter sparams = get_drive_params(storectrl, store);
+    if(count == 0 || count > Storage::MAX_DRIVES)
+        throw Exception(E_ARGS_INVALID, 64, "Invalid number of virtual drives (%zu)", count);
+    if(base == store)
+        throw Exception(E_ARGS_INVALID, "Base and store have to be different drives");
+    if(!(_params.flags & sparams.flags & Storage::Parameter::FLAG_HARDDISK))
+        throw Exception(E_ARGS_INVALID, "Base and store have to be harddisks");
+    if(_params.sector_size != sparams.sector_size)
+        throw Exception(E_ARGS_INVALID, "Base and store need the same sector size");
+
+    _base.ctrl = basectrl;
+    _base.cache = basecache;
+    _base.drive = base;
+    _store.ctrl = storectrl;
+    _store.cache = storecache;
+    _store.drive = store;
+    _used.clear_all();
+
+    size_t pages = Math::blockcount<sector_type>(
+        Math::blockcount<sector_type>(_params.sectors, BLOCK_SECTORS), MAP_PAGE);
+    _drives = new Drive[count];
+    for(size_t i = 0; i < count; ++i) {
+        _drives[i].map = new uint32_t *[pages]();
+        _drives[i].used = 0;
+    }
+
+    char name[32];
+    OStringStream os(name, sizeof(name));
+    os << "storage-overlay-" << id;
+    GlobalThread *gt = GlobalThread::create(completion_thread, CPU::current().log_id(), String(name));
+    gt->set_tls<OverlayCtrl*>(Thread::TLS_PARAM, this);
+    gt->start();
+}
+
+void OverlayCtrl::get_params(size_t drive, Storage::Parameter *params) const {
+    *params = _params;
+    params->flags = Storage::Parameter::FLAG_HARDDISK;
+    params->max_requests = MAX_OPS;
+    OStringStream os(params->name, sizeof(params->name));
+    os << "Overlay " << (drive % Storage::MAX_DRIVES) << " of " << _params.name;
+}
+
+void OverlayCtrl::flush(size_t drive, producer_type *prod, tag_type tag) {
+    // the base drive is never written, so that it's enough to flush the store
+    submit(new Request(Request::FLUSH, _drives + drive % Storage::MAX_DRIVES, prod, tag, 0,
+                       0, 0, dma_type()));
+}
+
+void OverlayCtrl::read(size_t drive, producer_type *prod, tag_type tag, const DataSpace &ds,
+                       sector_type sector, const dma_type &dma) {
+    submit(new Request(Request::READ, _drives + drive % Storage::MAX_DRIVES, prod, tag, &ds,
+                       sector, dma.bytecount() / _params.sector_size, dma));
+}
+
+void OverlayCtrl::write(size_t drive, producer_type *prod, tag_type tag, const DataSpace &ds,
+                        sector_type sector, const dma_type &dma) {
+    submit(new Request(Request::WRITE, _drives + drive % Storage::MAX_DRIVES, prod, tag, &ds,
+                       sector, dma.bytecount() / _params.sector_size, dma));
+}
+
+void OverlayCtrl::detach(const DataSpace &ds) {
+    {
+        ScopedLock<UserSm> guard(&_sm);
+        for(DList<Request>::iterator it = _waiting.begin(); it != _waiting.end(); ) {
+            Request *r = &*it++;
+            if(r->ds == &ds) {
+                _waiting.remove(r);
+                delete r;
+            }
+        }
+        // the commands that are in progress are finished, but without the client
+        for(size_t i = 0; i < MAX_OPS; ++i) {
+            if(_ops[i].kind != Op::FREE && _ops[i].req->ds == &ds) {
+                _ops[i].req->ds = 0;
+                _ops[i].req->prod = 0;
+            }
+        }
+    }
+    if(_base.cache)
+        _base.cache->detach(ds);
+    if(_store.cache)
+        _store.cache->detach(ds);
+}
+
+void OverlayCtrl::completion_thread(void*) {
+    OverlayCtrl *oc = Thread::current()->get_tls<OverlayCtrl*>(Thread::TLS_PARAM);
+    Storage::Packet pk;
+    while(oc->_cons.consume(pk)) {
+        while(1) {
+            {
+                ScopedLock<UserSm> guard(&oc->_sm);
+                oc->handle(pk);
+                while(oc->_cons.try_consume(pk))
+                    oc->handle(pk);
+                oc->retry();
+                oc->issue_queued();
+                if(!oc->stalled()) {
+                    oc->_kicked = false;
+                    break;
+                }
+            }
+            // the drives are busy with commands of others, which don't complete on our ring. so,
+            // try it again in a millisecond
+            oc->_sleep.down(Util::tsc() + Hip::get().freq_tsc);
+            pk.tag = KICK;
+        }
+    }
+}
+
+void OverlayCtrl::submit(Request *r) {
+    ScopedLock<UserSm> guard(&_sm);
+    try {
+        if(!start(r))
+            _waiting.append(r);
+    }
+    catch(...) {
+        delete r;
+        throw;
+    }
+    issue_queued();
+    kick();
+}
+
+void OverlayCtrl::kick() {
+    if(stalled() && !_kicked) {
+        _kicked = true;
+        _prod.produce(Storage::Packet(KICK, 0));
+    }
+}
+
+bool OverlayCtrl::start(Request *r) {
+    if(r->type == Request::FLUSH) {
+        if(_opcount == MAX_OPS)
+            return false;
+        alloc_op(r, Op::FLUSH, true);
+        return true;
+    }
+
+    // determine the number of commands we need and whether we have to wait for a redirection
+    sector_type first = r->sector / BLOCK_SECTORS;
+    sector_type last = (r->sector + r->count - 1) / BLOCK_SECTORS;
+    size_t needed = 0;
+    size_t allocs = 0;
+    bool base = false;
+    for(sector_type no = first; no <= last; ++no) {
+        if(redirecting(r->drv, no))
+            return false;
+        bool mapped = lookup(r->drv, no) != 0;
+        if(r->type == Request::WRITE) {
+            needed++;
+            allocs += !mapped;
+        }
+        else {
+            // consecutive blocks on the base drive are read with one command
+            if(mapped || !base)
+                needed++;
+            base = !mapped;
+        }
+    }
+    if(needed > MAX_OPS)
+        throw Exception(E_ARGS_INVALID, 64, "Request too large (%zu commands)", needed);
+    if(needed > MAX_OPS - _opcount)
+        return false;
+    if(allocs > _free)
+        throw Exception(E_CAPACITY, "The overlay store is full");
+
+    Op *run = 0;
+    size_t runoff = 0;
+    size_t runlen = 0;
+    size_t off = 0;
+    for(sector_type no = first; no <= last; ++no) {
+        uint32_t mask = sector_mask(no, r->sector, r->count);
+        sector_type sec = Math::bit_scan_forward(mask);
+        size_t len = Math::popcount(mask) * _params.sector_size;
+        uint32_t target = lookup(r->drv, no);
+
+        if(r->type == Request::READ) {
+            if(!target) {
+                if(!run) {
+                    run = alloc_op(r, Op::READ, false);
+                    run->sector = no * BLOCK_SECTORS + sec;
+                    runoff = off;
+                    runlen = 0;
+                }
+                runlen += len;
+            }
+            else {
+                if(run) {
+                    slice(r->dma, runoff, runlen, run->dma);
+                    run = 0;
+                }
+                Op *op = alloc_op(r, Op::READ, true);
+                op->sector = (target - 1) * BLOCK_SECTORS + sec;
+                slice(r->dma, off, len, op->dma);
+            }
+        }
+        else if(target) {
+            Op *op = alloc_op(r, Op::WRITE, true);
+            op->sector = (target - 1) * BLOCK_SECTORS + sec;
+            slice(r->dma, off, len, op->dma);
+        }
+        else {
+            // if the block is written completely, we don't need its content on the base drive
+            uint32_t all = sector_mask(no, no * BLOCK_SECTORS, BLOCK_SECTORS);
+            bool complete = mask == all;
+            Op *op = alloc_op(r, complete ? Op::REDIRECT : Op::FILL, complete);
+            alloc_block(&op->target);
+            op->block = no;
+            op->mask = mask;
+            op->reqoff = off;
+            if(complete) {
+                r->dma.in(reinterpret_cast<void*>(_bounce.virt() + bounce(op)), len, off, *r->ds);
+                redirect(op);
+            }
+            else {
+                op->sector = no * BLOCK_SECTORS;
+                op->dma.push(DMADesc(bounce(op), Math::popcount(all) * _params.sector_size));
+            }
+        }
+        off += len;
+    }
+    if(run)
+        slice(r->dma, runoff, runlen, run->dma);
+    return true;
+}
+
+void OverlayCtrl::redirect(Op *op) {
+    uint32_t all = sector_mask(op->block, op->block * BLOCK_SECTORS, BLOCK_SECTORS);
+    op->kind = Op::REDIRECT;
+    op->store = true;
+    op->sector = static_cast<sector_type>(op->target) * BLOCK_SECTORS;
+    op->dma.clear();
+    op->dma.push(DMADesc(bounce(op), Math::popcount(all) * _params.sector_size));
+}
+
+void OverlayCtrl::retry() {
+    for(DList<Request>::iterator it = _waiting.begin(); it != _waiting.end(); ) {
+        Request *r = &*it++;
+        try {
+            if(!start(r))
+                continue;
+            _waiting.remove(r);
+        }
+        catch(const Exception &e) {
+            // there is nobody to throw it to, so report it in the completion
+            _waiting.remove(r);
+            r->status = e.code();
+            complete(r);
+        }
+    }
+}
+
+void OverlayCtrl::issue_queued() {
+    while(_queued.length() > 0) {
+        Op *op = &*_queued.begin();
+        try {
+            issue(op);
+        }
+        catch(const Exception &e) {
+            // the drive is busy; try it again when something completed
+            if(e.code() == E_CAPACITY)
+                break;
+            _queued.remove(op);
+            finish(op, e.code());
+            continue;
+        }
+        _queued.remove(op);
+        _inflight++;
+    }
+}
+
+void OverlayCtrl::issue(Op *op) {
+    const Backend &be = op->store ? _store : _base;
+    tag_type tag = op - _ops;
+    const DataSpace *ds = &_bounce;
+    if(op->kind == Op::READ || op->kind == Op::WRITE) {
+        if(!op->req->ds)
+            throw Exception(E_NOT_FOUND, "Session is gone");
+        ds = op->req->ds;
+    }
+
+    switch(op->kind) {
+        case Op::READ:
+        case Op::FILL:
+            if(be.cache)
+                be.cache->read(&_prod, tag, *ds, op->sector, op->dma);
+            else
+                be.ctrl->read(be.drive, &_prod, tag, *ds, op->sector, op->dma);
+            break;
+        case Op::WRITE:
+        case Op::REDIRECT:
+            if(be.cache)
+                be.cache->write(&_prod, tag, *ds, op->sector, op->dma);
+            else
+                be.ctrl->write(be.drive, &_prod, tag, *ds, op->sector, op->dma);
+            break;
+        default:
+            if(be.cache)
+                be.cache->flush(&_prod, tag, _bounce);
+            else
+                be.ctrl->flush(be.drive, &_prod, tag);
+            break;
+    }
+}
+
+void OverlayCtrl::handle(const Storage::Packet &pk) {
+    if(pk.tag >= MAX_OPS)
+        return;
+    _inflight--;
+    finish(_ops + pk.tag, pk.status);
+}
+
+void OverlayCtrl::finish(Op *op, uint status) {
+    Request *r = op->req;
+    if(op->kind == Op::FILL && status == 0) {
+        if(r->ds) {
+            // put the written sectors into the block and write it to the store
+            uintptr_t dst = _bounce.virt() + bounce(op);
+            dst += Math::bit_scan_forward(op->mask) * _params.sector_size;
+            r->dma.in(reinterpret_cast<void*>(dst), Math::popcount(op->mask) * _params.sector_size,
+                      op->reqoff, *r->ds);
+            redirect(op);
+            _queued.append(op);
+            return;
+        }
+        status = E_NOT_FOUND;
+    }
+    if(op->kind == Op::FILL || op->kind == Op::REDIRECT) {
+        if(status == 0) {
+            map(r->drv, op->block, op->target + 1);
+            r->drv->used++;
+        }
+        else
+            free_block(op->target);
+    }
+
+    if(status && !r->status)
+        r->status = status;
+    free_op(op);
+    if(--r->pending == 0)
+        complete(r);
+}
+
+void OverlayCtrl::complete(Request *r) {
+    if(r->prod) {
+        TRACE(STORAGE_REQ, ASYNC_END, r->tag);
+        r->prod->produce(Storage::Packet(r->tag, r->status));
+    }
+    delete r;
+}
+
+bool OverlayCtrl::redirecting(const Drive *drv, sector_type no) const {
+    for(size_t i = 0; i < MAX_OPS; ++i) {
+        const Op *op = _ops + i;
+        if((op->kind == Op::FILL || op->kind == Op::REDIRECT) && op->req->drv == drv &&
+           op->block == no)
+            return true;
+    }
+    return false;
+}
+
+void OverlayCtrl::map(Drive *drv, sector_type no, uint32_t target) {
+    uint32_t *&page = drv->map[no / MAP_PAGE];
+    if(!page)
+        page = new uint32_t[MAP_PAGE]();
+    page[no % MAP_PAGE] = target;
+}
+
+bool OverlayCtrl::alloc_block(uint32_t *block) {
+    for(size_t i = 0; _free > 0 && i < _blocks; ++i) {
+        size_t b = (_next + i) % _blocks;
+        if(!_used.get(b)) {
+            _used.set(b, 1);
+            _free--;
+            _next = b + 1;
+            *block = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+void OverlayCtrl::free_block(uint32_t block) {
+    _used.set(block, 0);
+    _free++;
+}
+
+OverlayCtrl::Op *OverlayCtrl::alloc_op(Request *r, Op::Kind kind, bool store) {
+    for(size_t i = 0; i < MAX_OPS; ++i) {
+        Op *op = _ops + i;
+        if(op->kind == Op::FREE) {
+            op->kind = kind;
+            op->req = r;
+            op->store = store;
+            op->dma.clear();
+            _opcount++;
+            r->pending++;
+            _queued.append(op);
+            return op;
+        }
+    }
+    return 0;
+}
+
+void OverlayCtrl::free_op(Op *op) {
+    op->kind = Op::FREE;
+    _opcount--;
+}
+
+void OverlayCtrl::slice(const dma_type &src, size_t offset, size_t len, dma_type &dst) {
+    for(dma_type::iterator it = src.begin(); it != src.end() && len > 0; ++it) {
+        if(offset >= it->count) {
+            offset -= it->count;
+            continue;
+        }
+        size_t sublen = Math::min<size_t>(it->count - offset, len);
+        dst.push(DMADesc(it->offset + offset, sublen));
+        offset = 0;
+        len -= sublen;
+    }
+}
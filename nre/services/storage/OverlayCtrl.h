@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <kobj/Sm.h>
+#include <kobj/UserSm.h>
+#include <mem/DataSpace.h>
+#include <ipc/MPConsumer.h>
+#include <util/MaskField.h>
+#include <util/DList.h>
+#include <util/Math.h>
+
+#include "Controller.h"
+#include "BlockCache.h"
+
+/**
+ * A controller with virtual drives that share one read-only base drive. Each virtual drive has a
+ * sparse overlay on a store drive. Reads of blocks that have never been written go to the base
+ * drive; writes are redirected to blocks of the store, which are allocated on the first write
+ * to a block (redirect-on-write). If the first write covers only a part of a block, the rest is
+ * copied from the base drive first. This way, a virtual drive is ready immediately, without
+ * copying the base drive, and all virtual drives read the unchanged blocks from the same place,
+ * which is cached only once if the base drive has a cache.
+ *
+ * The store is shared by all virtual drives and blocks are allocated from it via a bitmap. The
+ * mapping from blocks of a virtual drive to blocks of the store is only kept in memory, i.e. the
+ * overlays start empty whenever the storage service is started.
+ */
+class OverlayCtrl : public Controller {
+    static const size_t BLOCK_SECTORS   = 8;
+    static const size_t MAX_OPS         = 64;
+    static const size_t MAP_PAGE        = 1024;
+    static const tag_type KICK          = ~0UL;
+
+    /**
+     * A drive below us. We use its cache, if there is one
+     */
+    struct Backend {
+        Controller *ctrl;
+        BlockCache *cache;
+        size_t drive;
+    };
+
+    /**
+     * A virtual drive. The map is two-level: pages of MAP_PAGE entries are allocated on demand and
+     * contain the store block + 1 for each redirected block (0 = not redirected)
+     */
+    struct Drive {
+        uint32_t **map;
+        size_t used;
+    };
+
+    struct Request : public nre::DListItem {
+        enum Type {
+            READ,
+            WRITE,
+            FLUSH
+        };
+
+        explicit Request(Type type, Drive *drv, producer_type *prod, tag_type tag,
+                         const nre::DataSpace *ds, sector_type sector, size_t count,
+                         const dma_type &dma)
+            : nre::DListItem(), type(type), drv(drv), prod(prod), tag(tag), ds(ds), sector(sector),
+              count(count), dma(dma), pending(), status() {
+        }
+
+        Type type;
+        Drive *drv;
+        producer_type *prod;
+        tag_type tag;
+        const nre::DataSpace *ds;
+        sector_type sector;
+        size_t count;
+        dma_type dma;
+        // the number of commands that have not completed yet
+        size_t pending;
+        uint status;
+    };
+
+    /**
+     * A command for the base or the store drive, which is part of a request. READ and WRITE
+     * transfer directly from or to the dataspace of the client; FILL reads a whole block of the
+     * base drive into the bounce buffer of the command and REDIRECT writes it to the store.
+     */
+    struct Op : public nre::DListItem {
+        enum Kind {
+            FREE,
+            READ,
+            WRITE,
+            FILL,
+            REDIRECT,
+            FLUSH
+        };
+
+        Kind kind;
+        Request *req;
+        bool store;
+        sector_type sector;
+        dma_type dma;
+        // for FILL and REDIRECT: the block of the virtual drive, the block of the store, the
+        // sectors in the block that are written by the request and their offset in the request
+        sector_type block;
+        uint32_t target;
+        uint32_t mask;
+        size_t reqoff;
+    };
+
+public:
+    /**
+     * Creates <count> virtual drives on top of <base> that put their overlays on <store>
+     *
+     * @param id the controller id
+     * @param base the controller, cache (may be 0) and number of the base drive
+     * @param store the controller, cache (may be 0) and number of the store drive
+     * @param count the number of virtual drives
+     * @throws Exception if the drives are not suitable
+     */
+    explicit OverlayCtrl(uint id, Controller *basectrl, BlockCache *basecache, size_t base,
+                         Controller *storectrl, BlockCache *storecache, size_t store,
+                         size_t count);
+
+    virtual bool exists(size_t drive) const {
+        return drive / nre::Storage::MAX_DRIVES == _id && drive % nre::Storage::MAX_DRIVES < _count;
+    }
+    virtual size_t drive_count() const {
+        return _count;
+    }
+    virtual void get_params(size_t drive, nre::Storage::Parameter *params) const;
+
+    virtual void flush(size_t drive, producer_type *prod, tag_type tag);
+    virtual void read(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
+                      sector_type sector, const dma_type &dma);
+    virtual void write(size_t drive, producer_type *prod, tag_type tag, const nre::DataSpace &ds,
+                       sector_type sector, const dma_type &dma);
+    virtual void detach(const nre::DataSpace &ds);
+
+private:
+    OverlayCtrl(const OverlayCtrl&);
+    OverlayCtrl& operator=(const OverlayCtrl&);
+
+    static void completion_thread(void*);
+
+    void submit(Request *r);
+    bool start(Request *r);
+    void retry();
+    void issue_queued();
+    void issue(Op *op);
+    void handle(const nre::Storage::Packet &pk);
+    void finish(Op *op, uint status);
+    void complete(Request *r);
+    void redirect(Op *op);
+    void kick();
+
+    bool redirecting(const Drive *drv, sector_type no) const;
+    uint32_t lookup(const Drive *drv, sector_type no) const {
+        uint32_t *page = drv->map[no / MAP_PAGE];
+        return page ? page[no % MAP_PAGE] : 0;
+    }
+    void map(Drive *drv, sector_type no, uint32_t target);
+    bool alloc_block(uint32_t *block);
+    void free_block(uint32_t block);
+
+    Op *alloc_op(Request *r, Op::Kind kind, bool store);
+    void free_op(Op *op);
+    static void slice(const dma_type &src, size_t offset, size_t len, dma_type &dst);
+
+    uint32_t sector_mask(sector_type no, sector_type sector, size_t count) const {
+        sector_type start = no * BLOCK_SECTORS;
+        sector_type first = nre::Math::max(sector, start);
+        sector_type end = nre::Math::min(nre::Math::min(sector + count, start + BLOCK_SECTORS),
+                                         _params.sectors);
+        return ((1U << (end - first)) - 1) << (first - start);
+    }
+    uintptr_t bounce(const Op *op) const {
+        return (op - _ops) * BLOCK_SECTORS * _params.sector_size;
+    }
+    bool stalled() const {
+        // nothing will complete, but we still have commands to submit
+        return _inflight == 0 && _queued.length() > 0;
+    }
+
+    Backend _base;
+    Backend _store;
+    nre::Storage::Parameter _params;
+    size_t _count;
+    Drive *_drives;
+    size_t _blocks;
+    // the allocated blocks of the store
+    nre::MaskField<1> _used;
+    size_t _free;
+    size_t _next;
+    nre::DataSpace _bounce;
+    nre::DataSpace _ringds;
+    nre::MPConsumer<nre::Storage::Packet> _cons;
+    producer_type _prod;
+    Op _ops[MAX_OPS];
+    size_t _opcount;
+    size_t _inflight;
+    nre::DList<Op> _queued;
+    nre::DList<Request> _waiting;
+    bool _kicked;
+    nre::Sm _sleep;
+    nre::UserSm _sm;
+};
@@ -15,14 +15,24 @@
  */
 
 #include <kobj/Sm.h>
-#include <ipc/Producer.h>
+#include <kobj/GlobalThread.h>
+#include <ipc/MPProducer.h>
 #include <services/PCIConfig.h>
 #include <services/ACPI.h>
+#include <services/Timer.h>
 #include <util/PCI.h>
+#include <util/Trace.h>
+#include <util/ObjectPool.h>
+#include <util/Atomic.h>
+#include <util/Clock.h>
+#include <arch/SpinLock.h>
+#include <stream/IStringStream.h>
 #include <Logging.h>
 #include <cstring>
 
 #include "ControllerMng.h"
+#include "BlockCache.h"
+#include "OverlayCtrl.h"
 
 using namespace nre;
 
@@ -32,17 +42,55 @@ class StorageService;
 // when we put the object here instead of a pointer??
 static ControllerMng *mng;
 static StorageService *srv;
+// the sessions are created and destroyed on all CPUs
+static ObjectPool<DataSpace, LockPolicyDefault<SpinLock> > dspool;
+// the caches of the harddisks, if enabled. they are shared by all sessions for the drive
+static BlockCache *caches[Storage::MAX_CONTROLLER * Storage::MAX_DRIVES];
+// the operations that sessions may not perform directly on a drive, because an overlay uses it
+enum {
+    DENY_READ   = 1 << 0,
+    DENY_WRITE  = 1 << 1
+};
+static uint denied[Storage::MAX_CONTROLLER * Storage::MAX_DRIVES];
+static uint cachestats_secs = 0;
 
 class StorageServiceSession : public ServiceSession {
+    typedef MPProducer<Storage::Packet> producer_type;
+
+    /**
+     * The completion queue for the commands that are submitted on one CPU
+     */
+    struct Queue {
+        explicit Queue(DataSpace *ds) : ds(ds), prod(ds, false) {
+        }
+        ~Queue() {
+            dspool.destroy(ds);
+        }
+
+        DataSpace *ds;
+        producer_type prod;
+    };
+
 public:
     explicit StorageServiceSession(Service *s, size_t id, capsel_t cap, capsel_t caps,
                                    Pt::portal_func func)
-        : ServiceSession(s, id, cap, caps, func), _ctrlds(), _prod(), _datads(), _drive() {
+        : ServiceSession(s, id, cap, caps, func), _ctrlds(), _prod(), _datads(), _drive(),
+          _queues(new Queue *[CPU::count()]) {
+        for(cpu_t cpu = 0; cpu < CPU::count(); ++cpu)
+            _queues[cpu] = 0;
     }
     virtual ~StorageServiceSession() {
-        delete _ctrlds;
+        if(_datads) {
+            if(caches[_drive])
+                caches[_drive]->detach(*_datads);
+            mng->get(ctrl())->detach(*_datads);
+        }
+        for(cpu_t cpu = 0; cpu < CPU::count(); ++cpu)
+            delete _queues[cpu];
+        delete[] _queues;
         delete _prod;
-        delete _datads;
+        dspool.destroy(_ctrlds);
+        dspool.destroy(_datads);
     }
 
     bool initialized() const {
@@ -60,41 +108,72 @@ public:
     const Storage::Parameter &params() const {
         return _params;
     }
-    Producer<Storage::Packet> *prod() {
-        return _prod;
+    /**
+     * @return the producer for the completions of the commands that are submitted on the current
+     *  CPU. we're running on the CPU of the client, because it has called our portal on its CPU.
+     */
+    producer_type *prod() {
+        Queue *q = _queues[CPU::current().log_id()];
+        return q ? &q->prod : _prod;
     }
 
-    void init(DataSpace *ctrlds, DataSpace *data, size_t drive) {
+    void init(capsel_t ctrlsel, capsel_t datasel, size_t drive) {
         size_t ctrl = drive / Storage::MAX_DRIVES;
         if(!mng->exists(ctrl) || !mng->get(ctrl)->exists(drive))
             throw Exception(E_ARGS_INVALID, 64, "Controller/drive (%zu,%zu) does not exist", ctrl, drive);
         if(_ctrlds)
             throw Exception(E_EXISTS, "Already initialized");
+        DataSpace *ctrlds = dspool.create(ctrlsel);
+        try {
+            _datads = dspool.create(datasel);
+        }
+        catch(...) {
+            dspool.destroy(ctrlds);
+            throw;
+        }
         _ctrlds = ctrlds;
-        _prod = new Producer<Storage::Packet>(_ctrlds, false);
-        _datads = data;
+        _prod = new producer_type(_ctrlds, false);
         _drive = drive;
         mng->get(ctrl)->get_params(_drive, &_params);
     }
 
+    void add_queue(capsel_t sel, cpu_t cpu) {
+        if(!initialized())
+            throw Exception(E_ARGS_INVALID, "Not initialized");
+        if(cpu >= CPU::count())
+            throw Exception(E_ARGS_INVALID, 32, "CPU %u does not exist", cpu);
+        Queue *q = new Queue(dspool.create(sel));
+        // the client might add queues on multiple CPUs concurrently
+        if(!Atomic::cmpnswap(_queues + cpu, static_cast<Queue*>(0), q)) {
+            delete q;
+            throw Exception(E_EXISTS, 32, "Queue for CPU %u exists already", cpu);
+        }
+    }
+
 private:
     DataSpace *_ctrlds;
-    Producer<Storage::Packet> *_prod;
+    producer_type *_prod;
     DataSpace *_datads;
     size_t _drive;
     Storage::Parameter _params;
+    Queue *volatile *_queues;
 };
 
 class StorageService : public Service {
 public:
     explicit StorageService(const char *name)
-        : Service(name, CPUSet(CPUSet::ALL), portal) {
+        : Service(name, CPUSet(CPUSet::ALL), portal), _dispatcher() {
         // we want to accept two dataspaces
         for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it) {
             LocalThread *ec = get_thread(it->log_id());
             UtcbFrameRef uf(ec->utcb());
             uf.accept_delegates(1);
         }
+        _dispatcher.add<Storage::Init, init>();
+        _dispatcher.add<Storage::Read, read>();
+        _dispatcher.add<Storage::Write, write>();
+        _dispatcher.add<Storage::Flush, flush>();
+        _dispatcher.add<Storage::AddQueue, add_queue>();
     }
 
 private:
@@ -103,86 +182,104 @@ private:
         return new StorageServiceSession(this, id, cap, caps, func);
     }
 
+    static void init(StorageServiceSession *sess, UtcbFrameRef &uf, const Storage::Init::In &in,
+                     Storage::Init::Out &out) {
+        sess->init(in.a1.sel, in.a2.sel, in.a3);
+        uf.accept_delegates();
+        out.a1 = sess->params();
+    }
+    static void add_queue(StorageServiceSession *sess, UtcbFrameRef &uf,
+                          const Storage::AddQueue::In &in, Storage::AddQueue::Out &) {
+        sess->add_queue(in.a1.sel, in.a2);
+        uf.accept_delegates();
+    }
+    static void flush(StorageServiceSession *sess, UtcbFrameRef &, const Storage::Flush::In &in,
+                      Storage::Flush::Out &) {
+        LOG(Logging::STORAGE_DETAIL, Serial::get().writef("[%zu,%#lx] FLUSH\n", sess->id(), in.a1));
+        TRACE(STORAGE_REQ, ASYNC_BEGIN, in.a1);
+        if(!sess->initialized())
+            throw Exception(E_ARGS_INVALID, "Not initialized");
+        if(caches[sess->drive()])
+            caches[sess->drive()]->flush(sess->prod(), in.a1, sess->data());
+        else
+            mng->get(sess->ctrl())->flush(sess->drive(), sess->prod(), in.a1);
+    }
+    static void read(StorageServiceSession *sess, UtcbFrameRef &, const Storage::Read::In &in,
+                     Storage::Read::Out &) {
+        readwrite(sess, Storage::READ, in.a1, in.a2, in.a3);
+    }
+    static void write(StorageServiceSession *sess, UtcbFrameRef &, const Storage::Write::In &in,
+                      Storage::Write::Out &) {
+        readwrite(sess, Storage::WRITE, in.a1, in.a2, in.a3);
+    }
+    static void readwrite(StorageServiceSession *sess, Storage::Command cmd, Storage::tag_type tag,
+                          Storage::sector_type sector, const Storage::dma_type &dma);
+
     PORTAL static void portal(capsel_t pid);
+
+    ProtocolDispatcher<StorageServiceSession, Storage::COMMAND_COUNT> _dispatcher;
 };
 
+void StorageService::readwrite(StorageServiceSession *sess, Storage::Command cmd,
+                               Storage::tag_type tag, Storage::sector_type sector,
+                               const Storage::dma_type &dma) {
+    if(!sess->initialized())
+        throw Exception(E_ARGS_INVALID, "Not initialized");
+
+    LOG(Logging::STORAGE_DETAIL,
+        Serial::get().writef("[%zu,%#lx] %s @ %Lu with ", sess->id(), tag,
+                             cmd == Storage::READ ? "READ" : "WRITE", sector);
+        Serial::get() << dma << "\n");
+    TRACE(STORAGE_REQ, ASYNC_BEGIN, tag);
+
+    // check offset and size
+    size_t size = dma.bytecount();
+    size_t count = size / sess->params().sector_size;
+    if(size == 0 || (size & (sess->params().sector_size - 1)))
+        throw Exception(E_ARGS_INVALID, 64, "Invalid size (%zu)", size);
+    if(sector >= sess->params().sectors) {
+        throw Exception(E_ARGS_INVALID, 64, "Sector %Lu is invalid (available: 0..%Lu)",
+                        sector,
+                        sess->params().sectors - 1);
+    }
+    if(sector + count > sess->params().sectors) {
+        throw Exception(E_ARGS_INVALID, 64, "Sector %Lu is invalid (available: 0..%Lu)",
+                        sector + count - 1, sess->params().sectors - 1);
+    }
+
+    BlockCache *cache = caches[sess->drive()];
+    if(cmd == Storage::READ) {
+        if(!(sess->data().flags() & DataSpaceDesc::R))
+            throw Exception(E_ARGS_INVALID, "Need to read, but no read permission");
+        if(denied[sess->drive()] & DENY_READ)
+            throw Exception(E_ARGS_INVALID, 64, "Drive %zu stores overlays", sess->drive());
+        if(cache)
+            cache->read(sess->prod(), tag, sess->data(), sector, dma);
+        else {
+            mng->get(sess->ctrl())->read(sess->drive(), sess->prod(), tag,
+                                         sess->data(), sector, dma);
+        }
+    }
+    else {
+        if(!(sess->data().flags() & DataSpaceDesc::W))
+            throw Exception(E_ARGS_INVALID, "Need to write, but no write permission");
+        if(denied[sess->drive()] & DENY_WRITE)
+            throw Exception(E_ARGS_INVALID, 64, "Drive %zu is used by an overlay", sess->drive());
+        if(cache)
+            cache->write(sess->prod(), tag, sess->data(), sector, dma);
+        else {
+            mng->get(sess->ctrl())->write(sess->drive(), sess->prod(), tag, sess->data(), sector,
+                                          dma);
+        }
+    }
+}
+
 void StorageService::portal(capsel_t pid) {
     ScopedLock<RCULock> guard(&RCU::lock());
     StorageServiceSession *sess = srv->get_session<StorageServiceSession>(pid);
     UtcbFrameRef uf;
     try {
-        Storage::Command cmd;
-        uf >> cmd;
-        switch(cmd) {
-            case Storage::INIT: {
-                capsel_t ctrlsel = uf.get_delegated(0).offset();
-                capsel_t datasel = uf.get_delegated(0).offset();
-                size_t drive;
-                uf >> drive;
-                uf.finish_input();
-                sess->init(new DataSpace(ctrlsel), new DataSpace(datasel), drive);
-                uf.accept_delegates();
-                uf << E_SUCCESS << sess->params();
-            }
-            break;
-
-            case Storage::FLUSH: {
-                Storage::tag_type tag;
-                uf >> tag;
-                uf.finish_input();
-                LOG(Logging::STORAGE_DETAIL, Serial::get().writef("[%zu,%#lx] FLUSH\n", sess->id(), tag));
-                mng->get(sess->ctrl())->flush(sess->drive(), sess->prod(), tag);
-                uf << E_SUCCESS;
-            }
-            break;
-
-            case Storage::READ:
-            case Storage::WRITE: {
-                Storage::tag_type tag;
-                Storage::sector_type sector;
-                DMADescList<Storage::MAX_DMA_DESCS> dma;
-                uf >> tag >> sector >> dma;
-                uf.finish_input();
-
-                if(!sess->initialized())
-                    throw Exception(E_ARGS_INVALID, "Not initialized");
-
-                LOG(Logging::STORAGE_DETAIL,
-                    Serial::get().writef("[%zu,%#lx] %s @ %Lu with ", sess->id(), tag,
-                                         cmd == Storage::READ ? "READ" : "WRITE", sector);
-                    Serial::get() << dma << "\n");
-
-                // check offset and size
-                size_t size = dma.bytecount();
-                size_t count = size / sess->params().sector_size;
-                if(size == 0 || (size & (sess->params().sector_size - 1)))
-                    throw Exception(E_ARGS_INVALID, 64, "Invalid size (%zu)", size);
-                if(sector >= sess->params().sectors) {
-                    throw Exception(E_ARGS_INVALID, 64, "Sector %Lu is invalid (available: 0..%Lu)",
-                                    sector,
-                                    sess->params().sectors - 1);
-                }
-                if(sector + count > sess->params().sectors) {
-                    throw Exception(E_ARGS_INVALID, 64, "Sector %Lu is invalid (available: 0..%Lu)",
-                                    sector + count - 1, sess->params().sectors - 1);
-                }
-
-                if(cmd == Storage::READ) {
-                    if(!(sess->data().flags() & DataSpaceDesc::R))
-                        throw Exception(E_ARGS_INVALID, "Need to read, but no read permission");
-                    mng->get(sess->ctrl())->read(sess->drive(), sess->prod(), tag,
-                                                 sess->data(), sector, dma);
-                }
-                else {
-                    if(!(sess->data().flags() & DataSpaceDesc::W))
-                        throw Exception(E_ARGS_INVALID, "Need to write, but no write permission");
-                    mng->get(sess->ctrl())->write(sess->drive(), sess->prod(), tag, sess->data(), sector,
-                                                  dma);
-                }
-                uf << E_SUCCESS;
-            }
-            break;
-        }
+        srv->_dispatcher.dispatch(sess, uf);
     }
     catch(const Exception &e) {
         Syscalls::revoke(uf.delegation_window(), true);
@@ -191,16 +288,115 @@ void StorageService::portal(capsel_t pid) {
     }
 }
 
+static void create_caches(size_t size, size_t readahead) {
+    for(size_t ctrl = 0; ctrl < Storage::MAX_CONTROLLER; ++ctrl) {
+        if(!mng->exists(ctrl))
+            continue;
+        for(size_t i = 0; i < Storage::MAX_DRIVES; ++i) {
+            size_t drive = ctrl * Storage::MAX_DRIVES + i;
+            if(!mng->get(ctrl)->exists(drive))
+                continue;
+            // ATAPI drives are read-only and rarely read twice
+            Storage::Parameter params;
+            mng->get(ctrl)->get_params(drive, &params);
+            if(!(params.flags & Storage::Parameter::FLAG_HARDDISK))
+                continue;
+            caches[drive] = new BlockCache(mng->get(ctrl), drive, params, size, readahead);
+            LOG(Logging::STORAGE, caches[drive]->print(Serial::get()));
+        }
+    }
+}
+
+static void create_overlay(const char *spec) {
+    // "overlay=<base>,<store>,<count>" creates <count> virtual drives on top of drive <base>,
+    // whose overlays are stored on drive <store>
+    size_t values = 1;
+    for(const char *s = spec; *s; ++s)
+        values += *s == ',';
+    if(values != 3) {
+        Serial::get() << "Ignoring invalid overlay specification '" << spec << "'\n";
+        return;
+    }
+
+    IStringStream is(spec);
+    size_t base, store, count;
+    is >> base >> store >> count;
+    size_t basectrl = base / Storage::MAX_DRIVES;
+    size_t storectrl = store / Storage::MAX_DRIVES;
+    if(!mng->exists(basectrl) || !mng->get(basectrl)->exists(base) ||
+       !mng->exists(storectrl) || !mng->get(storectrl)->exists(store)) {
+        Serial::get() << "Ignoring overlay '" << spec << "': drive does not exist\n";
+        return;
+    }
+
+    try {
+        size_t id = mng->count();
+        mng->add(new OverlayCtrl(id, mng->get(basectrl), caches[base], base,
+                                 mng->get(storectrl), caches[store], store, count));
+        // the overlays rely on the base not changing and on nobody else using the store. they
+        // talk to the controllers directly, so that this doesn't affect them
+        denied[base] |= DENY_WRITE;
+        denied[store] |= DENY_READ | DENY_WRITE;
+        LOG(Logging::STORAGE, Serial::get().writef(
+                "Drives %zu..%zu: overlays of drive %zu, stored on drive %zu\n",
+                id * Storage::MAX_DRIVES, id * Storage::MAX_DRIVES + count - 1, base, store));
+    }
+    catch(const Exception &e) {
+        Serial::get() << "Unable to create overlay '" << spec << "': " << e.msg() << "\n";
+    }
+}
+
+static void cachestats_thread(void*) {
+    Connection timercon("timer");
+    TimerSession timer(timercon);
+    Clock clock(1000);
+    while(1) {
+        timer.wait_until(clock.source_time(cachestats_secs * 1000));
+        for(size_t i = 0; i < ARRAY_SIZE(caches); ++i) {
+            if(!caches[i])
+                continue;
+            caches[i]->print(Serial::get());
+            BlockCache::Stats s = caches[i]->stats();
+            uint64_t rate = s.lookups ? (s.hits * 100) / s.lookups : 0;
+            Serial::get().writef("BENCH: storage.cache%zu.hitrate %% n=1 avg=%Lu med=%Lu\n",
+                                 i, rate, rate);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     bool idedma = true;
+    size_t cachesize = 0;
+    size_t readahead = 32;
+    // cache=<MiB>: cache that many MiB of each harddisk. readahead=<blocks>: the maximum number
+    // of blocks to read ahead for sequential reads. cachestats=<secs>: print the counters of the
+    // caches every <secs> seconds. overlay=<base>,<store>,<count>: see create_overlay()
     for(int i = 1; i < argc; ++i) {
         if(strcmp(argv[i], "noidedma") == 0) {
             LOG(Logging::STORAGE, Serial::get() << "Disabling DMA for IDE devices\n");
             idedma = false;
         }
+        else if(strncmp(argv[i], "cache=", 6) == 0)
+            cachesize = IStringStream::read_from<size_t>(argv[i] + 6) * 1024 * 1024;
+        else if(strncmp(argv[i], "readahead=", 10) == 0)
+            readahead = IStringStream::read_from<size_t>(argv[i] + 10);
+        else if(strncmp(argv[i], "cachestats=", 11) == 0)
+            cachestats_secs = IStringStream::read_from<uint>(argv[i] + 11);
     }
 
+    Trace::init();
     mng = new ControllerMng(idedma);
+    if(cachesize) {
+        create_caches(cachesize, readahead);
+        if(cachestats_secs) {
+            GlobalThread::create(cachestats_thread, CPU::current().log_id(),
+                                 String("storage-cachestats"))->start();
+        }
+    }
+    for(int i = 1; i < argc; ++i) {
+        if(strncmp(argv[i], "overlay=", 8) == 0)
+            create_overlay(argv[i] + 8);
+    }
     srv = new StorageService("storage");
     srv->start();
     return 0;
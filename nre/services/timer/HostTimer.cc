@@ -28,15 +28,16 @@
 
 using namespace nre;
 
-void HostTimer::ClientData::init(size_t _sid, cpu_t cpuno, HostTimer::PerCpu *per_cpu) {
-    sm = new nre::Sm(0);
+void HostTimer::ClientData::init(size_t _sid, cpu_t cpuno, HostTimer::PerCpu *per_cpu, nre::Sm *_sm) {
+    sm = _sm;
     nr = per_cpu->abstimeouts.alloc(this);
     cpu = cpuno;
     sid = _sid;
 }
 
 HostTimer::HostTimer(bool force_pit, bool force_hpet_legacy, bool slow_rtc)
-    : _clocks_per_tick(0), _timer(), _rtc(), _clock(Timer::WALLCLOCK_FREQ), _per_cpu(), _xcpu_up(0) {
+    : _clocks_per_tick(0), _timer(), _rtc(), _clock(Timer::WALLCLOCK_FREQ), _per_cpu(), _xcpu_up(0),
+      _sms() {
     if(!force_pit) {
         try {
             _timer = new HostHPET(force_hpet_legacy);
@@ -213,6 +214,7 @@ void HostTimer::portal_per_cpu(capsel_t) {
     UtcbFrameRef uf;
     WorkerMessage m;
     uf >> m;
+    ScopedLock<UserSm> guard(&per_cpu->lock);
     bool reprogram = false;
 
     // We jump here if we were to late with timer
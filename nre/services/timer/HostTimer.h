@@ -21,8 +21,12 @@
 #include <kobj/LocalThread.h>
 #include <kobj/Pt.h>
 #include <kobj/Sm.h>
+#include <kobj/UserSm.h>
 #include <services/Timer.h>
 #include <util/TimeoutList.h>
+#include <util/ObjectPool.h>
+#include <util/ScopedLock.h>
+#include <arch/SpinLock.h>
 
 #include "HostTimerDevice.h"
 #include "HostRTC.h"
@@ -53,7 +57,7 @@ public:
         explicit ClientData() : abstimeout(0), count(0), nr(0), cpu(0), sm(0), sid() {
         }
 
-        void init(size_t sid, cpu_t cpu, HostTimer::PerCpu *per_cpu);
+        void init(size_t sid, cpu_t cpu, HostTimer::PerCpu *per_cpu, nre::Sm *sm);
     };
 
 private:
@@ -74,6 +78,8 @@ private:
         bool has_timer;
         HostTimerDevice::Timer *timer;
         nre::TimeoutList<MAX_CLIENTS, ClientData> abstimeouts;
+        // protects abstimeouts against the session creation and destruction on other CPUs
+        nre::UserSm lock;
 
         nre::LocalThread *ec;
         nre::Pt worker_pt;
@@ -89,7 +95,7 @@ private:
         size_t slot_count; // with this many entries
 
         explicit PerCpu(HostTimer *ht, cpu_t cpu)
-            : has_timer(false), timer(0), abstimeouts(), ec(nre::LocalThread::create(cpu)),
+            : has_timer(false), timer(0), abstimeouts(), lock(), ec(nre::LocalThread::create(cpu)),
               worker_pt(ec, portal_per_cpu), xcpu_sm(0), last_to(~0ULL), remote_sm(),
               remote_slot(), slots(), slot_count() {
             ec->set_tls(nre::Thread::TLS_PARAM, ht);
@@ -100,7 +106,19 @@ public:
     explicit HostTimer(bool force_pit = false, bool force_hpet_legacy = false, bool slow_rtc = false);
 
     void setup_clientdata(size_t sid, ClientData *data, cpu_t cpu) {
-        data->init(sid, cpu, _per_cpu[cpu]);
+        nre::ScopedLock<nre::UserSm> guard(&_per_cpu[cpu]->lock);
+        data->init(sid, cpu, _per_cpu[cpu], _sms.create(0U));
+    }
+    void destroy_clientdata(ClientData *data) {
+        {
+            // the timeout has to be gone before the Sm goes back to the pool. otherwise, the
+            // worker might up it when it already belongs to a different session
+            PerCpu *per_cpu = _per_cpu[data->cpu];
+            nre::ScopedLock<nre::UserSm> guard(&per_cpu->lock);
+            per_cpu->abstimeouts.dealloc(data->nr, true);
+        }
+        _sms.destroy(data->sm);
+        data->sm = 0;
     }
 
     void program_timer(ClientData *data, timevalue_t time) {
@@ -146,4 +164,6 @@ private:
     nre::Clock _clock;
     PerCpu **_per_cpu;
     nre::Sm _xcpu_up;
+    // the semaphores for the clients; sessions are created and destroyed on all CPUs
+    nre::ObjectPool<nre::Sm, nre::LockPolicyDefault<nre::SpinLock> > _sms;
 };
@@ -35,6 +35,8 @@ public:
             timer->setup_clientdata(id, _data + it->log_id(), it->log_id());
     }
     virtual ~TimerSessionData() {
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
+            timer->destroy_clientdata(_data + it->log_id());
         delete[] _data;
     }
 
@@ -49,7 +51,14 @@ private:
 class TimerService : public Service {
 public:
     explicit TimerService(const char *name, Pt::portal_func func)
-        : Service(name, CPUSet(CPUSet::ALL), func) {
+        : Service(name, CPUSet(CPUSet::ALL), func), _dispatcher() {
+        _dispatcher.add<nre::Timer::GetSms, get_sms>();
+        _dispatcher.add<nre::Timer::ProgTimer, prog_timer>();
+        _dispatcher.add<nre::Timer::GetTime, get_time>();
+    }
+
+    void dispatch(TimerSessionData *sess, UtcbFrameRef &uf) const {
+        _dispatcher.dispatch(sess, uf);
     }
 
 private:
@@ -57,6 +66,30 @@ private:
                                            Pt::portal_func func) {
         return new TimerSessionData(this, id, cap, caps, func);
     }
+
+    static void get_sms(TimerSessionData *sess, UtcbFrameRef &uf,
+                        const nre::Timer::GetSms::In &, nre::Timer::GetSms::Out &) {
+        for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
+            uf.delegate(sess->data(it->log_id())->sm->sel(), it->log_id());
+    }
+
+    static void prog_timer(TimerSessionData *sess, UtcbFrameRef &,
+                           const nre::Timer::ProgTimer::In &in, nre::Timer::ProgTimer::Out &) {
+        LOG(Logging::TIMER_DETAIL,
+            Serial::get().writef("TIMER: (%zu) Programming for %#Lx on %u\n",
+                                 sess->id(), in.a1, CPU::current().log_id()));
+        timer->program_timer(sess->data(CPU::current().log_id()), in.a1);
+    }
+
+    static void get_time(TimerSessionData *sess, UtcbFrameRef &,
+                         const nre::Timer::GetTime::In &, nre::Timer::GetTime::Out &out) {
+        timer->get_time(out.a1, out.a2);
+        LOG(Logging::TIMER_DETAIL,
+            Serial::get().writef("TIMER: (%zu) Getting time up=%#Lx unix=%#Lx\n",
+                                 sess->id(), out.a1, out.a2));
+    }
+
+    ProtocolDispatcher<TimerSessionData, nre::Timer::COMMAND_COUNT> _dispatcher;
 };
 
 PORTAL static void portal_timer(capsel_t pid) {
@@ -64,43 +97,7 @@ PORTAL static void portal_timer(capsel_t pid) {
     TimerSessionData *sess = srv->get_session<TimerSessionData>(pid);
     UtcbFrameRef uf;
     try {
-        nre::Timer::Command cmd;
-        uf >> cmd;
-
-        switch(cmd) {
-            case nre::Timer::GET_SMS:
-                uf.finish_input();
-
-                for(CPU::iterator it = CPU::begin(); it != CPU::end(); ++it)
-                    uf.delegate(sess->data(it->log_id())->sm->sel(), it->log_id());
-                uf << E_SUCCESS;
-                break;
-
-            case nre::Timer::PROG_TIMER: {
-                timevalue_t time;
-                uf >> time;
-                uf.finish_input();
-
-                LOG(Logging::TIMER_DETAIL,
-                    Serial::get().writef("TIMER: (%zu) Programming for %#Lx on %u\n",
-                                         sess->id(), time, CPU::current().log_id()));
-                timer->program_timer(sess->data(CPU::current().log_id()), time);
-                uf << E_SUCCESS;
-            }
-            break;
-
-            case nre::Timer::GET_TIME: {
-                uf.finish_input();
-
-                timevalue_t uptime, unixts;
-                timer->get_time(uptime, unixts);
-                LOG(Logging::TIMER_DETAIL,
-                    Serial::get().writef("TIMER: (%zu) Getting time up=%#Lx unix=%#Lx\n",
-                                         sess->id(), uptime, unixts));
-                uf << E_SUCCESS << uptime << unixts;
-            }
-            break;
-        }
+        srv->dispatch(sess, uf);
     }
     catch(const Exception &e) {
         uf.clear();
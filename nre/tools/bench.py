@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+
+import argparse
+import json
+import re
+import sys
+
+# the log service puts color codes and the session id around each line
+colorre = re.compile(r'\x1b\[[0-9;]*m')
+prefixre = re.compile(r'^\[\d+\]\s*')
+
+# collects the results of all "BENCH:" lines in <file>. the statistics of one benchmark are
+# spread over multiple lines, so that they are merged by the benchmark name
+def parse_log(file):
+    res = {}
+    for line in file:
+        line = prefixre.sub('', colorre.sub('', line)).strip()
+        pos = line.find('BENCH: ')
+        if pos == -1:
+            continue
+        parts = line[pos + 7:].split()
+        if len(parts) < 3:
+            continue
+        bench = res.setdefault(parts[0], {'units': parts[1]})
+        for p in parts[2:]:
+            if '=' in p:
+                key, val = p.split('=', 1)
+                try:
+                    bench[key] = int(val)
+                except ValueError:
+                    pass
+    return res
+
+def load_log(path):
+    if path == '-':
+        return parse_log(sys.stdin)
+    with open(path) as f:
+        return parse_log(f)
+
+def show(args):
+    res = load_log(args.log)
+    print("%-28s %8s %10s %10s %10s %10s %10s" % ('benchmark', 'n', 'min', 'med', 'p90', 'p99', 'max'))
+    for name in sorted(res):
+        b = res[name]
+        print("%-28s %8d %10d %10d %10d %10d %10d %s" % (
+            name, b.get('n', 0), b.get('min', 0), b.get('med', 0), b.get('p90', 0), b.get('p99', 0),
+            b.get('max', 0), b['units']
+        ))
+
+def save(args):
+    res = load_log(args.log)
+    if len(res) == 0:
+        exit("No benchmark results found in " + args.log)
+    with open(args.baseline, 'w') as f:
+        json.dump(res, f, indent=2, sort_keys=True)
+
+# compares the median (or the metric given by --metric) of all benchmarks against the baseline.
+# benchmarks that don't have this metric are compared by their average. exits with 1 if at least
+# one benchmark got slower by more than --threshold percent
+def compare(args):
+    res = load_log(args.log)
+    with open(args.baseline) as f:
+        base = json.load(f)
+
+    regressions = 0
+    for name in sorted(base):
+        if name not in res:
+            print("%-28s missing" % name)
+            continue
+        # throughput benchmarks only report the average
+        metric = args.metric if args.metric in base[name] else 'avg'
+        old = base[name].get(metric, 0)
+        new = res[name].get(metric, 0)
+        if old == 0:
+            continue
+        diff = (new - old) * 100.0 / old
+        # for rates (e.g. calls/s), larger is better
+        slower = -diff if res[name]['units'].endswith('/s') else diff
+        state = 'ok'
+        if slower > args.threshold:
+            state = 'REGRESSION'
+            regressions += 1
+        elif slower < -args.threshold:
+            state = 'improved'
+        print("%-28s %10d -> %10d %s (%+.1f%%) %s" % (name, old, new, res[name]['units'], diff, state))
+    for name in sorted(res):
+        if name not in base:
+            print("%-28s new" % name)
+
+    if regressions > 0:
+        print("%d regression(s) found" % regressions)
+        sys.exit(1)
+
+# argument handling
+parser = argparse.ArgumentParser(description='This is a tool for evaluating the "BENCH:" lines'
+    + ' that the unittests write to the serial log. It can store the results as a baseline and'
+    + ' compare later runs against it.')
+subparsers = parser.add_subparsers(
+    title='subcommands',description='valid subcommands',help='additional help'
+)
+
+parser_show = subparsers.add_parser('show', description='Prints all results in <log>.')
+parser_show.add_argument('log', metavar='<log>', help='the serial log or "-" for stdin')
+parser_show.set_defaults(func=show)
+
+parser_save = subparsers.add_parser('save', description='Stores the results in <log> as the'
+    + ' baseline <baseline>.')
+parser_save.add_argument('log', metavar='<log>', help='the serial log or "-" for stdin')
+parser_save.add_argument('baseline', metavar='<baseline>')
+parser_save.set_defaults(func=save)
+
+parser_compare = subparsers.add_parser('compare', description='Compares the results in <log>'
+    + ' against <baseline> and exits with 1 if there are regressions.')
+parser_compare.add_argument('log', metavar='<log>', help='the serial log or "-" for stdin')
+parser_compare.add_argument('baseline', metavar='<baseline>')
+parser_compare.add_argument('--threshold', type=float, default=5.0,
+    help='the allowed slowdown in percent (default: 5)')
+parser_compare.add_argument('--metric', default='med', choices=['avg', 'min', 'med', 'p90', 'p99'],
+    help='the statistic to compare (default: med)')
+parser_compare.set_defaults(func=compare)
+
+args = parser.parse_args()
+args.func(args)
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of NRE (NOVA runtime environment).
+ *
+ * NRE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * NRE is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+/*
+ * Converts the output of nre::Trace::dump(), as found in the serial log, into the Chrome-trace
+ * JSON format, which can be viewed with chrome://tracing or Perfetto. The records of all dumps
+ * (i.e. of all protection domains) are merged into one timeline.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Event {
+    unsigned long long tsc;
+    unsigned pid;
+    unsigned cpu;
+    unsigned long thread;
+    string point;
+    char phase;
+    unsigned long arg;
+
+    bool operator<(const Event &e) const {
+        return tsc < e.tsc;
+    }
+};
+
+struct Process {
+    string name;
+    unsigned long freq;
+};
+
+static vector<Process> procs;
+static vector<Event> events;
+
+// removes the color codes and the session prefix that the log service puts around the line
+static string strip_line(const string &line, string &session) {
+    string res;
+    for(size_t i = 0; i < line.length(); ++i) {
+        if(line[i] == '\033') {
+            while(i < line.length() && line[i] != 'm')
+                i++;
+            continue;
+        }
+        res += line[i];
+    }
+    session = "";
+    if(res.length() > 0 && res[0] == '[') {
+        size_t end = res.find(']');
+        if(end != string::npos)
+            session = res.substr(1, end - 1);
+    }
+    return res;
+}
+
+static void parse(istream &in) {
+    string line;
+    int cur = -1;
+    while(getline(in, line)) {
+        string session;
+        line = strip_line(line, session);
+        size_t pos = line.find("TRACE: ");
+        if(pos == string::npos)
+            continue;
+
+        istringstream is(line.substr(pos + 7));
+        string first;
+        is >> first;
+        if(first == "begin") {
+            // the name is optional: "begin [<name>] <freq_khz> <cpus>"
+            vector<string> args;
+            string arg;
+            while(is >> arg)
+                args.push_back(arg);
+            if(args.size() < 2)
+                continue;
+            Process p;
+            p.name = args.size() > 2 ? args[0] : "";
+            p.freq = strtoul(args[args.size() - 2].c_str(), NULL, 10);
+            if(p.freq == 0)
+                continue;
+            if(!session.empty())
+                p.name += "[" + session + "]";
+            procs.push_back(p);
+            cur = procs.size() - 1;
+        }
+        else if(first == "end")
+            cur = -1;
+        else if(cur != -1) {
+            Event ev;
+            ev.pid = cur;
+            ev.cpu = strtoul(first.c_str(), NULL, 10);
+            is >> ev.tsc >> hex >> ev.thread >> ev.point >> ev.phase >> ev.arg;
+            if(!is.fail())
+                events.push_back(ev);
+        }
+    }
+}
+
+static void print_event(ostream &out, const Event &ev, unsigned long long base, bool first) {
+    const Process &p = procs[ev.pid];
+    double ts = static_cast<double>(ev.tsc - base) * 1000.0 / p.freq;
+    out << (first ? "" : ",\n");
+    out << "{\"name\":\"" << ev.point << "\",\"cat\":\"nre\",\"ph\":\"" << ev.phase << "\"";
+    out << ",\"ts\":" << fixed << ts << ",\"pid\":" << ev.pid << ",\"tid\":" << ev.thread;
+    if(ev.phase == 'b' || ev.phase == 'e')
+        out << ",\"id\":\"0x" << hex << ev.arg << dec << "\"";
+    if(ev.phase == 'i')
+        out << ",\"s\":\"t\"";
+    out << ",\"args\":{\"cpu\":" << ev.cpu << ",\"arg\":\"0x" << hex << ev.arg << dec << "\"}}";
+}
+
+int main(int argc, char *argv[]) {
+    if(argc != 2) {
+        cerr << "Usage: " << argv[0] << " <seriallog>|-" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if(strcmp(argv[1], "-") == 0)
+        parse(cin);
+    else {
+        ifstream in(argv[1]);
+        if(!in) {
+            cerr << "Unable to open " << argv[1] << " for reading" << endl;
+            return EXIT_FAILURE;
+        }
+        parse(in);
+    }
+
+    // the TSC is synchronized across all CPUs, so we can simply merge by it
+    stable_sort(events.begin(), events.end());
+    unsigned long long base = events.empty() ? 0 : events[0].tsc;
+
+    cout << "{\"traceEvents\":[\n";
+    bool first = true;
+    for(size_t i = 0; i < procs.size(); ++i) {
+        cout << (first ? "" : ",\n");
+        cout << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << i;
+        cout << ",\"args\":{\"name\":\"" << procs[i].name << "\"}}";
+        first = false;
+    }
+    for(size_t i = 0; i < events.size(); ++i) {
+        print_event(cout, events[i], base, first);
+        first = false;
+    }
+    cout << "\n]}\n";
+    return EXIT_SUCCESS;
+}